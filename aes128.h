@@ -0,0 +1,58 @@
+// aes128.h
+// AES-128（FIPS 197）CBC 模式加解密，PKCS#7 填充，用于上报负载加密
+// x86 上 CPU 支持 AES-NI 时走硬件指令（解密 4 块交错流水），否则走可移植的软件实现；
+// 密钥调度在 aes128_key_init 中一次算好（加密轮密钥 + 等价逆密码的解密轮密钥），两种实现共用，
+// 同一会话密钥反复加解密时不再重复扩展
+
+#ifndef AES128_H
+#define AES128_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AES128_BLOCK 16
+#define AES128_KEY_LEN 16
+#define AES128_ROUNDS 10
+
+typedef enum {
+	AES_IMPL_AUTO = 0, // 支持 AES-NI 时用硬件，否则软件
+	AES_IMPL_SOFT = 1,
+	AES_IMPL_NI = 2
+} aes_impl_t;
+
+typedef struct {
+	uint8_t enc[AES128_ROUNDS + 1][AES128_BLOCK]; // 加密轮密钥
+	uint8_t dec[AES128_ROUNDS + 1][AES128_BLOCK]; // 解密轮密钥（逆序，中间各轮已做 InvMixColumns）
+	uint8_t impl;                                 // 实际使用的实现（AES_IMPL_SOFT/AES_IMPL_NI）
+} aes128_key_t;
+
+// 本机 CPU 是否支持 AES-NI（非 x86 或编译器不支持时恒为 0）
+int aes128_ni_available(void);
+
+// 扩展密钥；请求 AES_IMPL_NI 但不支持时退回软件实现
+void aes128_key_init(aes128_key_t *k, const uint8_t key[AES128_KEY_LEN], aes_impl_t impl);
+
+const char *aes128_impl_name(aes_impl_t impl);
+
+// PKCS#7 填充后的密文长度（总是多出 1~16 字节）
+static inline size_t aes128_cbc_padded_len(size_t len) {
+	return (len / AES128_BLOCK + 1) * AES128_BLOCK;
+}
+
+// 加密 in[0..len) 写入 out（允许 out == in，此时 out 需容得下填充）；返回密文长度，-1 表示 cap 不足
+int aes128_cbc_encrypt(const aes128_key_t *k, const uint8_t iv[AES128_BLOCK],
+	const uint8_t *in, size_t len, uint8_t *out, size_t cap);
+
+// 解密并去掉填充（允许 out == in）；返回明文长度，-1 表示长度不是块的整数倍或填充不对
+int aes128_cbc_decrypt(const aes128_key_t *k, const uint8_t iv[AES128_BLOCK],
+	const uint8_t *in, size_t len, uint8_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AES128_H
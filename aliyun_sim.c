@@ -1,5 +1,20 @@
 // aliyun_sim.c
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // pthread_setaffinity_np / CPU_SET
+#endif
 #include "aliyun_sim.h"
+#include "coap_msg.h"
+#include "device_registry.h"
+#include "coap_dedup.h"
+#include "coap_auth.h"
+#include "sensor_json.h"
+#include "sensor_cbor.h"
+#include "senml.h"
+#include "coap_block.h"
+#include "coap_observe.h"
+#include "coap_router.h"
+#include "coap_client.h"
+#include "coap_log.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -10,194 +25,1391 @@
 #include <ws2tcpip.h>
 #pragma comment(lib, "ws2_32.lib")
 typedef SOCKET socket_t;
+#include <process.h>
 #else
+#ifdef __linux__
+#include <sched.h>
+#include <netinet/udp.h>
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103 // 旧版 glibc 头文件未定义
+#endif
+#endif
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <unistd.h>
+#include <pthread.h>
 typedef int socket_t;
 #endif
 
+#define SIM_POLL_MS 100 // 接收超时，工作线程据此检查停止标志
+#define SIM_BATCH_MAX 1024
+#define SIM_PKT_MAX 1500 // 单个请求报文的接收缓冲
+#ifdef __linux__
+#define SIM_RECV_FLAGS MSG_TRUNC // recvfrom 返回报文实际长度，超过缓冲即说明被截断
+#else
+#define SIM_RECV_FLAGS 0 // Windows 上超长报文直接以 WSAEMSGSIZE 失败
+#endif
+#define SIM_RESP_MAX COAP_MAX_PKT // 响应缓冲：处理函数至多生成一个完整报文
+#define SIM_GSO_BYTES 65000 // GSO 合并后的报文总长上限（UDP 报文不超过 64 KB）
+#define SIM_GSO_MAX 64   // 内核单个 GSO 报文最多切分的段数
+#define SIM_URING_SLOTS 1024 // io_uring 后端同时在途的响应数
+#define SIM_URING_BUFS 4096  // io_uring 接收缓冲环大小
+#define SIM_URING_TAG_SEND (1ull << 63)
+#define SIM_AUTH_TTL_S 3600 // 会话 Token 默认有效期
+#define SIM_OBS_TTL_S 600   // 观察注册默认有效期，观察者须在此之前重新注册
+#define SIM_OBS_SCAN_MS 10  // 分片检查被观察资源是否更新的最短间隔（同一资源在此期间的多次更新合并为一次通知）
+#define SIM_OBS_BATCH 256   // 通知每次 sendmmsg 的报文数
+#define SIM_OBS_BODY_MAX 96 // 通知的选项与负载
+#define SIM_OBS_PUBLISH_TRIES 64 // 发布最新读数时与其他分片争用同一资源的重试次数
+#define SIM_ROUTES_MAX 64   // 路由表条目（含内置路由）
+#define SIM_ROUTE_NODES 256 // 路由前缀树节点数
+#define SIM_ROUTE_PATH_MAX 128
+#define COAP_CF_LINK_FORMAT 40 // application/link-format
+
+// 服务端分片：每个工作线程一个，独占套接字、缓冲与计数，计数只在读取时汇总
+typedef struct {
+	socket_t sock;
+#ifdef _WIN32
+	HANDLE thread;
+#else
+	pthread_t thread;
+#endif
+	int started;
+	uint32_t index;
+	aliyun_sim_stats_t stats;  // 仅本分片线程写入（STAT_ADD/STAT_SET），其他线程经 aliyun_sim_get_stats 原子读取
+	int gso;                   // 当前是否启用 UDP GSO（内核拒绝时关闭）
+	coap_dedup_t dedup;        // CON 去重缓存，capacity 为 0 表示关闭
+	uint64_t now_ms;           // 本分片最近一次收包后的单调时钟，去重按它判断过期
+	uint32_t now_s;            // 同一时刻的 Unix 秒，会话 Token 按它判断过期
+	auth_cache_t auth_cache;   // 已校验的会话 Token，entries 为 NULL 表示关闭缓存
+	aes128_key_t *session_keys; // 按 auth_cache 槽号存放会话密钥调度，NULL 表示每次现算
+	uint8_t *key_ready;        // 对应槽的密钥调度是否已算好（槽被新 Token 占用时清零）
+	coap_block_table_t blocks; // Block1 分块上传的重组表，capacity 为 0 表示不支持分块
+	coap_obs_table_t obs;      // 经本分片注册的观察者，max_observers 为 0 表示不支持观察
+	struct sim_obs_tx *obs_tx; // 通知的批量发送缓冲
+	uint64_t obs_scan_ms;      // 上次检查被观察资源的时刻
+	uint16_t obs_mid;          // 通知报文的 MID
+	char pad[64];              // 避免相邻分片计数伪共享
+} sim_shard_t;
+
+// 交给路由处理函数的请求：所在分片、来源地址与解码后的报文
+struct sim_request {
+	sim_shard_t *sh;
+	const struct sockaddr_in *from;
+	const coap_msg_view_t *m;
+};
+
+typedef struct {
+	uint8_t method;
+	char path[SIM_ROUTE_PATH_MAX];
+	aliyun_sim_handler_t fn;
+	void *arg;
+} sim_route_t;
+
 static volatile int g_server_running = 0;
+static io_backend_t g_backend = IO_BACKEND_SOCKET;
 static aliyun_sim_conf_t g_conf;
+static sim_shard_t *g_shards = NULL;
+static uint32_t g_shard_count = 0;
+static device_registry_t *g_registry = NULL; // 启动时建好，运行期间只读，各分片共享
+static coap_obs_slot_t *g_obs_values = NULL;  // 按设备号存放最新读数（观察的资源），任一分片发布、各分片读取
+static auth_issuer_t g_issuer;                // 会话 Token 的签发密钥，启动时随机生成
+static sim_route_t g_routes[SIM_ROUTES_MAX];  // 前 g_user_route_count 条为调用方注册，其后是启动时追加的内置路由
+static uint32_t g_user_route_count = 0;
+static uint32_t g_route_count = 0;
+static coap_router_t g_router;                // 启动时由 g_routes 建好，运行期间只读，各分片共享
+static char *g_links = NULL;                  // /.well-known/core 的资源列表，启动时按路由表分配并生成
+static int g_links_len = 0;
+static reading_store_t *g_store = NULL;       // 接受的读数追加到这里，每个分片是一个生产者
+static uint64_t g_wall_base = 0;              // Unix 毫秒 - 单调毫秒，分片据此由 now_ms 得到墙钟
 
-static const char* now_ts() {
-	static char buf[32];
-	time_t t = time(NULL);
-	struct tm tmv;
+static uint64_t mono_ms(void) {
 #ifdef _WIN32
-	localtime_s(&tmv, &t);
+	return (uint64_t)GetTickCount64();
 #else
-	localtime_r(&t, &tmv);
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
 #endif
-	strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tmv);
-	return buf;
 }
 
-// 和客户端约定的简化 Token 算法：
-// token = hex32( sum(byte(productKey+deviceName+deviceSecret)) ^ 0x5A )
-static void make_token_inner(const device_triple_t *triple, char *out, int out_len) {
-	unsigned int sum = 0;
-	const char *p;
-	for (p = triple->product_key; *p; ++p) sum += (unsigned char)(*p);
-	for (p = triple->device_name; *p; ++p) sum += (unsigned char)(*p);
-	for (p = triple->device_secret; *p; ++p) sum += (unsigned char)(*p);
-	unsigned int v = (sum ^ 0x5Au) & 0xFFFFFFFFu;
-	snprintf(out, out_len, "%08X", v);
+// 分片计数只由本分片线程更新，但统计输出与基准会在运行中读取：按 64 位原子读写，32 位平台上也不会读到撕裂的值
+#ifdef _MSC_VER
+static void stat_add(uint64_t *p, uint64_t v) { InterlockedExchangeAdd64((volatile LONG64*)p, (LONG64)v); }
+static void stat_set(uint64_t *p, uint64_t v) { InterlockedExchange64((volatile LONG64*)p, (LONG64)v); }
+static uint64_t stat_load(const uint64_t *p) { return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)p, 0, 0); }
+#else
+static void stat_add(uint64_t *p, uint64_t v) { __atomic_fetch_add(p, v, __ATOMIC_RELAXED); }
+static void stat_set(uint64_t *p, uint64_t v) { __atomic_store_n(p, v, __ATOMIC_RELAXED); }
+static uint64_t stat_load(const uint64_t *p) { return __atomic_load_n(p, __ATOMIC_RELAXED); }
+#endif
+#define STAT_ADD(sh, field, v) stat_add(&(sh)->stats.field, (uint64_t)(v))
+#define STAT_SET(sh, field, v) stat_set(&(sh)->stats.field, (uint64_t)(v))
+
+// 收到一批报文后刷新分片时钟
+static void shard_tick(sim_shard_t *sh) {
+	sh->now_ms = mono_ms();
+	sh->now_s = (uint32_t)time(NULL);
 }
 
+// 和客户端约定的简化 Token 算法：
+// token = hex32( sum(byte(productKey+deviceName+deviceSecret)) ^ 0x5A )
 void aliyun_make_token(const device_triple_t *triple, char *out, int out_len) {
-	make_token_inner(triple, out, out_len);
-}
-
-static int parse_coap_basic(const uint8_t *buf, int len,
-							 uint8_t *out_type, uint8_t *out_code, uint16_t *out_mid,
-							 const uint8_t **out_opt_start, int *out_opt_len,
-							 const uint8_t **out_payload, int *out_payload_len) {
-	if (len < 4) return -1;
-	uint8_t ver = (buf[0] >> 6) & 0x03;
-	if (ver != 1) return -2;
-	uint8_t tkl = buf[0] & 0x0F;
-	int off = 4;
-	if (len < off + tkl) return -3;
-	*out_type = (buf[0] >> 4) & 0x03;
-	*out_code = buf[1];
-	*out_mid = (uint16_t)((buf[2] << 8) | buf[3]);
-	// 跳过 Token
-	off += tkl;
-	int opt_start = off;
-	// 解析到 payload marker 0xFF 或结束
-	while (off < len) {
-		if (buf[off] == 0xFF) { // payload marker
-			*out_opt_start = buf + opt_start;
-			*out_opt_len = off - opt_start;
-			*out_payload = buf + off + 1;
-			*out_payload_len = len - (off + 1);
-			return 0;
-		}
-		// option header 1 byte + ext
-		uint8_t delta = (buf[off] >> 4) & 0x0F;
-		uint8_t olen = buf[off] & 0x0F;
-		off++;
-		if (delta == 13) off++;
-		else if (delta == 14) off += 2;
-		if (olen == 13) off++;
-		else if (olen == 14) off += 2;
-		off += olen;
-	}
-	*out_opt_start = buf + opt_start;
-	*out_opt_len = len - opt_start;
-	*out_payload = NULL;
-	*out_payload_len = 0;
-	return 0;
+	snprintf(out, out_len, "%08X", registry_token(triple->product_key, triple->device_name, triple->device_secret));
 }
 
-static int build_coap_response(uint8_t *out, int cap, uint8_t type, uint8_t code, uint16_t mid) {
-	if (cap < 4) return -1;
-	out[0] = (uint8_t)((1 << 6) | (type << 4) | 0); // ver=1, tkl=0
+static int build_coap_response(uint8_t *out, int cap, uint8_t type, uint8_t code, uint16_t mid,
+							   const uint8_t *token, uint8_t tkl) {
+	if (cap < 4 + tkl) return -1;
+	out[0] = (uint8_t)((1 << 6) | (type << 4) | (tkl & 0x0F)); // ver=1，回显请求 Token
 	out[1] = code;
 	out[2] = (uint8_t)(mid >> 8);
 	out[3] = (uint8_t)(mid & 0xFF);
-	return 4; // 无 token、无 options、无 payload
+	if (tkl) memcpy(out + 4, token, tkl);
+	return 4 + tkl; // 无 options、无 payload
 }
 
-#ifdef _WIN32
-#include <process.h>
-static unsigned __stdcall server_thread(void *arg)
-#else
-#include <pthread.h>
-static void* server_thread(void *arg)
+// 带 Content-Format=50（JSON）与负载的响应
+static int build_coap_response_json(uint8_t *out, int cap, uint8_t type, uint8_t code, uint16_t mid,
+	const uint8_t *token, uint8_t tkl, const char *json, int json_len) {
+	int n = build_coap_response(out, cap, type, code, mid, token, tkl);
+	if (n < 0 || n + 3 + json_len > cap) return -1;
+	out[n++] = (uint8_t)((COAP_OPT_CONTENT_FORMAT << 4) | 1);
+	out[n++] = 50;
+	out[n++] = 0xFF;
+	memcpy(out + n, json, (size_t)json_len);
+	return n + json_len;
+}
+
+const coap_msg_view_t *aliyun_sim_request_msg(const aliyun_sim_request_t *req) {
+	return req->m;
+}
+
+int aliyun_sim_reply(const aliyun_sim_request_t *req, uint8_t code, const char *json, uint8_t *resp, int resp_cap) {
+	const coap_msg_view_t *m = req->m;
+	uint8_t type = m->type == 0 ? 2 : 1; // CON 回 ACK，NON 回 NON
+	if (json) return build_coap_response_json(resp, resp_cap, type, code, m->mid, m->token, m->tkl, json, (int)strlen(json));
+	return build_coap_response(resp, resp_cap, type, code, m->mid, m->token, m->tkl);
+}
+
+// 在响应末尾追加一个 uint 格式选项（Block1/Size1），须按编号升序调用；返回新长度，<0 空间不足
+static int resp_add_uint_option(uint8_t *out, int cap, int n, uint16_t *last, uint16_t number, uint32_t v) {
+	if (n < 0) return n;
+	uint8_t val[4];
+	int vl = 0;
+	for (int sh = 24; sh >= 0; sh -= 8) {
+		if (vl || (v >> sh) & 0xFFu) val[vl++] = (uint8_t)(v >> sh);
+	}
+	uint16_t delta = (uint16_t)(number - *last);
+	int ext = delta >= 13;
+	if (n + 1 + ext + vl > cap) return -1;
+	out[n++] = (uint8_t)(((ext ? 13 : delta) << 4) | vl);
+	if (ext) out[n++] = (uint8_t)(delta - 13);
+	memcpy(out + n, val, (size_t)vl);
+	*last = number;
+	return n + vl;
+}
+
+// 认证握手：POST /auth，校验设备签名后签发会话 Token
+static int handle_auth(const aliyun_sim_request_t *rq, void *arg, uint8_t *resp, int resp_cap) {
+	sim_shard_t *sh = rq->sh;
+	const coap_msg_view_t *m = rq->m;
+	auth_request_t req;
+	(void)arg;
+	if (!m->payload || auth_parse_request(m->payload, m->payload_len, &req) != 0) {
+		STAT_ADD(sh, malformed, 1);
+		if (g_conf.log_packets) COAP_LOG_PKT("认证请求格式错误，返回 4.00 (MID=0x%04X)", m->mid);
+		return build_coap_response(resp, resp_cap, 2, (uint8_t)((4<<5)|0), m->mid, m->token, m->tkl); // 4.00 Bad Request
+	}
+	const registry_entry_t *e = registry_find_name(g_registry, req.product_key, req.device_name);
+	if (!e || !auth_check_sign(&req, e->device_secret)) {
+		STAT_ADD(sh, rejected, 1);
+		if (g_conf.log_packets) COAP_LOG_PKT("设备 %s/%s 认证失败，返回 4.01", req.product_key, req.device_name);
+		return build_coap_response(resp, resp_cap, 2, (uint8_t)((4<<5)|1), m->mid, m->token, m->tkl);
+	}
+	STAT_ADD(sh, auth_handshakes, 1);
+	char tok[AUTH_TOKEN_LEN + 1];
+	auth_issue_token(&g_issuer, registry_index_of(g_registry, e), sh->now_s + g_conf.auth_ttl_s, tok);
+	char json[96];
+	int jl = snprintf(json, sizeof(json), "{\"token\":\"%s\",\"expires\":%u}", tok, g_conf.auth_ttl_s);
+	if (g_conf.log_packets) COAP_LOG_PKT("设备 %s/%s 认证通过，签发会话 Token", req.product_key, req.device_name);
+	return build_coap_response_json(resp, resp_cap, 2, (uint8_t)((2<<5)|5), m->mid, m->token, m->tkl, json, jl);
+}
+
+// 校验上报携带的 token：8 位十六进制为简化 Token（查注册表），AUTH_TOKEN_LEN 位为会话 Token
+// 会话 Token 先查已校验缓存，未命中才做一次 HMAC，通过后放入缓存
+// 通过时输出设备号与缓存槽号（未进缓存为 -1）
+static int check_token(sim_shard_t *sh, const uint8_t *v, uint32_t len, uint32_t *dev, int *slot) {
+	*slot = -1;
+	if (len == 8) {
+		uint32_t token;
+		const registry_entry_t *e = registry_parse_token(v, 8, &token) == 0 ? registry_find_token(g_registry, token) : NULL;
+		if (e) *dev = registry_index_of(g_registry, e);
+		return e != NULL;
+	}
+	uint8_t raw[AUTH_TOKEN_RAW];
+	if (auth_token_decode(v, len, raw) != 0) return 0;
+	if (sh->auth_cache.entries && (*slot = auth_cache_lookup(&sh->auth_cache, raw, sh->now_s, dev)) >= 0) {
+		STAT_ADD(sh, auth_cache_hits, 1);
+		return 1;
+	}
+	STAT_ADD(sh, auth_verifies, 1);
+	if (auth_token_verify(&g_issuer, raw, sh->now_s, dev) != 0) return 0;
+	if (sh->auth_cache.entries) {
+		*slot = auth_cache_insert(&sh->auth_cache, raw, *dev, sh->now_s);
+		if (sh->key_ready) sh->key_ready[*slot] = 0;
+		STAT_SET(sh, auth_cache_evicted, sh->auth_cache.evicted);
+	}
+	return 1;
+}
+
+// 解密 Content-Format 42 的上报负载：会话密钥由设备密钥与 Token 算出并扩展，
+// 有密钥表时按 Token 的缓存槽保存，同一会话之后的报文直接复用；返回明文长度，<0 失败
+static int decrypt_payload(sim_shard_t *sh, const uint8_t *tok, uint32_t tok_len, uint32_t dev, int slot,
+	const uint8_t *in, size_t len, uint8_t *out) {
+	aes128_key_t tmp;
+	aes128_key_t *k = (slot >= 0 && sh->session_keys) ? &sh->session_keys[slot] : &tmp;
+	if (k == &tmp || !sh->key_ready[slot]) {
+		const registry_entry_t *e = registry_entry_at(g_registry, dev);
+		if (!e) return -1;
+		uint8_t key[AES128_KEY_LEN];
+		auth_session_key(e->device_secret, tok, tok_len, key);
+		aes128_key_init(k, key, g_conf.aes_impl);
+		STAT_ADD(sh, session_keys, 1);
+		if (k != &tmp) sh->key_ready[slot] = 1;
+	}
+	int n = aes128_cbc_decrypt(k, AUTH_PAYLOAD_IV, in, len, out);
+	if (n >= 0) STAT_ADD(sh, decrypted, 1);
+	return n;
+}
+
+// 分块上传的一块：写入重组表，请求体未收齐时直接生成响应（2.31 或错误码）并返回其长度；
+// 最后一块到达且完整时返回 0，请求体在 (*xfer)->body，长度写入 *body_len
+// 传输按来源地址、端口与 Uri-Path/Uri-Query 区分，同一设备对同一资源同时只有一个分块上传
+static int handle_block1(sim_shard_t *sh, const struct sockaddr_in *from, const coap_msg_view_t *m,
+	uint32_t bval, uint8_t *resp, int resp_cap, coap_block_xfer_t **xfer, size_t *body_len) {
+	uint16_t mid = m->mid;
+	if (!sh->blocks.capacity) {
+		STAT_ADD(sh, block_rejected, 1);
+		if (g_conf.log_packets) COAP_LOG_PKT("未启用分块传输，返回 4.02 (MID=0x%04X)", mid);
+		return build_coap_response(resp, resp_cap, 2, (uint8_t)((4<<5)|2), mid, m->token, m->tkl); // 4.02 Bad Option
+	}
+	uint32_t h = 2166136261u; // FNV-1a
+	for (uint8_t i = 0; i < m->opt_count; ++i) {
+		const coap_opt_view_t *o = &m->opts[i];
+		if (o->number != COAP_OPT_URI_PATH && o->number != COAP_OPT_URI_QUERY) continue;
+		for (uint16_t j = 0; j < o->len; ++j) h = (h ^ o->value[j]) * 16777619u;
+		h = (h ^ 0xFFu) * 16777619u; // 段分隔
+	}
+	uint32_t num;
+	int more;
+	uint8_t szx;
+	coap_block_parse(bval, &num, &more, &szx);
+	const coap_opt_view_t *s1 = coap_msg_find(m, COAP_OPT_SIZE1);
+	int rc = coap_block_put(&sh->blocks, coap_block_key(from->sin_addr.s_addr, from->sin_port, h), sh->now_ms,
+		num, more, szx, m->payload, m->payload_len, s1 ? coap_opt_uint(s1) : 0, xfer);
+	STAT_SET(sh, block_expired, sh->blocks.expired);
+	if (rc > 0) {
+		STAT_ADD(sh, block_uploads, 1);
+		*body_len = (size_t)rc;
+		return 0;
+	}
+	uint8_t code;
+	uint16_t last = 0;
+	int n;
+	switch (rc) {
+	case 0:
+		STAT_ADD(sh, block_continues, 1);
+		n = build_coap_response(resp, resp_cap, 2, (uint8_t)((2<<5)|31), mid, m->token, m->tkl); // 2.31 Continue
+		return resp_add_uint_option(resp, resp_cap, n, &last, COAP_OPT_BLOCK1, bval);
+	case -1:
+		STAT_ADD(sh, block_rejected, 1);
+		if (g_conf.log_packets) COAP_LOG_PKT("分块上传超过 %d 字节，返回 4.13 (MID=0x%04X)", COAP_BLOCK_BODY_MAX, mid);
+		n = build_coap_response(resp, resp_cap, 2, (uint8_t)((4<<5)|13), mid, m->token, m->tkl); // 4.13 Request Entity Too Large
+		return resp_add_uint_option(resp, resp_cap, n, &last, COAP_OPT_SIZE1, COAP_BLOCK_BODY_MAX);
+	case -2:
+		code = (uint8_t)((5<<5)|3); // 5.03 Service Unavailable
+		STAT_ADD(sh, block_rejected, 1);
+		break;
+	case -3:
+		code = (uint8_t)((4<<5)|8); // 4.08 Request Entity Incomplete
+		STAT_ADD(sh, block_incomplete, 1);
+		break;
+	default:
+		code = (uint8_t)((4<<5)|0);
+		STAT_ADD(sh, block_rejected, 1);
+		break;
+	}
+	if (g_conf.log_packets) COAP_LOG_PKT("分块 %u 无法重组 (%d)，返回 %u.%02u (MID=0x%04X)", num, rc,
+		code >> 5, code & 0x1F, mid);
+	return build_coap_response(resp, resp_cap, 2, code, mid, m->token, m->tkl);
+}
+
+// 上报：在 Uri-Query 选项中查找 "token=..." 鉴权，回 2.05 或 4.01；
+// 鉴权通过后按 Content-Format 解码校验读数（50/缺省 JSON，60 CBOR，110/112 SenML pack，42 先解密再按首字节区分），
+// 解不开或没有有效读数回 4.00，其他 Content-Format 回 4.15
+// 带 Block1 的请求先进重组表，收齐后对整个请求体做同样的处理，最终响应回显 Block1
+static int handle_upload_body(sim_shard_t *sh, const coap_msg_view_t *m, uint32_t cf, const uint8_t *body,
+	size_t body_len, uint8_t *plain, const coap_opt_view_t *tq, uint32_t dev, int slot, uint8_t *resp, int resp_cap);
+
+static int handle_upload(const aliyun_sim_request_t *req, void *arg, uint8_t *resp, int resp_cap) {
+	sim_shard_t *sh = req->sh;
+	const coap_msg_view_t *m = req->m;
+	int ok = 0, slot = -1;
+	(void)arg;
+	uint32_t dev = 0;
+	const coap_opt_view_t *tq = NULL;
+	for (const coap_opt_view_t *q = coap_msg_find(m, COAP_OPT_URI_QUERY); q; q = coap_msg_next(m, q)) {
+		if (q->len > 6 && memcmp(q->value, "token=", 6) == 0) {
+			tq = q;
+			ok = check_token(sh, q->value + 6, q->len - 6u, &dev, &slot);
+			break;
+		}
+	}
+	uint16_t mid = m->mid;
+	if (!ok) {
+		STAT_ADD(sh, rejected, 1);
+		if (g_conf.log_packets) COAP_LOG_PKT("鉴权失败，返回 4.01 (MID=0x%04X)", mid);
+		return build_coap_response(resp, resp_cap, (m->type==0)?2:2, (uint8_t)((4<<5)|1), mid, m->token, m->tkl); // 4.01 Unauthorized
+	}
+	const coap_opt_view_t *cfo = coap_msg_find(m, COAP_OPT_CONTENT_FORMAT);
+	uint32_t cf = cfo ? coap_opt_uint(cfo) : COAP_CF_JSON;
+	if (cf != COAP_CF_JSON && cf != COAP_CF_CBOR && cf != SENML_CF_JSON && cf != SENML_CF_CBOR &&
+		cf != COAP_CF_OCTET_STREAM) {
+		STAT_ADD(sh, bad_payload, 1);
+		if (g_conf.log_packets) COAP_LOG_PKT("不支持的 Content-Format %u，返回 4.15 (MID=0x%04X)", (unsigned)cf, mid);
+		return build_coap_response(resp, resp_cap, 2, (uint8_t)((4<<5)|15), mid, m->token, m->tkl); // 4.15 Unsupported Content-Format
+	}
+	const coap_opt_view_t *b1 = coap_msg_find(m, COAP_OPT_BLOCK1);
+	if (!b1) {
+		uint8_t plain[SIM_PKT_MAX];
+		return handle_upload_body(sh, m, cf, m->payload, m->payload_len, plain, tq, dev, slot, resp, resp_cap);
+	}
+	uint32_t bval = coap_opt_uint(b1);
+	coap_block_xfer_t *xfer = NULL;
+	size_t body_len = 0;
+	int n = handle_block1(sh, req->from, m, bval, resp, resp_cap, &xfer, &body_len);
+	if (n != 0) return n;
+	// 请求体已收齐：加密负载在重组缓冲内原地解密
+	n = handle_upload_body(sh, m, cf, xfer->body, body_len, xfer->body, tq, dev, slot, resp, resp_cap);
+	coap_block_release(&sh->blocks, xfer);
+	uint16_t last = 0;
+	return resp_add_uint_option(resp, resp_cap, n, &last, COAP_OPT_BLOCK1, bval);
+}
+
+static int handle_upload_body(sim_shard_t *sh, const coap_msg_view_t *m, uint32_t cf, const uint8_t *body,
+	size_t body_len, uint8_t *plain, const coap_opt_view_t *tq, uint32_t dev, int slot, uint8_t *resp, int resp_cap) {
+	uint16_t mid = m->mid;
+	if (body && cf == COAP_CF_OCTET_STREAM) {
+		int n = decrypt_payload(sh, tq->value + 6, tq->len - 6u, dev, slot, body, body_len, plain);
+		body = n >= 0 ? plain : NULL;
+		body_len = n >= 0 ? (size_t)n : 0;
+		// 明文按首字节区分：JSON 对象 '{'（或空白），SenML JSON '['，CBOR map 0xA0~0xBF，SenML CBOR 数组 0x80~0x9F
+		if (body_len && body[0] == '[') cf = SENML_CF_JSON;
+		else if (body_len && (body[0] & 0xE0) == 0xA0) cf = COAP_CF_CBOR;
+		else if (body_len && (body[0] & 0xE0) == 0x80) cf = SENML_CF_CBOR;
+	}
+	sensor_reading_t reading;
+	senml_sample_t samples[SENML_BATCH_MAX];
+	int jr, nr = 0;
+	uint32_t dropped = 0, abn = 0;
+	if (!body) {
+		jr = -1;
+	} else if (cf == SENML_CF_JSON || cf == SENML_CF_CBOR) {
+		nr = senml_decode(body, body_len, cf == SENML_CF_CBOR, samples, SENML_BATCH_MAX, &dropped);
+		jr = nr > 0 ? 0 : nr == 0 ? -4 : nr; // 全部超出量程按无效读数处理
+		for (int i = 0; i < nr; ++i) abn += samples[i].r.is_abnormal != 0;
+		STAT_ADD(sh, dropped_readings, dropped);
+	} else {
+		jr = cf == COAP_CF_CBOR ? sensor_cbor_decode(body, body_len, &reading) : sensor_json_decode(body, body_len, &reading);
+		nr = 1;
+		abn = jr == 0 && reading.is_abnormal;
+	}
+	if (jr != 0) {
+		STAT_ADD(sh, bad_payload, 1);
+		if (g_conf.log_packets) COAP_LOG_PKT("上报负载无效 (%d)，返回 4.00 (MID=0x%04X)", jr, mid);
+		return build_coap_response(resp, resp_cap, 2, (uint8_t)((4<<5)|0), mid, m->token, m->tkl); // 4.00 Bad Request
+	}
+	STAT_ADD(sh, accepted, 1);
+	if (g_store) {
+		// 单条读数不带时刻，按服务端接收时刻入库；SenML 各条用自己的采样时刻
+		if (cf == SENML_CF_JSON || cf == SENML_CF_CBOR) {
+			for (int i = 0; i < nr; ++i) {
+				const sensor_reading_t *x = &samples[i].r;
+				reading_store_append(g_store, sh->index, dev, samples[i].t_ms, x->temperature_c, x->humidity_rh,
+					(uint8_t)(x->is_abnormal != 0));
+			}
+		} else {
+			reading_store_append(g_store, sh->index, dev, g_wall_base + sh->now_ms, reading.temperature_c, reading.humidity_rh,
+				(uint8_t)(reading.is_abnormal != 0));
+		}
+	}
+	if (g_obs_values) {
+		// 被观察的资源：发布该设备最新的一条读数
+		const sensor_reading_t *latest = &reading;
+		if (cf == SENML_CF_JSON || cf == SENML_CF_CBOR) {
+			int k = 0;
+			for (int i = 1; i < nr; ++i) if (samples[i].t_ms > samples[k].t_ms) k = i;
+			latest = &samples[k].r;
+		}
+		// 另一分片正在写同一资源时重试：对方只拷贝一条读数，很快结束；仍失败则本条读数不会被观察到，计数
+		int t = 0;
+		while (coap_obs_publish(&g_obs_values[dev], latest, (uint8_t)sizeof(*latest)) != 0 && ++t < SIM_OBS_PUBLISH_TRIES) {}
+		if (t == SIM_OBS_PUBLISH_TRIES) STAT_ADD(sh, obs_publish_lost, 1);
+	}
+	STAT_ADD(sh, readings, (uint64_t)nr);
+	STAT_ADD(sh, abnormal, abn);
+	if (cf == SENML_CF_JSON || cf == SENML_CF_CBOR) STAT_ADD(sh, senml_packs, 1);
+	else if (cf == COAP_CF_CBOR) STAT_ADD(sh, cbor_payloads, 1);
+	else STAT_ADD(sh, json_payloads, 1);
+	STAT_ADD(sh, payload_bytes, body_len);
+	if (g_conf.log_packets) {
+		if (cf == SENML_CF_JSON || cf == SENML_CF_CBOR) {
+			COAP_LOG_PKT("已接收 SenML pack (MID=0x%04X) 读数 %d 条（异常 %u，超量程丢弃 %u）, 返回 2.05", mid,
+				nr, abn, dropped);
+		} else {
+			COAP_LOG_PKT("已接收上报 (MID=0x%04X) temp=%.1f humidity=%.1f%s, 返回 2.05", mid,
+				reading.temperature_c, reading.humidity_rh, reading.is_abnormal ? "（异常）" : "");
+		}
+	}
+	return build_coap_response(resp, resp_cap, (m->type==0)?2:2, (uint8_t)((2<<5)|5), mid, m->token, m->tkl); // 2.05 Content
+}
+
+// 通知的批量发送缓冲：每个观察者一段报文头，选项与负载共用一段
+typedef struct sim_obs_tx {
+	uint8_t hdr[SIM_OBS_BATCH * COAP_OBS_HDR_MAX];
+	uint8_t hdr_len[SIM_OBS_BATCH];
+	struct sockaddr_in to[SIM_OBS_BATCH];
+#if defined(__linux__)
+	struct iovec iov[SIM_OBS_BATCH * 2];
+	struct mmsghdr msgs[SIM_OBS_BATCH];
 #endif
-{
+} sim_obs_tx_t;
+
+// 观察资源的选项与负载：[Observe=seq]、Content-Format=50，有读数时带 JSON 负载；seq < 0 不带 Observe。返回字节数
+static int obs_body(uint8_t *out, int cap, int32_t seq, const sensor_reading_t *r) {
+	int n = 0;
+	uint16_t opt = 0;
+	if (cap < 12) return -1;
+	if (seq >= 0) {
+		uint8_t v[3];
+		int vl = seq > 0xFFFF ? 3 : seq > 0xFF ? 2 : seq > 0 ? 1 : 0;
+		for (int i = 0; i < vl; ++i) v[i] = (uint8_t)(seq >> (8 * (vl - 1 - i)));
+		out[n++] = (uint8_t)((COAP_OPT_OBSERVE << 4) | vl);
+		memcpy(out + n, v, (size_t)vl);
+		n += vl;
+		opt = COAP_OPT_OBSERVE;
+	}
+	out[n++] = (uint8_t)(((COAP_OPT_CONTENT_FORMAT - opt) << 4) | 1);
+	out[n++] = COAP_CF_JSON;
+	if (!r) return n;
+	out[n++] = 0xFF;
+	int jl = snprintf((char*)out + n, (size_t)(cap - n), "{\"temp\":%.1f,\"humidity\":%.1f,\"abn\":%d}",
+		r->temperature_c, r->humidity_rh, r->is_abnormal);
+	return jl < 0 || jl >= cap - n ? -1 : n + jl;
+}
+
+// 读取或观察设备最新读数：GET /things/<productKey>/<deviceName>，设备不存在回 4.04
+// Observe=0 注册（同一端点 + Token 再次注册只刷新有效期），Observe=1 取消；
+// 响应 2.05 带当前读数（JSON），注册成功时另带 Observe 序号。观察者已满时按普通 GET 回复（不带 Observe）
+static int handle_get(const aliyun_sim_request_t *req, void *arg, uint8_t *resp, int resp_cap) {
+	sim_shard_t *sh = req->sh;
+	const struct sockaddr_in *from = req->from;
+	const coap_msg_view_t *m = req->m;
 	(void)arg;
-	socket_t s = (socket_t)socket(AF_INET, SOCK_DGRAM, 0);
-	if ((int)s < 0) {
-		perror("server socket");
+	// 路由保证路径为 things/<pk>/<dn> 三段
+	const coap_opt_view_t *p1 = coap_msg_next(m, coap_msg_find(m, COAP_OPT_URI_PATH));
+	const coap_opt_view_t *p2 = coap_msg_next(m, p1);
+	const registry_entry_t *e = NULL;
+	char pk[64], dn[64];
+	if (p1->len < sizeof(pk) && p2->len < sizeof(dn)) {
+		memcpy(pk, p1->value, p1->len);
+		pk[p1->len] = '\0';
+		memcpy(dn, p2->value, p2->len);
+		dn[p2->len] = '\0';
+		e = registry_find_name(g_registry, pk, dn);
+	}
+	uint8_t type = m->type == 0 ? 2 : 1; // CON 回 ACK，NON 回 NON
+	if (!e) {
+		STAT_ADD(sh, not_found, 1);
+		if (g_conf.log_packets) COAP_LOG_PKT("GET 的资源不存在，返回 4.04 (MID=0x%04X)", m->mid);
+		return build_coap_response(resp, resp_cap, type, (uint8_t)((4<<5)|4), m->mid, m->token, m->tkl); // 4.04 Not Found
+	}
+	uint32_t dev = registry_index_of(g_registry, e);
+	sensor_reading_t r;
+	uint8_t len = 0;
+	uint8_t val[COAP_OBS_VALUE_MAX];
+	uint32_t ver = g_obs_values ? coap_obs_read(&g_obs_values[dev], val, &len) : 0;
+	if (ver) memcpy(&r, val, sizeof(r));
+	const coap_opt_view_t *ob = coap_msg_find(m, COAP_OPT_OBSERVE);
+	int observing = 0;
+	if (ob && sh->obs.max_observers) {
+		uint32_t v = coap_opt_uint(ob);
+		if (v == 0) {
+			int rc = coap_obs_register(&sh->obs, dev, from->sin_addr.s_addr, from->sin_port, m->token, m->tkl,
+				sh->now_s + g_conf.observe_ttl_s);
+			observing = rc >= 0;
+			if (rc == 0) STAT_ADD(sh, obs_registered, 1);
+			else if (rc == 1) STAT_ADD(sh, obs_refreshed, 1);
+			else STAT_ADD(sh, obs_rejected, 1);
+			// 资源的第一个观察者：当前值已在响应里，之后的更新才通知
+			coap_obs_list_t *l = observing ? coap_obs_find_list(&sh->obs, dev) : NULL;
+			if (l && l->count == 1) l->notified = ver;
+		} else if (v == 1 && coap_obs_deregister(&sh->obs, from->sin_addr.s_addr, from->sin_port, m->token, m->tkl) == 0) {
+			STAT_ADD(sh, obs_cancelled, 1);
+		}
+		STAT_SET(sh, obs_active, sh->obs.active);
+	}
+	if (g_conf.log_packets) {
+		COAP_LOG_PKT("GET %s/%s%s，返回 2.05 (MID=0x%04X)", pk, dn,
+			observing ? "（注册观察）" : ob ? "（取消观察）" : "", m->mid);
+	}
+	int n = build_coap_response(resp, resp_cap, type, (uint8_t)((2<<5)|5), m->mid, m->token, m->tkl);
+	if (n < 0) return n;
+	int bl = obs_body(resp + n, resp_cap - n, observing ? (int32_t)coap_obs_seq(ver) : -1, ver ? &r : NULL);
+	return bl < 0 ? -1 : n + bl;
+}
+
+// 资源发现：GET /.well-known/core，返回启动时生成的 CoRE Link Format 资源列表
+static int handle_core(const aliyun_sim_request_t *req, void *arg, uint8_t *resp, int resp_cap) {
+	(void)arg;
+	int n = aliyun_sim_reply(req, (uint8_t)((2<<5)|5), NULL, resp, resp_cap);
+	if (n < 0 || n + 3 + g_links_len > resp_cap) return -1;
+	resp[n++] = (uint8_t)((COAP_OPT_CONTENT_FORMAT << 4) | 1);
+	resp[n++] = COAP_CF_LINK_FORMAT;
+	resp[n++] = 0xFF;
+	memcpy(resp + n, g_links, (size_t)g_links_len);
+	return n + g_links_len;
+}
+
+// 把一轮通知发给列表中的全部观察者：每 SIM_OBS_BATCH 条一批，报文头各自一段，body 所有报文共享
+static void obs_send(sim_shard_t *sh, const coap_obs_list_t *l, const uint8_t *body, int body_len) {
+	sim_obs_tx_t *tx = sh->obs_tx;
+	for (uint32_t base = 0; base < l->count; base += SIM_OBS_BATCH) {
+		uint32_t n = coap_obs_headers(l, base, SIM_OBS_BATCH, (uint8_t)((2<<5)|5), (uint16_t)(l->round_mid + base),
+			tx->hdr, tx->hdr_len);
+		for (uint32_t i = 0; i < n; ++i) {
+			const coap_obs_peer_t *p = &l->peers[base + i];
+			memset(&tx->to[i], 0, sizeof(tx->to[i]));
+			tx->to[i].sin_family = AF_INET;
+			tx->to[i].sin_addr.s_addr = p->addr;
+			tx->to[i].sin_port = p->port;
+		}
+#if defined(__linux__)
+		for (uint32_t i = 0; i < n; ++i) {
+			tx->iov[2 * i].iov_base = tx->hdr + (size_t)i * COAP_OBS_HDR_MAX;
+			tx->iov[2 * i].iov_len = tx->hdr_len[i];
+			tx->iov[2 * i + 1].iov_base = (void*)body;
+			tx->iov[2 * i + 1].iov_len = (size_t)body_len;
+			struct msghdr *mh = &tx->msgs[i].msg_hdr;
+			memset(mh, 0, sizeof(*mh));
+			mh->msg_name = &tx->to[i];
+			mh->msg_namelen = sizeof(struct sockaddr_in);
+			mh->msg_iov = &tx->iov[2 * i];
+			mh->msg_iovlen = 2;
+		}
+		uint32_t done = 0;
+		while (done < n) {
+			int k = sendmmsg(sh->sock, tx->msgs + done, n - done, 0);
+			STAT_ADD(sh, obs_send_calls, 1);
+			if (k <= 0) break;
+			done += (uint32_t)k;
+		}
+		STAT_ADD(sh, obs_notifications, done);
+#else
+		for (uint32_t i = 0; i < n; ++i) {
 #ifdef _WIN32
-		return 0;
+			WSABUF bufs[2];
+			bufs[0].buf = (char*)tx->hdr + (size_t)i * COAP_OBS_HDR_MAX; bufs[0].len = tx->hdr_len[i];
+			bufs[1].buf = (char*)body; bufs[1].len = (ULONG)body_len;
+			DWORD sent = 0;
+			int ok = WSASendTo(sh->sock, bufs, 2, &sent, 0, (struct sockaddr*)&tx->to[i], sizeof(tx->to[i]), NULL, NULL) == 0;
 #else
-		return NULL;
+			struct iovec iov[2];
+			iov[0].iov_base = tx->hdr + (size_t)i * COAP_OBS_HDR_MAX; iov[0].iov_len = tx->hdr_len[i];
+			iov[1].iov_base = (void*)body; iov[1].iov_len = (size_t)body_len;
+			struct msghdr mh;
+			memset(&mh, 0, sizeof(mh));
+			mh.msg_name = &tx->to[i];
+			mh.msg_namelen = sizeof(tx->to[i]);
+			mh.msg_iov = iov;
+			mh.msg_iovlen = 2;
+			int ok = sendmsg(sh->sock, &mh, 0) >= 0;
+#endif
+			STAT_ADD(sh, obs_send_calls, 1);
+			STAT_ADD(sh, obs_notifications, (uint64_t)ok);
+		}
 #endif
 	}
-	struct sockaddr_in addr; memset(&addr, 0, sizeof(addr));
-	addr.sin_family = AF_INET;
-	addr.sin_port = htons(g_conf.listen_port);
-	addr.sin_addr.s_addr = htonl(INADDR_ANY);
-	if (bind(s, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-		perror("bind");
-#ifdef _WIN32
-		closesocket(s);
+}
+
+// 观察通知：每 SIM_OBS_SCAN_MS 检查一次本分片有观察者的资源，版本变了（期间多次更新只取最新值）
+// 就把选项与负载序列化一次，发给全部观察者；过期未重新注册的观察者在此时移除
+static void shard_notify(sim_shard_t *sh) {
+	if (!sh->obs.active) return;
+	uint64_t now = mono_ms();
+	if (now - sh->obs_scan_ms < SIM_OBS_SCAN_MS) return;
+	sh->obs_scan_ms = now;
+	uint32_t now_s = (uint32_t)time(NULL);
+	for (uint32_t li = 0; li < sh->obs.list_count; ++li) {
+		coap_obs_list_t *l = &sh->obs.lists[li];
+		if (!l->count) continue;
+		uint8_t val[COAP_OBS_VALUE_MAX], len;
+		uint32_t ver = coap_obs_read(&g_obs_values[l->resource], val, &len);
+		if (ver == l->notified) continue;
+		l->notified = ver;
+		STAT_ADD(sh, obs_expired, coap_obs_expire(&sh->obs, li, now_s));
+		if (!l->count) continue;
+		sensor_reading_t r;
+		memcpy(&r, val, sizeof(r));
+		uint8_t body[SIM_OBS_BODY_MAX];
+		int bl = obs_body(body, sizeof(body), (int32_t)coap_obs_seq(ver), &r);
+		if (bl < 0) continue;
+		l->round_mid = sh->obs_mid;
+		l->round_count = l->count;
+		sh->obs_mid = (uint16_t)(sh->obs_mid + l->count);
+		obs_send(sh, l, body, bl);
+		STAT_ADD(sh, obs_rounds, 1);
+	}
+	STAT_SET(sh, obs_active, sh->obs.active);
+}
+
+// 超过接收缓冲被截断的报文：按畸形丢弃，不回复（截断后的内容可能恰好能解析，不能交给处理流程）
+static void drop_truncated(sim_shard_t *sh) {
+	STAT_ADD(sh, received, 1);
+	STAT_ADD(sh, malformed, 1);
+}
+
+// 处理一个请求报文，生成响应；返回响应长度，0 表示不回复
+static int handle_datagram(sim_shard_t *sh, const struct sockaddr_in *from, const uint8_t *buf, int r,
+	uint8_t *resp, int resp_cap) {
+	STAT_ADD(sh, received, 1);
+	// CON 重传：只看固定头部的类型、MID 与 Token，在去重缓存中命中则直接重放上次的响应
+	uint64_t dkey = 0, dtok = 0;
+	uint8_t tkl = (uint8_t)(buf[0] & 0x0F);
+	int dedup = sh->dedup.capacity && r >= 4 + tkl && tkl <= 8 && (buf[0] & 0xF0) == 0x40;
+	if (dedup) {
+		dkey = coap_dedup_key(from->sin_addr.s_addr, from->sin_port, (uint16_t)((buf[2] << 8) | buf[3]));
+		dtok = coap_dedup_token(buf + 4, tkl);
+		int len = coap_dedup_lookup(&sh->dedup, dkey, dtok, tkl, sh->now_ms, resp, (uint32_t)resp_cap);
+		if (len >= 0) {
+			STAT_ADD(sh, dedup_hits, 1);
+			if (g_conf.log_packets) COAP_LOG_PKT("重复的 CON (MID=0x%04X)，重放上次的响应", (buf[2] << 8) | buf[3]);
+			return len;
+		}
+		STAT_ADD(sh, dedup_misses, 1);
+	}
+	coap_msg_view_t m;
+	int resp_len;
+	if (coap_msg_parse(&m, buf, (size_t)r) != 0) {
+		STAT_ADD(sh, malformed, 1);
 		return 0;
+	}
+	// 观察者以 RST 拒收通知时取消其观察；ACK 与 RST 都不回复
+	if (m.type >= 2) {
+		if (m.type == 3 && sh->obs.active &&
+			coap_obs_reset(&sh->obs, from->sin_addr.s_addr, from->sin_port, m.mid) == 0) {
+			STAT_ADD(sh, obs_reset, 1);
+			STAT_SET(sh, obs_active, sh->obs.active);
+		}
+		return 0;
+	}
+	// 空 CON（0.00，CoAP ping）回 RST，不走路由
+	if (m.code == 0) {
+		STAT_ADD(sh, pings, 1);
+		if (m.type != 0) return 0;
+		resp_len = build_coap_response(resp, resp_cap, 3, 0, m.mid, NULL, 0);
+		if (dedup) coap_dedup_insert(&sh->dedup, dkey, dtok, tkl, sh->now_ms, resp, (uint32_t)resp_len);
+		return resp_len;
+	}
+	// 按方法与 Uri-Path 分发；路径不存在回 4.04，方法不对回 4.05
+	aliyun_sim_request_t req = {sh, from, &m};
+	uint16_t route;
+	int rc = coap_router_match(&g_router, &m, &route);
+	if (rc == 0) {
+		resp_len = g_routes[route].fn(&req, g_routes[route].arg, resp, resp_cap);
+	} else {
+		if (rc == -1) STAT_ADD(sh, not_found, 1);
+		else STAT_ADD(sh, bad_method, 1);
+		if (g_conf.log_packets) COAP_LOG_PKT("没有对应的路由，返回 %s (MID=0x%04X)", rc == -1 ? "4.04" : "4.05", m.mid);
+		resp_len = aliyun_sim_reply(&req, (uint8_t)(rc == -1 ? (4<<5)|4 : (4<<5)|5), NULL, resp, resp_cap);
+	}
+	if (resp_len < 0) resp_len = 0;
+	if (dedup) {
+		coap_dedup_insert(&sh->dedup, dkey, dtok, tkl, sh->now_ms, resp, (uint32_t)resp_len);
+		STAT_SET(sh, dedup_evicted, sh->dedup.evicted);
+	}
+	return resp_len;
+}
+
+#if defined(__linux__)
+// 批量收发：一次 recvmmsg 读入最多 batch 条请求，响应攒成一批 sendmmsg 发出
+// 启用 GSO 时，同一批内发往同一地址、长度相同的连续响应合并成一个带 UDP_SEGMENT 的报文，由内核切分
+typedef struct {
+	struct mmsghdr *rx;
+	struct iovec *rx_iov;
+	struct sockaddr_in *from;
+	uint8_t *bufs;
+	struct mmsghdr *tx;
+	struct iovec *tx_iov;
+	uint8_t *resp;
+	int *resp_len;
+	char (*ctrl)[CMSG_SPACE(sizeof(uint16_t))];
+} sim_batch_t;
+
+static void batch_free(sim_batch_t *b) {
+	free(b->rx); free(b->rx_iov); free(b->from); free(b->bufs);
+	free(b->tx); free(b->tx_iov); free(b->resp); free(b->resp_len); free(b->ctrl);
+}
+
+static int batch_alloc(sim_batch_t *b, uint32_t n) {
+	memset(b, 0, sizeof(*b));
+	b->rx = (struct mmsghdr*)calloc(n, sizeof(struct mmsghdr));
+	b->rx_iov = (struct iovec*)calloc(n, sizeof(struct iovec));
+	b->from = (struct sockaddr_in*)calloc(n, sizeof(struct sockaddr_in));
+	b->bufs = (uint8_t*)malloc((size_t)n * SIM_PKT_MAX);
+	b->tx = (struct mmsghdr*)calloc(n, sizeof(struct mmsghdr));
+	b->tx_iov = (struct iovec*)calloc(n, sizeof(struct iovec));
+	b->resp = (uint8_t*)malloc((size_t)n * SIM_RESP_MAX);
+	b->resp_len = (int*)calloc(n, sizeof(int));
+	b->ctrl = calloc(n, sizeof(*b->ctrl));
+	if (!b->rx || !b->rx_iov || !b->from || !b->bufs || !b->tx || !b->tx_iov || !b->resp || !b->resp_len || !b->ctrl) {
+		batch_free(b);
+		return -1;
+	}
+	for (uint32_t i = 0; i < n; ++i) {
+		b->rx_iov[i].iov_base = b->bufs + (size_t)i * SIM_PKT_MAX;
+		b->rx_iov[i].iov_len = SIM_PKT_MAX;
+		b->rx[i].msg_hdr.msg_iov = &b->rx_iov[i];
+		b->rx[i].msg_hdr.msg_iovlen = 1;
+		b->rx[i].msg_hdr.msg_name = &b->from[i];
+	}
+	return 0;
+}
+
+static int same_peer(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+	return a->sin_port == b->sin_port && a->sin_addr.s_addr == b->sin_addr.s_addr;
+}
+
+// 把第 0..n-1 条请求的响应组装成 tx 消息，返回消息数
+static int batch_build_tx(sim_shard_t *sh, sim_batch_t *b, int n) {
+	int m = 0, iv = 0;
+	for (int i = 0; i < n; ++i) {
+		if (b->resp_len[i] <= 0) continue;
+		int len = b->resp_len[i];
+		struct msghdr *mh = &b->tx[m].msg_hdr;
+		memset(mh, 0, sizeof(*mh));
+		mh->msg_name = &b->from[i];
+		mh->msg_namelen = sizeof(struct sockaddr_in);
+		mh->msg_iov = &b->tx_iov[iv];
+		int segs = 0;
+		// 合并其后发往同一地址、同样长度的响应（GSO 要求除最后一段外等长）
+		int max_segs = sh->gso ? SIM_GSO_BYTES / len : 1;
+		if (max_segs > SIM_GSO_MAX) max_segs = SIM_GSO_MAX;
+		for (int j = i; j < n && segs < max_segs; ++j) {
+			if (b->resp_len[j] <= 0) continue;
+			if (j != i && (b->resp_len[j] != len || !same_peer(&b->from[j], &b->from[i]))) break;
+			b->tx_iov[iv].iov_base = b->resp + (size_t)j * SIM_RESP_MAX;
+			b->tx_iov[iv].iov_len = (size_t)len;
+			iv++; segs++;
+			if (j != i) b->resp_len[j] = -b->resp_len[j]; // 标记已并入
+		}
+		mh->msg_iovlen = (size_t)segs;
+		if (segs > 1) {
+			mh->msg_control = b->ctrl[m];
+			mh->msg_controllen = sizeof(b->ctrl[m]);
+			struct cmsghdr *cm = CMSG_FIRSTHDR(mh);
+			cm->cmsg_level = SOL_UDP;
+			cm->cmsg_type = UDP_SEGMENT;
+			cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+			uint16_t gso_size = (uint16_t)len;
+			memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+		}
+		m++;
+	}
+	return m;
+}
+
+static void server_loop_batch(sim_shard_t *sh, uint32_t batch) {
+	sim_batch_t b;
+	if (batch_alloc(&b, batch) != 0) {
+		coap_log_error("分片 %u: 批量缓冲分配失败", sh->index);
+		return;
+	}
+	while (g_server_running) {
+		shard_notify(sh);
+		for (uint32_t i = 0; i < batch; ++i) b.rx[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		// MSG_WAITFORONE：首条按接收超时阻塞，之后有多少取多少
+		int n = recvmmsg(sh->sock, b.rx, batch, MSG_WAITFORONE, NULL);
+		STAT_ADD(sh, recv_calls, 1);
+		if (n <= 0) continue;
+		shard_tick(sh);
+		for (int i = 0; i < n; ++i) {
+			if (b.rx[i].msg_hdr.msg_flags & MSG_TRUNC) {
+				drop_truncated(sh);
+				b.resp_len[i] = 0;
+				continue;
+			}
+			b.resp_len[i] = handle_datagram(sh, &b.from[i], b.bufs + (size_t)i * SIM_PKT_MAX, (int)b.rx[i].msg_len,
+				b.resp + (size_t)i * SIM_RESP_MAX, SIM_RESP_MAX);
+		}
+		int m = batch_build_tx(sh, &b, n);
+		int k = 0;
+		while (k < m) {
+			int r = sendmmsg(sh->sock, b.tx + k, (unsigned)(m - k), 0);
+			STAT_ADD(sh, send_calls, 1);
+			if (r <= 0) {
+				if (sh->gso && errno == EIO) {
+					// 网卡/内核不支持 UDP GSO：关闭；本批尚未发出任何响应时按逐条重组重发
+					sh->gso = 0;
+					coap_log_warn("分片 %u: UDP GSO 不可用，已关闭", sh->index);
+					if (k == 0) {
+						for (int i = 0; i < n; ++i) if (b.resp_len[i] < 0) b.resp_len[i] = -b.resp_len[i];
+						m = batch_build_tx(sh, &b, n);
+						continue;
+					}
+				}
+				break;
+			}
+			for (int i = k; i < k + r; ++i) {
+				STAT_ADD(sh, sent, b.tx[i].msg_hdr.msg_iovlen);
+				if (b.tx[i].msg_hdr.msg_iovlen > 1) STAT_ADD(sh, gso_sends, 1);
+			}
+			k += r;
+		}
+	}
+	batch_free(&b);
+}
+
+// io_uring 后端：一个常驻 multishot recvmsg 持续产出请求（缓冲取自注册的提供缓冲环），
+// 响应以 SENDMSG SQE 提交，与下一次等待合并为一次 io_uring_enter；稳态下每批报文只有一次系统调用
+typedef struct {
+	struct msghdr msg;
+	struct iovec iov;
+	struct sockaddr_in to;
+	uint8_t resp[SIM_RESP_MAX];
+} sim_uring_slot_t;
+
+// 处理一个已收到的请求：占用一个响应槽并提交 SENDMSG；槽或 SQ 用尽时返回 0（请求暂留）
+static int uring_serve(sim_shard_t *sh, uring_t *ring, uring_bufring_t *br, const struct msghdr *rmsg,
+	sim_uring_slot_t *slots, uint32_t *free_ids, uint32_t *free_top, uint16_t bid, int32_t res) {
+	if (*free_top == 0 || uring_sq_pending(ring) >= ring->sq_entries) return 0;
+	uint8_t *b = uring_buf_addr(br, bid);
+	const struct io_uring_recvmsg_out *out = (const struct io_uring_recvmsg_out*)b;
+	if (res > 0 && (out->flags & MSG_TRUNC)) {
+		drop_truncated(sh);
+	} else if (res > 0 && out->namelen >= sizeof(struct sockaddr_in)) {
+		const uint8_t *pkt = b + sizeof(*out) + rmsg->msg_namelen + rmsg->msg_controllen;
+		uint32_t id = free_ids[*free_top - 1];
+		sim_uring_slot_t *sl = &slots[id];
+		memcpy(&sl->to, b + sizeof(*out), sizeof(sl->to));
+		int len = handle_datagram(sh, &sl->to, pkt, (int)out->payloadlen, sl->resp, SIM_RESP_MAX);
+		struct io_uring_sqe *sqe = len > 0 ? uring_get_sqe(ring) : NULL;
+		if (sqe) {
+			(*free_top)--;
+			sl->iov.iov_base = sl->resp;
+			sl->iov.iov_len = (size_t)len;
+			memset(&sl->msg, 0, sizeof(sl->msg));
+			sl->msg.msg_name = &sl->to;
+			sl->msg.msg_namelen = sizeof(sl->to);
+			sl->msg.msg_iov = &sl->iov;
+			sl->msg.msg_iovlen = 1;
+			uring_prep_sendmsg(sqe, (int)sh->sock, &sl->msg, SIM_URING_TAG_SEND | id);
+		}
+	}
+	uring_buf_recycle(br, bid);
+	return 1;
+}
+
+static int server_loop_uring(sim_shard_t *sh) {
+	uring_t ring;
+	uring_bufring_t br;
+	int ur = uring_init(&ring, SIM_URING_SLOTS, 4 * SIM_URING_BUFS);
+	if (ur != 0) return ur;
+	// 每个缓冲：io_uring_recvmsg_out + 对端地址 + 报文
+	uint32_t bsize = (uint32_t)(sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in) + SIM_PKT_MAX);
+	ur = uring_bufring_init(&ring, &br, 0, SIM_URING_BUFS, bsize);
+	sim_uring_slot_t *slots = (sim_uring_slot_t*)calloc(SIM_URING_SLOTS, sizeof(sim_uring_slot_t));
+	uint32_t *free_ids = (uint32_t*)malloc(SIM_URING_SLOTS * sizeof(uint32_t));
+	// 暂未处理的请求（bid, res）：每条占着一个接收缓冲，数量不会超过缓冲环大小
+	uint16_t *bl_bid = (uint16_t*)malloc(br.count * sizeof(uint16_t));
+	int32_t *bl_res = (int32_t*)malloc(br.count * sizeof(int32_t));
+	if (ur != 0 || !slots || !free_ids || !bl_bid || !bl_res) {
+		free(slots);
+		free(free_ids);
+		free(bl_bid);
+		free(bl_res);
+		uring_bufring_destroy(&ring, &br);
+		uring_destroy(&ring);
+		return ur != 0 ? ur : -ENOMEM;
+	}
+	uint32_t free_top = 0;
+	for (uint32_t i = 0; i < SIM_URING_SLOTS; ++i) free_ids[free_top++] = i;
+	uint32_t bl_head = 0, bl_tail = 0, bl_mask = br.count - 1;
+
+	struct msghdr rmsg;
+	memset(&rmsg, 0, sizeof(rmsg));
+	rmsg.msg_namelen = sizeof(struct sockaddr_in);
+	int armed = 0;
+	while (g_server_running) {
+		if (!armed) {
+			struct io_uring_sqe *sqe = uring_get_sqe(&ring);
+			if (sqe) {
+				uring_prep_recvmsg_multishot(sqe, (int)sh->sock, &rmsg, br.bgid, 0);
+				armed = 1;
+			}
+		}
+		// 提交本轮响应并等待新完成事件（积压请求可立即处理时不等待），超时用于检查停止标志
+		unsigned wait_nr = (bl_head != bl_tail && free_top > 0) ? 0 : 1;
+		if (uring_submit(&ring, wait_nr, (int64_t)SIM_POLL_MS * 1000) < 0) break;
+		shard_tick(sh);
+		// 先收割全部完成事件：发送完成归还响应槽，请求进入积压队列（按到达顺序处理，
+		// 避免响应槽用尽时请求挡在 CQ 队首、后面的发送完成取不到而互相等待）
+		struct io_uring_cqe *cqe;
+		while ((cqe = uring_peek_cqe(&ring)) != NULL) {
+			uint64_t ud = cqe->user_data;
+			int32_t res = cqe->res;
+			uint32_t flags = cqe->flags;
+			uring_cqe_seen(&ring);
+			if (ud & SIM_URING_TAG_SEND) {
+				if (res >= 0) STAT_ADD(sh, sent, 1);
+				free_ids[free_top++] = (uint32_t)ud;
+				continue;
+			}
+			if (!(flags & IORING_CQE_F_MORE)) armed = 0; // 缓冲耗尽或出错，下一轮重新挂上
+			if (!(flags & IORING_CQE_F_BUFFER)) continue;
+			bl_bid[bl_tail & bl_mask] = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+			bl_res[bl_tail & bl_mask] = res;
+			bl_tail++;
+		}
+		while (bl_head != bl_tail &&
+			uring_serve(sh, &ring, &br, &rmsg, slots, free_ids, &free_top, bl_bid[bl_head & bl_mask], bl_res[bl_head & bl_mask])) {
+			bl_head++;
+		}
+		STAT_SET(sh, uring_enters, ring.enters);
+		shard_notify(sh);
+	}
+	uring_bufring_destroy(&ring, &br);
+	uring_destroy(&ring);
+	free(slots);
+	free(free_ids);
+	free(bl_bid);
+	free(bl_res);
+	return 0;
+}
+#endif
+
+#ifdef _WIN32
+static unsigned __stdcall server_thread(void *arg)
 #else
-		close(s);
-		return NULL;
+static void* server_thread(void *arg)
 #endif
+{
+	sim_shard_t *sh = (sim_shard_t*)arg;
+#if defined(__linux__)
+	// 每个分片绑定到一个核
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu > 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET((int)(sh->index % (uint32_t)ncpu), &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
 	}
-
-	printf("[%s] 阿里云模拟服务启动，端口 %u\n", now_ts(), g_conf.listen_port);
-	uint8_t buf[1500];
+#endif
+#if defined(__linux__)
+	if (g_backend == IO_BACKEND_URING) {
+		int ur = server_loop_uring(sh);
+		if (ur == 0) return NULL;
+		coap_log_warn("分片 %u: io_uring 初始化失败 (%d)，退回套接字收发", sh->index, ur);
+	}
+	if (g_conf.batch_size > 1) {
+		server_loop_batch(sh, g_conf.batch_size > SIM_BATCH_MAX ? SIM_BATCH_MAX : g_conf.batch_size);
+		return NULL;
+	}
+#endif
+	uint8_t buf[SIM_PKT_MAX];
+	uint8_t resp[SIM_RESP_MAX];
 	while (g_server_running) {
+		shard_notify(sh);
 		struct sockaddr_in from; socklen_t fl = sizeof(from);
-		int r = recvfrom(s, (char*)buf, sizeof(buf), 0, (struct sockaddr*)&from, &fl);
+		int r = recvfrom(sh->sock, (char*)buf, sizeof(buf), SIM_RECV_FLAGS, (struct sockaddr*)&from, &fl);
+		STAT_ADD(sh, recv_calls, 1);
 		if (r <= 0) {
-			// 继续
+			// 超时（用于检查停止标志）或出错，继续
 			continue;
 		}
-		uint8_t type, code; uint16_t mid;
-		const uint8_t *opt_start, *payload; int opt_len, payload_len;
-		if (parse_coap_basic(buf, r, &type, &code, &mid, &opt_start, &opt_len, &payload, &payload_len) != 0) {
+		if (r > (int)sizeof(buf)) {
+			drop_truncated(sh);
 			continue;
 		}
-		// 简化：从 options 中查找 Uri-Query 里的 token=xxxx
-		// 这里不完全解析 options 编码，而是直接在 opt 字节流中寻找 "token=" 的 ASCII 片段
-		int ok = 0;
-		char token_expect[16];
-		make_token_inner(&g_conf.triple, token_expect, sizeof(token_expect));
-		for (int i = 0; i + 6 < opt_len; ++i) {
-			if (opt_start[i] == 't' && i + 12 < opt_len) {
-				if (memcmp(opt_start + i, "token=", 6) == 0) {
-					if (i + 6 + 8 <= opt_len && memcmp(opt_start + i + 6, token_expect, 8) == 0) {
-						ok = 1; break;
-					}
-				}
-			}
-		}
-		uint8_t resp[64]; int resp_len;
-		if (!ok) {
-			resp_len = build_coap_response(resp, sizeof(resp), (type==0)?2:2, (uint8_t)((4<<5)|1), mid); // 4.01 Unauthorized
-			printf("[%s] 鉴权失败，返回 4.01 (MID=0x%04X)\n", now_ts(), mid);
-		} else {
-			resp_len = build_coap_response(resp, sizeof(resp), (type==0)?2:2, (uint8_t)((2<<5)|5), mid); // 2.05 Content
-			printf("[%s] 已接收上报 (MID=0x%04X), 返回 2.05\n", now_ts(), mid);
+		shard_tick(sh);
+		int resp_len = handle_datagram(sh, &from, buf, r, resp, sizeof(resp));
+		if (resp_len > 0) STAT_ADD(sh, send_calls, 1);
+		if (resp_len > 0 && sendto(sh->sock, (const char*)resp, resp_len, 0, (struct sockaddr*)&from, fl) > 0) {
+			STAT_ADD(sh, sent, 1);
 		}
-		sendto(s, (const char*)resp, resp_len, 0, (struct sockaddr*)&from, fl);
 	}
+#ifdef _WIN32
+	return 0;
+#else
+	return NULL;
+#endif
+}
 
+static void close_socket(socket_t s) {
 #ifdef _WIN32
 	closesocket(s);
-	return 0;
 #else
 	close(s);
-	return NULL;
 #endif
 }
 
+// 为分片建立监听套接字：多分片时用 SO_REUSEPORT 绑定同一端口，由内核按四元组散列分发
+static int open_shard_socket(sim_shard_t *sh, int reuseport) {
+	socket_t s = (socket_t)socket(AF_INET, SOCK_DGRAM, 0);
+	if ((int)s < 0) {
+		perror("server socket");
+		return -1;
+	}
+#ifdef SO_REUSEPORT
+	if (reuseport) {
+		int one = 1;
+		if (setsockopt(s, SOL_SOCKET, SO_REUSEPORT, (const char*)&one, sizeof(one)) != 0) {
+			perror("SO_REUSEPORT");
+			close_socket(s);
+			return -1;
+		}
+	}
+#else
+	(void)reuseport;
+#endif
+	struct sockaddr_in addr; memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(g_conf.listen_port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(s, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+		perror("bind");
+		close_socket(s);
+		return -1;
+	}
+
+	// 多设备并发上报时突发量大，放大接收缓冲减少内核丢包
+	int rcvbuf = 4 * 1024 * 1024;
+	setsockopt(s, SOL_SOCKET, SO_RCVBUF, (const char*)&rcvbuf, sizeof(rcvbuf));
+	// 接收超时用于周期性检查停止标志，保证 aliyun_sim_stop 能回收线程
+#ifdef _WIN32
+	DWORD tv = SIM_POLL_MS;
+	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
+#else
+	struct timeval tv;
+	tv.tv_sec = 0;
+	tv.tv_usec = SIM_POLL_MS * 1000;
+	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+#endif
+	sh->sock = s;
+	return 0;
+}
+
+// 建立设备注册表：配置中的三元组总是登记，另可从文件批量加载；Token 都在这里一次算好
+static int registry_setup(const aliyun_sim_conf_t *conf) {
+	if (registry_create(&g_registry, 1) != 0) return -2;
+	if (registry_add(g_registry, conf->triple.product_key, conf->triple.device_name, conf->triple.device_secret) < 0) {
+		registry_destroy(g_registry);
+		g_registry = NULL;
+		return -1;
+	}
+	if (!conf->registry_file) return 0;
+	struct timespec t0, t1;
+	timespec_get(&t0, TIME_UTC);
+	uint32_t loaded = 0, bad = 0;
+	int rc = registry_load_file(g_registry, conf->registry_file, conf->registry_threads, &loaded, &bad);
+	timespec_get(&t1, TIME_UTC);
+	if (rc != 0) {
+		coap_log_error("加载设备注册表 %s 失败 (%d)", conf->registry_file, rc);
+		registry_destroy(g_registry);
+		g_registry = NULL;
+		return -4;
+	}
+	double ms = (double)(t1.tv_sec - t0.tv_sec) * 1000.0 + (double)(t1.tv_nsec - t0.tv_nsec) / 1e6;
+	coap_log_info("设备注册表：从 %s 加载 %u 台（格式错误 %u 行），共 %u 台，用时 %.1f ms",
+		conf->registry_file, loaded, bad, registry_count(g_registry), ms);
+	return 0;
+}
+
+// 会话 Token 密钥：进程内首次启动时随机生成；同一进程内重启服务端（如 --io compare）已签发的 Token 仍然有效
+static void issuer_setup(void) {
+	static int ready = 0;
+	if (ready) return;
+	ready = 1;
+	uint64_t x = mono_ms() ^ ((uint64_t)time(NULL) << 20) ^ (uint64_t)(uintptr_t)&x;
+	uint8_t secret[32];
+	for (int i = 0; i < 32; i += 8) {
+		// splitmix64
+		uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		z ^= z >> 31;
+		memcpy(secret + i, &z, 8);
+	}
+	auth_issuer_init(&g_issuer, secret, sizeof(secret));
+}
+
+// 分片的固定内存：去重缓存、已校验 Token 缓存及按槽挂接的会话密钥表，运行期间不再分配
+static int shard_alloc(sim_shard_t *sh, const aliyun_sim_conf_t *conf) {
+	if (conf->dedup_entries && coap_dedup_init(&sh->dedup, conf->dedup_entries, 0) != 0) return -2;
+	if (conf->block_transfers && coap_block_init(&sh->blocks, conf->block_transfers, conf->block_timeout_ms) != 0) return -2;
+	if (conf->observe_observers) {
+		if (coap_obs_init(&sh->obs, conf->observe_observers, conf->observe_resources ? conf->observe_resources : 1024) != 0) return -2;
+		sh->obs_tx = (sim_obs_tx_t*)malloc(sizeof(sim_obs_tx_t));
+		if (!sh->obs_tx) return -2;
+	}
+	if (!conf->auth_cache_entries) return 0;
+	if (auth_cache_init(&sh->auth_cache, conf->auth_cache_entries, g_conf.auth_ttl_s) != 0) return -2;
+	if (conf->session_key_cache) {
+		uint32_t slots = auth_cache_slots(&sh->auth_cache);
+		sh->session_keys = (aes128_key_t*)malloc((size_t)slots * sizeof(aes128_key_t));
+		sh->key_ready = (uint8_t*)calloc(slots, 1);
+		if (!sh->session_keys || !sh->key_ready) return -2;
+	}
+	return 0;
+}
+
+static void shard_free(sim_shard_t *sh) {
+	coap_dedup_destroy(&sh->dedup);
+	coap_block_destroy(&sh->blocks);
+	coap_obs_destroy(&sh->obs);
+	free(sh->obs_tx);
+	sh->obs_tx = NULL;
+	auth_cache_destroy(&sh->auth_cache);
+	free(sh->session_keys);
+	free(sh->key_ready);
+	sh->session_keys = NULL;
+	sh->key_ready = NULL;
+}
+
+int aliyun_sim_add_route(uint8_t method, const char *path, aliyun_sim_handler_t fn, void *arg) {
+	if (g_shards) return -3;
+	if (!path || !fn || method < 1 || method > COAP_ROUTER_METHODS || strlen(path) >= SIM_ROUTE_PATH_MAX) return -1;
+	if (g_user_route_count == SIM_ROUTES_MAX - 4) return -2; // 给内置路由留位置
+	sim_route_t *r = &g_routes[g_user_route_count++];
+	r->method = method;
+	strcpy(r->path, path);
+	r->fn = fn;
+	r->arg = arg;
+	return 0;
+}
+
+// 在调用方注册的路由后追加内置路由，建前缀树并生成资源列表；与调用方路由重复的内置路由跳过
+static int router_setup(void) {
+	static const struct {
+		uint8_t method;
+		const char *path;
+		aliyun_sim_handler_t fn;
+	} builtin[] = {
+		{2, "auth", handle_auth},
+		{2, "things/upload", handle_upload},
+		{1, "things/+/+", handle_get},
+		{1, ".well-known/core", handle_core},
+	};
+	g_route_count = g_user_route_count;
+	for (size_t i = 0; i < sizeof(builtin) / sizeof(builtin[0]); ++i) {
+		sim_route_t *r = &g_routes[g_route_count++];
+		r->method = builtin[i].method;
+		strcpy(r->path, builtin[i].path);
+		r->fn = builtin[i].fn;
+		r->arg = NULL;
+	}
+	if (coap_router_init(&g_router, SIM_ROUTE_NODES) != 0) return -1;
+	for (uint32_t i = 0; i < g_route_count; ++i) {
+		int rc = coap_router_add(&g_router, g_routes[i].method, g_routes[i].path, (uint16_t)i);
+		if (rc == -3 && i >= g_user_route_count) continue;
+		if (rc != 0) {
+			coap_log_error("路由 %s 无法注册 (%d)", g_routes[i].path, rc);
+			coap_router_destroy(&g_router);
+			return -1;
+		}
+	}
+	// 每条路由至多输出 "</path>,"
+	size_t cap = 1;
+	for (uint32_t i = 0; i < g_route_count; ++i) cap += strlen(g_routes[i].path) + 4;
+	g_links = (char*)malloc(cap);
+	if (!g_links) {
+		coap_router_destroy(&g_router);
+		return -1;
+	}
+	g_links_len = (int)coap_router_links(&g_router, g_links, cap);
+	return 0;
+}
+
+static void router_teardown(void) {
+	coap_router_destroy(&g_router);
+	free(g_links);
+	g_links = NULL;
+	g_links_len = 0;
+}
+
 int aliyun_sim_start(const aliyun_sim_conf_t *conf) {
 	if (!conf) return -1;
+	if (g_shards) return -3; // 已在运行
 	g_conf = *conf;
+	uint32_t n = conf->worker_threads ? conf->worker_threads : 1;
+#ifndef SO_REUSEPORT
+	n = 1; // 平台不支持端口复用时退化为单分片
+#endif
+	if (g_conf.auth_ttl_s == 0) g_conf.auth_ttl_s = SIM_AUTH_TTL_S;
+	if (g_conf.observe_ttl_s == 0) g_conf.observe_ttl_s = SIM_OBS_TTL_S;
+	if (router_setup() != 0) return -1;
+	int rc = registry_setup(conf);
+	if (rc != 0) {
+		router_teardown();
+		return rc;
+	}
+	issuer_setup();
+	g_shards = (sim_shard_t*)calloc(n, sizeof(sim_shard_t));
+	if (conf->observe_observers) g_obs_values = (coap_obs_slot_t*)calloc(registry_count(g_registry), sizeof(coap_obs_slot_t));
+	if (g_shards && conf->store_dir) {
+		int src = reading_store_open(&g_store, conf->store_dir, registry_count(g_registry), n, 0, conf->store_commit_ms);
+		if (src != 0) {
+			coap_log_error("列存 %s 无法打开 (%d)", conf->store_dir, src);
+			free(g_shards);
+			g_shards = NULL;
+			free(g_obs_values);
+			g_obs_values = NULL;
+			registry_destroy(g_registry);
+			g_registry = NULL;
+			router_teardown();
+			return -5;
+		}
+	}
+	g_wall_base = (uint64_t)time(NULL) * 1000u - mono_ms();
+	if (!g_shards || (conf->observe_observers && !g_obs_values)) {
+		free(g_shards);
+		g_shards = NULL;
+		free(g_obs_values);
+		g_obs_values = NULL;
+		registry_destroy(g_registry);
+		g_registry = NULL;
+		router_teardown();
+		reading_store_close(g_store);
+		g_store = NULL;
+		return -2;
+	}
+	g_shard_count = n;
+	g_backend = conf->io_backend;
+	if (g_backend == IO_BACKEND_URING && !uring_available()) {
+		coap_log_warn("内核不支持 io_uring，服务端退回套接字后端");
+		g_backend = IO_BACKEND_SOCKET;
+	}
+
+	// 套接字在启动线程前建好：绑定失败能直接返回，客户端也不会抢在服务端就绪前发包
+	for (uint32_t i = 0; i < n; ++i) {
+		sim_shard_t *sh = &g_shards[i];
+		sh->index = i;
+		sh->gso = conf->gso;
+		if (shard_alloc(sh, conf) != 0 || open_shard_socket(sh, n > 1) != 0) {
+			for (uint32_t j = 0; j < i; ++j) close_socket(g_shards[j].sock);
+			for (uint32_t j = 0; j <= i; ++j) shard_free(&g_shards[j]);
+			free(g_shards);
+			g_shards = NULL;
+			g_shard_count = 0;
+			free(g_obs_values);
+			g_obs_values = NULL;
+			registry_destroy(g_registry);
+			g_registry = NULL;
+			router_teardown();
+			reading_store_close(g_store);
+			g_store = NULL;
+			return -2;
+		}
+	}
+
 	g_server_running = 1;
+	for (uint32_t i = 0; i < n; ++i) {
+		sim_shard_t *sh = &g_shards[i];
 #ifdef _WIN32
-	uintptr_t th = _beginthreadex(NULL, 0, server_thread, NULL, 0, NULL);
-	if (th == 0) return -2;
+		sh->thread = (HANDLE)_beginthreadex(NULL, 0, server_thread, sh, 0, NULL);
+		sh->started = sh->thread != 0;
 #else
-	pthread_t th; if (pthread_create(&th, NULL, server_thread, NULL) != 0) return -2; pthread_detach(th);
+		sh->started = pthread_create(&sh->thread, NULL, server_thread, sh) == 0;
 #endif
+		if (!sh->started) {
+			aliyun_sim_stop();
+			return -2;
+		}
+	}
+	coap_log_info("阿里云模拟服务启动，端口 %u，工作线程 %u，收发后端 %s，去重缓存 %u 条/分片",
+		g_conf.listen_port, n, io_backend_name(g_backend), g_conf.dedup_entries);
 	return 0;
 }
 
 void aliyun_sim_stop(void) {
+	if (!g_shards) return;
 	g_server_running = 0;
+	for (uint32_t i = 0; i < g_shard_count; ++i) {
+		sim_shard_t *sh = &g_shards[i];
+		if (!sh->started) continue;
+#ifdef _WIN32
+		WaitForSingleObject(sh->thread, INFINITE);
+		CloseHandle(sh->thread);
+#else
+		pthread_join(sh->thread, NULL);
+#endif
+	}
+	for (uint32_t i = 0; i < g_shard_count; ++i) {
+		close_socket(g_shards[i].sock);
+		shard_free(&g_shards[i]);
+	}
+	free(g_shards);
+	g_shards = NULL;
+	g_shard_count = 0;
+	free(g_obs_values);
+	g_obs_values = NULL;
+	registry_destroy(g_registry);
+	g_registry = NULL;
+	router_teardown();
+	reading_store_close(g_store); // 写线程先提交环里剩下的读数
+	g_store = NULL;
 }
 
+uint32_t aliyun_sim_get_stats(aliyun_sim_stats_t *total, aliyun_sim_stats_t *per_shard, uint32_t max_shards) {
+	// 统计结构的字段全部是 uint64_t 计数，按数组逐个原子读取、累加
+	enum { NFIELDS = sizeof(aliyun_sim_stats_t) / sizeof(uint64_t) };
+	if (total) memset(total, 0, sizeof(*total));
+	for (uint32_t i = 0; i < g_shard_count; ++i) {
+		const uint64_t *st = (const uint64_t*)&g_shards[i].stats;
+		uint64_t *ps = per_shard && i < max_shards ? (uint64_t*)&per_shard[i] : NULL;
+		uint64_t *tt = (uint64_t*)total;
+		for (uint32_t k = 0; k < NFIELDS; ++k) {
+			uint64_t v = stat_load(&st[k]);
+			if (ps) ps[k] = v;
+			if (tt) tt[k] += v;
+		}
+	}
+	return g_shard_count;
+}
 
+reading_store_t *aliyun_sim_store(void) {
+	return g_store;
+}
+
+uint32_t aliyun_sim_device_count(void) {
+	return registry_count(g_registry);
+}
+
+int aliyun_sim_device_triple(uint32_t index, device_triple_t *out) {
+	const registry_entry_t *e = g_registry ? registry_entry_at(g_registry, index) : NULL;
+	if (!e || !out) return -1;
+	memset(out, 0, sizeof(*out));
+	snprintf(out->product_key, sizeof(out->product_key), "%s", e->product_key);
+	snprintf(out->device_name, sizeof(out->device_name), "%s", e->device_name);
+	snprintf(out->device_secret, sizeof(out->device_secret), "%s", e->device_secret);
+	return 0;
+}
+
+io_backend_t aliyun_sim_io_backend(void) {
+	return g_backend;
+}
@@ -5,6 +5,10 @@
 #define ALIYUN_SIM_H
 
 #include <stdint.h>
+#include "uring_io.h"
+#include "aes128.h"
+#include "coap_msg.h"
+#include "reading_store.h"
 
 typedef struct {
 	char product_key[64];
@@ -15,15 +19,118 @@ typedef struct {
 typedef struct {
 	unsigned short listen_port; // 例如 5683
 	device_triple_t triple;     // 服务端保存的一份，用于验证
+	int log_packets;            // 是否逐包打印日志（多设备压测时关闭）
+	uint32_t worker_threads;    // 工作线程（分片）数，0 视为 1；>1 时各分片以 SO_REUSEPORT 绑定同一端口并各绑一个核
+	uint32_t batch_size;        // >1 时用 recvmmsg/sendmmsg 每次收发最多 batch_size 条（仅 Linux）；0/1 为逐包收发
+	int gso;                    // 批量模式下把发往同一地址的等长响应合并为一个 UDP GSO 报文（仅 Linux）
+	io_backend_t io_backend;    // IO_BACKEND_URING 时各分片用 io_uring 收发（内核不支持时退回套接字，batch_size/gso 不再生效）
+	const char *registry_file;  // 非 NULL 时启动前从该文件加载设备三元组（每行 pk,dn,ds），与 triple 一起登记到注册表
+	uint32_t registry_threads;  // 加载注册表的线程数，0 为 CPU 数
+	uint32_t dedup_entries;     // 每个分片的 CON 去重缓存条目数（固定内存，满时覆盖最旧的），0 关闭去重
+	uint32_t auth_ttl_s;        // /auth 签发的会话 Token 有效期（秒），0 取 3600
+	uint32_t auth_cache_entries; // 每个分片已校验会话 Token 缓存的条目数，0 关闭缓存（每个报文都做 HMAC）
+	int session_key_cache;      // 为已校验缓存的每个槽预留会话密钥调度（客户端加密上报时打开），否则每个加密报文现算密钥
+	aes_impl_t aes_impl;        // 解密 Content-Format 42 负载所用的 AES 实现
+	uint32_t block_transfers;   // 每个分片同时进行的 Block1 分块上传数（每个固定占 8 KB 重组缓冲），0 不支持分块（回 4.02）
+	uint32_t block_timeout_ms;  // 分块上传的空闲超时，超时后槽位可被新传输占用，0 取 10000
+	uint32_t observe_observers; // 每个分片可登记的观察者数（GET Observe），0 不支持观察（按普通 GET 回复）
+	uint32_t observe_resources; // 每个分片可被观察的资源（设备）数，0 取 1024
+	uint32_t observe_ttl_s;     // 观察注册的有效期（秒），到期未重新注册即移除，0 取 600
+	const char *store_dir;      // 非 NULL 时把接受的读数追加到该目录下的列存（reading_store），已有的数据保留
+	uint32_t store_commit_ms;   // 列存的组提交间隔，0 取 10
 } aliyun_sim_conf_t;
 
-// 在独立线程中启动 UDP CoAP 服务器；返回 0 成功
+// 服务端统计：字段只能是 uint64_t 计数（aliyun_sim_get_stats 按数组逐个原子读取并累加）
+typedef struct {
+	uint64_t received;  // 收到的报文
+	uint64_t accepted;  // 鉴权通过且读数有效（2.05），按报文计
+	uint64_t rejected;  // 鉴权失败（4.01）
+	uint64_t bad_payload; // 负载解密失败、JSON 不合法或读数超出量程（4.00）
+	uint64_t abnormal;  // 接收的读数中标记为异常（abn=1）的条数
+	uint64_t readings;  // 接收的读数条数（单条负载 1 条，SenML pack 为其中的有效读数）
+	uint64_t dropped_readings; // SenML pack 中因超出量程被单独丢弃的读数
+	uint64_t json_payloads; // 接收的 JSON 负载条数
+	uint64_t cbor_payloads; // 接收的 CBOR 负载条数
+	uint64_t senml_packs;   // 接收的 SenML pack 个数（JSON 与 CBOR 合计）
+	uint64_t payload_bytes; // 接收负载的字节数合计（加密负载按解密后计）
+	uint64_t malformed; // 无法解析而丢弃
+	uint64_t sent;      // 发出的响应
+	uint64_t recv_calls; // 收包系统调用次数（含超时返回）
+	uint64_t send_calls; // 发包系统调用次数
+	uint64_t gso_sends;  // 合并了多条响应的 GSO 报文数
+	uint64_t uring_enters; // io_uring 后端的 io_uring_enter 调用次数
+	uint64_t dedup_hits;   // 命中去重缓存、直接重放响应的重复 CON
+	uint64_t dedup_misses; // 查找去重缓存未命中的 CON
+	uint64_t dedup_evicted; // 未到 EXCHANGE_LIFETIME 就因容量不足被覆盖的去重记录
+	uint64_t auth_handshakes; // 通过的 /auth 握手（签名校验 + 签发 Token）
+	uint64_t auth_verifies;   // 会话 Token 的 HMAC 校验次数（缓存未命中）
+	uint64_t auth_cache_hits; // 会话 Token 命中已校验缓存
+	uint64_t auth_cache_evicted; // 缓存中未失效就被替换的 Token
+	uint64_t decrypted;       // 解密成功的上报负载
+	uint64_t session_keys;    // 会话密钥派生与扩展次数（密钥表未命中）
+	uint64_t block_continues; // 回 2.31 的中间块
+	uint64_t block_uploads;   // 重组完成的分块上传（之后按一个普通上报处理）
+	uint64_t block_incomplete; // 最后一块到达时仍有缺块（4.08）
+	uint64_t block_expired;   // 空闲超时后被新传输占用槽位的分块上传
+	uint64_t block_rejected;  // 未启用分块、请求体过大、重组表已满或块格式错误（4.02/4.13/5.03/4.00）
+	uint64_t not_found;       // 请求的资源不存在（4.04）
+	uint64_t bad_method;      // 路径存在但不支持该方法（4.05）
+	uint64_t pings;           // 空消息（0.00）：CON 即 CoAP ping，回 RST；NON 忽略
+	uint64_t obs_registered;  // 新的观察注册
+	uint64_t obs_refreshed;   // 同一端点 + Token 的重新注册（只刷新有效期）
+	uint64_t obs_cancelled;   // GET Observe=1 取消的观察
+	uint64_t obs_reset;       // 观察者以 RST 拒收通知而移除
+	uint64_t obs_expired;     // 到期未重新注册而移除
+	uint64_t obs_rejected;    // 观察者或资源已满，按普通 GET 回复
+	uint64_t obs_active;      // 当前观察者数
+	uint64_t obs_rounds;      // 通知轮数（每轮选项与负载序列化一次）
+	uint64_t obs_notifications; // 发出的通知报文
+	uint64_t obs_send_calls;  // 发送通知的系统调用次数
+	uint64_t obs_publish_lost; // 与其他分片争用同一资源、重试后仍未发布的读数
+} aliyun_sim_stats_t;
+
+// 路由：请求按方法与 Uri-Path 分发到处理函数，没有对应路径回 4.04，路径存在但方法不对回 4.05
+// 内置路由：POST /auth（认证握手）、POST /things/upload（上报）、GET /things/+/+（读取/观察设备读数）、GET /.well-known/core
+typedef struct sim_request aliyun_sim_request_t;
+
+// 处理函数：生成完整的响应报文写入 resp（至多 resp_cap 字节，即一个完整报文 COAP_MAX_PKT），返回长度；0 不回复，<0 按失败不回复
+typedef int (*aliyun_sim_handler_t)(const aliyun_sim_request_t *req, void *arg, uint8_t *resp, int resp_cap);
+
+// 注册路由：method 为 CoAP 方法码（1 GET，2 POST，3 PUT，4 DELETE），path 为 '/' 分隔的 Uri-Path，"+" 匹配任意一段；
+// 与内置路由相同时替换内置处理。在 aliyun_sim_start 之前调用，之后每次启动都生效
+// 返回 0 成功；-1 参数错误；-2 路由已满；-3 服务端运行中
+int aliyun_sim_add_route(uint8_t method, const char *path, aliyun_sim_handler_t fn, void *arg);
+
+// 请求报文（零拷贝视图，只在处理函数内有效）
+const coap_msg_view_t *aliyun_sim_request_msg(const aliyun_sim_request_t *req);
+
+// 生成响应：CON 回 ACK、NON 回 NON，回显 MID 与 Token；json 非 NULL 时带 Content-Format 50 与 JSON 负载
+// 返回响应长度，<0 缓冲不足
+int aliyun_sim_reply(const aliyun_sim_request_t *req, uint8_t code, const char *json, uint8_t *resp, int resp_cap);
+
+// 启动 UDP CoAP 服务器：在调用线程中建好全部分片套接字，再为每个分片启动一个工作线程
+// 启动前建立设备注册表并算好全部设备的 Token，收包时鉴权只需一次散列查找
+// 返回 0 成功；-1 参数错误（或路由表无法建立）；-2 套接字/线程创建失败；-3 已在运行；-4 注册表文件加载失败；-5 列存无法打开
 int aliyun_sim_start(const aliyun_sim_conf_t *conf);
 
-// 停止服务器（本示例用全局开关实现）
+// 停止服务器：通知并等待所有分片线程退出，关闭套接字
 void aliyun_sim_stop(void);
 
-// 基于设备三元组生成简化 Token（与客户端保持相同算法）
+// 读取统计：total 为各分片之和，per_shard（可为 NULL）逐分片输出最多 max_shards 项；返回分片数
+uint32_t aliyun_sim_get_stats(aliyun_sim_stats_t *total, aliyun_sim_stats_t *per_shard, uint32_t max_shards);
+
+// 注册表中的设备数（服务端未运行时为 0）
+uint32_t aliyun_sim_device_count(void);
+// 按注册表下标取设备三元组（下标 0 为内置三元组，--registry 文件中的设备依次在后）；返回 0 成功，-1 下标越界
+int aliyun_sim_device_triple(uint32_t index, device_triple_t *out);
+
+// 列存（未配置 store_dir 或服务端未运行时为 NULL），可在服务端运行期间查询，aliyun_sim_stop 时关闭
+reading_store_t *aliyun_sim_store(void);
+
+// 实际使用的收发后端（请求 io_uring 但不可用时为 IO_BACKEND_SOCKET）
+io_backend_t aliyun_sim_io_backend(void);
+
+// 基于设备三元组生成简化 Token（与客户端保持相同算法）；上报也可改用 /auth 握手签发的会话 Token
 void aliyun_make_token(const device_triple_t *triple, char *out, int out_len);
 
 #endif // ALIYUN_SIM_H
@@ -0,0 +1,202 @@
+// coap_auth.c
+#include "coap_auth.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void auth_sign(const char *product_key, const char *device_name, const char *device_secret,
+	const char *client_id, const char *timestamp, char out[AUTH_SIGN_HEX_LEN + 1]) {
+	// 参与签名的字段按名称字典序拼接：clientId、deviceName、productKey、timestamp
+	char content[320];
+	int n = snprintf(content, sizeof(content), "clientId%sdeviceName%sproductKey%stimestamp%s",
+		client_id, device_name, product_key, timestamp);
+	if (n < 0) n = 0;
+	if ((size_t)n >= sizeof(content)) n = (int)sizeof(content) - 1;
+	uint8_t mac[SHA256_DIGEST_LEN];
+	hmac_sha256(device_secret, strlen(device_secret), content, (size_t)n, mac);
+	hex_encode(mac, sizeof(mac), out);
+}
+
+int auth_build_request(char *out, size_t cap, const char *product_key, const char *device_name,
+	const char *device_secret, const char *client_id, const char *timestamp) {
+	char sign[AUTH_SIGN_HEX_LEN + 1];
+	auth_sign(product_key, device_name, device_secret, client_id, timestamp, sign);
+	int n = snprintf(out, cap,
+		"{\"productKey\":\"%s\",\"deviceName\":\"%s\",\"clientId\":\"%s\",\"timestamp\":\"%s\","
+		"\"signmethod\":\"hmacsha256\",\"sign\":\"%s\"}",
+		product_key, device_name, client_id, timestamp, sign);
+	return (n < 0 || (size_t)n >= cap) ? -1 : n;
+}
+
+// 在扁平 JSON 对象中查找 "key":"value"，把 value 拷入 out；返回 0 成功，-1 不存在或超长
+static int json_str_field(const uint8_t *p, size_t len, const char *key, char *out, size_t cap) {
+	size_t kl = strlen(key);
+	for (size_t i = 0; i + kl + 2 <= len; ++i) {
+		if (p[i] != '"' || memcmp(p + i + 1, key, kl) != 0 || p[i + 1 + kl] != '"') continue;
+		size_t j = i + kl + 2;
+		while (j < len && (p[j] == ' ' || p[j] == '\t')) j++;
+		if (j >= len || p[j] != ':') continue;
+		j++;
+		while (j < len && (p[j] == ' ' || p[j] == '\t')) j++;
+		if (j >= len || p[j] != '"') return -1;
+		size_t s = ++j;
+		while (j < len && p[j] != '"' && p[j] != '\\') j++;
+		if (j >= len || p[j] != '"' || j - s >= cap) return -1;
+		memcpy(out, p + s, j - s);
+		out[j - s] = '\0';
+		return 0;
+	}
+	return -1;
+}
+
+int auth_parse_response(const uint8_t *payload, size_t len, char *token, size_t cap) {
+	return json_str_field(payload, len, "token", token, cap);
+}
+
+int auth_parse_request(const uint8_t *payload, size_t len, auth_request_t *req) {
+	if (json_str_field(payload, len, "productKey", req->product_key, sizeof(req->product_key)) != 0 ||
+		json_str_field(payload, len, "deviceName", req->device_name, sizeof(req->device_name)) != 0 ||
+		json_str_field(payload, len, "clientId", req->client_id, sizeof(req->client_id)) != 0 ||
+		json_str_field(payload, len, "timestamp", req->timestamp, sizeof(req->timestamp)) != 0 ||
+		json_str_field(payload, len, "sign", req->sign, sizeof(req->sign)) != 0) {
+		return -1;
+	}
+	char method[16];
+	// signmethod 可省略，给出时只支持 hmacsha256
+	if (json_str_field(payload, len, "signmethod", method, sizeof(method)) == 0 && strcmp(method, "hmacsha256") != 0) {
+		return -1;
+	}
+	return 0;
+}
+
+int auth_check_sign(const auth_request_t *req, const char *device_secret) {
+	char expect[AUTH_SIGN_HEX_LEN + 1];
+	auth_sign(req->product_key, req->device_name, device_secret, req->client_id, req->timestamp, expect);
+	if (strlen(req->sign) != AUTH_SIGN_HEX_LEN) return 0;
+	uint8_t diff = 0;
+	for (int i = 0; i < AUTH_SIGN_HEX_LEN; ++i) {
+		uint8_t c = (uint8_t)req->sign[i];
+		if (c >= 'A' && c <= 'F') c = (uint8_t)(c - 'A' + 'a');
+		diff |= (uint8_t)(c ^ (uint8_t)expect[i]);
+	}
+	return diff == 0;
+}
+
+void auth_session_key(const char *device_secret, const uint8_t *token, size_t token_len, uint8_t key[AES128_KEY_LEN]) {
+	uint8_t mac[SHA256_DIGEST_LEN];
+	hmac_sha256(device_secret, strlen(device_secret), token, token_len, mac);
+	memcpy(key, mac, AES128_KEY_LEN);
+}
+
+void auth_issuer_init(auth_issuer_t *is, const uint8_t *secret, size_t len) {
+	hmac_sha256_key(&is->key, secret, len);
+}
+
+static void token_mac(const auth_issuer_t *is, const uint8_t head[8], uint8_t mac[SHA256_DIGEST_LEN]) {
+	hmac_sha256_with(&is->key, head, 8, mac);
+}
+
+static void put_be32(uint8_t *p, uint32_t v) {
+	p[0] = (uint8_t)(v >> 24);
+	p[1] = (uint8_t)(v >> 16);
+	p[2] = (uint8_t)(v >> 8);
+	p[3] = (uint8_t)v;
+}
+
+static uint32_t get_be32(const uint8_t *p) {
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+void auth_issue_token(const auth_issuer_t *is, uint32_t device_id, uint32_t expiry, char *out) {
+	uint8_t raw[AUTH_TOKEN_RAW];
+	uint8_t mac[SHA256_DIGEST_LEN];
+	put_be32(raw, expiry);
+	put_be32(raw + 4, device_id);
+	token_mac(is, raw, mac);
+	memcpy(raw + 8, mac, AUTH_TOKEN_RAW - 8);
+	hex_encode(raw, sizeof(raw), out);
+}
+
+// 十六进制字符 -> 值 + 1，非法字符为 0
+static const uint8_t g_hexval[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5, ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16
+};
+
+int auth_token_decode(const uint8_t *text, size_t len, uint8_t raw[AUTH_TOKEN_RAW]) {
+	if (len != AUTH_TOKEN_LEN) return -1;
+	int bad = 0;
+	for (size_t i = 0; i < AUTH_TOKEN_RAW; ++i) {
+		uint8_t hi = g_hexval[text[2 * i]], lo = g_hexval[text[2 * i + 1]];
+		bad |= (hi == 0) | (lo == 0);
+		raw[i] = (uint8_t)((hi - 1) << 4 | ((lo - 1) & 0x0F));
+	}
+	return bad ? -1 : 0;
+}
+
+int auth_token_verify(const auth_issuer_t *is, const uint8_t raw[AUTH_TOKEN_RAW], uint32_t now_s, uint32_t *device_id) {
+	uint8_t mac[SHA256_DIGEST_LEN];
+	token_mac(is, raw, mac);
+	uint8_t diff = 0;
+	for (int i = 8; i < AUTH_TOKEN_RAW; ++i) diff |= (uint8_t)(raw[i] ^ mac[i - 8]);
+	if (diff) return -2;
+	if (get_be32(raw) <= now_s) return -3;
+	if (device_id) *device_id = get_be32(raw + 4);
+	return 0;
+}
+
+// ---- 缓存 ----
+
+int auth_cache_init(auth_cache_t *c, uint32_t capacity, uint32_t ttl_s) {
+	memset(c, 0, sizeof(*c));
+	uint32_t sets = 1;
+	while ((uint64_t)sets * AUTH_CACHE_WAYS < capacity && sets < 0x40000000u) sets <<= 1;
+	c->entries = (auth_cache_entry_t*)calloc((size_t)sets * AUTH_CACHE_WAYS, sizeof(auth_cache_entry_t));
+	if (!c->entries) return -2;
+	c->set_mask = sets - 1;
+	c->ttl_s = ttl_s;
+	return 0;
+}
+
+void auth_cache_destroy(auth_cache_t *c) {
+	free(c->entries);
+	c->entries = NULL;
+}
+
+// MAC 部分已是均匀随机的字节，直接取来定位组
+static auth_cache_entry_t *cache_set(const auth_cache_t *c, const uint8_t raw[AUTH_TOKEN_RAW]) {
+	return &c->entries[(size_t)(get_be32(raw + 8) & c->set_mask) * AUTH_CACHE_WAYS];
+}
+
+int auth_cache_lookup(auth_cache_t *c, const uint8_t raw[AUTH_TOKEN_RAW], uint32_t now_s, uint32_t *device_id) {
+	auth_cache_entry_t *set = cache_set(c, raw);
+	for (int w = 0; w < AUTH_CACHE_WAYS; ++w) {
+		if (set[w].until > now_s && memcmp(set[w].raw, raw, AUTH_TOKEN_RAW) == 0) {
+			c->hits++;
+			if (device_id) *device_id = set[w].device_id;
+			return (int)(set - c->entries) + w;
+		}
+	}
+	c->misses++;
+	return -1;
+}
+
+int auth_cache_insert(auth_cache_t *c, const uint8_t raw[AUTH_TOKEN_RAW], uint32_t device_id, uint32_t now_s) {
+	auth_cache_entry_t *set = cache_set(c, raw);
+	auth_cache_entry_t *victim = &set[0];
+	for (int w = 0; w < AUTH_CACHE_WAYS; ++w) {
+		if (set[w].until <= now_s) {
+			victim = &set[w];
+			break;
+		}
+		if (set[w].until < victim->until) victim = &set[w];
+	}
+	if (victim->until > now_s) c->evicted++;
+	uint32_t until = now_s + c->ttl_s;
+	uint32_t expiry = get_be32(raw);
+	memcpy(victim->raw, raw, AUTH_TOKEN_RAW);
+	victim->device_id = device_id;
+	victim->until = expiry < until ? expiry : until;
+	return (int)(victim - c->entries);
+}
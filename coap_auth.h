@@ -0,0 +1,114 @@
+// coap_auth.h
+// 设备认证握手（仿阿里云 CoAP 接入）：设备向 /auth 提交
+//   {"productKey","deviceName","clientId","timestamp","signmethod":"hmacsha256","sign"}，
+// sign = hex(HMAC-SHA256(deviceSecret, "clientId{cid}deviceName{dn}productKey{pk}timestamp{ts}"))；
+// 服务端校验签名后签发会话 Token，之后的上报以 Uri-Query "token=..." 携带
+// 会话 Token 自带有效期与设备号，并由服务端密钥做 HMAC，服务端无需保存会话即可校验；
+// 校验通过的 Token 放入固定容量、带 TTL 的缓存，稳态下每个报文只需一次查表而不是一次 HMAC
+
+#ifndef COAP_AUTH_H
+#define COAP_AUTH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sha256.h"
+#include "aes128.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AUTH_SIGN_HEX_LEN 64 // 签名的十六进制长度
+#define AUTH_TOKEN_RAW 24    // 会话 Token 二进制：有效期(4, 大端秒) + 设备号(4) + MAC 前 16 字节
+#define AUTH_TOKEN_LEN 48    // 会话 Token 文本（十六进制）长度
+#define AUTH_CACHE_WAYS 4    // 缓存组相联路数
+// 加密上报（Content-Format 42）：AES-128-CBC + PKCS#7，与平台一致使用固定 IV
+#define AUTH_PAYLOAD_IV ((const uint8_t*)"543yhjy97ae7fyfg")
+
+typedef struct {
+	char product_key[64];
+	char device_name[64];
+	char client_id[64];
+	char timestamp[24];
+	char sign[AUTH_SIGN_HEX_LEN + 1];
+} auth_request_t;
+
+// ---- 设备侧 ----
+
+// 计算握手签名（小写十六进制）
+void auth_sign(const char *product_key, const char *device_name, const char *device_secret,
+	const char *client_id, const char *timestamp, char out[AUTH_SIGN_HEX_LEN + 1]);
+
+// 生成 /auth 请求负载（JSON）；返回长度，<0 表示缓冲不足
+int auth_build_request(char *out, size_t cap, const char *product_key, const char *device_name,
+	const char *device_secret, const char *client_id, const char *timestamp);
+
+// 从 /auth 响应负载中取出会话 Token；返回 0 成功，-1 没有 token 字段
+int auth_parse_response(const uint8_t *payload, size_t len, char *token, size_t cap);
+
+// 会话密钥（负载加密用）：HMAC-SHA256(deviceSecret, 会话 Token 文本) 的前 16 字节，
+// 设备与服务端各自由 Token 算出，不在网络上传输
+void auth_session_key(const char *device_secret, const uint8_t *token, size_t token_len, uint8_t key[AES128_KEY_LEN]);
+
+// ---- 服务端 ----
+
+// 解析 /auth 请求负载（只认不含转义的字符串字段）；返回 0 成功，-1 缺少字段或超长
+int auth_parse_request(const uint8_t *payload, size_t len, auth_request_t *req);
+
+// 用设备密钥重算签名并比较（不区分大小写、等时比较）；返回 1 通过，0 不通过
+int auth_check_sign(const auth_request_t *req, const char *device_secret);
+
+// 会话 Token 签发者：持有服务端密钥（HMAC 内外层状态已预先算好）
+typedef struct {
+	hmac_sha256_key_t key;
+} auth_issuer_t;
+
+void auth_issuer_init(auth_issuer_t *is, const uint8_t *secret, size_t len);
+
+// 签发 Token：expiry 为过期时刻（Unix 秒），out 至少 AUTH_TOKEN_LEN+1 字节
+void auth_issue_token(const auth_issuer_t *is, uint32_t device_id, uint32_t expiry, char *out);
+
+// 十六进制 Token 文本转二进制；返回 0 成功，-1 长度或字符不对
+int auth_token_decode(const uint8_t *text, size_t len, uint8_t raw[AUTH_TOKEN_RAW]);
+
+// 校验二进制 Token（一次 HMAC）；返回 0 有效，-2 MAC 不符，-3 已过期
+int auth_token_verify(const auth_issuer_t *is, const uint8_t raw[AUTH_TOKEN_RAW], uint32_t now_s, uint32_t *device_id);
+
+// ---- 已校验 Token 缓存 ----
+// 组相联（AUTH_CACHE_WAYS 路），条目一次性分配；条目在 min(Token 过期, 插入时刻 + ttl) 后失效，
+// 组满时替换最早失效的一路。单线程使用（每个服务端分片一份）
+
+typedef struct {
+	uint8_t raw[AUTH_TOKEN_RAW];
+	uint32_t device_id;
+	uint32_t until;      // 失效时刻（Unix 秒），0 表示空
+} auth_cache_entry_t;
+
+typedef struct {
+	auth_cache_entry_t *entries;
+	uint32_t set_mask;
+	uint32_t ttl_s;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evicted;    // 替换掉的未失效条目
+} auth_cache_t;
+
+// capacity 向上取整为 AUTH_CACHE_WAYS 的 2 的幂倍；返回 0 成功，<0 内存不足
+int auth_cache_init(auth_cache_t *c, uint32_t capacity, uint32_t ttl_s);
+void auth_cache_destroy(auth_cache_t *c);
+
+// 槽总数（组数 * 路数）；调用方可按槽号挂接每个会话的附加数据，如会话密钥调度
+static inline uint32_t auth_cache_slots(const auth_cache_t *c) {
+	return (c->set_mask + 1) * AUTH_CACHE_WAYS;
+}
+
+// 命中返回槽号（>=0）并输出设备号，未命中返回 -1
+int auth_cache_lookup(auth_cache_t *c, const uint8_t raw[AUTH_TOKEN_RAW], uint32_t now_s, uint32_t *device_id);
+// 返回写入的槽号（该槽原有的附加数据随之作废）
+int auth_cache_insert(auth_cache_t *c, const uint8_t raw[AUTH_TOKEN_RAW], uint32_t device_id, uint32_t now_s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COAP_AUTH_H
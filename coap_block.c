@@ -0,0 +1,100 @@
+// coap_block.c
+#include "coap_block.h"
+#include <stdlib.h>
+#include <string.h>
+
+int coap_block_init(coap_block_table_t *t, uint32_t capacity, uint32_t timeout_ms) {
+	memset(t, 0, sizeof(*t));
+	if (capacity == 0) return -1;
+	t->xfers = (coap_block_xfer_t*)calloc(capacity, sizeof(coap_block_xfer_t));
+	t->bodies = (uint8_t*)malloc((size_t)capacity * COAP_BLOCK_BODY_MAX);
+	if (!t->xfers || !t->bodies) {
+		coap_block_destroy(t);
+		return -2;
+	}
+	for (uint32_t i = 0; i < capacity; ++i) t->xfers[i].body = t->bodies + (size_t)i * COAP_BLOCK_BODY_MAX;
+	t->capacity = capacity;
+	t->timeout_ms = timeout_ms ? timeout_ms : COAP_BLOCK_TIMEOUT_MS;
+	return 0;
+}
+
+void coap_block_destroy(coap_block_table_t *t) {
+	free(t->xfers);
+	free(t->bodies);
+	t->xfers = NULL;
+	t->bodies = NULL;
+	t->capacity = 0;
+	t->active = 0;
+}
+
+void coap_block_release(coap_block_table_t *t, coap_block_xfer_t *xfer) {
+	if (!xfer || !xfer->key) return;
+	xfer->key = 0;
+	t->active--;
+}
+
+// 找到 key 的传输；没有时占用一个空闲或已超时的槽
+static coap_block_xfer_t *xfer_get(coap_block_table_t *t, uint64_t key, uint64_t now_ms) {
+	coap_block_xfer_t *spare = NULL;
+	for (uint32_t i = 0; i < t->capacity; ++i) {
+		coap_block_xfer_t *x = &t->xfers[i];
+		if (x->key == key) return x;
+		if (spare && !spare->key) continue;
+		if (!x->key || now_ms - x->last_ms >= t->timeout_ms) spare = x;
+	}
+	if (!spare) return NULL;
+	if (spare->key) {
+		t->expired++;
+	} else {
+		t->active++;
+	}
+	spare->key = key;
+	spare->size1 = 0;
+	memset(spare->have, 0, sizeof(spare->have));
+	return spare;
+}
+
+static void mark(coap_block_xfer_t *x, uint32_t from, uint32_t to) {
+	for (uint32_t u = from; u < to; ++u) x->have[u >> 6] |= 1ull << (u & 63);
+}
+
+// 单元 [0, to) 是否全部收到
+static int complete(const coap_block_xfer_t *x, uint32_t to) {
+	uint32_t w = 0;
+	for (; (w + 1) * 64 <= to; ++w) {
+		if (x->have[w] != ~0ull) return 0;
+	}
+	uint32_t rest = to - w * 64;
+	return rest == 0 || (x->have[w] & ((1ull << rest) - 1)) == ((1ull << rest) - 1);
+}
+
+int coap_block_put(coap_block_table_t *t, uint64_t key, uint64_t now_ms, uint32_t num, int more, uint8_t szx,
+	const uint8_t *data, size_t len, uint32_t size1, coap_block_xfer_t **xfer) {
+	*xfer = NULL;
+	if (szx > COAP_BLOCK_SZX_MAX) return -4;
+	uint32_t size = coap_block_size(szx);
+	if (more ? len != size : len > size) return -4;
+	uint64_t off = (uint64_t)num * size;
+	if (!more && off + len == 0) return -4; // 空请求体不走分块
+	int too_large = size1 > COAP_BLOCK_BODY_MAX || off + len > COAP_BLOCK_BODY_MAX;
+	coap_block_xfer_t *x = xfer_get(t, key, now_ms);
+	if (!x) return too_large ? -1 : -2;
+	if (too_large) {
+		coap_block_release(t, x);
+		return -1;
+	}
+	x->last_ms = now_ms;
+	if (size1) x->size1 = size1;
+	if (len) memcpy(x->body + off, data, len);
+	uint32_t end = (uint32_t)(off + len);
+	mark(x, (uint32_t)(off / COAP_BLOCK_UNIT), (end + COAP_BLOCK_UNIT - 1) / COAP_BLOCK_UNIT);
+	if (more) return 0;
+	if (!complete(x, (end + COAP_BLOCK_UNIT - 1) / COAP_BLOCK_UNIT) || (x->size1 && x->size1 != end)) {
+		t->incomplete++;
+		coap_block_release(t, x);
+		return -3;
+	}
+	t->completed++;
+	*xfer = x;
+	return (int)end;
+}
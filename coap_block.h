@@ -0,0 +1,84 @@
+// coap_block.h
+// 分块传输（RFC 7959 Block1）：Block1 选项值的编解码，以及服务端按传输重组请求体的固定容量表
+// 重组表一次性分配 capacity 个传输槽，每槽带 COAP_BLOCK_BODY_MAX 字节的请求体缓冲，运行期间不再分配；
+// 块可以乱序到达（客户端并发发送多块时），按字节偏移写入并用 16 字节粒度的位图记录已收到的范围，
+// 最后一块（M=0）到达时检查是否连续完整；空闲超过 timeout_ms 的传输视为放弃，槽位可被新传输占用。
+// 单线程使用（每个服务端分片一份）
+
+#ifndef COAP_BLOCK_H
+#define COAP_BLOCK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define COAP_OPT_BLOCK1 27
+#define COAP_OPT_SIZE1  60
+
+#define COAP_BLOCK_SZX_MAX 6       // 块大小 2^(SZX+4)：16..1024 字节（7 为保留值）
+#define COAP_BLOCK_BODY_MAX 8192   // 单个分块请求重组后的最大字节数
+#define COAP_BLOCK_UNIT 16         // 位图粒度（最小块大小）
+#define COAP_BLOCK_TIMEOUT_MS 10000 // 传输空闲超时的默认值
+
+static inline uint32_t coap_block_size(uint8_t szx) {
+	return 16u << szx;
+}
+
+// Block1 选项值：NUM << 4 | M << 3 | SZX（uint 选项，0~3 字节）
+static inline uint32_t coap_block_value(uint32_t num, int more, uint8_t szx) {
+	return (num << 4) | (more ? 8u : 0u) | (szx & 7u);
+}
+
+static inline void coap_block_parse(uint32_t v, uint32_t *num, int *more, uint8_t *szx) {
+	*num = v >> 4;
+	*more = (v >> 3) & 1;
+	*szx = (uint8_t)(v & 7u);
+}
+
+typedef struct {
+	uint64_t key;       // 传输标识（来源地址、端口与请求 URI），0 表示空闲
+	uint64_t last_ms;   // 最近一次收到块的时刻
+	uint32_t size1;     // 客户端在 Size1 中声明的总长度，0 表示未声明
+	uint8_t *body;      // COAP_BLOCK_BODY_MAX 字节
+	uint64_t have[COAP_BLOCK_BODY_MAX / COAP_BLOCK_UNIT / 64]; // 已收到的 16 字节单元
+} coap_block_xfer_t;
+
+typedef struct {
+	coap_block_xfer_t *xfers;
+	uint8_t *bodies;
+	uint32_t capacity;
+	uint32_t timeout_ms;
+	uint32_t active;     // 占用中的槽数
+	uint64_t completed;  // 重组完成的传输
+	uint64_t expired;    // 超时被回收的传输
+	uint64_t incomplete; // 最后一块到达时仍有缺块
+} coap_block_table_t;
+
+// 分配 capacity 个传输槽；timeout_ms 为 0 时取 COAP_BLOCK_TIMEOUT_MS。返回 0 成功，-1 参数错误，-2 内存不足
+int coap_block_init(coap_block_table_t *t, uint32_t capacity, uint32_t timeout_ms);
+void coap_block_destroy(coap_block_table_t *t);
+
+// 传输标识：IPv4 地址与端口按网络序原样传入，uri_hash 为请求 Uri-Path/Uri-Query 的散列（同一设备的不同资源分开重组）
+static inline uint64_t coap_block_key(uint32_t addr, uint16_t port, uint32_t uri_hash) {
+	uint64_t k = ((uint64_t)addr << 32 | (uint64_t)port << 16) ^ ((uint64_t)uri_hash * 0x9E3779B97F4A7C15ull);
+	return k ? k : 1;
+}
+
+// 写入一块：块 num 大小 2^(szx+4)，more 为 M 位，size1 为 Size1 选项（没有为 0）
+// 返回 >0 表示最后一块已到且全部连续，请求体在 (*xfer)->body，长度为返回值，用完后须 coap_block_release；
+// 0 表示还需后续块；-1 超出 COAP_BLOCK_BODY_MAX（4.13）；-2 没有空闲槽（5.03）；
+// -3 最后一块到达时前面有缺块，传输已放弃（4.08）；-4 块格式不对（非最后一块长度不等于块大小、SZX 为保留值等）
+int coap_block_put(coap_block_table_t *t, uint64_t key, uint64_t now_ms, uint32_t num, int more, uint8_t szx,
+	const uint8_t *data, size_t len, uint32_t size1, coap_block_xfer_t **xfer);
+
+// 结束传输并归还槽位
+void coap_block_release(coap_block_table_t *t, coap_block_xfer_t *xfer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COAP_BLOCK_H
@@ -2,12 +2,19 @@
 // 简易 CoAP 客户端实现（RFC7252 子集）：支持 CON/NON、Token、Uri 选项、MID 自增与重传
 
 #include "coap_client.h"
+#include "coap_msg.h"
+#include "coap_auth.h"
+#include "coap_block.h"
+#include "coap_log.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
 #ifdef _WIN32
 #pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/uio.h>
 #endif
 
 #define COAP_VERSION 1
@@ -17,19 +24,6 @@ static uint8_t coap_make_code(uint8_t cls, uint8_t detail) {
 	return (uint8_t)((cls << 5) | (detail & 0x1F));
 }
 
-static const char* now_ts() {
-	static char buf[32];
-	time_t t = time(NULL);
-	struct tm tmv;
-#ifdef _WIN32
-	localtime_s(&tmv, &t);
-#else
-	localtime_r(&t, &tmv);
-#endif
-	strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tmv);
-	return buf;
-}
-
 int platform_net_init(void) {
 #ifdef _WIN32
 	WSADATA wsa;
@@ -63,41 +57,221 @@ static int set_recv_timeout(socket_t s, uint32_t ms) {
 #endif
 }
 
+static uint64_t splitmix64(uint64_t x) {
+	x += 0x9E3779B97F4A7C15ull;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
+static uint64_t next_rand(uint64_t *state) {
+	// xorshift64*
+	uint64_t x = *state;
+	x ^= x >> 12; x ^= x << 25; x ^= x >> 27;
+	*state = x;
+	return x * 0x2545F4914F6CDD1Dull;
+}
+
+static void close_sock(socket_t s) {
+#ifdef _WIN32
+	closesocket(s);
+#else
+	close(s);
+#endif
+}
+
 int coap_client_init(coap_client_t *client, const coap_client_conf_t *conf) {
+	return coap_client_init_with_pool(client, conf, NULL);
+}
+
+static int client_init(coap_client_t *client, const coap_client_conf_t *conf, coap_pool_t *pool, socket_t shared) {
+	static uint64_t seed_counter = 0;
 	if (!client || !conf) return -1;
 	memset(client, 0, sizeof(*client));
 	client->conf = *conf;
+	if (client->conf.nstart == 0) client->conf.nstart = 1;
 	client->next_mid = 0;
+	client->rng = splitmix64((uint64_t)time(NULL) ^ ((uint64_t)clock() << 20) ^
+		(uint64_t)(uintptr_t)client ^ (++seed_counter << 40));
+	if (client->rng == 0) client->rng = 1;
+	coap_rto_init(&client->rto, conf->rto_mode, conf->ack_timeout_ms, conf->max_retransmit);
 
-	client->sock = (socket_t)socket(AF_INET, SOCK_DGRAM, 0);
-	if ((int)client->sock < 0) {
-		perror("socket");
-		return -2;
+	if ((int)shared >= 0) {
+		client->sock = shared;
+		client->sock_shared = 1;
+	} else {
+		client->sock = (socket_t)socket(AF_INET, SOCK_DGRAM, 0);
+		if ((int)client->sock < 0) {
+			perror("socket");
+			return -2;
+		}
 	}
 	memset(&client->server_addr, 0, sizeof(client->server_addr));
 	client->server_addr.sin_family = AF_INET;
 	client->server_addr.sin_port = htons(conf->server_port);
 	if (inet_pton(AF_INET, conf->server_host, &client->server_addr.sin_addr) != 1) {
 		perror("inet_pton");
-#ifdef _WIN32
-		closesocket(client->sock);
-#else
-		close(client->sock);
-#endif
+		if (!client->sock_shared) close_sock(client->sock);
+		client->sock = (socket_t)-1;
 		return -3;
 	}
+
+	// 事务槽 + Token 索引（索引容量取不小于 2*nstart 的 2 的幂，保持低装载率）
+	uint32_t cap = 4;
+	while (cap < 2u * client->conf.nstart) cap <<= 1;
+	client->txns = (coap_txn_t*)calloc(client->conf.nstart, sizeof(coap_txn_t));
+	client->txn_index = (uint16_t*)calloc(cap, sizeof(uint16_t));
+	client->txn_mask = cap - 1;
+	if (pool) {
+		client->pool = pool;
+	} else if (coap_pool_init(&client->own_pool, client->conf.nstart, COAP_MAX_PKT) == 0) {
+		client->pool = &client->own_pool;
+	}
+	// 分块上传的密文缓冲：只有自建缓冲池的客户端会分块，多设备引擎的客户端不分配
+	if (!pool && conf->payload_key) client->block_cipher = (uint8_t*)malloc(COAP_BLOCK_BODY_MAX);
+	if (!client->txns || !client->txn_index || !client->pool || (!pool && conf->payload_key && !client->block_cipher)) {
+		coap_client_close(client);
+		return -4;
+	}
+	return 0;
+}
+
+int coap_client_init_with_pool(coap_client_t *client, const coap_client_conf_t *conf, coap_pool_t *pool) {
+	return client_init(client, conf, pool, (socket_t)-1);
+}
+
+int coap_client_init_shared(coap_client_t *client, const coap_client_conf_t *conf, coap_pool_t *pool,
+	socket_t sock, uint32_t tag) {
+	if ((int)sock < 0) return -1;
+	int rc = client_init(client, conf, pool, sock);
+	if (rc != 0) return rc;
+	client->token_tagged = 1;
+	client->token_tag = tag;
 	return 0;
 }
 
 void coap_client_close(coap_client_t *client) {
 	if (!client) return;
-	if ((int)client->sock >= 0) {
-#ifdef _WIN32
-		closesocket(client->sock);
-#else
-		close(client->sock);
-#endif
+	if ((int)client->sock >= 0 && !client->sock_shared) close_sock(client->sock);
+	client->sock = (socket_t)-1;
+	if (client->txns && client->pool) {
+		for (uint32_t i = 0; i < client->conf.nstart; ++i) {
+			if (client->txns[i].in_use) coap_pool_free(client->pool, client->txns[i].buf);
+		}
 	}
+	free(client->txns);
+	free(client->txn_index);
+	free(client->block_cipher);
+	client->txns = NULL;
+	client->txn_index = NULL;
+	client->block_cipher = NULL;
+	coap_pool_destroy(&client->own_pool);
+	client->pool = NULL;
+}
+
+// ---- 事务表：固定槽位 + 按 Token 的线性探测索引 ----
+
+static uint32_t token_hash(const coap_client_t *client, uint64_t token) {
+	return (uint32_t)(token ^ (token >> 32)) & client->txn_mask;
+}
+
+static coap_txn_t *txn_find_token(coap_client_t *client, uint64_t token) {
+	for (uint32_t i = token_hash(client, token); ; i = (i + 1) & client->txn_mask) {
+		uint16_t slot = client->txn_index[i];
+		if (slot == 0) return NULL;
+		if (client->txns[slot - 1].token == token) return &client->txns[slot - 1];
+	}
+}
+
+static void txn_index_remove(coap_client_t *client, const coap_txn_t *txn) {
+	uint16_t slot = (uint16_t)(txn - client->txns + 1);
+	uint32_t i = token_hash(client, txn->token);
+	while (client->txn_index[i] != slot) i = (i + 1) & client->txn_mask;
+	// 反向移位删除：把后续同簇元素前移，避免墓碑
+	for (uint32_t j = (i + 1) & client->txn_mask; client->txn_index[j] != 0; j = (j + 1) & client->txn_mask) {
+		uint32_t home = token_hash(client, client->txns[client->txn_index[j] - 1].token);
+		if (((j - home) & client->txn_mask) >= ((j - i) & client->txn_mask)) {
+			client->txn_index[i] = client->txn_index[j];
+			i = j;
+		}
+	}
+	client->txn_index[i] = 0;
+}
+
+coap_txn_t *coap_client_txn_open(coap_client_t *client) {
+	if (!client || client->txn_count >= client->conf.nstart) return NULL;
+	coap_txn_t *txn = NULL;
+	for (uint32_t i = 0; i < client->conf.nstart; ++i) {
+		if (!client->txns[i].in_use) { txn = &client->txns[i]; break; }
+	}
+	if (!txn) return NULL;
+	uint8_t *buf = coap_pool_alloc(client->pool);
+	if (!buf) return NULL;
+
+	uint64_t token;
+	do {
+		token = next_rand(&client->rng);
+		if (client->token_tagged) token = ((uint64_t)client->token_tag << 32) | (uint32_t)token;
+	} while (txn_find_token(client, token));
+	memset(txn, 0, sizeof(*txn));
+	txn->token = token;
+	txn->buf = buf;
+	txn->in_use = 1;
+	uint32_t i = token_hash(client, token);
+	while (client->txn_index[i] != 0) i = (i + 1) & client->txn_mask;
+	client->txn_index[i] = (uint16_t)(txn - client->txns + 1);
+	client->txn_count++;
+	return txn;
+}
+
+void coap_client_txn_close(coap_client_t *client, coap_txn_t *txn) {
+	if (!client || !txn || !txn->in_use) return;
+	txn_index_remove(client, txn);
+	coap_pool_free(client->pool, txn->buf);
+	txn->buf = NULL;
+	txn->in_use = 0;
+	client->txn_count--;
+}
+
+uint32_t coap_client_txn_arm(coap_client_t *client, coap_txn_t *txn, uint64_t now_us) {
+	txn->first_send_us = now_us;
+	txn->attempt = 0;
+	txn->wait_ms = coap_rto_initial(&client->rto, now_us, (uint32_t)(next_rand(&client->rng) >> 32));
+	return txn->wait_ms;
+}
+
+uint8_t coap_client_txn_finish(coap_client_t *client, coap_txn_t *txn, int acked, uint64_t now_us) {
+	return coap_rto_complete(&client->rto, acked, txn->first_send_us, now_us, txn->attempt);
+}
+
+coap_txn_t *coap_client_match_reply(coap_client_t *client, const uint8_t *buf, size_t len,
+	uint8_t *out_type, uint8_t *out_code) {
+	if (!client || len < 4) return NULL;
+	uint8_t ver = (buf[0] >> 6) & 0x03;
+	uint8_t type = (buf[0] >> 4) & 0x03;
+	uint8_t tkl = buf[0] & 0x0F;
+	uint8_t code = buf[1];
+	uint16_t mid = (uint16_t)((buf[2] << 8) | buf[3]);
+	if (ver != COAP_VERSION || tkl > 8 || len < (size_t)4 + tkl) return NULL;
+
+	coap_txn_t *txn = NULL;
+	if (tkl == COAP_TOKEN_LEN) {
+		uint64_t token = 0;
+		for (uint8_t i = 0; i < tkl; ++i) token = (token << 8) | buf[4 + i];
+		txn = txn_find_token(client, token);
+		// 捎带响应（ACK）必须同时匹配 MID；单独响应（CON/NON）只看 Token
+		if (txn && type == 2 && txn->mid != mid) txn = NULL;
+	} else if (tkl == 0 && (type == 2 || type == 3)) {
+		// 空 ACK / RST 只携带 MID
+		for (uint32_t i = 0; i < client->conf.nstart; ++i) {
+			if (client->txns[i].in_use && client->txns[i].mid == mid) { txn = &client->txns[i]; break; }
+		}
+	}
+	if (txn) {
+		if (out_type) *out_type = type;
+		if (out_code) *out_code = code;
+	}
+	return txn;
 }
 
 static size_t encode_uint_option(uint8_t *buf, uint32_t value) {
@@ -115,6 +289,7 @@ static size_t encode_uint_option(uint8_t *buf, uint32_t value) {
 static int add_option(uint8_t *pkt, size_t pkt_cap, size_t *offset,
 					 uint16_t *last_opt_num, uint16_t opt_num,
 					 const uint8_t *val, size_t val_len) {
+	if (opt_num < *last_opt_num) return -1; // 选项必须按编号升序添加
 	// 计算 Option Delta
 	uint16_t delta = (uint16_t)(opt_num - *last_opt_num);
 	uint8_t ext_delta_bytes[2]; size_t ext_delta_len = 0;
@@ -141,6 +316,95 @@ static int add_option(uint8_t *pkt, size_t pkt_cap, size_t *offset,
 	return 0;
 }
 
+int coap_tmpl_build(coap_tmpl_t *tmpl, coap_msg_type_t type,
+	const char *uri_host, const char *uri_path, const char *uri_query) {
+	return coap_tmpl_build_cf(tmpl, type, uri_host, uri_path, uri_query, COAP_CF_JSON);
+}
+
+// Uri-Path 按 '/' 拆成逐段的选项（RFC7252 6.5），空段跳过
+static int add_path_options(uint8_t *pkt, size_t pkt_cap, size_t *offset, uint16_t *last_opt_num, const char *path) {
+	int rc = 0;
+	while (*path) {
+		const char *end = strchr(path, '/');
+		size_t len = end ? (size_t)(end - path) : strlen(path);
+		if (len) rc |= add_option(pkt, pkt_cap, offset, last_opt_num, 11, (const uint8_t*)path, len);
+		path += len;
+		if (*path == '/') path++;
+	}
+	return rc;
+}
+
+int coap_tmpl_build_cf(coap_tmpl_t *tmpl, coap_msg_type_t type,
+	const char *uri_host, const char *uri_path, const char *uri_query, uint16_t content_format) {
+	if (!tmpl) return -1;
+	size_t off = 0; uint16_t last_opt = 0; int rc = 0;
+	tmpl->hdr[0] = (uint8_t)((COAP_VERSION << 6) | ((type & 0x03) << 4) | (COAP_TOKEN_LEN & 0x0F));
+	tmpl->hdr[1] = coap_make_code(0, 02); // 0.02 POST
+	tmpl->hdr[2] = tmpl->hdr[3] = 0;
+
+	// Options 按编号升序：Uri-Host=3, Uri-Path=11, Content-Format=12, Uri-Query=15
+	if (uri_host && *uri_host) {
+		rc |= add_option(tmpl->opts, sizeof(tmpl->opts), &off, &last_opt, 3, (const uint8_t*)uri_host, strlen(uri_host));
+	}
+	if (uri_path && *uri_path) {
+		rc |= add_path_options(tmpl->opts, sizeof(tmpl->opts), &off, &last_opt, uri_path);
+	}
+	{
+		uint8_t fmtbuf[4]; size_t fmtn = encode_uint_option(fmtbuf, content_format);
+		rc |= add_option(tmpl->opts, sizeof(tmpl->opts), &off, &last_opt, 12, fmtbuf, fmtn);
+	}
+	if (uri_query && *uri_query) {
+		rc |= add_option(tmpl->opts, sizeof(tmpl->opts), &off, &last_opt, 15, (const uint8_t*)uri_query, strlen(uri_query));
+	}
+	if (rc != 0 || off + 1 > sizeof(tmpl->opts)) return -2;
+	tmpl->opts[off++] = 0xFF;
+	tmpl->opts_len = (uint16_t)off;
+	tmpl->last_opt = last_opt;
+	return 0;
+}
+
+int coap_client_txn_transmit(coap_client_t *client, const coap_txn_t *txn, int connected) {
+	if (!txn->tmpl) {
+		if (connected) return (int)send(client->sock, (const char*)txn->buf, (int)txn->len, 0);
+		return (int)sendto(client->sock, (const char*)txn->buf, (int)txn->len, 0,
+			(struct sockaddr*)&client->server_addr, sizeof(client->server_addr));
+	}
+	// 追加了 Block1 等选项时模板的负载标记改由追加段给出：{头部, 模板选项（去掉 0xFF）, 追加选项 + 0xFF, 负载}
+	const uint8_t *seg[4] = { txn->buf, txn->tmpl->opts, txn->buf + COAP_HDR_LEN, txn->payload };
+	size_t seg_len[4] = { COAP_HDR_LEN, txn->tmpl->opts_len, txn->ext_len, txn->payload_len };
+	int nseg = 0;
+	if (txn->ext_len) seg_len[1]--;
+#ifdef _WIN32
+	WSABUF bufs[4];
+	for (int i = 0; i < 4; ++i) {
+		if (i == 2 && !txn->ext_len) continue;
+		bufs[nseg].buf = (char*)seg[i]; bufs[nseg].len = (ULONG)seg_len[i];
+		nseg++;
+	}
+	DWORD sent = 0;
+	int r = WSASendTo(client->sock, bufs, (DWORD)nseg, &sent, 0,
+		connected ? NULL : (struct sockaddr*)&client->server_addr,
+		connected ? 0 : (int)sizeof(client->server_addr), NULL, NULL);
+	return r == 0 ? (int)sent : -1;
+#else
+	struct iovec iov[4];
+	for (int i = 0; i < 4; ++i) {
+		if (i == 2 && !txn->ext_len) continue;
+		iov[nseg].iov_base = (void*)seg[i]; iov[nseg].iov_len = seg_len[i];
+		nseg++;
+	}
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	if (!connected) {
+		msg.msg_name = &client->server_addr;
+		msg.msg_namelen = sizeof(client->server_addr);
+	}
+	msg.msg_iov = iov;
+	msg.msg_iovlen = (size_t)nseg;
+	return (int)sendmsg(client->sock, &msg, 0);
+#endif
+}
+
 const char* coap_code_to_text(uint8_t code) {
 	static char tmp[16];
 	uint8_t cls = code >> 5; uint8_t detail = code & 0x1F;
@@ -148,80 +412,123 @@ const char* coap_code_to_text(uint8_t code) {
 	return tmp;
 }
 
-// 发送并（在 CON 模式）等待 ACK/响应
-static int send_and_wait(coap_client_t *client, const uint8_t *buf, size_t len,
-						  uint16_t expect_mid, uint8_t expect_type,
-						  uint32_t timeout_ms, uint8_t max_retry,
-						  uint8_t *out_code) {
+uint64_t coap_mono_us(void) {
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER c;
+	if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&c);
+	return (uint64_t)(c.QuadPart / freq.QuadPart) * 1000000u +
+		(uint64_t)(c.QuadPart % freq.QuadPart) * 1000000u / (uint64_t)freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+#endif
+}
+
+// 发送并（在 CON 模式）等待 ACK/响应；报文取自事务缓冲，重传原样重发
+// 不属于本事务的响应（如早先超时事务迟到的 ACK）被丢弃并继续等待
+// resp 非 NULL 时把响应负载拷入 resp（容量 *resp_len，返回时为实际长度）
+static int send_and_wait(coap_client_t *client, coap_txn_t *txn,
+						  uint8_t expect_type, uint8_t max_retry,
+						  uint8_t *out_code, uint8_t *resp, size_t *resp_len) {
 	if (client->conf.net_mode == NETWORK_DOWN) {
-		printf("[%s] 网络中断，发送丢弃\n", now_ts());
+		coap_log_info("网络中断，发送丢弃");
 		return -1;
 	}
 
-	uint32_t wait_ms = timeout_ms;
-	for (uint8_t attempt = 0; ; ++attempt) {
-		ssize_t s = sendto(client->sock, (const char*)buf, (int)len, 0,
-						 (struct sockaddr*)&client->server_addr, sizeof(client->server_addr));
+	coap_client_txn_arm(client, txn, coap_mono_us());
+	for (;;) {
+		int s = coap_client_txn_transmit(client, txn, 0);
 		if (s < 0) {
 			perror("sendto");
 			return -2;
 		}
-		printf("[%s] 已发送 %zu 字节 (MID=0x%04X)\n", now_ts(), len, expect_mid);
+		COAP_LOG_PKT("已发送 %u 字节 (MID=0x%04X)", (unsigned)txn->len, txn->mid);
 
 		if (client->conf.msg_type == COAP_TYPE_NON) {
 			// 非确认消息，不等待
 			return 0;
 		}
 
-		set_recv_timeout(client->sock, client->conf.net_mode == NETWORK_TIMEOUT ? 10 : wait_ms);
-		uint8_t rbuf[1152];
-		struct sockaddr_in from; socklen_t flen = sizeof(from);
-		ssize_t r = recvfrom(client->sock, (char*)rbuf, sizeof(rbuf), 0, (struct sockaddr*)&from, &flen);
-		if (r <= 0) {
-			if (client->conf.net_mode == NETWORK_TIMEOUT) {
-				printf("[%s] 超时未收到响应 (模拟)\n", now_ts());
-			} else {
-				printf("[%s] 超时未收到响应\n", now_ts());
+		uint32_t wait_ms = client->conf.net_mode == NETWORK_TIMEOUT ? 10 : txn->wait_ms;
+		uint64_t deadline = coap_mono_us() + (uint64_t)wait_ms * 1000u;
+		for (;;) {
+			uint64_t now = coap_mono_us();
+			if (now >= deadline) break;
+			set_recv_timeout(client->sock, (uint32_t)((deadline - now + 999u) / 1000u));
+			uint8_t rbuf[COAP_MAX_PKT];
+			struct sockaddr_in from; socklen_t flen = sizeof(from);
+			ssize_t r = recvfrom(client->sock, (char*)rbuf, sizeof(rbuf), 0, (struct sockaddr*)&from, &flen);
+			if (r <= 0) break;
+
+			uint8_t type = 0, code = 0;
+			coap_txn_t *hit = coap_client_match_reply(client, rbuf, (size_t)r, &type, &code);
+			if (hit != txn) {
+				COAP_LOG_PKT("丢弃不匹配的响应 (%zd 字节)", r);
+				continue;
+			}
+			if (type != expect_type && type != 2 /* ACK */) {
+				coap_log_info("响应类型不匹配");
+				return -7;
+			}
+			uint64_t now_done = coap_mono_us();
+			coap_client_txn_finish(client, txn, 1, now_done);
+			if (client->metrics) {
+				coap_metrics_record(client->metrics, 0, coap_outcome_of(0, code), now_done - txn->first_send_us, txn->attempt);
+			}
+			if (out_code) *out_code = code;
+			if (resp) {
+				coap_msg_view_t m;
+				size_t n = 0;
+				if (coap_msg_parse(&m, rbuf, (size_t)r) == 0 && m.payload) {
+					n = m.payload_len < *resp_len ? m.payload_len : *resp_len;
+					memcpy(resp, m.payload, n);
+				}
+				*resp_len = n;
 			}
-			if (attempt >= max_retry) return -3; // 放弃
-			wait_ms *= 2; // 指数退避
-			continue; // 重传
+			COAP_LOG_PKT("收到响应 code=%s (0x%02X), RTT %.2f ms", coap_code_to_text(code), code,
+				(double)(now_done - txn->first_send_us) / 1000.0);
+			return 0;
 		}
 
-		// 解析最小头部
-		if (r < 4) { printf("[%s] 响应长度过短\n", now_ts()); return -4; }
-		uint8_t ver = (rbuf[0] >> 6) & 0x03;
-		uint8_t type = (rbuf[0] >> 4) & 0x03;
-		uint8_t tkl = rbuf[0] & 0x0F;
-		uint8_t code = rbuf[1];
-		uint16_t mid = (uint16_t)((rbuf[2] << 8) | rbuf[3]);
-		if (ver != COAP_VERSION) { printf("[%s] 响应版本错误\n", now_ts()); return -5; }
-		if (mid != expect_mid) { printf("[%s] 响应 MID 不匹配\n", now_ts()); return -6; }
-		if (type != expect_type && type != 2 /* ACK */) {
-			printf("[%s] 响应类型不匹配\n", now_ts());
-			return -7;
+		if (client->conf.net_mode == NETWORK_TIMEOUT) {
+			COAP_LOG_PKT("超时未收到响应 (模拟)");
+		} else {
+			COAP_LOG_PKT("超时未收到响应");
 		}
-		if (out_code) *out_code = code;
-		printf("[%s] 收到响应 code=%s (0x%02X)\n", now_ts(), coap_code_to_text(code), code);
-		return 0;
+		if (txn->attempt >= max_retry) { // 放弃
+			uint64_t now = coap_mono_us();
+			coap_client_txn_finish(client, txn, 0, now);
+			if (client->metrics) {
+				coap_metrics_record(client->metrics, 0, COAP_OUTCOME_TIMEOUT, now - txn->first_send_us, txn->attempt);
+			}
+			return -3;
+		}
+		txn->attempt++;
+		txn->wait_ms = coap_rto_backoff(&client->rto, txn->wait_ms);
 	}
 }
 
-int coap_client_post_json(
+int coap_client_encode_post(
 	coap_client_t *client,
+	coap_txn_t *txn,
 	const char *uri_host,
 	const char *uri_path,
 	const char *uri_query,
-	const char *json_payload,
-	uint16_t *out_message_id
+	const uint8_t *payload,
+	size_t payload_len
 ) {
-	if (!client || !json_payload) return -1;
+	if (!client || !txn || !txn->buf || (!payload && payload_len)) return -1;
 
-	uint8_t pkt[1152]; size_t off = 0; uint16_t last_opt = 0;
-	uint8_t token[4] = {0xA1,0xB2,0xC3,0xD4};
-	uint8_t tkl = sizeof(token);
+	uint8_t *pkt = txn->buf;
+	size_t pkt_cap = client->pool->buf_size;
+	size_t off = 0; uint16_t last_opt = 0;
+	uint8_t tkl = COAP_TOKEN_LEN;
+	if (pkt_cap < (size_t)4 + tkl) return -2;
 	uint16_t mid = next_mid_inc(&client->next_mid);
-	if (out_message_id) *out_message_id = mid;
+	txn->mid = mid;
 
 	// Header
 	uint8_t ver_type_tkl = (uint8_t)((COAP_VERSION << 6) | ((client->conf.msg_type & 0x03) << 4) | (tkl & 0x0F));
@@ -231,38 +538,339 @@ int coap_client_post_json(
 	pkt[off++] = (uint8_t)((mid >> 8) & 0xFF);
 	pkt[off++] = (uint8_t)(mid & 0xFF);
 
-	// Token
-	for (size_t i = 0; i < tkl; ++i) pkt[off++] = token[i];
+	// Token（大端）
+	for (size_t i = 0; i < tkl; ++i) pkt[off++] = (uint8_t)(txn->token >> (8 * (tkl - 1 - i)));
 
-	// Options (Uri-Host=3, Uri-Path=11, Uri-Query=15, Content-Format=12)
+	// Options 按编号升序：Uri-Host=3, Uri-Path=11, Content-Format=12, Uri-Query=15
 	if (uri_host && *uri_host) {
-		add_option(pkt, sizeof(pkt), &off, &last_opt, 3, (const uint8_t*)uri_host, strlen(uri_host));
+		add_option(pkt, pkt_cap, &off, &last_opt, 3, (const uint8_t*)uri_host, strlen(uri_host));
 	}
 	if (uri_path && *uri_path) {
-		add_option(pkt, sizeof(pkt), &off, &last_opt, 11, (const uint8_t*)uri_path, strlen(uri_path));
-	}
-	if (uri_query && *uri_query) {
-		add_option(pkt, sizeof(pkt), &off, &last_opt, 15, (const uint8_t*)uri_query, strlen(uri_query));
+		add_path_options(pkt, pkt_cap, &off, &last_opt, uri_path);
 	}
-	// Content-Format: application/json (50)
+	// Content-Format: application/json (50) 或 application/cbor (60)，加密负载为 application/octet-stream (42)
 	{
-		uint8_t fmtbuf[4]; size_t fmtn = encode_uint_option(fmtbuf, 50);
-		add_option(pkt, sizeof(pkt), &off, &last_opt, 12, fmtbuf, fmtn);
+		uint8_t fmtbuf[4]; size_t fmtn = encode_uint_option(fmtbuf, coap_client_content_format(&client->conf));
+		add_option(pkt, pkt_cap, &off, &last_opt, 12, fmtbuf, fmtn);
+	}
+	if (uri_query && *uri_query) {
+		add_option(pkt, pkt_cap, &off, &last_opt, 15, (const uint8_t*)uri_query, strlen(uri_query));
 	}
 
 	// Payload Marker
+	if (off + 1 > pkt_cap) return -2;
 	pkt[off++] = 0xFF;
 	// Payload
-	size_t payload_len = strlen(json_payload);
-	if (off + payload_len > sizeof(pkt)) return -2;
-	memcpy(pkt + off, json_payload, payload_len);
+	if (client->conf.payload_key) {
+		int n = aes128_cbc_encrypt(client->conf.payload_key, AUTH_PAYLOAD_IV, payload, payload_len,
+			pkt + off, pkt_cap - off);
+		if (n < 0) return -2;
+		payload_len = (size_t)n;
+	} else {
+		if (off + payload_len > pkt_cap) return -2;
+		if (payload_len) memcpy(pkt + off, payload, payload_len);
+	}
 	off += payload_len;
+	txn->len = (uint16_t)off;
+	return (int)off;
+}
 
+int coap_client_txn_prepare_tmpl(coap_client_t *client, coap_txn_t *txn, const coap_tmpl_t *tmpl,
+	const uint8_t *payload, size_t payload_len) {
+	if (client->conf.payload_key) {
+		uint8_t *body = txn->buf + COAP_HDR_LEN;
+		int n = aes128_cbc_encrypt(client->conf.payload_key, AUTH_PAYLOAD_IV, payload, payload_len,
+			body, client->pool->buf_size - COAP_HDR_LEN);
+		if (n < 0) return -2;
+		payload = body;
+		payload_len = (size_t)n;
+	}
+	if ((size_t)COAP_HDR_LEN + tmpl->opts_len + payload_len > COAP_MAX_PKT) return -2;
+	txn->mid = next_mid_inc(&client->next_mid);
+	coap_tmpl_stamp(tmpl, txn->buf, txn->mid, txn->token);
+	txn->tmpl = tmpl;
+	txn->payload = payload;
+	txn->payload_len = (uint16_t)payload_len;
+	txn->len = (uint16_t)(COAP_HDR_LEN + tmpl->opts_len + payload_len);
+	return (int)txn->len;
+}
+
+// 显式配置了块大小且负载（加密时按密文）超过一块时直接分块；未配置时只在一个报文放不下时分块
+static int block_wanted(const coap_client_t *client, size_t payload_len) {
+	size_t wire = client->conf.payload_key ? aes128_cbc_padded_len(payload_len) : payload_len;
+	return client->conf.block_size && wire > client->conf.block_size;
+}
+
+// 阻塞发送一个已编码的事务并等待结果，结束后关闭事务
+static int post_txn(coap_client_t *client, coap_txn_t *txn, uint8_t *out_code, uint8_t *resp, size_t *resp_len) {
 	uint8_t resp_code = 0;
-	int rc = send_and_wait(client, pkt, off, mid,
+	int rc = send_and_wait(client, txn,
 		client->conf.msg_type == COAP_TYPE_CON ? 2 /* ACK */ : 1 /* NON */,
-		client->conf.ack_timeout_ms, client->conf.max_retransmit, &resp_code);
+		client->conf.max_retransmit, &resp_code, resp, resp_len);
+	coap_client_txn_close(client, txn);
+	if (out_code) *out_code = resp_code;
+	return rc;
+}
+
+int coap_client_post(
+	coap_client_t *client,
+	const char *uri_host,
+	const char *uri_path,
+	const char *uri_query,
+	const uint8_t *payload,
+	size_t payload_len,
+	uint16_t *out_message_id
+) {
+	if (!client || (!payload && payload_len)) return -1;
+
+	int n = -2;
+	coap_txn_t *txn = NULL;
+	if (!block_wanted(client, payload_len)) {
+		txn = coap_client_txn_open(client);
+		if (!txn) return -8;
+		n = coap_client_encode_post(client, txn, uri_host, uri_path, uri_query, payload, payload_len);
+		if (out_message_id) *out_message_id = txn->mid;
+	}
+	if (n < 0) {
+		if (txn) coap_client_txn_close(client, txn);
+		if (n != -2 || !payload_len) return n;
+		// 分块：按同样的选项建模板
+		coap_tmpl_t tmpl;
+		if (coap_tmpl_build_cf(&tmpl, client->conf.msg_type, uri_host, uri_path, uri_query,
+				coap_client_content_format(&client->conf)) != 0) return -2;
+		if (out_message_id) *out_message_id = client->next_mid;
+		return coap_client_post_blockwise(client, &tmpl, payload, payload_len, NULL);
+	}
+	return post_txn(client, txn, NULL, NULL, NULL);
+}
+
+int coap_client_post_json(
+	coap_client_t *client,
+	const char *uri_host,
+	const char *uri_path,
+	const char *uri_query,
+	const char *json_payload,
+	uint16_t *out_message_id
+) {
+	if (!json_payload) return -1;
+	return coap_client_post(client, uri_host, uri_path, uri_query, (const uint8_t*)json_payload, strlen(json_payload),
+		out_message_id);
+}
+
+int coap_client_post_json_resp(
+	coap_client_t *client,
+	const char *uri_host,
+	const char *uri_path,
+	const char *uri_query,
+	const char *json_payload,
+	uint8_t *out_code,
+	uint8_t *resp,
+	size_t resp_cap,
+	size_t *resp_len
+) {
+	if (!client || !json_payload || !resp || !resp_len) return -1;
+	*resp_len = 0;
+	coap_txn_t *txn = coap_client_txn_open(client);
+	if (!txn) return -8;
+	int n = coap_client_encode_post(client, txn, uri_host, uri_path, uri_query,
+		(const uint8_t*)json_payload, strlen(json_payload));
+	if (n < 0) {
+		coap_client_txn_close(client, txn);
+		return n;
+	}
+	*resp_len = resp_cap;
+	int rc = post_txn(client, txn, out_code, resp, resp_len);
+	if (rc != 0) *resp_len = 0;
 	return rc;
 }
 
+int coap_client_post_tmpl(
+	coap_client_t *client,
+	const coap_tmpl_t *tmpl,
+	const uint8_t *payload,
+	size_t payload_len,
+	uint16_t *out_message_id
+) {
+	if (!client || !tmpl || (!payload && payload_len)) return -1;
+
+	if (block_wanted(client, payload_len)) {
+		if (out_message_id) *out_message_id = client->next_mid;
+		return coap_client_post_blockwise(client, tmpl, payload, payload_len, NULL);
+	}
+	coap_txn_t *txn = coap_client_txn_open(client);
+	if (!txn) return -8;
+	int n = coap_client_txn_prepare_tmpl(client, txn, tmpl, payload, payload_len);
+	if (out_message_id) *out_message_id = txn->mid;
+	if (n < 0) {
+		coap_client_txn_close(client, txn);
+		return n == -2 && payload_len ? coap_client_post_blockwise(client, tmpl, payload, payload_len, NULL) : n;
+	}
+	return post_txn(client, txn, NULL, NULL, NULL);
+}
+
+// ---- Block1 分块上传 ----
+
+// 按模板准备第 num 块：Block1（首块另带 Size1）与负载标记写在事务缓冲的头部之后，负载直接引用 body 的切片
+static void txn_prepare_block(coap_client_t *client, coap_txn_t *txn, const coap_tmpl_t *tmpl,
+	const uint8_t *body, size_t body_len, uint32_t num, uint8_t szx) {
+	size_t size = coap_block_size(szx), off = (size_t)num * size;
+	int more = off + size < body_len;
+	uint8_t *ext = txn->buf + COAP_HDR_LEN;
+	size_t n = 0;
+	uint16_t last = tmpl->last_opt;
+	uint8_t v[4];
+	add_option(ext, 16, &n, &last, COAP_OPT_BLOCK1, v, encode_uint_option(v, coap_block_value(num, more, szx)));
+	if (num == 0) add_option(ext, 16, &n, &last, COAP_OPT_SIZE1, v, encode_uint_option(v, (uint32_t)body_len));
+	ext[n++] = 0xFF;
+	txn->mid = next_mid_inc(&client->next_mid);
+	coap_tmpl_stamp(tmpl, txn->buf, txn->mid, txn->token);
+	txn->tmpl = tmpl;
+	txn->ext_len = (uint8_t)n;
+	txn->payload = body + off;
+	txn->payload_len = (uint16_t)(more ? size : body_len - off);
+	txn->len = (uint16_t)(COAP_HDR_LEN + tmpl->opts_len - 1 + n + txn->payload_len);
+}
+
+// CON 分块：窗口内并发发送非最后块，逐个等 2.31，全部确认后再发最后一块
+// 整个传输在 metrics 中只记一个请求：时延从首块发出到最终响应（或放弃），重传数为各块之和
+static int block_run_con(coap_client_t *client, const coap_tmpl_t *tmpl, const uint8_t *body, size_t body_len,
+	uint8_t szx, uint8_t *out_code, uint32_t *retx) {
+	uint32_t size = coap_block_size(szx);
+	uint32_t nblocks = (uint32_t)((body_len + size - 1) / size);
+	uint64_t deadline[256]; // 按事务槽号（nstart <= 255）
+	uint64_t start_us = 0;
+	uint32_t next = 0, continued = 0;
+	uint8_t code = 0;
+	int rc = 1;
+	while (rc > 0) {
+		while (next < nblocks && (next + 1 < nblocks || (continued + 1 == nblocks && client->txn_count == 0))) {
+			coap_txn_t *txn = coap_client_txn_open(client);
+			if (!txn) break;
+			txn_prepare_block(client, txn, tmpl, body, body_len, next, szx);
+			uint64_t now = coap_mono_us();
+			if (!start_us) start_us = now;
+			coap_client_txn_arm(client, txn, now);
+			if (coap_client_txn_transmit(client, txn, 0) < 0) {
+				perror("sendto");
+				coap_client_txn_close(client, txn);
+				rc = -2;
+				break;
+			}
+			uint32_t wait_ms = client->conf.net_mode == NETWORK_TIMEOUT ? 10 : txn->wait_ms;
+			deadline[txn - client->txns] = now + (uint64_t)wait_ms * 1000u;
+			next++;
+		}
+		if (rc <= 0) break;
+		if (client->txn_count == 0) { rc = -8; break; }
 
+		uint64_t first = UINT64_MAX;
+		for (uint32_t i = 0; i < client->conf.nstart; ++i) {
+			if (client->txns[i].in_use && deadline[i] < first) first = deadline[i];
+		}
+		uint64_t now = coap_mono_us();
+		if (now < first) {
+			set_recv_timeout(client->sock, (uint32_t)((first - now + 999u) / 1000u));
+			uint8_t rbuf[COAP_MAX_PKT];
+			struct sockaddr_in from; socklen_t flen = sizeof(from);
+			ssize_t r = recvfrom(client->sock, (char*)rbuf, sizeof(rbuf), 0, (struct sockaddr*)&from, &flen);
+			uint8_t type = 0;
+			coap_txn_t *hit = r > 0 ? coap_client_match_reply(client, rbuf, (size_t)r, &type, &code) : NULL;
+			if (hit) {
+				uint32_t num = (uint32_t)((hit->payload - body) / size);
+				coap_client_txn_finish(client, hit, 1, coap_mono_us());
+				coap_client_txn_close(client, hit);
+				if (num + 1 == nblocks) {
+					// 最后一块还回 2.31 说明服务端没有结束传输，按协议错误处理
+					rc = code == coap_make_code(2, 31) ? -10 : 0;
+				} else if (code == coap_make_code(2, 31)) {
+					continued++;
+				} else {
+					rc = -9;
+				}
+			}
+			continue;
+		}
+		// 到期的块：未达上限则按 RTO 策略退避重发，否则放弃整个传输
+		for (uint32_t i = 0; i < client->conf.nstart && rc > 0; ++i) {
+			coap_txn_t *txn = &client->txns[i];
+			if (!txn->in_use || deadline[i] > now) continue;
+			if (txn->attempt >= client->conf.max_retransmit) {
+				coap_client_txn_finish(client, txn, 0, now);
+				rc = -3;
+				break;
+			}
+			txn->attempt++;
+			txn->wait_ms = coap_rto_backoff(&client->rto, txn->wait_ms);
+			(*retx)++;
+			coap_client_txn_transmit(client, txn, 0);
+			uint32_t wait_ms = client->conf.net_mode == NETWORK_TIMEOUT ? 10 : txn->wait_ms;
+			deadline[i] = now + (uint64_t)wait_ms * 1000u;
+		}
+	}
+	for (uint32_t i = 0; i < client->conf.nstart; ++i) {
+		if (client->txns[i].in_use) coap_client_txn_close(client, &client->txns[i]);
+	}
+	if (client->metrics && start_us) {
+		// 中途以 4.xx/5.xx 结束的按响应码归类（4.01 记为未授权），其余失败按返回码
+		coap_outcome_t o = rc == -9 && (code >> 5) >= 4 ? coap_outcome_of(0, code) : coap_outcome_of(rc, code);
+		coap_metrics_record(client->metrics, 0, o, coap_mono_us() - start_us, *retx);
+	}
+	if (out_code && (rc == 0 || rc == -9 || rc == -10)) *out_code = code;
+	return rc;
+}
+
+int coap_client_post_blockwise(
+	coap_client_t *client,
+	const coap_tmpl_t *tmpl,
+	const uint8_t *payload,
+	size_t payload_len,
+	uint8_t *out_code
+) {
+	if (!client || !tmpl || !payload || !payload_len) return -1;
+	uint8_t code = 0;
+	if (client->conf.net_mode == NETWORK_DOWN) {
+		coap_log_info("网络中断，发送丢弃");
+		return -1;
+	}
+	// 加密时整体加密一次（CBC 链跨块），各块引用密文切片
+	const uint8_t *body = payload;
+	size_t body_len = payload_len;
+	if (client->conf.payload_key) {
+		body_len = aes128_cbc_padded_len(payload_len);
+		if (!client->block_cipher || body_len > COAP_BLOCK_BODY_MAX ||
+				aes128_cbc_encrypt(client->conf.payload_key, AUTH_PAYLOAD_IV, payload, payload_len,
+				client->block_cipher, body_len) < 0) return -2;
+		body = client->block_cipher;
+	}
+	if (body_len > COAP_BLOCK_BODY_MAX) return -2;
+	// 块大小取配置值；加上头部、选项与 Block1/Size1（至多 10 字节）放不进一个报文时逐级减半
+	uint32_t want = client->conf.block_size ? client->conf.block_size : coap_block_size(COAP_BLOCK_SZX_MAX);
+	uint8_t szx = COAP_BLOCK_SZX_MAX;
+	while (szx > 0 && (coap_block_size(szx) > want ||
+			(size_t)COAP_HDR_LEN + tmpl->opts_len + 10 + coap_block_size(szx) > COAP_MAX_PKT)) szx--;
+	uint32_t size = coap_block_size(szx);
+	uint32_t nblocks = (uint32_t)((body_len + size - 1) / size);
+	uint32_t retx = 0;
+	int rc = 0;
+	if ((tmpl->hdr[0] >> 4 & 0x03) == COAP_TYPE_CON) {
+		rc = block_run_con(client, tmpl, body, body_len, szx, &code, &retx);
+	} else {
+		// NON：逐块发出，不等待响应
+		for (uint32_t num = 0; num < nblocks && rc == 0; ++num) {
+			coap_txn_t *txn = coap_client_txn_open(client);
+			if (!txn) { rc = -8; break; }
+			txn_prepare_block(client, txn, tmpl, body, body_len, num, szx);
+			if (coap_client_txn_transmit(client, txn, 0) < 0) rc = -2;
+			coap_client_txn_close(client, txn);
+		}
+	}
+	if (rc == 0) {
+		coap_log_info("Block1 上传 %zu 字节：%u 块 x %u 字节（窗口 %u），重传 %u 次%s%s", body_len, nblocks, size,
+			client->conf.nstart, retx, code ? "，响应 " : "", code ? coap_code_to_text(code) : "");
+	} else {
+		coap_log_info("Block1 上传 %zu 字节失败 rc=%d（%u 块 x %u 字节）%s%s", body_len, rc, nblocks, size,
+			code ? "，响应 " : "", code ? coap_code_to_text(code) : "");
+	}
+	if (out_code) *out_code = code;
+	return rc;
+}
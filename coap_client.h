@@ -8,6 +8,12 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include "coap_pool.h"
+#include "coap_rto.h"
+#include "timer_wheel.h"
+#include "aes128.h"
+#include "coap_metrics.h"
+
 #ifdef _WIN32
 #include <winsock2.h>
 #include <ws2tcpip.h>
@@ -25,6 +31,11 @@ typedef int socket_t;
 extern "C" {
 #endif
 
+#define COAP_MAX_PKT 1152 // 单个 CoAP 报文缓冲上限（RFC7252 建议的 1152 字节）
+#define COAP_TOKEN_LEN 8  // 每个请求随机生成的 Token 长度
+#define COAP_HDR_LEN (4 + COAP_TOKEN_LEN) // 固定头部 + Token
+#define COAP_TMPL_MAX 512 // 预编码选项区上限
+
 typedef enum {
 	COAP_TYPE_CON = 0,
 	COAP_TYPE_NON = 1
@@ -36,6 +47,14 @@ typedef enum {
 	NETWORK_DOWN = 2
 } network_mode_t;
 
+// 上报负载编码
+typedef enum {
+	COAP_PAYLOAD_JSON = 0,       // application/json（50）
+	COAP_PAYLOAD_CBOR = 1,       // application/cbor（60）
+	COAP_PAYLOAD_SENML_JSON = 2, // application/senml+json（110），多条读数聚合
+	COAP_PAYLOAD_SENML_CBOR = 3  // application/senml+cbor（112）
+} coap_payload_fmt_t;
+
 typedef struct {
 	char server_host[128]; // 例如 "127.0.0.1"
 	uint16_t server_port;  // 例如 5683
@@ -43,25 +62,113 @@ typedef struct {
 	uint32_t ack_timeout_ms;   // 初始超时时间（重传以指数退避）
 	uint8_t max_retransmit;    // 最大重传次数（不含首次）
 	network_mode_t net_mode;   // 网络模拟
+	uint8_t nstart;            // 同一服务端允许的最大在途 CON 数（RFC7252 NSTART），0 视为 1
+	coap_rto_mode_t rto_mode;  // 重传超时策略：固定指数退避或 CoCoA 自适应
+	const aes128_key_t *payload_key; // 非 NULL 时 POST 负载用会话密钥 AES-128-CBC 加密（Content-Format 42），须在客户端存续期间有效
+	coap_payload_fmt_t payload_fmt;  // 上报负载编码，决定 POST 的 Content-Format
+	uint16_t block_size;       // Block1 分块大小（16..1024 的 2 的幂）：负载超过它时 coap_client_post 分块上传；
+	                           // 0 时只在负载放不进一个报文时分块，块大小取 1024
 } coap_client_conf_t;
 
+// POST 负载的 Content-Format：加密时 42（服务端解密后按首字节区分编码），否则按 payload_fmt 取 50/60/110/112
+static inline uint16_t coap_client_content_format(const coap_client_conf_t *conf) {
+	static const uint16_t cf[4] = { 50, 60, 110, 112 };
+	return conf->payload_key ? 42 : cf[conf->payload_fmt & 3];
+}
+
+// 在途事务：按 Token 与 MID 匹配响应，报文存放在缓冲池中供重传原样重发
+typedef struct {
+	uint64_t token;     // 随机 Token（按大端写入报文）
+	uint16_t mid;
+	uint8_t in_use;
+	uint8_t attempt;    // 已重传次数
+	uint32_t wait_ms;   // 当前超时（按 RTO 策略退避）
+	uint16_t len;       // 报文长度
+	uint8_t *buf;       // 报文缓冲（来自 coap_pool_t）；模板发送时只存头部（及异步发送时的负载）
+	const struct coap_tmpl *tmpl; // 非 NULL 时按 {头部, 模板选项, 负载} 三段 iovec 发送
+	const uint8_t *payload;
+	uint16_t payload_len;
+	uint8_t ext_len;    // 模板选项之后追加的选项（Block1/Size1）连同负载标记的字节数，存放在 buf 的头部之后
+	uint64_t first_send_us; // 首次发送时刻（单调时钟 us），用于 RTT 测量
+	tw_timer_t timer;   // 重传定时器（事件驱动引擎的时间轮节点）
+	uint32_t owner;     // 所属设备下标（事件驱动引擎使用）
+} coap_txn_t;
+
+// 预编译请求模板：固定设备的 Uri-Host/Uri-Path/Uri-Query/Content-Format 选项只编码一次，
+// 每次发送只在头部填入 MID 与 Token，负载通过 sendmsg/iovec 直接引用，不再拷贝
+typedef struct coap_tmpl {
+	uint8_t hdr[4];              // Ver/Type/TKL + Code 原型，MID 字段每次填写
+	uint8_t opts[COAP_TMPL_MAX]; // 预编码选项 + 0xFF 负载标记
+	uint16_t opts_len;
+	uint16_t last_opt;           // 最后一个选项的编号（追加 Block1 等选项时按它计算 delta）
+} coap_tmpl_t;
+
 typedef struct {
 	socket_t sock;
+	uint8_t sock_shared;   // 套接字由外部持有（coap_client_init_shared），关闭客户端时不关闭
+	uint8_t token_tagged;  // Token 高 32 位固定为 token_tag，只有低 32 位随机
+	uint32_t token_tag;
 	struct sockaddr_in server_addr;
 	uint16_t next_mid; // 消息ID 0..65535 循环
 	coap_client_conf_t conf;
+	coap_txn_t *txns;      // nstart 个事务槽，位置固定
+	uint16_t *txn_index;   // Token 开放寻址索引，值为槽号+1，0 表示空
+	uint32_t txn_mask;     // 索引容量-1（2 的幂）
+	uint32_t txn_count;    // 在途事务数
+	coap_pool_t *pool;     // 报文缓冲池（可由多个客户端共享）
+	coap_pool_t own_pool;  // 未提供共享池时自建，容量为 nstart
+	uint64_t rng;          // Token/超时抖动随机数状态（xorshift64*）
+	coap_rto_t rto;        // 该远端的 RTT 估计与重传计数
+	coap_metrics_t *metrics; // 非 NULL 时阻塞发送的每个 CON 请求结束后按结果记入（设备号 0）；初始化后由调用方设置
+	uint8_t *block_cipher; // 加密的分块上传整体加密到这里（COAP_BLOCK_BODY_MAX 字节）；自建缓冲池且启用加密时初始化分配
 } coap_client_t;
 
 // 初始化/反初始化 socket 环境（Windows 需要）
 int platform_net_init(void);
 void platform_net_deinit(void);
 
+// 单调时钟（微秒）
+uint64_t coap_mono_us(void);
+
 // 创建/销毁客户端
 int coap_client_init(coap_client_t *client, const coap_client_conf_t *conf);
+// 使用外部共享的缓冲池创建客户端（pool 为 NULL 时等同 coap_client_init）
+int coap_client_init_with_pool(coap_client_t *client, const coap_client_conf_t *conf, coap_pool_t *pool);
+// 多个客户端共用一个外部创建的未连接套接字（不关闭它），发送须带目的地址（connected 传 0）；
+// 每个 Token 的高 32 位固定为 tag，收包方据此把响应分给对应客户端
+int coap_client_init_shared(coap_client_t *client, const coap_client_conf_t *conf, coap_pool_t *pool,
+	socket_t sock, uint32_t tag);
 void coap_client_close(coap_client_t *client);
 
-// 发送一条带 JSON 负载的 POST 请求，带 Uri-Host/Path/Query 选项
+// 开启一个事务：占用事务槽与池缓冲并生成唯一随机 Token；在途数已达 NSTART 或池耗尽时返回 NULL
+coap_txn_t *coap_client_txn_open(coap_client_t *client);
+// 结束事务并归还缓冲
+void coap_client_txn_close(coap_client_t *client, coap_txn_t *txn);
+// CON 交换开始：记录首次发送时刻，按 RTO 策略返回首次超时（ms）
+uint32_t coap_client_txn_arm(coap_client_t *client, coap_txn_t *txn, uint64_t now_us);
+// CON 交换结束（acked=1 收到响应，0 放弃）：更新 RTT 估计与重传计数
+// 返回固定策略下估计会产生的重传次数
+uint8_t coap_client_txn_finish(coap_client_t *client, coap_txn_t *txn, int acked, uint64_t now_us);
+// 解析一个响应报文并匹配在途事务（有 Token 时按 Token，空 ACK/RST 按 MID）
+// 匹配成功返回事务并输出类型与响应码，否则返回 NULL
+coap_txn_t *coap_client_match_reply(coap_client_t *client, const uint8_t *buf, size_t len,
+	uint8_t *out_type, uint8_t *out_code);
+
+// 发送一条 POST 请求，带 Uri-Host/Path/Query 选项，负载按 coap_client_content_format 标注 Content-Format
+// 负载超过 conf.block_size 或放不进一个报文时改用 coap_client_post_blockwise 分块上传（MID 输出首块的 MID）
 // 返回 0 表示成功收到 2.05（Content）或 2.01/2.04（此处统一当成功），>0 表示服务端 4.xx/5.xx，<0 表示失败
+// （-8 表示在途事务已达 NSTART 或缓冲池耗尽）
+int coap_client_post(
+	coap_client_t *client,
+	const char *uri_host,
+	const char *uri_path,
+	const char *uri_query,
+	const uint8_t *payload,
+	size_t payload_len,
+	uint16_t *out_message_id
+);
+
+// 同 coap_client_post，负载为以 '\0' 结尾的 JSON 文本
 int coap_client_post_json(
 	coap_client_t *client,
 	const char *uri_host,
@@ -71,6 +178,82 @@ int coap_client_post_json(
 	uint16_t *out_message_id
 );
 
+// 同 coap_client_post_json，另输出响应码与响应负载（最多 resp_cap 字节，实际长度写入 *resp_len）
+// 用于需要读取响应内容的请求，如 /auth 握手
+int coap_client_post_json_resp(
+	coap_client_t *client,
+	const char *uri_host,
+	const char *uri_path,
+	const char *uri_query,
+	const char *json_payload,
+	uint8_t *out_code,
+	uint8_t *resp,
+	size_t resp_cap,
+	size_t *resp_len
+);
+
+// 把一条 POST 报文编码进事务缓冲（不发送），阻塞与事件驱动两种发送路径共用
+// 会占用一个 MID 并写入 txn->mid/len；返回报文长度，<0 表示失败（-2 表示缓冲区不足）
+int coap_client_encode_post(
+	coap_client_t *client,
+	coap_txn_t *txn,
+	const char *uri_host,
+	const char *uri_path,
+	const char *uri_query,
+	const uint8_t *payload,
+	size_t payload_len
+);
+
+// 构建 POST 请求模板（选项按 RFC7252 要求的编号顺序编码，附 Content-Format=50 与负载标记）
+// 返回 0 成功，-2 选项超出模板容量
+int coap_tmpl_build(coap_tmpl_t *tmpl, coap_msg_type_t type,
+	const char *uri_host, const char *uri_path, const char *uri_query);
+// 同上，指定 Content-Format（通常取 coap_client_content_format）
+int coap_tmpl_build_cf(coap_tmpl_t *tmpl, coap_msg_type_t type,
+	const char *uri_host, const char *uri_path, const char *uri_query, uint16_t content_format);
+
+// 按模板填写 COAP_HDR_LEN 字节的报文头（MID + Token）
+static inline void coap_tmpl_stamp(const coap_tmpl_t *tmpl, uint8_t *hdr, uint16_t mid, uint64_t token) {
+	hdr[0] = tmpl->hdr[0];
+	hdr[1] = tmpl->hdr[1];
+	hdr[2] = (uint8_t)(mid >> 8);
+	hdr[3] = (uint8_t)(mid & 0xFF);
+	for (int i = 0; i < COAP_TOKEN_LEN; ++i) hdr[4 + i] = (uint8_t)(token >> (8 * (COAP_TOKEN_LEN - 1 - i)));
+}
+
+// 按模板准备事务：分配 MID、在事务缓冲中写入头部并引用负载（负载须在事务结束前保持有效）
+// 配置了 payload_key 时负载加密写入事务缓冲头部之后（payload 可以就是该位置），改为引用密文
+// 返回报文总长度，<0 表示失败（-2 表示超出报文上限）
+int coap_client_txn_prepare_tmpl(coap_client_t *client, coap_txn_t *txn, const coap_tmpl_t *tmpl,
+	const uint8_t *payload, size_t payload_len);
+
+// 使用模板发送一条 POST：头部写入事务缓冲，选项与负载以 iovec 引用，零拷贝；语义与返回值同 coap_client_post_json
+int coap_client_post_tmpl(
+	coap_client_t *client,
+	const coap_tmpl_t *tmpl,
+	const uint8_t *payload,
+	size_t payload_len,
+	uint16_t *out_message_id
+);
+
+// Block1 分块上传（RFC 7959）：负载按 conf.block_size 切块，每块以 {头部, 模板选项, Block1/Size1, 负载切片}
+// 直接引用调用方缓冲发送，不拷贝整个负载（加密时先整体加密一次）；CON 时除最后一块外最多 NSTART 块同时在途，
+// 各块收到 2.31 Continue 后才发最后一块，其响应即最终响应，响应码写入 *out_code
+// NON 时逐块发出不等待。返回 0 成功；-2 负载超过 COAP_BLOCK_BODY_MAX 或加密失败（含共享缓冲池、没有密文缓冲的客户端）；-3 某块重传耗尽；
+// -8 事务槽或缓冲池不足；-9 服务端中途以非 2.31 的响应结束传输（响应码在 *out_code）；
+// -10 最后一块仍收到 2.31（协议错误）。CON 传输在 client->metrics 中按一个请求记录（首块发出到最终响应）
+int coap_client_post_blockwise(
+	coap_client_t *client,
+	const coap_tmpl_t *tmpl,
+	const uint8_t *payload,
+	size_t payload_len,
+	uint8_t *out_code
+);
+
+// 发送事务报文（重传同样调用）：模板事务走 sendmsg 三段 iovec，否则直接发送缓冲
+// connected 非 0 表示套接字已 connect，不带目的地址；返回发送字节数，<0 失败
+int coap_client_txn_transmit(coap_client_t *client, const coap_txn_t *txn, int connected);
+
 // 获取可读的响应码文本
 const char* coap_code_to_text(uint8_t code);
 
@@ -0,0 +1,88 @@
+// coap_dedup.c
+#include "coap_dedup.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DEDUP_NIL 0xFFFFFFFFu
+
+static uint32_t bucket_of(const coap_dedup_t *d, uint64_t key) {
+	return (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & d->bucket_mask;
+}
+
+int coap_dedup_init(coap_dedup_t *d, uint32_t capacity, uint32_t lifetime_ms) {
+	memset(d, 0, sizeof(*d));
+	if (capacity == 0) return -1;
+	uint32_t nb = 1;
+	while (nb < capacity && nb < 0x80000000u) nb <<= 1;
+	d->ring = (coap_dedup_entry_t*)malloc((size_t)capacity * sizeof(coap_dedup_entry_t));
+	d->buckets = (uint32_t*)malloc((size_t)nb * sizeof(uint32_t));
+	if (!d->ring || !d->buckets) {
+		coap_dedup_destroy(d);
+		return -2;
+	}
+	memset(d->buckets, 0xFF, (size_t)nb * sizeof(uint32_t));
+	d->capacity = capacity;
+	d->bucket_mask = nb - 1;
+	d->lifetime_ms = lifetime_ms ? lifetime_ms : COAP_EXCHANGE_LIFETIME_MS;
+	return 0;
+}
+
+void coap_dedup_destroy(coap_dedup_t *d) {
+	free(d->ring);
+	free(d->buckets);
+	d->ring = NULL;
+	d->buckets = NULL;
+	d->capacity = d->count = 0;
+}
+
+int coap_dedup_lookup(coap_dedup_t *d, uint64_t key, uint64_t token, uint8_t tkl, uint64_t now_ms,
+	uint8_t *resp, uint32_t resp_cap) {
+	for (uint32_t i = d->buckets[bucket_of(d, key)]; i != DEDUP_NIL; i = d->ring[i].next) {
+		const coap_dedup_entry_t *e = &d->ring[i];
+		// 同一端点与 MID 但 Token 不同：是复用端口的新请求，不是重传
+		if (e->key != key || e->token != token || e->tkl != tkl) continue;
+		// 链上最新的在前：首个同键条目已过期则更旧的也过期
+		if (now_ms - e->t_ms >= d->lifetime_ms || e->resp_len > resp_cap) break;
+		memcpy(resp, e->resp, e->resp_len);
+		d->hits++;
+		return e->resp_len;
+	}
+	d->misses++;
+	return -1;
+}
+
+// 把第 idx 条从其散列链上摘下
+static void unlink_entry(coap_dedup_t *d, uint32_t idx) {
+	uint32_t *link = &d->buckets[bucket_of(d, d->ring[idx].key)];
+	while (*link != DEDUP_NIL) {
+		if (*link == idx) {
+			*link = d->ring[idx].next;
+			return;
+		}
+		link = &d->ring[*link].next;
+	}
+}
+
+int coap_dedup_insert(coap_dedup_t *d, uint64_t key, uint64_t token, uint8_t tkl, uint64_t now_ms,
+	const uint8_t *resp, uint32_t resp_len) {
+	if (resp_len > COAP_DEDUP_RESP_MAX) return -1;
+	uint32_t idx = d->pos;
+	coap_dedup_entry_t *e = &d->ring[idx];
+	if (d->count == d->capacity) {
+		if (now_ms - e->t_ms < d->lifetime_ms) d->evicted++;
+		unlink_entry(d, idx);
+	} else {
+		d->count++;
+	}
+	uint32_t b = bucket_of(d, key);
+	e->key = key;
+	e->token = token;
+	e->tkl = tkl;
+	e->t_ms = now_ms;
+	e->resp_len = (uint16_t)resp_len;
+	if (resp_len) memcpy(e->resp, resp, resp_len);
+	e->next = d->buckets[b];
+	d->buckets[b] = idx;
+	d->pos = idx + 1 == d->capacity ? 0 : idx + 1;
+	return 0;
+}
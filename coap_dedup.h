@@ -0,0 +1,73 @@
+// coap_dedup.h
+// 服务端消息去重缓存（RFC7252 4.5）：以 (源地址, 源端口, MID) 为键记住处理过的 CON 请求及其响应，
+// 重传的请求在 EXCHANGE_LIFETIME 内直接重放缓存的响应，不再解析、鉴权；
+// 重放前还要求 Token 相同：重启的客户端复用了端口、MID 又从头分配时，新请求（Token 不同）不会拿到旧响应
+// 容量固定：条目放在一次性分配的环形数组中，按插入顺序覆盖最旧的条目（FIFO 即按时间），
+// 另有链式散列索引；运行期间不再分配内存。单线程使用（每个服务端分片一份）
+
+#ifndef COAP_DEDUP_H
+#define COAP_DEDUP_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// EXCHANGE_LIFETIME = MAX_TRANSMIT_SPAN(45s) + 2*MAX_LATENCY(200s) + PROCESSING_DELAY(2s)
+#define COAP_EXCHANGE_LIFETIME_MS 247000u
+#define COAP_DEDUP_RESP_MAX 96 // 缓存的响应最长字节数（容得下 /auth 握手响应），更长的响应不缓存
+
+typedef struct {
+	uint64_t key;
+	uint64_t token;     // 请求的 Token（按大端折成整数，见 coap_dedup_token）
+	uint64_t t_ms;      // 插入时刻
+	uint32_t next;      // 同一散列桶的下一条，UINT32_MAX 结束
+	uint16_t resp_len;
+	uint8_t tkl;
+	uint8_t resp[COAP_DEDUP_RESP_MAX];
+} coap_dedup_entry_t;
+
+typedef struct {
+	coap_dedup_entry_t *ring;
+	uint32_t *buckets;   // 桶 -> 链首条目下标（最新的在前）
+	uint32_t capacity;
+	uint32_t bucket_mask;
+	uint32_t pos;        // 下一个写入位置
+	uint32_t count;
+	uint32_t lifetime_ms;
+	uint64_t hits;       // 命中并重放
+	uint64_t misses;     // 查找未命中（新请求或已过期）
+	uint64_t evicted;    // 未到过期时间就因容量不足被覆盖的条目
+} coap_dedup_t;
+
+// 分配 capacity 个条目；lifetime_ms 为 0 时取 COAP_EXCHANGE_LIFETIME_MS。返回 0 成功，<0 内存不足
+int coap_dedup_init(coap_dedup_t *d, uint32_t capacity, uint32_t lifetime_ms);
+void coap_dedup_destroy(coap_dedup_t *d);
+
+// IPv4 地址与端口按网络序原样传入
+static inline uint64_t coap_dedup_key(uint32_t addr, uint16_t port, uint16_t mid) {
+	return ((uint64_t)addr << 32) | ((uint64_t)port << 16) | mid;
+}
+
+// 报文中的 Token（tkl 为 0..8）
+static inline uint64_t coap_dedup_token(const uint8_t *token, uint8_t tkl) {
+	uint64_t t = 0;
+	for (uint8_t i = 0; i < tkl; ++i) t = (t << 8) | token[i];
+	return t;
+}
+
+// 查找未过期且 Token 相同的记录：命中时把缓存的响应拷入 resp 并返回其长度（>=0），未命中返回 -1
+int coap_dedup_lookup(coap_dedup_t *d, uint64_t key, uint64_t token, uint8_t tkl, uint64_t now_ms,
+	uint8_t *resp, uint32_t resp_cap);
+
+// 记录一次处理结果（resp_len 为 0 表示该请求不回复）；满时覆盖最旧的条目
+// 返回 0 成功，-1 响应超过 COAP_DEDUP_RESP_MAX 未缓存
+int coap_dedup_insert(coap_dedup_t *d, uint64_t key, uint64_t token, uint8_t tkl, uint64_t now_ms,
+	const uint8_t *resp, uint32_t resp_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COAP_DEDUP_H
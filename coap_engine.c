@@ -0,0 +1,812 @@
+// coap_engine.c
+// 事件驱动的多设备 CoAP 客户端引擎（epoll + timerfd 驱动的分层时间轮）
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // recvmmsg/sendmmsg
+#endif
+
+#include "coap_engine.h"
+#include "coap_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/timerfd.h>
+
+#define TIMERFD_ID 0xFFFFFFFFu // epoll 数据中标识 timerfd（设备下标不会取到）
+#define BATCH_MAX 1024          // recvmmsg/sendmmsg 单次上限（内核 UIO_MAXIOV）
+#define URING_ID 0xFFFFFFFEu    // epoll 数据中标识 io_uring 环
+#define URING_SQ 4096
+#define URING_TAG_SEND (1ull << 63) // CQE user_data 高位区分发送完成与设备接收
+#define ENGINE_SHARED_SOCKS 64  // 批量模式默认的共享套接字数
+#define ENGINE_SHARED_RCVBUF (4 * 1024 * 1024) // 共享套接字承接多台设备的响应，接收缓冲放大（受 rmem_max 限制）
+
+struct coap_engine {
+	coap_engine_conf_t conf;
+	int epfd;
+	int tfd;               // 按时间轮下一次到期时刻设置的 timerfd
+	uint64_t tfd_armed;    // timerfd 当前设定的 tick，0 表示未设
+	coap_client_t *devs;
+	coap_pool_t pool;      // 全部设备共享的报文缓冲池
+	timer_wheel_t wheel;   // 重传与开环发送共用的时间轮
+	uint64_t origin_us;    // tick 0 对应的单调时钟时刻
+	struct epoll_event *events;
+	coap_engine_done_cb cb;
+	void *user;
+	coap_engine_stats_t stats;
+	int fired_done;        // 本轮定时器回调中完成的请求数
+	// 开环调度
+	coap_engine_traffic_t traffic;
+	coap_tmpl_t traffic_tmpl; // 开环发送共用的请求模板
+	tw_timer_t *send_timers;
+	traffic_state_t *tstates;
+	uint64_t *planned_us;  // 每个设备下一次计划发送时刻
+	// 批量收发（batch_size > 1）：设备不再各自持有套接字，而是按下标轮流分到 nsocks 个共享的未连接套接字上，
+	// 每个共享套接字一条待发队列，一次 sendmmsg 可以合并不同设备的报文（每条报文带服务端地址）；
+	// 收包按 Token 高 32 位（设备下标）分给设备。mmsghdr/iovec/缓冲全部预分配，热路径不分配
+	uint32_t batch;
+	uint32_t nsocks;
+	int *socks;
+	struct mmsghdr *rx_msgs;
+	struct iovec *rx_iov;
+	struct sockaddr_in *rx_addrs; // 每条接收报文的来源，只接受来自服务端的
+	uint8_t *rx_bufs;      // batch 个 COAP_MAX_PKT 接收缓冲
+	struct mmsghdr *tx_msgs; // nsocks 条队列，每条 batch 个
+	struct iovec *tx_iov;  // 每条待发报文 3 段
+	uint8_t *tx_copy;      // NON 报文发出前即释放事务，先拷到这里（每条待发报文 COAP_MAX_PKT）；CON 直接引用事务缓冲
+	uint32_t *tx_count;    // 每条队列的待发数
+	uint32_t tx_pending;   // 全部队列的待发数
+	// io_uring 后端：每个设备一个常驻 multishot 接收，共用一个提供缓冲环；
+	// 发送 SQE 引用的 msghdr/iovec 与缓冲池槽一一对应，槽在其所有发送完成前不会被复用
+	io_backend_t backend;
+	uring_t ring;
+	uring_bufring_t rxbr;
+	struct msghdr *slot_msgs;
+	struct iovec *slot_iov;
+	uint16_t *slot_sends;  // 每个槽已提交、尚未收到完成事件的 SENDMSG 数
+	uint8_t *slot_held;    // 事务已结束但发送未完成：缓冲暂不还池，最后一个发送完成时归还
+	// CON 请求按结果的往返时延分布与每设备计数
+	coap_metrics_t metrics;
+};
+
+static uint64_t now_tick(const coap_engine_t *eng) {
+	return (coap_mono_us() - eng->origin_us) / eng->conf.timer_tick_us;
+}
+
+static uint64_t us_to_tick(const coap_engine_t *eng, uint64_t mono_us) {
+	return mono_us <= eng->origin_us ? 0 :
+		(mono_us - eng->origin_us + eng->conf.timer_tick_us - 1) / eng->conf.timer_tick_us;
+}
+
+static void on_retx_timer(tw_timer_t *t, void *ctx);
+static void on_send_timer(tw_timer_t *t, void *ctx);
+
+// ---- 设备与事务 ----
+
+static void raise_fd_limit(uint32_t want) {
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) != 0) return;
+	if (rl.rlim_cur >= want) return;
+	rl.rlim_cur = (rl.rlim_max == RLIM_INFINITY || rl.rlim_max >= want) ? want : rl.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &rl);
+}
+
+static void uring_arm_recv(coap_engine_t *eng, uint32_t dev) {
+	struct io_uring_sqe *sqe = uring_get_sqe(&eng->ring);
+	if (!sqe) {
+		uring_submit(&eng->ring, 0, -1);
+		sqe = uring_get_sqe(&eng->ring);
+	}
+	uring_prep_recv_multishot(sqe, eng->devs[dev].sock, eng->rxbr.bgid, dev);
+}
+
+static void uring_queue_send(coap_engine_t *eng, coap_client_t *c, const coap_txn_t *txn) {
+	uint32_t slot = coap_pool_index(&eng->pool, txn->buf);
+	struct msghdr *mh = &eng->slot_msgs[slot];
+	struct iovec *iov = &eng->slot_iov[slot * 3];
+	memset(mh, 0, sizeof(*mh));
+	mh->msg_iov = iov;
+	if (txn->tmpl) {
+		iov[0].iov_base = txn->buf; iov[0].iov_len = COAP_HDR_LEN;
+		iov[1].iov_base = (void*)txn->tmpl->opts; iov[1].iov_len = txn->tmpl->opts_len;
+		iov[2].iov_base = (void*)txn->payload; iov[2].iov_len = txn->payload_len;
+		mh->msg_iovlen = 3;
+	} else {
+		iov[0].iov_base = txn->buf; iov[0].iov_len = txn->len;
+		mh->msg_iovlen = 1;
+	}
+	struct io_uring_sqe *sqe = uring_get_sqe(&eng->ring);
+	if (!sqe) {
+		uring_submit(&eng->ring, 0, -1);
+		sqe = uring_get_sqe(&eng->ring);
+	}
+	// 同一事务的重传可能与上一次发送同时在途：重写的 msghdr 内容不变，按槽计数即可
+	uring_prep_sendmsg(sqe, c->sock, mh, URING_TAG_SEND | slot);
+	eng->slot_sends[slot]++;
+}
+
+// 事务结束时其缓冲若仍被未完成的 SENDMSG 引用：从事务上摘下，留到发送完成事件再还池
+static void uring_hold_buf(coap_engine_t *eng, coap_txn_t *txn) {
+	uint32_t slot = coap_pool_index(&eng->pool, txn->buf);
+	if (!eng->slot_sends[slot]) return;
+	eng->slot_held[slot] = 1;
+	txn->buf = NULL;
+}
+
+static void uring_send_done(coap_engine_t *eng, uint32_t slot) {
+	if (--eng->slot_sends[slot] || !eng->slot_held[slot]) return;
+	eng->slot_held[slot] = 0;
+	coap_pool_free(&eng->pool, eng->pool.slab + (size_t)slot * eng->pool.buf_size);
+}
+
+// 一条共享套接字队列的待发报文用 sendmmsg 发出；发送失败的按丢包处理，CON 由重传定时器兜底
+static void tx_flush_sock(coap_engine_t *eng, uint32_t s) {
+	struct mmsghdr *q = &eng->tx_msgs[(size_t)s * eng->batch];
+	uint32_t n = eng->tx_count[s], k = 0;
+	while (k < n) {
+		int r = sendmmsg(eng->socks[s], &q[k], n - k, 0);
+		eng->stats.send_calls++;
+		if (r <= 0) break; // 缓冲满或 ICMP 错误：余下的等重传
+		eng->stats.sent += (uint64_t)r;
+		k += (uint32_t)r;
+	}
+	eng->tx_pending -= n;
+	eng->tx_count[s] = 0;
+}
+
+static void tx_flush(coap_engine_t *eng) {
+	for (uint32_t s = 0; s < eng->nsocks && eng->tx_pending; ++s) {
+		if (eng->tx_count[s]) tx_flush_sock(eng, s);
+	}
+}
+
+// 报文排入所属共享套接字的队列：CON 引用事务缓冲（ACK 前一直有效），NON 拷贝一份；队列满时先发出
+static int tx_queue(coap_engine_t *eng, const coap_txn_t *txn) {
+	uint32_t s = txn->owner % eng->nsocks;
+	if (eng->tx_count[s] == eng->batch) tx_flush_sock(eng, s);
+	size_t idx = (size_t)s * eng->batch + eng->tx_count[s];
+	struct iovec *iov = &eng->tx_iov[idx * 3];
+	struct msghdr *mh = &eng->tx_msgs[idx].msg_hdr;
+	mh->msg_iov = iov;
+	if (eng->conf.client.msg_type == COAP_TYPE_NON) {
+		uint8_t *dst = eng->tx_copy + idx * COAP_MAX_PKT;
+		size_t len = txn->len;
+		if (txn->tmpl) {
+			len = (size_t)COAP_HDR_LEN + txn->tmpl->opts_len + txn->payload_len;
+			if (len > COAP_MAX_PKT) return -1;
+			memcpy(dst, txn->buf, COAP_HDR_LEN);
+			memcpy(dst + COAP_HDR_LEN, txn->tmpl->opts, txn->tmpl->opts_len);
+			memcpy(dst + COAP_HDR_LEN + txn->tmpl->opts_len, txn->payload, txn->payload_len);
+		} else {
+			memcpy(dst, txn->buf, len);
+		}
+		iov[0].iov_base = dst; iov[0].iov_len = len;
+		mh->msg_iovlen = 1;
+	} else if (txn->tmpl) {
+		iov[0].iov_base = txn->buf; iov[0].iov_len = COAP_HDR_LEN;
+		iov[1].iov_base = (void*)txn->tmpl->opts; iov[1].iov_len = txn->tmpl->opts_len;
+		iov[2].iov_base = (void*)txn->payload; iov[2].iov_len = txn->payload_len;
+		mh->msg_iovlen = 3;
+	} else {
+		iov[0].iov_base = txn->buf; iov[0].iov_len = txn->len;
+		mh->msg_iovlen = 1;
+	}
+	eng->tx_count[s]++;
+	eng->tx_pending++;
+	return 0;
+}
+
+static int txn_send(coap_engine_t *eng, coap_client_t *c, const coap_txn_t *txn) {
+	// NON 发出后立即释放事务，只有 CON 能交给 io_uring 异步发送；批量模式下 NON 拷贝后同样排队
+	if (eng->backend == IO_BACKEND_URING && eng->conf.client.msg_type == COAP_TYPE_CON) {
+		uring_queue_send(eng, c, txn);
+		return 0;
+	}
+	if (eng->batch > 1) return tx_queue(eng, txn);
+	eng->stats.send_calls++;
+	if (coap_client_txn_transmit(c, txn, 1) < 0) return -1;
+	eng->stats.sent++;
+	return 0;
+}
+
+static void txn_complete(coap_engine_t *eng, coap_txn_t *txn, int rc, uint8_t code) {
+	uint32_t dev = txn->owner;
+	uint16_t mid = txn->mid;
+	tw_del(&eng->wheel, &txn->timer);
+	uint64_t now = coap_mono_us();
+	coap_metrics_record(&eng->metrics, dev, coap_outcome_of(rc, code), now - txn->first_send_us, txn->attempt);
+	eng->stats.retransmits_fixed += coap_client_txn_finish(&eng->devs[dev], txn, rc == 0, now);
+	if (eng->backend == IO_BACKEND_URING) uring_hold_buf(eng, txn);
+	coap_client_txn_close(&eng->devs[dev], txn);
+	eng->stats.inflight--;
+	if (rc == 0) eng->stats.completed++;
+	else eng->stats.failed++;
+	if (eng->cb) eng->cb(eng->user, dev, mid, rc, code);
+}
+
+int coap_engine_create(coap_engine_t **out, const coap_engine_conf_t *conf,
+					   coap_engine_done_cb cb, void *user) {
+	if (!out || !conf || conf->device_count == 0) return -1;
+	*out = NULL;
+	coap_engine_t *eng = (coap_engine_t*)calloc(1, sizeof(*eng));
+	if (!eng) return -2;
+	eng->conf = *conf;
+	if (eng->conf.client.nstart == 0) eng->conf.client.nstart = 1;
+	if (eng->conf.max_events == 0) eng->conf.max_events = 1024;
+	if (eng->conf.timer_tick_us == 0) eng->conf.timer_tick_us = 100;
+	eng->batch = eng->conf.batch_size > BATCH_MAX ? BATCH_MAX : eng->conf.batch_size;
+	eng->backend = eng->conf.io_backend;
+	eng->ring.fd = -1;
+	if (eng->backend == IO_BACKEND_URING && !uring_available()) {
+		coap_log_warn("coap_engine: 内核不支持 io_uring，退回套接字后端");
+		eng->backend = IO_BACKEND_SOCKET;
+	}
+	uint64_t max_inflight = (uint64_t)conf->device_count * eng->conf.client.nstart;
+	if (eng->conf.pool_size == 0 || eng->conf.pool_size > max_inflight) eng->conf.pool_size = (uint32_t)max_inflight;
+	eng->cb = cb;
+	eng->user = user;
+	eng->epfd = -1;
+	eng->tfd = -1;
+	eng->origin_us = coap_mono_us();
+	tw_init(&eng->wheel, 0);
+
+	eng->devs = (coap_client_t*)calloc(conf->device_count, sizeof(coap_client_t));
+	eng->events = (struct epoll_event*)malloc(sizeof(struct epoll_event) * eng->conf.max_events);
+	if (!eng->devs || !eng->events || coap_metrics_init(&eng->metrics, conf->device_count) != 0 ||
+		coap_pool_init(&eng->pool, eng->conf.pool_size, COAP_MAX_PKT) != 0) {
+		coap_engine_destroy(eng);
+		return -2;
+	}
+	for (uint32_t i = 0; i < conf->device_count; ++i) eng->devs[i].sock = -1;
+	eng->metrics.start_us = eng->origin_us;
+	eng->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (eng->epfd < 0) { perror("epoll_create1"); coap_engine_destroy(eng); return -3; }
+	eng->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (eng->tfd < 0) { perror("timerfd_create"); coap_engine_destroy(eng); return -3; }
+	{
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.u32 = TIMERFD_ID;
+		if (epoll_ctl(eng->epfd, EPOLL_CTL_ADD, eng->tfd, &ev) != 0) {
+			perror("epoll_ctl");
+			coap_engine_destroy(eng);
+			return -3;
+		}
+	}
+
+	if (eng->backend == IO_BACKEND_URING) {
+		// 缓冲环至少容纳全部在途响应；CQ 需放得下一轮的接收与发送完成
+		uint32_t nbuf = eng->conf.pool_size < 256 ? 256 : eng->conf.pool_size;
+		eng->slot_msgs = (struct msghdr*)calloc(eng->conf.pool_size, sizeof(struct msghdr));
+		eng->slot_iov = (struct iovec*)calloc((size_t)eng->conf.pool_size * 3, sizeof(struct iovec));
+		eng->slot_sends = (uint16_t*)calloc(eng->conf.pool_size, sizeof(uint16_t));
+		eng->slot_held = (uint8_t*)calloc(eng->conf.pool_size, sizeof(uint8_t));
+		if (!eng->slot_msgs || !eng->slot_iov || !eng->slot_sends || !eng->slot_held) { coap_engine_destroy(eng); return -2; }
+		int ur = uring_init(&eng->ring, URING_SQ, 4 * URING_SQ + 2 * (nbuf > 32768 ? 32768 : nbuf));
+		if (ur == 0) ur = uring_bufring_init(&eng->ring, &eng->rxbr, 0, nbuf, COAP_MAX_PKT);
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.u32 = URING_ID;
+		if (ur == 0 && epoll_ctl(eng->epfd, EPOLL_CTL_ADD, eng->ring.fd, &ev) != 0) ur = -errno;
+		if (ur == 0) {
+			eng->batch = 0;
+		} else {
+			// 探测通过但创建失败（如 memlock 限制）：拆掉半成品，按套接字后端继续
+			coap_log_warn("coap_engine: io_uring 初始化失败 (%d)，退回套接字后端", ur);
+			uring_bufring_destroy(&eng->ring, &eng->rxbr);
+			if (eng->ring.fd >= 0) uring_destroy(&eng->ring);
+			free(eng->slot_msgs);
+			free(eng->slot_iov);
+			free(eng->slot_sends);
+			free(eng->slot_held);
+			eng->slot_msgs = NULL;
+			eng->slot_iov = NULL;
+			eng->slot_sends = NULL;
+			eng->slot_held = NULL;
+			eng->backend = IO_BACKEND_SOCKET;
+		}
+	}
+
+	if (eng->batch > 1) {
+		uint32_t b = eng->batch;
+		eng->nsocks = eng->conf.shared_sockets ? eng->conf.shared_sockets : ENGINE_SHARED_SOCKS;
+		if (eng->nsocks > conf->device_count) eng->nsocks = conf->device_count;
+		size_t nq = (size_t)eng->nsocks * b;
+		eng->socks = (int*)malloc(eng->nsocks * sizeof(int));
+		eng->rx_msgs = (struct mmsghdr*)calloc(b, sizeof(struct mmsghdr));
+		eng->rx_iov = (struct iovec*)calloc(b, sizeof(struct iovec));
+		eng->rx_addrs = (struct sockaddr_in*)calloc(b, sizeof(struct sockaddr_in));
+		eng->rx_bufs = (uint8_t*)malloc((size_t)b * COAP_MAX_PKT);
+		eng->tx_msgs = (struct mmsghdr*)calloc(nq, sizeof(struct mmsghdr));
+		eng->tx_iov = (struct iovec*)calloc(nq * 3, sizeof(struct iovec));
+		eng->tx_count = (uint32_t*)calloc(eng->nsocks, sizeof(uint32_t));
+		if (eng->conf.client.msg_type == COAP_TYPE_NON) eng->tx_copy = (uint8_t*)malloc(nq * COAP_MAX_PKT);
+		if (eng->socks) for (uint32_t s = 0; s < eng->nsocks; ++s) eng->socks[s] = -1;
+		if (!eng->socks || !eng->rx_msgs || !eng->rx_iov || !eng->rx_addrs || !eng->rx_bufs || !eng->tx_msgs ||
+			!eng->tx_iov || !eng->tx_count || (eng->conf.client.msg_type == COAP_TYPE_NON && !eng->tx_copy)) {
+			coap_engine_destroy(eng);
+			return -2;
+		}
+		for (uint32_t i = 0; i < b; ++i) {
+			eng->rx_iov[i].iov_base = eng->rx_bufs + (size_t)i * COAP_MAX_PKT;
+			eng->rx_iov[i].iov_len = COAP_MAX_PKT;
+			eng->rx_msgs[i].msg_hdr.msg_iov = &eng->rx_iov[i];
+			eng->rx_msgs[i].msg_hdr.msg_iovlen = 1;
+			eng->rx_msgs[i].msg_hdr.msg_name = &eng->rx_addrs[i];
+		}
+	}
+
+	if (eng->batch > 1) {
+		// 共享套接字不 connect：所有设备的报文都发往同一服务端，每条 mmsghdr 带上服务端地址
+		for (uint32_t s = 0; s < eng->nsocks; ++s) {
+			int sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+			eng->socks[s] = sock;
+			if (sock < 0) { perror("socket"); coap_engine_destroy(eng); return -4; }
+			int rcvbuf = ENGINE_SHARED_RCVBUF;
+			setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+			struct epoll_event ev;
+			ev.events = EPOLLIN;
+			ev.data.u32 = s;
+			if (epoll_ctl(eng->epfd, EPOLL_CTL_ADD, sock, &ev) != 0) {
+				perror("epoll_ctl");
+				coap_engine_destroy(eng);
+				return -3;
+			}
+		}
+		for (uint32_t i = 0; i < conf->device_count; ++i) {
+			if (coap_client_init_shared(&eng->devs[i], &eng->conf.client, &eng->pool, eng->socks[i % eng->nsocks], i) != 0) {
+				coap_engine_destroy(eng);
+				return -4;
+			}
+		}
+		struct sockaddr_in *to = &eng->devs[0].server_addr;
+		for (size_t k = 0; k < (size_t)eng->nsocks * eng->batch; ++k) {
+			eng->tx_msgs[k].msg_hdr.msg_name = to;
+			eng->tx_msgs[k].msg_hdr.msg_namelen = sizeof(*to);
+		}
+		*out = eng;
+		return 0;
+	}
+
+	raise_fd_limit(conf->device_count + 64);
+	for (uint32_t i = 0; i < conf->device_count; ++i) {
+		coap_client_t *c = &eng->devs[i];
+		if (coap_client_init_with_pool(c, &eng->conf.client, &eng->pool) != 0) {
+			coap_engine_destroy(eng);
+			return -4;
+		}
+		// 连接到服务端：内核只投递来自服务端的报文，send 也无需每次带地址
+		if (connect(c->sock, (struct sockaddr*)&c->server_addr, sizeof(c->server_addr)) != 0 ||
+			fcntl(c->sock, F_SETFL, fcntl(c->sock, F_GETFL, 0) | O_NONBLOCK) != 0) {
+			perror("connect");
+			coap_engine_destroy(eng);
+			return -4;
+		}
+		if (eng->backend == IO_BACKEND_URING) {
+			uring_arm_recv(eng, i);
+			continue;
+		}
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.u32 = i;
+		if (epoll_ctl(eng->epfd, EPOLL_CTL_ADD, c->sock, &ev) != 0) {
+			perror("epoll_ctl");
+			coap_engine_destroy(eng);
+			return -3;
+		}
+	}
+	if (eng->backend == IO_BACKEND_URING) uring_submit(&eng->ring, 0, -1);
+	*out = eng;
+	return 0;
+}
+
+void coap_engine_destroy(coap_engine_t *eng) {
+	if (!eng) return;
+	if (eng->ring.fd >= 0) {
+		// 先拆环：撤销常驻接收并释放内核对套接字的引用
+		uring_bufring_destroy(&eng->ring, &eng->rxbr);
+		uring_destroy(&eng->ring);
+	}
+	if (eng->tx_pending) tx_flush(eng); // NON 入队即算完成，销毁前发出
+	if (eng->devs) {
+		for (uint32_t i = 0; i < eng->conf.device_count; ++i) coap_client_close(&eng->devs[i]);
+	}
+	if (eng->socks) {
+		for (uint32_t s = 0; s < eng->nsocks; ++s) if (eng->socks[s] >= 0) close(eng->socks[s]);
+	}
+	if (eng->epfd >= 0) close(eng->epfd);
+	if (eng->tfd >= 0) close(eng->tfd);
+	coap_pool_destroy(&eng->pool);
+	coap_metrics_destroy(&eng->metrics);
+	free(eng->devs);
+	free(eng->events);
+	free(eng->send_timers);
+	free(eng->tstates);
+	free(eng->planned_us);
+	free(eng->socks);
+	free(eng->rx_msgs);
+	free(eng->rx_iov);
+	free(eng->rx_addrs);
+	free(eng->rx_bufs);
+	free(eng->tx_msgs);
+	free(eng->tx_iov);
+	free(eng->tx_copy);
+	free(eng->tx_count);
+	free(eng->slot_msgs);
+	free(eng->slot_iov);
+	free(eng->slot_sends);
+	free(eng->slot_held);
+	free(eng);
+}
+
+// 发送已编码的事务：CON 进入时间轮等待 ACK，NON 立即完成
+static int txn_submit(coap_engine_t *eng, uint32_t device, coap_txn_t *txn) {
+	coap_client_t *c = &eng->devs[device];
+	eng->stats.submitted++;
+	uint64_t now_us = coap_mono_us();
+	if (eng->conf.client.msg_type == COAP_TYPE_CON) coap_client_txn_arm(c, txn, now_us);
+	if (txn_send(eng, c, txn) != 0) {
+		coap_client_txn_close(c, txn);
+		eng->stats.failed++;
+		return -4;
+	}
+	if (eng->conf.client.msg_type == COAP_TYPE_NON) {
+		uint16_t mid = txn->mid;
+		coap_client_txn_close(c, txn);
+		eng->stats.completed++;
+		if (eng->cb) eng->cb(eng->user, device, mid, 0, 0);
+		return 0;
+	}
+	eng->stats.inflight++;
+	tw_add(&eng->wheel, &txn->timer, us_to_tick(eng, now_us + (uint64_t)txn->wait_ms * 1000u));
+	return 0;
+}
+
+static coap_txn_t *txn_begin(coap_engine_t *eng, uint32_t device) {
+	coap_txn_t *txn = coap_client_txn_open(&eng->devs[device]);
+	if (!txn) {
+		eng->stats.backpressure++;
+		return NULL;
+	}
+	txn->owner = device;
+	tw_timer_init(&txn->timer, on_retx_timer);
+	return txn;
+}
+
+int coap_engine_post_json(
+	coap_engine_t *eng,
+	uint32_t device,
+	const char *uri_host,
+	const char *uri_path,
+	const char *uri_query,
+	const char *json_payload,
+	uint16_t *out_message_id
+) {
+	if (!eng || device >= eng->conf.device_count || !json_payload) return -1;
+	if (eng->conf.client.net_mode == NETWORK_DOWN) return -1;
+	coap_txn_t *txn = txn_begin(eng, device);
+	if (!txn) return -3;
+	int n = coap_client_encode_post(&eng->devs[device], txn, uri_host, uri_path, uri_query,
+		(const uint8_t*)json_payload, strlen(json_payload));
+	if (out_message_id) *out_message_id = txn->mid;
+	if (n < 0) {
+		coap_client_txn_close(&eng->devs[device], txn);
+		return -2;
+	}
+	return txn_submit(eng, device, txn);
+}
+
+int coap_engine_post_tmpl(
+	coap_engine_t *eng,
+	uint32_t device,
+	const coap_tmpl_t *tmpl,
+	const uint8_t *payload,
+	size_t payload_len,
+	uint16_t *out_message_id
+) {
+	if (!eng || device >= eng->conf.device_count || !tmpl || (!payload && payload_len)) return -1;
+	if (eng->conf.client.net_mode == NETWORK_DOWN) return -1;
+	const aes128_key_t *key = eng->devs[device].conf.payload_key;
+	if ((size_t)COAP_HDR_LEN + (key ? aes128_cbc_padded_len(payload_len) : payload_len) > eng->pool.buf_size) return -2;
+	coap_txn_t *txn = txn_begin(eng, device);
+	if (!txn) return -3;
+	// 异步发送需在重传期间持有负载：放在事务缓冲头部之后，选项仍直接引用模板；
+	// 加密时由 prepare 直接把密文写到该位置，省去一次明文拷贝
+	uint8_t *body = txn->buf + COAP_HDR_LEN;
+	if (payload_len && !key) memcpy(body, payload, payload_len);
+	int n = coap_client_txn_prepare_tmpl(&eng->devs[device], txn, tmpl, key ? payload : body, payload_len);
+	if (out_message_id) *out_message_id = txn->mid;
+	if (n < 0) {
+		coap_client_txn_close(&eng->devs[device], txn);
+		return -2;
+	}
+	return txn_submit(eng, device, txn);
+}
+
+static int dev_reply(coap_engine_t *eng, coap_client_t *c, const uint8_t *buf, size_t len) {
+	eng->stats.recv_datagrams++;
+	if (eng->conf.client.net_mode == NETWORK_TIMEOUT) return 0; // 模拟响应丢失
+	uint8_t type = 0, code = 0;
+	coap_txn_t *txn = coap_client_match_reply(c, buf, len, &type, &code);
+	if (!txn) {
+		if (eng->conf.client.msg_type == COAP_TYPE_CON) eng->stats.stray++;
+		return 0;
+	}
+	txn_complete(eng, txn, 0, code);
+	return 1;
+}
+
+// 读空一个共享套接字：只接受来自服务端的报文，按 Token 高 32 位交给对应设备；
+// 无 8 字节 Token（如空 RST）或设备不属于该套接字的报文无法归属，按无主响应计
+static int sock_drain(coap_engine_t *eng, uint32_t s) {
+	const struct sockaddr_in *srv = &eng->devs[0].server_addr;
+	int done = 0;
+	for (;;) {
+		for (uint32_t i = 0; i < eng->batch; ++i) eng->rx_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		int n = recvmmsg(eng->socks[s], eng->rx_msgs, eng->batch, MSG_DONTWAIT, NULL);
+		eng->stats.recv_calls++;
+		if (n <= 0) break;
+		for (int i = 0; i < n; ++i) {
+			const uint8_t *buf = eng->rx_bufs + (size_t)i * COAP_MAX_PKT;
+			uint32_t len = eng->rx_msgs[i].msg_len;
+			if (eng->rx_addrs[i].sin_addr.s_addr != srv->sin_addr.s_addr || eng->rx_addrs[i].sin_port != srv->sin_port) continue;
+			uint32_t dev = len >= COAP_HDR_LEN && (buf[0] & 0x0F) == COAP_TOKEN_LEN ?
+				((uint32_t)buf[4] << 24) | ((uint32_t)buf[5] << 16) | ((uint32_t)buf[6] << 8) | buf[7] : UINT32_MAX;
+			if (dev >= eng->conf.device_count || dev % eng->nsocks != s) {
+				eng->stats.recv_datagrams++;
+				if (eng->conf.client.msg_type == COAP_TYPE_CON) eng->stats.stray++;
+				continue;
+			}
+			done += dev_reply(eng, &eng->devs[dev], buf, len);
+		}
+		// 不足一批说明已读空；epoll 为水平触发，漏读的下一轮还会通知，省掉一次返回 EAGAIN 的调用
+		if ((uint32_t)n < eng->batch) break;
+	}
+	return done;
+}
+
+// 读空一个设备套接字上的所有响应
+static int dev_drain(coap_engine_t *eng, uint32_t idx) {
+	coap_client_t *c = &eng->devs[idx];
+	int done = 0;
+	uint8_t rbuf[COAP_MAX_PKT];
+	for (;;) {
+		ssize_t r = recv(c->sock, rbuf, sizeof(rbuf), 0);
+		eng->stats.recv_calls++;
+		if (r < 0) break; // EAGAIN 或 ICMP 错误，留给定时器处理
+		done += dev_reply(eng, c, rbuf, (size_t)r);
+	}
+	return done;
+}
+
+// 收割 io_uring 完成事件：设备接收交给响应匹配，用完的缓冲还回缓冲环；multishot 终止（缓冲耗尽等）时重新挂上
+static int uring_reap(coap_engine_t *eng) {
+	int done = 0;
+	struct io_uring_cqe *cqe;
+	while ((cqe = uring_peek_cqe(&eng->ring)) != NULL) {
+		uint64_t ud = cqe->user_data;
+		int32_t res = cqe->res;
+		uint32_t flags = cqe->flags;
+		uring_cqe_seen(&eng->ring);
+		if (ud & URING_TAG_SEND) {
+			if (res >= 0) eng->stats.sent++; // 失败按丢包处理，由重传定时器兜底
+			uring_send_done(eng, (uint32_t)ud);
+			continue;
+		}
+		uint32_t dev = (uint32_t)ud;
+		if (flags & IORING_CQE_F_BUFFER) {
+			uint16_t bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+			if (res > 0) done += dev_reply(eng, &eng->devs[dev], uring_buf_addr(&eng->rxbr, bid), (size_t)res);
+			uring_buf_recycle(&eng->rxbr, bid);
+		}
+		if (!(flags & IORING_CQE_F_MORE)) uring_arm_recv(eng, dev);
+	}
+	return done;
+}
+
+// 重传定时器到期：未达上限则重发并按 RTO 策略退避，否则放弃
+static void on_retx_timer(tw_timer_t *t, void *ctx) {
+	coap_engine_t *eng = (coap_engine_t*)ctx;
+	coap_txn_t *txn = (coap_txn_t*)((char*)t - offsetof(coap_txn_t, timer));
+	if (txn->attempt >= eng->conf.client.max_retransmit) {
+		txn_complete(eng, txn, -3, 0); // 放弃
+		eng->fired_done++;
+		return;
+	}
+	txn->attempt++;
+	txn->wait_ms = coap_rto_backoff(&eng->devs[txn->owner].rto, txn->wait_ms);
+	eng->stats.retransmits++;
+	txn_send(eng, &eng->devs[txn->owner], txn); // 发送失败同样等待下一次超时
+	tw_add(&eng->wheel, &txn->timer, us_to_tick(eng, coap_mono_us() + (uint64_t)txn->wait_ms * 1000u));
+}
+
+// 开环发送定时器到期：按计划发送一条，并以计划时刻（而不是当前时刻）为基准排下一次
+static void on_send_timer(tw_timer_t *t, void *ctx) {
+	coap_engine_t *eng = (coap_engine_t*)ctx;
+	uint32_t dev = (uint32_t)(t - eng->send_timers);
+	uint64_t planned = eng->planned_us[dev];
+	uint64_t now = coap_mono_us();
+	uint64_t lag = now > planned ? now - planned : 0;
+	eng->stats.sched_fired++;
+	eng->stats.sched_lag_sum_us += lag;
+	if (lag > eng->stats.sched_lag_max_us) eng->stats.sched_lag_max_us = lag;
+
+	uint8_t payload[COAP_MAX_PKT];
+	int plen = eng->traffic.fill(eng->traffic.fill_user, dev, payload, sizeof(payload));
+	if (plen >= 0) {
+		const coap_tmpl_t *tmpl = eng->traffic.tmpls ? &eng->traffic.tmpls[dev % eng->traffic.tmpl_count] : &eng->traffic_tmpl;
+		if (coap_engine_post_tmpl(eng, dev, tmpl, payload, (size_t)plen, NULL) != 0) {
+			eng->stats.sched_skipped++;
+		}
+	}
+	planned += traffic_next_interval_us(&eng->traffic.traffic, &eng->tstates[dev]);
+	eng->planned_us[dev] = planned;
+	tw_add(&eng->wheel, t, us_to_tick(eng, planned));
+}
+
+int coap_engine_start_traffic(coap_engine_t *eng, const coap_engine_traffic_t *tr) {
+	if (!eng || !tr || !tr->fill || tr->traffic.rate_hz <= 0.0 || (tr->tmpls && !tr->tmpl_count)) return -1;
+	uint32_t n = eng->conf.device_count;
+	if (!eng->send_timers) {
+		eng->send_timers = (tw_timer_t*)calloc(n, sizeof(tw_timer_t));
+		eng->tstates = (traffic_state_t*)calloc(n, sizeof(traffic_state_t));
+		eng->planned_us = (uint64_t*)calloc(n, sizeof(uint64_t));
+		if (!eng->send_timers || !eng->tstates || !eng->planned_us) return -2;
+	} else {
+		coap_engine_stop_traffic(eng);
+	}
+	eng->traffic = *tr;
+	if (!tr->tmpls && coap_tmpl_build_cf(&eng->traffic_tmpl, eng->conf.client.msg_type, tr->uri_host, tr->uri_path, tr->uri_query,
+			coap_client_content_format(&eng->conf.client)) != 0) return -1;
+	uint64_t now = coap_mono_us();
+	uint64_t seed = now;
+	for (uint32_t i = 0; i < n; ++i) {
+		seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+		traffic_state_init(&eng->tstates[i], seed ^ ((uint64_t)i << 32));
+		eng->planned_us[i] = now + traffic_first_offset_us(&tr->traffic, &eng->tstates[i]);
+		tw_timer_init(&eng->send_timers[i], on_send_timer);
+		tw_add(&eng->wheel, &eng->send_timers[i], us_to_tick(eng, eng->planned_us[i]));
+	}
+	return 0;
+}
+
+void coap_engine_stop_traffic(coap_engine_t *eng) {
+	if (!eng || !eng->send_timers) return;
+	for (uint32_t i = 0; i < eng->conf.device_count; ++i) tw_del(&eng->wheel, &eng->send_timers[i]);
+}
+
+// 把 timerfd 设到时间轮下一次到期的时刻；返回到期前还需等待的 tick 数（0 表示已有到期）
+static uint64_t arm_timerfd(coap_engine_t *eng, uint64_t now) {
+	uint64_t next = tw_next_expiry(&eng->wheel);
+	if (next == UINT64_MAX) return UINT64_MAX;
+	if (next <= now) return 0;
+	if (next != eng->tfd_armed) {
+		uint64_t at = eng->origin_us + next * eng->conf.timer_tick_us;
+		struct itimerspec its;
+		memset(&its, 0, sizeof(its));
+		its.it_value.tv_sec = (time_t)(at / 1000000u);
+		its.it_value.tv_nsec = (long)(at % 1000000u) * 1000L;
+		timerfd_settime(eng->tfd, TFD_TIMER_ABSTIME, &its, NULL);
+		eng->tfd_armed = next;
+	}
+	return next - now;
+}
+
+int coap_engine_poll(coap_engine_t *eng, int max_wait_ms) {
+	if (!eng) return -1;
+	if (eng->tx_pending) tx_flush(eng);
+	if (eng->backend == IO_BACKEND_URING && uring_sq_pending(&eng->ring)) uring_submit(&eng->ring, 0, -1);
+	int timeout = max_wait_ms;
+	if (arm_timerfd(eng, now_tick(eng)) == 0) timeout = 0;
+	int n = epoll_wait(eng->epfd, eng->events, (int)eng->conf.max_events, timeout);
+	if (n < 0 && errno != EINTR) { perror("epoll_wait"); return -1; }
+	int done = 0;
+	for (int i = 0; i < n; ++i) {
+		uint32_t id = eng->events[i].data.u32;
+		if (id == TIMERFD_ID) {
+			uint64_t expirations;
+			if (read(eng->tfd, &expirations, sizeof(expirations)) < 0) { /* 已被读空 */ }
+			eng->tfd_armed = 0;
+			continue;
+		}
+		if (id == URING_ID) {
+			done += uring_reap(eng);
+			continue;
+		}
+		done += eng->batch > 1 ? sock_drain(eng, id) : dev_drain(eng, id);
+	}
+	eng->fired_done = 0;
+	tw_advance(&eng->wheel, now_tick(eng), eng);
+	if (eng->tx_pending) tx_flush(eng);
+	if (eng->backend == IO_BACKEND_URING && uring_sq_pending(&eng->ring)) uring_submit(&eng->ring, 0, -1);
+	return done + eng->fired_done;
+}
+
+void coap_engine_get_stats(const coap_engine_t *eng, coap_engine_stats_t *out) {
+	if (!eng || !out) return;
+	*out = eng->stats;
+	out->uring_enters = eng->ring.enters;
+}
+
+io_backend_t coap_engine_io_backend(const coap_engine_t *eng) {
+	return eng ? eng->backend : IO_BACKEND_SOCKET;
+}
+
+int coap_engine_set_payload_key(coap_engine_t *eng, uint32_t device, const aes128_key_t *key) {
+	if (!eng || device >= eng->conf.device_count || eng->devs[device].txn_count) return -1;
+	eng->devs[device].conf.payload_key = key;
+	return 0;
+}
+
+uint64_t coap_engine_latency_us(const coap_engine_t *eng, double q) {
+	return eng ? coap_hist_quantile(&eng->metrics.t.rtt[COAP_OUTCOME_OK], q) : 0;
+}
+
+void coap_engine_reset_latency(coap_engine_t *eng) {
+	if (!eng) return;
+	coap_metrics_reset(&eng->metrics);
+	eng->metrics.start_us = coap_mono_us();
+}
+
+const coap_metrics_t *coap_engine_metrics(const coap_engine_t *eng) {
+	return eng ? &eng->metrics : NULL;
+}
+
+#else // !__linux__
+
+int coap_engine_create(coap_engine_t **out, const coap_engine_conf_t *conf,
+					   coap_engine_done_cb cb, void *user) {
+	(void)conf; (void)cb; (void)user;
+	if (out) *out = NULL;
+	coap_log_error("coap_engine: 当前平台不支持 epoll");
+	return -5;
+}
+
+void coap_engine_destroy(coap_engine_t *eng) { (void)eng; }
+
+int coap_engine_post_json(coap_engine_t *eng, uint32_t device, const char *uri_host,
+	const char *uri_path, const char *uri_query, const char *json_payload, uint16_t *out_message_id) {
+	(void)eng; (void)device; (void)uri_host; (void)uri_path; (void)uri_query; (void)json_payload; (void)out_message_id;
+	return -1;
+}
+
+int coap_engine_post_tmpl(coap_engine_t *eng, uint32_t device, const coap_tmpl_t *tmpl,
+	const uint8_t *payload, size_t payload_len, uint16_t *out_message_id) {
+	(void)eng; (void)device; (void)tmpl; (void)payload; (void)payload_len; (void)out_message_id;
+	return -1;
+}
+
+int coap_engine_start_traffic(coap_engine_t *eng, const coap_engine_traffic_t *tr) { (void)eng; (void)tr; return -1; }
+
+void coap_engine_stop_traffic(coap_engine_t *eng) { (void)eng; }
+
+int coap_engine_poll(coap_engine_t *eng, int max_wait_ms) { (void)eng; (void)max_wait_ms; return -1; }
+
+void coap_engine_get_stats(const coap_engine_t *eng, coap_engine_stats_t *out) {
+	(void)eng;
+	if (out) memset(out, 0, sizeof(*out));
+}
+
+io_backend_t coap_engine_io_backend(const coap_engine_t *eng) { (void)eng; return IO_BACKEND_SOCKET; }
+
+int coap_engine_set_payload_key(coap_engine_t *eng, uint32_t device, const aes128_key_t *key) {
+	(void)eng; (void)device; (void)key;
+	return -1;
+}
+
+uint64_t coap_engine_latency_us(const coap_engine_t *eng, double q) { (void)eng; (void)q; return 0; }
+
+void coap_engine_reset_latency(coap_engine_t *eng) { (void)eng; }
+
+const coap_metrics_t *coap_engine_metrics(const coap_engine_t *eng) { (void)eng; return NULL; }
+
+#endif // __linux__
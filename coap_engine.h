@@ -0,0 +1,136 @@
+// coap_engine.h
+// 事件驱动的多设备 CoAP 客户端引擎：单进程内模拟大量设备
+// 每个设备拥有独立的 UDP 套接字、MID 空间与事务表（每设备最多 NSTART 个在途 CON），
+// 批量模式下设备改为分组共用少量未连接套接字，以便一次 sendmmsg 合并不同设备的报文；
+// 所有套接字挂在一个 epoll 上，报文缓冲来自全引擎共享的预分配缓冲池，
+// CON 重传由定时器事件驱动而不是阻塞等待，可同时保持成千上万个在途事务；
+// 可选的开环调度按流量模型为每个设备定时发送，发送计划与重传共用一个分层时间轮
+// 仅支持 Linux（epoll），其他平台上 coap_engine_create 返回失败
+
+#ifndef COAP_ENGINE_H
+#define COAP_ENGINE_H
+
+#include "coap_client.h"
+#include "traffic_sched.h"
+#include "uring_io.h"
+#include "coap_metrics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct coap_engine coap_engine_t;
+
+typedef struct {
+	coap_client_conf_t client; // 所有设备共用的客户端配置（服务端地址、CON/NON、超时、重传、网络模拟）
+	uint32_t device_count;     // 模拟设备数
+	uint32_t max_events;       // 单次 epoll_wait 处理的事件上限，0 表示默认 1024
+	uint32_t pool_size;        // 报文缓冲池容量，0 表示 device_count * nstart
+	uint32_t timer_tick_us;    // 时间轮 tick 长度（us），0 表示默认 100us
+	uint32_t batch_size;       // >1 时收包用 recvmmsg、发包攒批后用 sendmmsg，每次最多 batch_size 条；0/1 为逐包收发
+	uint32_t shared_sockets;   // 批量模式下设备共用的未连接套接字数（设备按下标轮流分配），0 表示默认 64，不超过设备数；
+	                           // 每个套接字的接收缓冲须放得下其设备一轮在途请求的响应（设备数/套接字数 × NSTART），否则丢包转为重传
+	io_backend_t io_backend;   // IO_BACKEND_URING 时收发走 io_uring，batch_size 不再生效（内核不支持或环创建失败时退回套接字）
+} coap_engine_conf_t;
+
+typedef struct {
+	uint64_t submitted;   // 提交的请求数
+	uint64_t sent;        // 发出的报文数（含重传）
+	uint64_t retransmits; // 重传次数
+	uint64_t retransmits_fixed; // 同样的 RTT 下固定重传策略估计会产生的重传次数（对比自适应 RTO 的节省）
+	uint64_t completed;   // 收到响应的请求数
+	uint64_t failed;      // 失败的请求数（超时放弃/发送错误）
+	uint64_t stray;       // 无法匹配在途事务的响应
+	uint64_t backpressure; // 因在途数达 NSTART 或缓冲池耗尽而拒绝的提交
+	uint32_t inflight;    // 当前在途 CON 数
+	uint64_t sched_fired;   // 开环调度触发的发送次数
+	uint64_t sched_skipped; // 触发时因在途窗口已满/提交失败而跳过的次数（按计划计入，不顺延）
+	uint64_t sched_lag_sum_us; // 实际触发相对计划时刻的累计滞后
+	uint64_t sched_lag_max_us; // 最大滞后
+	uint64_t recv_calls;  // 收包系统调用次数（recv/recvmmsg，含读空时返回 EAGAIN 的一次）
+	uint64_t recv_datagrams; // 收到的报文数
+	uint64_t send_calls;  // 发包系统调用次数（sendmsg/sendmmsg）
+	uint64_t uring_enters; // io_uring 后端的 io_uring_enter 调用次数（收发合计）
+} coap_engine_stats_t;
+
+// 请求完成回调：rc 含义同 coap_client_post_json（0 成功，<0 失败），code 为响应码（rc==0 时有效）
+typedef void (*coap_engine_done_cb)(void *user, uint32_t device, uint16_t mid, int rc, uint8_t code);
+
+// 创建/销毁引擎；创建时为每个设备建立非阻塞套接字（批量模式下只建 shared_sockets 个共享套接字），必要时提升进程文件描述符上限
+// 返回 0 成功；-1 参数错误；-2 内存不足；-3 epoll 失败；-4 套接字创建失败；-5 平台不支持
+int coap_engine_create(coap_engine_t **out, const coap_engine_conf_t *conf,
+					   coap_engine_done_cb cb, void *user);
+void coap_engine_destroy(coap_engine_t *eng);
+
+// 非阻塞提交一条 JSON POST：编码后立即发送，CON 进入在途表等待 ACK 或定时重传，NON 立即完成
+// 返回 0 成功；-1 参数错误或网络中断；-2 编码失败；-3 该设备在途数已达 NSTART 或缓冲池耗尽；-4 发送失败
+int coap_engine_post_json(
+	coap_engine_t *eng,
+	uint32_t device,
+	const char *uri_host,
+	const char *uri_path,
+	const char *uri_query,
+	const char *json_payload,
+	uint16_t *out_message_id
+);
+
+// 使用预编译模板非阻塞提交：选项不再编码，负载拷入事务缓冲（重传期间需持有），
+// 发送时以 {头部, 模板选项, 负载} 三段 iovec 交给内核；模板须在事务结束前保持有效
+// 返回值同 coap_engine_post_json
+int coap_engine_post_tmpl(
+	coap_engine_t *eng,
+	uint32_t device,
+	const coap_tmpl_t *tmpl,
+	const uint8_t *payload,
+	size_t payload_len,
+	uint16_t *out_message_id
+);
+
+// 开环调度触发时生成负载：写入 payload（编码与 Content-Format 一致），返回负载字节数，<0 表示本次不发
+typedef int (*coap_engine_fill_cb)(void *user, uint32_t device, uint8_t *payload, size_t cap);
+
+typedef struct {
+	traffic_conf_t traffic;    // 流量模型
+	char uri_host[64];
+	char uri_path[64];
+	char uri_query[128];
+	coap_engine_fill_cb fill;
+	void *fill_user;
+	const coap_tmpl_t *tmpls;  // 非 NULL 时设备 d 用 tmpls[d % tmpl_count] 发送（如各设备 Token 不同），不再按 uri_* 构建；须在调度期间有效
+	uint32_t tmpl_count;
+} coap_engine_traffic_t;
+
+// 启动开环调度（未给出 tmpls 时按 uri_* 构建一个共用请求模板）：每个设备按流量模型在计划时刻发送，不等待之前的响应；计划时刻只按模型累加，
+// 事件循环滞后时照常补发并记入滞后统计。由 coap_engine_poll 驱动。返回 0 成功，<0 失败
+int coap_engine_start_traffic(coap_engine_t *eng, const coap_engine_traffic_t *tr);
+void coap_engine_stop_traffic(coap_engine_t *eng);
+
+// 处理一轮套接字事件与到期的定时器（重传与开环发送），最多阻塞 max_wait_ms（-1 表示直到有事件或定时器到期）
+// 批量模式下进入等待前及处理完定时器后都会发出攒批中的报文（某个共享套接字的队列攒满时也会立即发出）；
+// NON 入队即算完成，提交后须再调用一次本函数（或销毁引擎）才会真正发出
+// 返回本轮完成的请求数，<0 表示错误
+int coap_engine_poll(coap_engine_t *eng, int max_wait_ms);
+
+// 读取统计计数
+void coap_engine_get_stats(const coap_engine_t *eng, coap_engine_stats_t *out);
+
+// 实际使用的收发后端（请求 io_uring 但不可用时为 IO_BACKEND_SOCKET）
+io_backend_t coap_engine_io_backend(const coap_engine_t *eng);
+
+// 为单个设备换用负载加密密钥（各设备握手得到的会话密钥不同），覆盖 conf.client.payload_key；
+// key 须在引擎存续期间有效，模板的 Content-Format 须与是否加密一致。设备有在途请求时返回 -1
+int coap_engine_set_payload_key(coap_engine_t *eng, uint32_t device, const aes128_key_t *key);
+
+// 成功 CON 的往返时延（首次发送到收到响应）分位数（us），q 取 0..1；按对数线性分桶，相对误差约 1.6%
+uint64_t coap_engine_latency_us(const coap_engine_t *eng, double q);
+// 清空请求统计（时延直方图与每设备计数），统计时长从此刻算起
+void coap_engine_reset_latency(coap_engine_t *eng);
+
+// CON 请求按结果（成功、4.01、其他错误、超时放弃）的往返时延直方图与每设备计数，只在驱动引擎的线程读取；平台不支持时为 NULL
+const coap_metrics_t *coap_engine_metrics(const coap_engine_t *eng);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COAP_ENGINE_H
@@ -0,0 +1,377 @@
+// coap_log.c
+#include "coap_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#endif
+
+#define LOG_RING_DEFAULT (256u << 10)
+#define LOG_REC_ALIGN 16u
+#define LOG_OUT_BUF (64u << 10)
+#define LOG_QUIESCE_MS 100 // 停止时等待正在压入的线程离开的上限，超时则不释放环
+
+// 环内记录：头部之后是正文（不含结尾 '\0'），整条按 16 字节对齐；skip 非 0 表示环尾的填充，读到后跳回环首
+typedef struct {
+	uint16_t len;
+	uint8_t level;
+	uint8_t skip;
+	uint32_t reserved;
+	uint64_t t_ms;
+} log_rec_t;
+
+// 单生产者单消费者字节环：head 只由所属线程写，tail 只由写线程写，两者分在不同缓存行；均为不回绕的字节计数
+typedef struct {
+	uint8_t *buf;
+	uint32_t size;
+	char pad0[64];
+	uint32_t head;
+	uint64_t written;
+	uint64_t dropped;
+	char pad1[64];
+	uint32_t tail;
+	char pad2[64];
+} log_ring_t;
+
+// ---- 平台相关：原子、线程、时钟 ----
+
+#ifdef _MSC_VER
+#define LOG_TLS __declspec(thread)
+static uint32_t load_acquire(const uint32_t *p) {
+	uint32_t v = *(const volatile uint32_t*)p;
+	MemoryBarrier();
+	return v;
+}
+static void store_release(uint32_t *p, uint32_t v) {
+	MemoryBarrier();
+	*(volatile uint32_t*)p = v;
+}
+static uint64_t load64(const uint64_t *p) { return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)p, 0, 0); }
+static void store64(uint64_t *p, uint64_t v) { InterlockedExchange64((volatile LONG64*)p, (LONG64)v); }
+static uint32_t fetch_add(uint32_t *p, uint32_t v) { return (uint32_t)InterlockedExchangeAdd((volatile LONG*)p, (LONG)v); }
+#else
+#define LOG_TLS __thread
+static uint32_t load_acquire(const uint32_t *p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static void store_release(uint32_t *p, uint32_t v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+static uint64_t load64(const uint64_t *p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static void store64(uint64_t *p, uint64_t v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+static uint32_t fetch_add(uint32_t *p, uint32_t v) { return __atomic_fetch_add(p, v, __ATOMIC_ACQ_REL); }
+#endif
+
+static uint64_t wall_ms(void) {
+#ifdef _WIN32
+	FILETIME ft;
+	GetSystemTimeAsFileTime(&ft);
+	uint64_t t = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime; // 1601 年起的 100 ns
+	return t / 10000u - 11644473600000ull;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+#endif
+}
+
+static void sleep_1ms(void) {
+#ifdef _WIN32
+	Sleep(1);
+#else
+	struct timespec ts = {0, 1000000L};
+	nanosleep(&ts, NULL);
+#endif
+}
+
+static void format_ts(uint64_t t_ms, char *out, size_t cap) {
+	time_t t = (time_t)(t_ms / 1000u);
+	struct tm tmv;
+#ifdef _WIN32
+	localtime_s(&tmv, &t);
+#else
+	localtime_r(&t, &tmv);
+#endif
+	strftime(out, cap, "%Y-%m-%d %H:%M:%S", &tmv);
+}
+
+// ---- 全局状态 ----
+
+static log_ring_t *g_rings[COAP_LOG_RINGS_MAX];
+static uint32_t g_nrings;       // 已分配的环槽（可能超过上限，超出的线程同步写出）
+static uint32_t g_gen;          // 每次启动加一，线程据此发现自己的环已随上次停止释放
+static uint32_t g_ring_bytes = LOG_RING_DEFAULT;
+static volatile int g_level = COAP_LOG_INFO;
+static volatile uint32_t g_sample = 1;
+static volatile int g_running;
+static uint32_t g_active;       // 正在取环或压入记录的线程数，停止时等它归零才释放环
+static FILE *g_fp;              // 启动时指定的写出目标，NULL 按级别分 stdout/stderr
+static uint64_t g_now_ms;       // 写线程每毫秒刷新的墙钟时刻
+static uint64_t g_passes;       // 写线程完成的轮数（flush 等待用）
+static uint64_t g_emitted;      // 写线程写出的条数
+#ifdef _WIN32
+static HANDLE g_writer;
+#else
+static pthread_t g_writer;
+#endif
+
+static LOG_TLS log_ring_t *t_ring; // NULL 且 t_gen 为当前代时表示本线程同步写出
+static LOG_TLS uint32_t t_gen;      // 取得 t_ring 时的代，0 为尚未取得
+static LOG_TLS uint32_t t_pkt;
+
+// 同步写出：未启动写线程、环数已满时使用；一次 fprintf 在 stdio 内部持锁，不与其他线程的行交错
+static void write_sync(coap_log_level_t level, const char *text) {
+	char ts[32];
+	format_ts(wall_ms(), ts, sizeof(ts));
+	fprintf(g_fp ? g_fp : level >= COAP_LOG_WARN ? stderr : stdout, "[%s] %s\n", ts, text);
+}
+
+// 当前线程的环；首次调用时分配并登记
+static log_ring_t *thread_ring(void) {
+	uint32_t gen = load_acquire(&g_gen);
+	if (t_gen == gen) return t_ring;
+	t_ring = NULL;
+	t_gen = gen;
+	uint32_t slot = fetch_add(&g_nrings, 1);
+	if (slot >= COAP_LOG_RINGS_MAX) return NULL;
+	log_ring_t *r = (log_ring_t*)calloc(1, sizeof(*r));
+	if (r) r->buf = (uint8_t*)malloc(g_ring_bytes);
+	if (!r || !r->buf) {
+		free(r);
+		return NULL;
+	}
+	r->size = g_ring_bytes;
+	// 写线程按槽号遍历，见到非 NULL 即可读
+#ifdef _MSC_VER
+	MemoryBarrier();
+	*(log_ring_t *volatile*)&g_rings[slot] = r;
+#else
+	__atomic_store_n(&g_rings[slot], r, __ATOMIC_RELEASE);
+#endif
+	t_ring = r;
+	return r;
+}
+
+// 压入一条记录：空间不够时丢弃
+static void ring_push(log_ring_t *r, coap_log_level_t level, const char *text, size_t len) {
+	uint32_t need = (uint32_t)((sizeof(log_rec_t) + len + LOG_REC_ALIGN - 1) & ~(size_t)(LOG_REC_ALIGN - 1));
+	uint32_t head = r->head, tail = load_acquire(&r->tail);
+	uint32_t at = head & (r->size - 1), to_end = r->size - at;
+	uint32_t pad = to_end < need ? to_end : 0;
+	if (r->size - (head - tail) < need + pad) {
+		r->dropped++;
+		return;
+	}
+	if (pad) {
+		log_rec_t *skip = (log_rec_t*)(r->buf + at);
+		skip->skip = 1;
+		at = 0;
+	}
+	log_rec_t *rec = (log_rec_t*)(r->buf + at);
+	rec->len = (uint16_t)len;
+	rec->level = (uint8_t)level;
+	rec->skip = 0;
+	rec->t_ms = load64(&g_now_ms);
+	memcpy(rec + 1, text, len);
+	r->written++;
+	store_release(&r->head, head + pad + need);
+}
+
+void coap_log_vwrite(coap_log_level_t level, const char *fmt, va_list ap) {
+	if ((int)level < g_level || level >= COAP_LOG_OFF) return;
+	char text[COAP_LOG_LINE_MAX];
+	int n = vsnprintf(text, sizeof(text), fmt, ap);
+	if (n < 0) return;
+	size_t len = (size_t)n < sizeof(text) ? (size_t)n : sizeof(text) - 1;
+	// 先登记再看 g_running：停止方清零 g_running 后只要见到 g_active 为 0，就不会再有线程碰到环
+	fetch_add(&g_active, 1);
+	log_ring_t *r = g_running ? thread_ring() : NULL;
+	if (r) ring_push(r, level, text, len);
+	fetch_add(&g_active, (uint32_t)-1);
+	if (!r) write_sync(level, text);
+}
+
+void coap_log_write(coap_log_level_t level, const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	coap_log_vwrite(level, fmt, ap);
+	va_end(ap);
+}
+
+int coap_log_packet_due(void) {
+	uint32_t n = g_sample;
+	if (n == 0 || g_level > COAP_LOG_INFO) return 0;
+	return t_pkt++ % n == 0;
+}
+
+void coap_log_set_level(coap_log_level_t level) { g_level = level; }
+
+void coap_log_set_packet_sample(uint32_t n) { g_sample = n; }
+
+// ---- 写线程 ----
+
+typedef struct {
+	char buf[LOG_OUT_BUF];
+	size_t len;
+	FILE *fp;
+} log_out_t;
+
+static void out_flush(log_out_t *o) {
+	if (!o->len) return;
+	fwrite(o->buf, 1, o->len, o->fp);
+	fflush(o->fp);
+	o->len = 0;
+}
+
+// 把一个环里的记录全部写进输出缓冲；时间前缀按秒缓存
+static void drain_ring(log_ring_t *r, log_out_t *out, log_out_t *err, uint64_t *cached_s, char *ts) {
+	uint32_t head = load_acquire(&r->head), tail = r->tail;
+	while (tail != head) {
+		const log_rec_t *rec = (const log_rec_t*)(r->buf + (tail & (r->size - 1)));
+		if (rec->skip) {
+			tail += r->size - (tail & (r->size - 1));
+			continue;
+		}
+		if (rec->t_ms / 1000u != *cached_s) {
+			*cached_s = rec->t_ms / 1000u;
+			format_ts(rec->t_ms, ts, 32);
+		}
+		log_out_t *o = rec->level >= COAP_LOG_WARN ? err : out;
+		if (o->len + rec->len + 40 > sizeof(o->buf)) out_flush(o);
+		o->len += (size_t)sprintf(o->buf + o->len, "[%s] ", ts);
+		memcpy(o->buf + o->len, rec + 1, rec->len);
+		o->len += rec->len;
+		o->buf[o->len++] = '\n';
+		g_emitted++;
+		tail += (uint32_t)((sizeof(log_rec_t) + rec->len + LOG_REC_ALIGN - 1) & ~(size_t)(LOG_REC_ALIGN - 1));
+	}
+	store_release(&r->tail, tail);
+}
+
+static log_out_t g_out, g_err;
+
+// 一轮：刷新缓存时刻，读空所有环并写出
+static void writer_pass(void) {
+	static uint64_t cached_s = UINT64_MAX;
+	static char ts[32];
+	store64(&g_now_ms, wall_ms());
+	uint32_t n = load_acquire(&g_nrings);
+	if (n > COAP_LOG_RINGS_MAX) n = COAP_LOG_RINGS_MAX;
+	for (uint32_t i = 0; i < n; ++i) {
+#ifdef _MSC_VER
+		log_ring_t *r = *(log_ring_t *volatile*)&g_rings[i];
+		MemoryBarrier();
+#else
+		log_ring_t *r = __atomic_load_n(&g_rings[i], __ATOMIC_ACQUIRE);
+#endif
+		if (r) drain_ring(r, &g_out, &g_err, &cached_s, ts);
+	}
+	out_flush(&g_out);
+	out_flush(&g_err);
+	store64(&g_passes, load64(&g_passes) + 1);
+}
+
+#ifdef _WIN32
+static unsigned __stdcall writer_thread(void *arg)
+#else
+static void* writer_thread(void *arg)
+#endif
+{
+	(void)arg;
+	while (g_running) {
+		writer_pass();
+		sleep_1ms();
+	}
+#ifdef _WIN32
+	return 0;
+#else
+	return NULL;
+#endif
+}
+
+int coap_log_start(const coap_log_conf_t *conf) {
+	if (!conf || g_running) return -1;
+	uint32_t bytes = conf->ring_bytes ? conf->ring_bytes : LOG_RING_DEFAULT;
+	if (bytes < 4096) bytes = 4096;
+	uint32_t size = 4096;
+	while (size < bytes && size < (1u << 30)) size <<= 1;
+	g_ring_bytes = size;
+	g_level = conf->level;
+	g_sample = conf->packet_sample;
+	g_fp = conf->out;
+	g_out.fp = g_fp ? g_fp : stdout;
+	g_err.fp = g_fp ? g_fp : stderr;
+	fflush(stdout);
+	store64(&g_now_ms, wall_ms());
+	fetch_add(&g_gen, 1);
+	g_running = 1;
+#ifdef _WIN32
+	g_writer = (HANDLE)_beginthreadex(NULL, 0, writer_thread, NULL, 0, NULL);
+	if (!g_writer) {
+		g_running = 0;
+		g_fp = NULL;
+		return -2;
+	}
+#else
+	if (pthread_create(&g_writer, NULL, writer_thread, NULL) != 0) {
+		g_running = 0;
+		g_fp = NULL;
+		return -2;
+	}
+#endif
+	return 0;
+}
+
+void coap_log_stop(void) {
+	if (!g_running) return;
+	g_running = 0;
+#ifdef _WIN32
+	WaitForSingleObject(g_writer, INFINITE);
+	CloseHandle(g_writer);
+#else
+	pthread_join(g_writer, NULL);
+#endif
+	// 已越过 g_running 检查的线程可能还在压入：等它们离开，之后的调用都走同步写出
+	uint32_t waited = 0;
+	while (fetch_add(&g_active, 0) != 0 && waited++ < LOG_QUIESCE_MS) sleep_1ms();
+	int quiet = fetch_add(&g_active, 0) == 0;
+	writer_pass();
+	coap_log_stats_t st;
+	coap_log_get_stats(&st);
+	// 换代后各线程不再沿用旧环；等不到静止（某线程卡在压入中）时宁可不释放
+	fetch_add(&g_gen, 1);
+	uint32_t n = g_nrings < COAP_LOG_RINGS_MAX ? g_nrings : COAP_LOG_RINGS_MAX;
+	for (uint32_t i = 0; i < n; ++i) {
+		if (quiet && g_rings[i]) free(g_rings[i]->buf);
+		if (quiet) free(g_rings[i]);
+		g_rings[i] = NULL;
+	}
+	g_nrings = 0;
+	g_fp = NULL;
+	if (st.dropped) coap_log_warn("日志环满，丢弃 %llu 条", (unsigned long long)st.dropped);
+}
+
+void coap_log_flush(void) {
+	if (!g_running) {
+		fflush(stdout);
+		return;
+	}
+	// 调用时正在进行的一轮可能已越过本线程的环，等两轮完整的写出
+	uint64_t target = load64(&g_passes) + 2;
+	while (g_running && load64(&g_passes) < target) sleep_1ms();
+}
+
+void coap_log_get_stats(coap_log_stats_t *st) {
+	memset(st, 0, sizeof(*st));
+	uint32_t n = load_acquire(&g_nrings);
+	st->rings = n < COAP_LOG_RINGS_MAX ? n : COAP_LOG_RINGS_MAX;
+	for (uint32_t i = 0; i < st->rings; ++i) {
+		const log_ring_t *r = g_rings[i];
+		if (!r) continue;
+		st->written += r->written;
+		st->dropped += r->dropped;
+	}
+	st->emitted = g_emitted;
+}
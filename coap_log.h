@@ -0,0 +1,85 @@
+// coap_log.h
+// 异步日志：每个线程首次写日志时分配一个单生产者字节环，写日志只做级别判断、格式化正文与一次拷贝，不加锁、不做 IO；
+// 后台写线程每毫秒刷新一次缓存的墙钟时刻（写日志时直接取用），并把所有环里的记录加上 "[YYYY-mm-dd HH:MM:SS] " 前缀
+// 成批写到 stdout（WARN/ERROR 写到 stderr）；时间前缀按秒缓存，一秒只格式化一次
+// 环满时丢弃并计数，不阻塞调用方；未启动写线程时同步写出（同样线程安全）
+// 逐包日志用 COAP_LOG_PKT：按采样率只输出 1/N；编译时定义 COAP_LOG_NO_PACKETS（压测构建）则整段编译掉
+
+#ifndef COAP_LOG_H
+#define COAP_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	COAP_LOG_DEBUG = 0,
+	COAP_LOG_INFO = 1,
+	COAP_LOG_WARN = 2,
+	COAP_LOG_ERROR = 3,
+	COAP_LOG_OFF = 4
+} coap_log_level_t;
+
+#define COAP_LOG_LINE_MAX 512 // 单条日志正文上限（超出截断）
+#define COAP_LOG_RINGS_MAX 512 // 线程环数上限，之后新线程的日志同步写出
+
+typedef struct {
+	coap_log_level_t level;  // 低于此级别的日志直接丢弃
+	uint32_t ring_bytes;     // 每个线程环的字节数（取 2 的幂），0 取 256 KiB
+	uint32_t packet_sample;  // 逐包日志每 N 条输出 1 条，0 关闭，1 全部输出
+	FILE *out;               // 非 NULL 时所有级别都写到这里（运行期间有效），NULL 为 stdout/stderr
+} coap_log_conf_t;
+
+#if defined(__GNUC__) || defined(__clang__)
+#define COAP_LOG_PRINTF(a, b) __attribute__((format(printf, a, b)))
+#else
+#define COAP_LOG_PRINTF(a, b)
+#endif
+
+// 启动写线程；未调用时日志同步写出。返回 0 成功，-1 参数错误，-2 线程创建失败
+int coap_log_start(const coap_log_conf_t *conf);
+// 写出所有环中剩余的日志并停止写线程，报告丢弃条数；之后的日志同步写出
+// 其他线程可以仍在写日志：先等正在压入的调用离开（至多 100 ms）再释放各线程的环，等不到时不释放
+void coap_log_stop(void);
+// 等待调用前写入的日志全部写出（之后直接 printf 的内容不会排到它们前面）
+void coap_log_flush(void);
+
+void coap_log_set_level(coap_log_level_t level);
+void coap_log_set_packet_sample(uint32_t n);
+
+// fmt 不需要以换行结尾
+void coap_log_write(coap_log_level_t level, const char *fmt, ...) COAP_LOG_PRINTF(2, 3);
+void coap_log_vwrite(coap_log_level_t level, const char *fmt, va_list ap);
+#define coap_log_debug(...) coap_log_write(COAP_LOG_DEBUG, __VA_ARGS__)
+#define coap_log_info(...) coap_log_write(COAP_LOG_INFO, __VA_ARGS__)
+#define coap_log_warn(...) coap_log_write(COAP_LOG_WARN, __VA_ARGS__)
+#define coap_log_error(...) coap_log_write(COAP_LOG_ERROR, __VA_ARGS__)
+
+// 按采样率判断本条逐包日志是否输出（每个线程单独计数）
+int coap_log_packet_due(void);
+
+#ifdef COAP_LOG_NO_PACKETS
+#define COAP_LOG_PKT(...) ((void)0)
+#else
+#define COAP_LOG_PKT(...) do { if (coap_log_packet_due()) coap_log_write(COAP_LOG_INFO, __VA_ARGS__); } while (0)
+#endif
+
+// 日志统计（只含经环的日志）：写入环、写线程已写出、环满丢弃的条数，以及已分配的线程环数
+typedef struct {
+	uint64_t written;
+	uint64_t emitted;
+	uint64_t dropped;
+	uint32_t rings;
+} coap_log_stats_t;
+void coap_log_get_stats(coap_log_stats_t *st);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COAP_LOG_H
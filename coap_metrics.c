@@ -0,0 +1,252 @@
+// coap_metrics.c
+#include "coap_metrics.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static uint32_t msb32(uint32_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+	return 31 - (uint32_t)__builtin_clz(x);
+#elif defined(_MSC_VER)
+	unsigned long i;
+	_BitScanReverse(&i, x);
+	return (uint32_t)i;
+#else
+	uint32_t n = 0;
+	while (x >>= 1) n++;
+	return n;
+#endif
+}
+
+static uint32_t hist_bucket(uint64_t us) {
+	if (us >= 0xFFFFFFFFu) us = 0xFFFFFFFFu;
+	if (us < 2 * COAP_HIST_SUB) return (uint32_t)us;
+	uint32_t shift = msb32((uint32_t)us) - COAP_HIST_SUB_BITS;
+	return 2 * COAP_HIST_SUB + (shift - 1) * COAP_HIST_SUB + (uint32_t)((us >> shift) - COAP_HIST_SUB);
+}
+
+// 桶的上界（含）
+static uint64_t hist_bucket_top(uint32_t b) {
+	if (b < 2 * COAP_HIST_SUB) return b;
+	uint32_t shift = (b - 2 * COAP_HIST_SUB) / COAP_HIST_SUB + 1;
+	uint64_t sub = (b - 2 * COAP_HIST_SUB) % COAP_HIST_SUB + COAP_HIST_SUB;
+	return ((sub + 1) << shift) - 1;
+}
+
+void coap_hist_record(coap_hist_t *h, uint64_t us) {
+	h->counts[hist_bucket(us)]++;
+	h->count++;
+	h->sum_us += us;
+	if (us > h->max_us) h->max_us = us;
+}
+
+uint64_t coap_hist_quantile(const coap_hist_t *h, double q) {
+	if (h->count == 0) return 0;
+	if (q < 0.0) q = 0.0;
+	if (q > 1.0) q = 1.0;
+	uint64_t rank = (uint64_t)(q * (double)h->count + 0.5);
+	if (rank == 0) rank = 1;
+	uint64_t seen = 0;
+	for (uint32_t b = 0; b < COAP_HIST_BUCKETS; ++b) {
+		seen += h->counts[b];
+		if (seen >= rank) {
+			uint64_t top = hist_bucket_top(b);
+			return top < h->max_us ? top : h->max_us;
+		}
+	}
+	return h->max_us;
+}
+
+void coap_hist_delta(coap_hist_t *out, const coap_hist_t *cur, const coap_hist_t *prev) {
+	out->max_us = 0;
+	for (uint32_t b = 0; b < COAP_HIST_BUCKETS; ++b) {
+		out->counts[b] = cur->counts[b] - prev->counts[b];
+		if (out->counts[b]) out->max_us = hist_bucket_top(b);
+	}
+	if (out->max_us > cur->max_us) out->max_us = cur->max_us;
+	out->count = cur->count - prev->count;
+	out->sum_us = cur->sum_us - prev->sum_us;
+}
+
+int coap_metrics_init(coap_metrics_t *m, uint32_t devices) {
+	memset(m, 0, sizeof(*m));
+	if (devices) {
+		m->devs = (coap_dev_metrics_t*)calloc(devices, sizeof(coap_dev_metrics_t));
+		if (!m->devs) return -2;
+		m->devices = devices;
+	}
+	return 0;
+}
+
+void coap_metrics_destroy(coap_metrics_t *m) {
+	free(m->devs);
+	memset(m, 0, sizeof(*m));
+}
+
+void coap_metrics_reset(coap_metrics_t *m) {
+	memset(&m->t, 0, sizeof(m->t));
+	if (m->devs) memset(m->devs, 0, (size_t)m->devices * sizeof(coap_dev_metrics_t));
+	m->start_us = 0;
+}
+
+coap_outcome_t coap_outcome_of(int rc, uint8_t code) {
+	if (rc == -3) return COAP_OUTCOME_TIMEOUT;
+	if (rc != 0) return COAP_OUTCOME_ERROR;
+	if ((code >> 5) < 4) return COAP_OUTCOME_OK;
+	return code == ((4 << 5) | 1) ? COAP_OUTCOME_UNAUTH : COAP_OUTCOME_ERROR;
+}
+
+void coap_metrics_record(coap_metrics_t *m, uint32_t device, coap_outcome_t outcome, uint64_t rtt_us, uint32_t retransmits) {
+	coap_hist_record(&m->t.rtt[outcome], rtt_us);
+	m->t.retransmits[outcome] += retransmits;
+	if (device >= m->devices) return;
+	coap_dev_metrics_t *d = &m->devs[device];
+	d->requests++;
+	d->retransmits += retransmits;
+	if (outcome != COAP_OUTCOME_OK) {
+		d->failures++;
+		return;
+	}
+	d->rtt_sum_us += rtt_us;
+	if (rtt_us > d->rtt_max_us) d->rtt_max_us = rtt_us > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)rtt_us;
+}
+
+void coap_metrics_summarize(const coap_metrics_totals_t *t, double seconds, coap_metrics_summary_t *s) {
+	memset(s, 0, sizeof(*s));
+	s->seconds = seconds;
+	for (int o = 0; o < COAP_OUTCOMES; ++o) {
+		s->outcomes[o] = t->rtt[o].count;
+		s->requests += t->rtt[o].count;
+		s->retransmits += t->retransmits[o];
+	}
+	const coap_hist_t *ok = &t->rtt[COAP_OUTCOME_OK];
+	s->throughput = seconds > 0.0 ? (double)ok->count / seconds : 0.0;
+	s->p50_us = coap_hist_quantile(ok, 0.50);
+	s->p99_us = coap_hist_quantile(ok, 0.99);
+	s->p999_us = coap_hist_quantile(ok, 0.999);
+	s->max_us = ok->max_us;
+	s->mean_us = ok->count ? (double)ok->sum_us / (double)ok->count : 0.0;
+	if (s->requests) {
+		s->retx_per_msg = (double)s->retransmits / (double)s->requests;
+		s->loss_rate = (double)s->retransmits / (double)(s->requests + s->retransmits);
+		s->timeout_rate = (double)s->outcomes[COAP_OUTCOME_TIMEOUT] / (double)s->requests;
+	}
+}
+
+void coap_metrics_delta(coap_metrics_totals_t *out, const coap_metrics_totals_t *cur, const coap_metrics_totals_t *prev) {
+	for (int o = 0; o < COAP_OUTCOMES; ++o) {
+		coap_hist_delta(&out->rtt[o], &cur->rtt[o], &prev->rtt[o]);
+		out->retransmits[o] = cur->retransmits[o] - prev->retransmits[o];
+	}
+}
+
+const char *coap_outcome_name(coap_outcome_t o) {
+	static const char *names[COAP_OUTCOMES] = { "ok", "unauthorized", "error", "timeout" };
+	return (unsigned)o < COAP_OUTCOMES ? names[o] : "unknown";
+}
+
+// 最大往返最高的 n 台设备（插入排序，n 很小）
+static uint32_t worst_devices(const coap_metrics_t *m, uint32_t *out, uint32_t n) {
+	uint32_t k = 0;
+	for (uint32_t d = 0; d < m->devices; ++d) {
+		if (m->devs[d].requests == 0) continue;
+		uint32_t v = m->devs[d].rtt_max_us, i = k < n ? k++ : n;
+		if (i == n && v <= m->devs[out[n - 1]].rtt_max_us) continue;
+		if (i == n) i = n - 1;
+		while (i > 0 && m->devs[out[i - 1]].rtt_max_us < v) {
+			out[i] = out[i - 1];
+			i--;
+		}
+		out[i] = d;
+	}
+	return k;
+}
+
+int coap_metrics_write_json(const coap_metrics_t *m, double seconds, FILE *fp) {
+	coap_metrics_summary_t s;
+	coap_metrics_summarize(&m->t, seconds, &s);
+	fprintf(fp, "{\"seconds\":%.3f,\"requests\":%llu,\"retransmits\":%llu,\"throughput\":%.1f,"
+		"\"retx_per_msg\":%.4f,\"loss_rate\":%.6f,\"timeout_rate\":%.6f,\"outcomes\":{",
+		seconds, (unsigned long long)s.requests, (unsigned long long)s.retransmits, s.throughput,
+		s.retx_per_msg, s.loss_rate, s.timeout_rate);
+	for (int o = 0; o < COAP_OUTCOMES; ++o) {
+		const coap_hist_t *h = &m->t.rtt[o];
+		fprintf(fp, "%s\"%s\":{\"count\":%llu,\"retransmits\":%llu,\"rtt_us\":{\"p50\":%llu,\"p99\":%llu,\"p999\":%llu,"
+			"\"max\":%llu,\"mean\":%.1f}}", o ? "," : "", coap_outcome_name((coap_outcome_t)o),
+			(unsigned long long)h->count, (unsigned long long)m->t.retransmits[o],
+			(unsigned long long)coap_hist_quantile(h, 0.50), (unsigned long long)coap_hist_quantile(h, 0.99),
+			(unsigned long long)coap_hist_quantile(h, 0.999), (unsigned long long)h->max_us,
+			h->count ? (double)h->sum_us / (double)h->count : 0.0);
+	}
+	uint32_t active = 0, failing = 0, worst[10];
+	for (uint32_t d = 0; d < m->devices; ++d) {
+		active += m->devs[d].requests != 0;
+		failing += m->devs[d].failures != 0;
+	}
+	uint32_t nw = worst_devices(m, worst, 10);
+	fprintf(fp, "},\"devices\":{\"count\":%u,\"active\":%u,\"with_failures\":%u,\"worst\":[", m->devices, active, failing);
+	for (uint32_t i = 0; i < nw; ++i) {
+		const coap_dev_metrics_t *d = &m->devs[worst[i]];
+		uint32_t ok = d->requests - d->failures;
+		fprintf(fp, "%s{\"device\":%u,\"requests\":%u,\"failures\":%u,\"retransmits\":%u,\"rtt_max_us\":%u,\"rtt_mean_us\":%.1f}",
+			i ? "," : "", worst[i], d->requests, d->failures, d->retransmits, d->rtt_max_us,
+			ok ? (double)d->rtt_sum_us / (double)ok : 0.0);
+	}
+	fprintf(fp, "]}}\n");
+	return ferror(fp) ? -1 : 0;
+}
+
+int coap_metrics_write_prom(const coap_metrics_t *m, double seconds, FILE *fp) {
+	static const double qs[3] = { 0.5, 0.99, 0.999 };
+	fprintf(fp, "# HELP coap_client_requests_total Finished requests by outcome.\n# TYPE coap_client_requests_total counter\n");
+	for (int o = 0; o < COAP_OUTCOMES; ++o) {
+		fprintf(fp, "coap_client_requests_total{outcome=\"%s\"} %llu\n", coap_outcome_name((coap_outcome_t)o),
+			(unsigned long long)m->t.rtt[o].count);
+	}
+	fprintf(fp, "# HELP coap_client_retransmits_total Retransmissions of requests that finished with the outcome.\n"
+		"# TYPE coap_client_retransmits_total counter\n");
+	for (int o = 0; o < COAP_OUTCOMES; ++o) {
+		fprintf(fp, "coap_client_retransmits_total{outcome=\"%s\"} %llu\n", coap_outcome_name((coap_outcome_t)o),
+			(unsigned long long)m->t.retransmits[o]);
+	}
+	fprintf(fp, "# HELP coap_client_rtt_seconds Time from first transmission to response (or giving up).\n"
+		"# TYPE coap_client_rtt_seconds summary\n");
+	for (int o = 0; o < COAP_OUTCOMES; ++o) {
+		const coap_hist_t *h = &m->t.rtt[o];
+		const char *name = coap_outcome_name((coap_outcome_t)o);
+		for (int i = 0; i < 3; ++i) {
+			fprintf(fp, "coap_client_rtt_seconds{outcome=\"%s\",quantile=\"%g\"} %.6f\n", name, qs[i],
+				(double)coap_hist_quantile(h, qs[i]) / 1e6);
+		}
+		fprintf(fp, "coap_client_rtt_seconds_sum{outcome=\"%s\"} %.6f\n", name, (double)h->sum_us / 1e6);
+		fprintf(fp, "coap_client_rtt_seconds_count{outcome=\"%s\"} %llu\n", name, (unsigned long long)h->count);
+	}
+	fprintf(fp, "# HELP coap_client_rtt_max_seconds Largest round-trip time by outcome.\n# TYPE coap_client_rtt_max_seconds gauge\n");
+	for (int o = 0; o < COAP_OUTCOMES; ++o) {
+		fprintf(fp, "coap_client_rtt_max_seconds{outcome=\"%s\"} %.6f\n", coap_outcome_name((coap_outcome_t)o),
+			(double)m->t.rtt[o].max_us / 1e6);
+	}
+	fprintf(fp, "# HELP coap_client_run_seconds Length of the measured run.\n# TYPE coap_client_run_seconds gauge\n"
+		"coap_client_run_seconds %.3f\n", seconds);
+	return ferror(fp) ? -1 : 0;
+}
+
+int coap_metrics_save(const coap_metrics_t *m, double seconds, const char *path, int prom) {
+	char tmp[512];
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) return -1;
+	FILE *fp = fopen(tmp, "w");
+	if (!fp) return -1;
+	int rc = prom ? coap_metrics_write_prom(m, seconds, fp) : coap_metrics_write_json(m, seconds, fp);
+	if (fclose(fp) != 0) rc = -1;
+#ifdef _WIN32
+	remove(path); // Windows 上 rename 不覆盖已有文件
+#endif
+	if (rc != 0 || rename(tmp, path) != 0) {
+		remove(tmp);
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,108 @@
+// coap_metrics.h
+// 客户端请求统计：按结果（成功、4.01、其他错误、超时放弃）各一个往返时延直方图，另记每个设备的请求、失败、重传与最大往返
+// 直方图按对数线性分桶（HDR 风格）：小于 2*COAP_HIST_SUB us 的值每 us 一桶，之后每个 2 的幂区间均分 COAP_HIST_SUB 桶，
+// 相对误差约 1.6%，覆盖 0..2^32 us；记录只是一次定位与几次加法，不分配内存、不加锁
+// 每个记录者（事件驱动引擎、单设备客户端）持有自己的一份，只在所在线程写入与读取；
+// 区间统计用两次快照相减得到，汇总可输出为可读文本、JSON 或 Prometheus 文本格式
+
+#ifndef COAP_METRICS_H
+#define COAP_METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define COAP_HIST_SUB_BITS 6
+#define COAP_HIST_SUB (1u << COAP_HIST_SUB_BITS)
+#define COAP_HIST_BUCKETS (2 * COAP_HIST_SUB + (32 - COAP_HIST_SUB_BITS - 1) * COAP_HIST_SUB)
+
+typedef struct {
+	uint64_t counts[COAP_HIST_BUCKETS];
+	uint64_t count;
+	uint64_t sum_us;
+	uint64_t max_us;
+} coap_hist_t;
+
+typedef enum {
+	COAP_OUTCOME_OK = 0,      // 2.xx
+	COAP_OUTCOME_UNAUTH = 1,  // 4.01
+	COAP_OUTCOME_ERROR = 2,   // 其他 4.xx/5.xx 响应
+	COAP_OUTCOME_TIMEOUT = 3, // 重传用尽仍无响应（时延记首次发送到放弃）
+	COAP_OUTCOMES
+} coap_outcome_t;
+
+typedef struct {
+	uint32_t requests;
+	uint32_t failures;    // 非 2.xx 或超时
+	uint32_t retransmits;
+	uint32_t rtt_max_us;  // 成功请求的最大往返
+	uint64_t rtt_sum_us;  // 成功请求的往返合计
+} coap_dev_metrics_t;
+
+// 全部设备合计：可整体拷贝作快照
+typedef struct {
+	coap_hist_t rtt[COAP_OUTCOMES];
+	uint64_t retransmits[COAP_OUTCOMES]; // 以该结果结束的请求累计重传次数
+} coap_metrics_totals_t;
+
+typedef struct {
+	coap_metrics_totals_t t;
+	coap_dev_metrics_t *devs;
+	uint32_t devices;
+	uint64_t start_us;    // 开始统计的单调时钟时刻
+} coap_metrics_t;
+
+// 汇总：速率按 seconds 计算，时延分位数取成功请求
+typedef struct {
+	double seconds;
+	uint64_t requests;
+	uint64_t outcomes[COAP_OUTCOMES];
+	uint64_t retransmits;
+	double throughput;        // 成功请求/s
+	uint64_t p50_us, p99_us, p999_us, max_us;
+	double mean_us;
+	double retx_per_msg;      // 平均每条请求的重传次数
+	double loss_rate;         // 估计丢包率：重传/(请求+重传)，每次重传意味着一个请求或响应报文丢失（或 RTO 过短）
+	double timeout_rate;      // 超时放弃的请求占比
+} coap_metrics_summary_t;
+
+void coap_hist_record(coap_hist_t *h, uint64_t us);
+// 分位数（us），q 取 0..1，返回所在桶的上界（不超过记录到的最大值）；空直方图返回 0
+uint64_t coap_hist_quantile(const coap_hist_t *h, double q);
+// 区间直方图：cur 减去更早的快照 prev；区间最大值取有计数的最高桶的上界
+void coap_hist_delta(coap_hist_t *out, const coap_hist_t *cur, const coap_hist_t *prev);
+
+// 分配 devices 个设备的计数（0 表示不按设备统计）。返回 0 成功，-2 内存不足
+int coap_metrics_init(coap_metrics_t *m, uint32_t devices);
+void coap_metrics_destroy(coap_metrics_t *m);
+void coap_metrics_reset(coap_metrics_t *m);
+
+// 请求结果分类：rc 非 0 时为 -3（超时放弃）以外的失败归为其他错误
+coap_outcome_t coap_outcome_of(int rc, uint8_t code);
+
+// 记录一个结束的请求：rtt_us 为首次发送到收到响应（或放弃），retransmits 为该请求的重传次数
+void coap_metrics_record(coap_metrics_t *m, uint32_t device, coap_outcome_t outcome, uint64_t rtt_us, uint32_t retransmits);
+
+// 汇总 t（全程或两次快照之差）
+void coap_metrics_summarize(const coap_metrics_totals_t *t, double seconds, coap_metrics_summary_t *s);
+// 区间合计：cur - prev
+void coap_metrics_delta(coap_metrics_totals_t *out, const coap_metrics_totals_t *cur, const coap_metrics_totals_t *prev);
+
+const char *coap_outcome_name(coap_outcome_t o);
+
+// 全程汇总写成 JSON（含各结果的分位数与最大往返最高的 10 台设备）或 Prometheus 文本格式（summary 与 counter）
+// seconds 为统计时长。返回 0 成功，-1 写入失败
+int coap_metrics_write_json(const coap_metrics_t *m, double seconds, FILE *fp);
+int coap_metrics_write_prom(const coap_metrics_t *m, double seconds, FILE *fp);
+// 写到 path：先写 path.tmp 再改名，读取方不会看到写了一半的文件。prom 非 0 时为 Prometheus 格式
+int coap_metrics_save(const coap_metrics_t *m, double seconds, const char *path, int prom);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COAP_METRICS_H
@@ -0,0 +1,82 @@
+// coap_msg.c
+#include "coap_msg.h"
+#include <string.h>
+
+// 读取 delta/长度的扩展字节（nibble 13：+1 字节，14：+2 字节）；越界返回 -3，保留值 15 返回 -5
+static int read_ext(uint32_t nibble, const uint8_t *buf, size_t len, size_t *off, uint32_t *out) {
+	if (nibble < 13) {
+		*out = nibble;
+		return 0;
+	}
+	if (nibble == 13) {
+		if (*off + 1 > len) return -3;
+		*out = 13u + buf[*off];
+		*off += 1;
+		return 0;
+	}
+	if (nibble == 14) {
+		if (*off + 2 > len) return -3;
+		*out = 269u + ((uint32_t)buf[*off] << 8 | buf[*off + 1]);
+		*off += 2;
+		return 0;
+	}
+	return -5;
+}
+
+int coap_msg_parse(coap_msg_view_t *m, const uint8_t *buf, size_t len) {
+	if (len < 4) return -1;
+	if ((buf[0] >> 6) != 1) return -2;
+	uint8_t tkl = buf[0] & 0x0F;
+	if (tkl > 8) return -4;
+	if (len < 4u + tkl) return -3;
+	m->type = (buf[0] >> 4) & 0x03;
+	m->code = buf[1];
+	m->mid = (uint16_t)((buf[2] << 8) | buf[3]);
+	m->tkl = tkl;
+	m->token = buf + 4;
+	m->payload = NULL;
+	m->payload_len = 0;
+	m->opt_count = 0;
+	memset(m->first, 0xFF, sizeof(m->first));
+
+	size_t off = 4u + tkl;
+	uint32_t number = 0;
+	while (off < len) {
+		uint8_t b = buf[off++];
+		if (b == 0xFF) {
+			if (off == len) return -7;
+			m->payload = buf + off;
+			m->payload_len = len - off;
+			return 0;
+		}
+		uint32_t delta, olen;
+		int rc = read_ext(b >> 4, buf, len, &off, &delta);
+		if (rc != 0) return rc;
+		rc = read_ext(b & 0x0F, buf, len, &off, &olen);
+		if (rc != 0) return rc;
+		if (olen > len - off) return -3;
+		number += delta;
+		if (number > 0xFFFF || olen > 0xFFFF || m->opt_count >= COAP_MSG_MAX_OPTS) return -6;
+		coap_opt_view_t *o = &m->opts[m->opt_count];
+		o->number = (uint16_t)number;
+		o->len = (uint16_t)olen;
+		o->value = buf + off;
+		if (number < COAP_MSG_FAST_OPTS && m->first[number] == 0xFF) m->first[number] = m->opt_count;
+		m->opt_count++;
+		off += olen;
+	}
+	return 0;
+}
+
+const coap_opt_view_t *coap_msg_find(const coap_msg_view_t *m, uint16_t number) {
+	if (number < COAP_MSG_FAST_OPTS) {
+		uint8_t i = m->first[number];
+		return i == 0xFF ? NULL : &m->opts[i];
+	}
+	// 选项按编号有序，遇到更大的编号即可停止
+	for (uint8_t i = 0; i < m->opt_count; ++i) {
+		if (m->opts[i].number == number) return &m->opts[i];
+		if (m->opts[i].number > number) break;
+	}
+	return NULL;
+}
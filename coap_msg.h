@@ -0,0 +1,74 @@
+// coap_msg.h
+// 零拷贝 CoAP 报文解码（RFC7252 第 3 节）：解析头部、Token 与全部选项，
+// 选项以 {编号, 长度, 指针} 视图数组给出，指针直接指向接收缓冲，不拷贝；
+// 所有扩展 delta/长度字节与选项值都做越界检查，保留值按格式错误拒绝
+
+#ifndef COAP_MSG_H
+#define COAP_MSG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 常用选项编号
+#define COAP_OPT_URI_HOST       3
+#define COAP_OPT_URI_PATH       11
+#define COAP_OPT_CONTENT_FORMAT 12
+#define COAP_OPT_URI_QUERY      15
+
+// 常用 Content-Format
+#define COAP_CF_OCTET_STREAM 42 // 加密上报负载
+#define COAP_CF_JSON         50
+#define COAP_CF_CBOR         60
+
+#define COAP_MSG_MAX_OPTS 32 // 单个报文最多解析的选项数，超出按格式错误处理
+#define COAP_MSG_FAST_OPTS 64 // 编号小于此值的选项记录首次出现位置，查找 O(1)
+
+typedef struct {
+	uint16_t number;
+	uint16_t len;
+	const uint8_t *value; // 指向原始缓冲
+} coap_opt_view_t;
+
+typedef struct {
+	uint8_t type;          // 0 CON / 1 NON / 2 ACK / 3 RST
+	uint8_t code;
+	uint16_t mid;
+	uint8_t tkl;
+	const uint8_t *token;
+	const uint8_t *payload; // 无负载时为 NULL
+	size_t payload_len;
+	uint8_t opt_count;
+	uint8_t first[COAP_MSG_FAST_OPTS]; // 编号 -> opts 下标，0xFF 表示不存在
+	coap_opt_view_t opts[COAP_MSG_MAX_OPTS]; // 按编号非降序（与报文中顺序一致）
+} coap_msg_view_t;
+
+// 解码 buf[0..len)；返回 0 成功，<0 失败：
+// -1 不足 4 字节；-2 版本不是 1；-3 Token/选项/扩展字节越界；-4 TKL 为保留值 9~15；
+// -5 选项 delta/长度为保留值 15；-6 选项数超过 COAP_MSG_MAX_OPTS 或编号溢出；-7 负载标记后没有负载
+int coap_msg_parse(coap_msg_view_t *m, const uint8_t *buf, size_t len);
+
+// 查找编号为 number 的第一个选项，不存在返回 NULL
+const coap_opt_view_t *coap_msg_find(const coap_msg_view_t *m, uint16_t number);
+
+// 同编号的下一个选项（可重复选项如 Uri-Path/Uri-Query），没有返回 NULL
+static inline const coap_opt_view_t *coap_msg_next(const coap_msg_view_t *m, const coap_opt_view_t *opt) {
+	const coap_opt_view_t *n = opt + 1;
+	return (n < m->opts + m->opt_count && n->number == opt->number) ? n : NULL;
+}
+
+// 把选项值按网络序无符号整数解读（uint 格式选项，最长 4 字节）
+static inline uint32_t coap_opt_uint(const coap_opt_view_t *opt) {
+	uint32_t v = 0;
+	for (uint16_t i = 0; i < opt->len && i < 4; ++i) v = (v << 8) | opt->value[i];
+	return v;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COAP_MSG_H
@@ -0,0 +1,270 @@
+// coap_observe.c
+#include "coap_observe.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#endif
+
+#define OBS_NIL 0xFFFFFFFFu
+#define OBS_MIN_PEERS 16
+
+// ---- 序列锁 ----
+
+#ifdef _MSC_VER
+static uint32_t version_load(const uint32_t *p) {
+	uint32_t v = *(const volatile uint32_t*)p;
+	MemoryBarrier();
+	return v;
+}
+
+static int version_begin(uint32_t *p, uint32_t v) {
+	return (uint32_t)InterlockedCompareExchange((volatile LONG*)p, (LONG)(v + 1), (LONG)v) == v;
+}
+
+static void version_end(uint32_t *p, uint32_t v) {
+	MemoryBarrier();
+	*(volatile uint32_t*)p = v;
+}
+
+static void read_fence(void) {
+	MemoryBarrier();
+}
+#else
+static uint32_t version_load(const uint32_t *p) {
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static int version_begin(uint32_t *p, uint32_t v) {
+	return __atomic_compare_exchange_n(p, &v, v + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static void version_end(uint32_t *p, uint32_t v) {
+	__atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static void read_fence(void) {
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+#endif
+
+int coap_obs_publish(coap_obs_slot_t *s, const void *value, uint8_t len) {
+	uint32_t v = version_load(&s->version);
+	if ((v & 1u) || len > COAP_OBS_VALUE_MAX || !version_begin(&s->version, v)) return -1;
+	memcpy(s->value, value, len);
+	s->len = len;
+	version_end(&s->version, v + 2);
+	return 0;
+}
+
+uint32_t coap_obs_read(const coap_obs_slot_t *s, void *value, uint8_t *len) {
+	for (;;) {
+		uint32_t v = version_load(&s->version);
+		if (v & 1u) continue;
+		uint8_t n = s->len;
+		memcpy(value, s->value, COAP_OBS_VALUE_MAX);
+		read_fence();
+		if (version_load(&s->version) == v) {
+			*len = n;
+			return v;
+		}
+	}
+}
+
+// ---- 观察者表 ----
+
+static uint32_t pow2_at_least(uint32_t n) {
+	uint32_t p = 1;
+	while (p < n && p < 0x80000000u) p <<= 1;
+	return p;
+}
+
+static uint32_t peer_hash(uint32_t addr, uint16_t port, const uint8_t *token, uint8_t tkl) {
+	uint64_t h = ((uint64_t)addr << 16 | port) ^ 1469598103934665603ull;
+	for (uint8_t i = 0; i < tkl; ++i) h = (h ^ token[i]) * 1099511628211ull;
+	return (uint32_t)((h * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+static int peer_is(const coap_obs_peer_t *p, uint32_t addr, uint16_t port, const uint8_t *token, uint8_t tkl) {
+	return p->addr == addr && p->port == port && p->tkl == tkl && memcmp(p->token, token, tkl) == 0;
+}
+
+static coap_obs_peer_t *node_peer(const coap_obs_table_t *t, uint32_t id) {
+	return &t->lists[t->nodes[id].list].peers[t->nodes[id].pos];
+}
+
+// 散列链上指向该观察者节点的链接，没有返回 NULL
+static uint32_t *find_link(coap_obs_table_t *t, uint32_t addr, uint16_t port, const uint8_t *token, uint8_t tkl) {
+	uint32_t *link = &t->buckets[peer_hash(addr, port, token, tkl) & t->bucket_mask];
+	for (; *link != OBS_NIL; link = &t->nodes[*link].next) {
+		if (peer_is(node_peer(t, *link), addr, port, token, tkl)) return link;
+	}
+	return NULL;
+}
+
+int coap_obs_init(coap_obs_table_t *t, uint32_t max_observers, uint32_t max_resources) {
+	memset(t, 0, sizeof(*t));
+	if (max_observers == 0 || max_resources == 0) return -1;
+	uint32_t rs = pow2_at_least(max_resources * 2u);
+	uint32_t nb = pow2_at_least(max_observers);
+	t->lists = (coap_obs_list_t*)calloc(max_resources, sizeof(coap_obs_list_t));
+	t->res_index = (uint32_t*)calloc(rs, sizeof(uint32_t));
+	t->nodes = (coap_obs_node_t*)malloc((size_t)max_observers * sizeof(coap_obs_node_t));
+	t->free_ids = (uint32_t*)malloc((size_t)max_observers * sizeof(uint32_t));
+	t->buckets = (uint32_t*)malloc((size_t)nb * sizeof(uint32_t));
+	if (!t->lists || !t->res_index || !t->nodes || !t->free_ids || !t->buckets) {
+		coap_obs_destroy(t);
+		return -2;
+	}
+	memset(t->buckets, 0xFF, (size_t)nb * sizeof(uint32_t));
+	for (uint32_t i = 0; i < max_observers; ++i) t->free_ids[i] = max_observers - 1 - i;
+	t->free_top = max_observers;
+	t->max_lists = max_resources;
+	t->res_mask = rs - 1;
+	t->bucket_mask = nb - 1;
+	t->max_observers = max_observers;
+	return 0;
+}
+
+void coap_obs_destroy(coap_obs_table_t *t) {
+	for (uint32_t i = 0; t->lists && i < t->list_count; ++i) free(t->lists[i].peers);
+	free(t->lists);
+	free(t->res_index);
+	free(t->nodes);
+	free(t->free_ids);
+	free(t->buckets);
+	memset(t, 0, sizeof(*t));
+}
+
+// 资源对应的列表下标；create 非 0 时没有就新建。返回 OBS_NIL 表示没有（或资源已满）
+static uint32_t list_of(coap_obs_table_t *t, uint32_t resource, int create) {
+	uint32_t i = (uint32_t)((resource * 0x9E3779B97F4A7C15ull) >> 32) & t->res_mask;
+	for (; t->res_index[i]; i = (i + 1) & t->res_mask) {
+		uint32_t li = t->res_index[i] - 1;
+		if (t->lists[li].resource == resource) return li;
+	}
+	if (!create || t->list_count == t->max_lists) return OBS_NIL;
+	uint32_t li = t->list_count++;
+	t->lists[li].resource = resource;
+	t->res_index[i] = li + 1;
+	return li;
+}
+
+coap_obs_list_t *coap_obs_find_list(coap_obs_table_t *t, uint32_t resource) {
+	uint32_t li = list_of(t, resource, 0);
+	return li == OBS_NIL ? NULL : &t->lists[li];
+}
+
+// 移除列表中第 pos 个观察者：末尾元素填洞，归还节点
+static void remove_at(coap_obs_table_t *t, uint32_t li, uint32_t pos) {
+	coap_obs_list_t *l = &t->lists[li];
+	coap_obs_peer_t *p = &l->peers[pos];
+	uint32_t id = p->id;
+	uint32_t *link = &t->buckets[peer_hash(p->addr, p->port, p->token, p->tkl) & t->bucket_mask];
+	while (*link != id) link = &t->nodes[*link].next;
+	*link = t->nodes[id].next;
+	uint32_t last = --l->count;
+	if (pos != last) {
+		l->peers[pos] = l->peers[last];
+		t->nodes[l->peers[pos].id].pos = pos;
+	}
+	t->free_ids[t->free_top++] = id;
+	t->active--;
+}
+
+int coap_obs_register(coap_obs_table_t *t, uint32_t resource, uint32_t addr, uint16_t port,
+	const uint8_t *token, uint8_t tkl, uint32_t expires_s) {
+	if (tkl > 8) tkl = 8;
+	int again = 0;
+	uint32_t *link = find_link(t, addr, port, token, tkl);
+	if (link) {
+		const coap_obs_node_t *n = &t->nodes[*link];
+		if (t->lists[n->list].resource == resource) {
+			t->lists[n->list].peers[n->pos].expires_s = expires_s;
+			return 1;
+		}
+		remove_at(t, n->list, n->pos); // 同一 Token 改观察别的资源
+		again = 1;
+	}
+	uint32_t li = list_of(t, resource, 1);
+	if (li == OBS_NIL) return -2;
+	if (t->free_top == 0) return -1;
+	coap_obs_list_t *l = &t->lists[li];
+	if (l->count == l->cap) {
+		uint32_t cap = l->cap ? l->cap * 2u : OBS_MIN_PEERS;
+		coap_obs_peer_t *np = (coap_obs_peer_t*)realloc(l->peers, (size_t)cap * sizeof(coap_obs_peer_t));
+		if (!np) return -3;
+		l->peers = np;
+		l->cap = cap;
+	}
+	uint32_t id = t->free_ids[--t->free_top];
+	coap_obs_peer_t *p = &l->peers[l->count];
+	memset(p, 0, sizeof(*p));
+	p->addr = addr;
+	p->port = port;
+	p->tkl = tkl;
+	memcpy(p->token, token, tkl);
+	p->id = id;
+	p->expires_s = expires_s;
+	uint32_t b = peer_hash(addr, port, token, tkl) & t->bucket_mask;
+	t->nodes[id].list = li;
+	t->nodes[id].pos = l->count;
+	t->nodes[id].next = t->buckets[b];
+	t->buckets[b] = id;
+	l->count++;
+	t->active++;
+	return again;
+}
+
+int coap_obs_deregister(coap_obs_table_t *t, uint32_t addr, uint16_t port, const uint8_t *token, uint8_t tkl) {
+	if (tkl > 8) return -1;
+	uint32_t *link = find_link(t, addr, port, token, tkl);
+	if (!link) return -1;
+	remove_at(t, t->nodes[*link].list, t->nodes[*link].pos);
+	return 0;
+}
+
+int coap_obs_reset(coap_obs_table_t *t, uint32_t addr, uint16_t port, uint16_t mid) {
+	for (uint32_t li = 0; li < t->list_count; ++li) {
+		const coap_obs_list_t *l = &t->lists[li];
+		uint32_t off = (uint16_t)(mid - l->round_mid);
+		if (off >= l->round_count || off >= l->count) continue;
+		if (l->peers[off].addr != addr || l->peers[off].port != port) continue;
+		remove_at(t, li, off);
+		return 0;
+	}
+	return -1;
+}
+
+uint32_t coap_obs_expire(coap_obs_table_t *t, uint32_t list, uint32_t now_s) {
+	coap_obs_list_t *l = &t->lists[list];
+	uint32_t removed = 0;
+	for (uint32_t i = 0; i < l->count;) {
+		if ((int32_t)(now_s - l->peers[i].expires_s) >= 0) {
+			remove_at(t, list, i); // 末尾元素填到 i，再检查一次
+			removed++;
+		} else {
+			i++;
+		}
+	}
+	return removed;
+}
+
+uint32_t coap_obs_headers(const coap_obs_list_t *l, uint32_t from, uint32_t n, uint8_t code, uint16_t mid,
+	uint8_t *hdr, uint8_t *hdr_len) {
+	if (from >= l->count) return 0;
+	if (n > l->count - from) n = l->count - from;
+	const coap_obs_peer_t *p = l->peers + from;
+	for (uint32_t i = 0; i < n; ++i, ++p) {
+		uint8_t *h = hdr + (size_t)i * COAP_OBS_HDR_MAX;
+		uint16_t m = (uint16_t)(mid + i);
+		h[0] = (uint8_t)(0x50 | p->tkl); // ver=1，NON
+		h[1] = code;
+		h[2] = (uint8_t)(m >> 8);
+		h[3] = (uint8_t)m;
+		memcpy(h + 4, p->token, 8);      // 定长拷贝，按 tkl 截取
+		hdr_len[i] = (uint8_t)(4 + p->tkl);
+	}
+	return n;
+}
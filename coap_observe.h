@@ -0,0 +1,115 @@
+// coap_observe.h
+// 资源观察（RFC 7641 Observe）：服务端观察者表与跨线程的资源最新值
+// 观察者表按资源分组，每个资源一段稠密数组存放观察者（地址、端口、Token、过期时刻），通知时顺序遍历、
+// 按批生成各自的报文头，选项与负载由调用方只序列化一次、所有报文共享；另有按 (端点, Token) 的链式散列索引，
+// 重新注册与取消都是 O(1)，删除时用末尾元素填洞保持数组稠密。单线程使用（每个服务端分片一份）
+// 资源最新值放在共享的 coap_obs_slot_t 中，用序列锁发布：任何线程写入，各分片读取并比较版本决定是否通知
+
+#ifndef COAP_OBSERVE_H
+#define COAP_OBSERVE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define COAP_OPT_OBSERVE 6
+#define COAP_OBS_SEQ_MASK 0xFFFFFFu // Observe 序号为 24 位
+#define COAP_OBS_HDR_MAX 12         // 通知报文头：固定头部 4 字节 + Token 至多 8 字节
+#define COAP_OBS_VALUE_MAX 24       // 资源值的最大字节数
+
+// ---- 资源最新值 ----
+
+typedef struct {
+	uint32_t version;  // 偶数为稳定值（0 表示尚未发布），奇数表示正在写入
+	uint8_t len;
+	uint8_t value[COAP_OBS_VALUE_MAX];
+} coap_obs_slot_t;
+
+// 发布新值；另一线程正在写同一资源时放弃本次（最新值以对方为准），返回 0 成功，-1 放弃
+int coap_obs_publish(coap_obs_slot_t *s, const void *value, uint8_t len);
+
+// 读取一致的快照：返回版本（偶数，0 表示尚未发布），值写入 value（至少 COAP_OBS_VALUE_MAX 字节）
+uint32_t coap_obs_read(const coap_obs_slot_t *s, void *value, uint8_t *len);
+
+// 版本对应的 Observe 序号：每发布一次加一，所有分片一致
+static inline uint32_t coap_obs_seq(uint32_t version) {
+	return (version >> 1) & COAP_OBS_SEQ_MASK;
+}
+
+// ---- 观察者表 ----
+
+typedef struct {
+	uint32_t addr;      // IPv4 地址，网络序
+	uint16_t port;      // 网络序
+	uint8_t tkl;
+	uint8_t token[8];
+	uint32_t id;        // 索引节点编号
+	uint32_t expires_s; // 注册过期时刻（Unix 秒），重新注册时刷新
+} coap_obs_peer_t;
+
+typedef struct {
+	uint32_t resource;      // 资源编号
+	uint32_t count;
+	uint32_t cap;
+	coap_obs_peer_t *peers; // 稠密数组，按需倍增
+	uint32_t notified;      // 已通知到的版本
+	uint16_t round_mid;     // 最近一轮通知的首个 MID，第 i 个观察者的 MID 为 round_mid + i
+	uint32_t round_count;   // 最近一轮通知的报文数，0 表示还没有通知过
+} coap_obs_list_t;
+
+typedef struct {
+	uint32_t list;  // 所在资源列表
+	uint32_t pos;   // 在列表中的下标
+	uint32_t next;  // 同一散列桶的下一节点
+} coap_obs_node_t;
+
+typedef struct {
+	coap_obs_list_t *lists;   // 有过观察者的资源，运行期间不删除
+	uint32_t list_count;
+	uint32_t max_lists;
+	uint32_t *res_index;      // 资源编号 -> 列表下标 + 1 的开放寻址表，0 为空
+	uint32_t res_mask;
+	coap_obs_node_t *nodes;   // max_observers 个
+	uint32_t *free_ids;       // 空闲节点栈
+	uint32_t free_top;
+	uint32_t *buckets;        // (端点, Token) 散列 -> 节点链首
+	uint32_t bucket_mask;
+	uint32_t max_observers;
+	uint32_t active;          // 当前观察者数
+} coap_obs_table_t;
+
+// 分配表：至多 max_observers 个观察者、max_resources 个资源。返回 0 成功，-1 参数错误，-2 内存不足
+int coap_obs_init(coap_obs_table_t *t, uint32_t max_observers, uint32_t max_resources);
+void coap_obs_destroy(coap_obs_table_t *t);
+
+// 注册；同一端点 + Token 已存在时为重新注册：刷新过期时刻（资源不同则移到新资源），不产生重复观察者
+// 返回 0 新注册，1 重新注册；-1 观察者已满，-2 资源已满，-3 内存不足
+int coap_obs_register(coap_obs_table_t *t, uint32_t resource, uint32_t addr, uint16_t port,
+	const uint8_t *token, uint8_t tkl, uint32_t expires_s);
+
+// 取消端点 + Token 的观察；返回 0 成功，-1 不存在
+int coap_obs_deregister(coap_obs_table_t *t, uint32_t addr, uint16_t port, const uint8_t *token, uint8_t tkl);
+
+// 观察者以 RST 回应通知：按 MID 在各资源最近一轮通知中定位并移除（该位置已换成其他端点时不动）
+// 返回 0 移除，-1 未找到
+int coap_obs_reset(coap_obs_table_t *t, uint32_t addr, uint16_t port, uint16_t mid);
+
+// 移除列表中已过期的观察者，返回移除个数
+uint32_t coap_obs_expire(coap_obs_table_t *t, uint32_t list, uint32_t now_s);
+
+// 为列表中 [from, from + n) 的观察者生成通知报文头（NON、code、MID = mid + 下标偏移、各自的 Token），
+// 第 i 条写在 hdr + i * COAP_OBS_HDR_MAX，长度写入 hdr_len[i]；返回生成条数
+uint32_t coap_obs_headers(const coap_obs_list_t *l, uint32_t from, uint32_t n, uint8_t code, uint16_t mid,
+	uint8_t *hdr, uint8_t *hdr_len);
+
+// 资源编号对应的列表，没有返回 NULL
+coap_obs_list_t *coap_obs_find_list(coap_obs_table_t *t, uint32_t resource);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COAP_OBSERVE_H
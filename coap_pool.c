@@ -0,0 +1,40 @@
+// coap_pool.c
+#include "coap_pool.h"
+#include <stdlib.h>
+#include <string.h>
+
+int coap_pool_init(coap_pool_t *pool, uint32_t count, uint32_t buf_size) {
+	if (!pool || count == 0 || buf_size == 0) return -1;
+	memset(pool, 0, sizeof(*pool));
+	pool->slab = (uint8_t*)malloc((size_t)count * buf_size);
+	pool->free_ids = (uint32_t*)malloc(sizeof(uint32_t) * count);
+	if (!pool->slab || !pool->free_ids) {
+		coap_pool_destroy(pool);
+		return -2;
+	}
+	pool->count = count;
+	pool->buf_size = buf_size;
+	// 逆序入栈，使低地址缓冲先被取出
+	for (uint32_t i = 0; i < count; ++i) pool->free_ids[i] = count - 1 - i;
+	pool->free_top = count;
+	return 0;
+}
+
+void coap_pool_destroy(coap_pool_t *pool) {
+	if (!pool) return;
+	free(pool->slab);
+	free(pool->free_ids);
+	memset(pool, 0, sizeof(*pool));
+}
+
+uint8_t *coap_pool_alloc(coap_pool_t *pool) {
+	if (pool->free_top == 0) return NULL;
+	uint32_t id = pool->free_ids[--pool->free_top];
+	return pool->slab + (size_t)id * pool->buf_size;
+}
+
+void coap_pool_free(coap_pool_t *pool, uint8_t *buf) {
+	if (!buf) return;
+	uint32_t id = (uint32_t)((size_t)(buf - pool->slab) / pool->buf_size);
+	pool->free_ids[pool->free_top++] = id;
+}
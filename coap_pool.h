@@ -0,0 +1,45 @@
+// coap_pool.h
+// 报文缓冲池：一次性预分配的定长缓冲 slab + 空闲下标栈
+// 在途 CON 报文存放在池中，重传时原样重发，收发热路径上不再 malloc
+
+#ifndef COAP_POOL_H
+#define COAP_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	uint8_t *slab;       // count * buf_size 字节的连续内存
+	uint32_t *free_ids;  // 空闲缓冲下标栈（LIFO，热缓冲优先复用）
+	uint32_t free_top;
+	uint32_t count;
+	uint32_t buf_size;
+} coap_pool_t;
+
+// 预分配 count 个 buf_size 字节的缓冲；返回 0 成功，<0 内存不足
+int coap_pool_init(coap_pool_t *pool, uint32_t count, uint32_t buf_size);
+void coap_pool_destroy(coap_pool_t *pool);
+
+// 取出/归还一个缓冲；池耗尽时返回 NULL
+uint8_t *coap_pool_alloc(coap_pool_t *pool);
+void coap_pool_free(coap_pool_t *pool, uint8_t *buf);
+
+// 当前可用缓冲数
+static inline uint32_t coap_pool_available(const coap_pool_t *pool) {
+	return pool->free_top;
+}
+
+// 缓冲在池中的下标（0..count-1），便于调用方为每个缓冲挂附加的预分配数据
+static inline uint32_t coap_pool_index(const coap_pool_t *pool, const uint8_t *buf) {
+	return (uint32_t)((size_t)(buf - pool->slab) / pool->buf_size);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COAP_POOL_H
@@ -0,0 +1,155 @@
+// coap_router.c
+#include "coap_router.h"
+#include <stdlib.h>
+#include <string.h>
+
+static void node_reset(coap_route_node_t *n) {
+	memset(n, 0, sizeof(*n));
+	n->first_child = n->next = n->wild_child = COAP_ROUTER_NONE;
+	for (int i = 0; i < COAP_ROUTER_METHODS; ++i) n->handler[i] = COAP_ROUTER_NONE;
+}
+
+static uint32_t seg_hash(const uint8_t *seg, size_t len) {
+	uint32_t h = 2166136261u; // FNV-1a
+	for (size_t i = 0; i < len; ++i) h = (h ^ seg[i]) * 16777619u;
+	return h;
+}
+
+static uint32_t edge_slot(const coap_router_t *r, uint16_t parent, uint32_t hash) {
+	return (uint32_t)(((hash ^ (uint64_t)parent << 32) * 0x9E3779B97F4A7C15ull) >> 32) & r->edge_mask;
+}
+
+int coap_router_init(coap_router_t *r, uint32_t max_nodes) {
+	memset(r, 0, sizeof(*r));
+	if (max_nodes == 0 || max_nodes >= COAP_ROUTER_NONE) return -1;
+	uint32_t ne = 1;
+	while (ne < max_nodes * 2u) ne <<= 1;
+	r->nodes = (coap_route_node_t*)malloc((size_t)max_nodes * sizeof(coap_route_node_t));
+	r->edges = (coap_route_edge_t*)malloc((size_t)ne * sizeof(coap_route_edge_t));
+	if (!r->nodes || !r->edges) {
+		coap_router_destroy(r);
+		return -2;
+	}
+	for (uint32_t i = 0; i < ne; ++i) r->edges[i].child = COAP_ROUTER_NONE;
+	r->edge_mask = ne - 1;
+	r->cap = (uint16_t)max_nodes;
+	r->count = 1;
+	node_reset(&r->nodes[0]);
+	return 0;
+}
+
+void coap_router_destroy(coap_router_t *r) {
+	free(r->nodes);
+	free(r->edges);
+	memset(r, 0, sizeof(*r));
+}
+
+// parent 下标签为 seg 的子节点；create 非 0 时没有就追加到兄弟链末尾。返回 COAP_ROUTER_NONE 表示没有（或已满）
+static uint16_t child_of(coap_router_t *r, uint16_t parent, const char *seg, size_t len, int create) {
+	int wild = len == 1 && seg[0] == '+';
+	uint16_t *link = &r->nodes[parent].first_child;
+	for (; *link != COAP_ROUTER_NONE; link = &r->nodes[*link].next) {
+		const coap_route_node_t *c = &r->nodes[*link];
+		if (c->len == len && memcmp(c->label, seg, len) == 0) return *link;
+	}
+	if (!create || r->count == r->cap) return COAP_ROUTER_NONE;
+	uint16_t id = r->count++;
+	coap_route_node_t *n = &r->nodes[id];
+	node_reset(n);
+	memcpy(n->label, seg, len);
+	n->len = (uint8_t)len;
+	n->wildcard = (uint8_t)wild;
+	*link = id;
+	if (wild) {
+		r->nodes[parent].wild_child = id;
+		return id;
+	}
+	uint32_t h = seg_hash((const uint8_t*)seg, len), i = edge_slot(r, parent, h);
+	while (r->edges[i].child != COAP_ROUTER_NONE) i = (i + 1) & r->edge_mask;
+	r->edges[i].hash = h;
+	r->edges[i].parent = parent;
+	r->edges[i].child = id;
+	return id;
+}
+
+int coap_router_add(coap_router_t *r, uint8_t method, const char *path, uint16_t handler) {
+	if (!r->nodes || !path || method < 1 || method > COAP_ROUTER_METHODS || handler == COAP_ROUTER_NONE) return -1;
+	while (*path == '/') path++;
+	uint16_t at = 0;
+	while (*path) {
+		const char *end = strchr(path, '/');
+		size_t len = end ? (size_t)(end - path) : strlen(path);
+		if (len == 0 || len >= COAP_ROUTER_SEG_MAX) return -1;
+		at = child_of(r, at, path, len, 1);
+		if (at == COAP_ROUTER_NONE) return -2;
+		path += len;
+		while (*path == '/') path++;
+	}
+	uint16_t *h = &r->nodes[at].handler[method - 1];
+	if (*h != COAP_ROUTER_NONE) return -3;
+	*h = handler;
+	return 0;
+}
+
+int coap_router_match(const coap_router_t *r, const coap_msg_view_t *m, uint16_t *handler) {
+	uint16_t at = 0;
+	for (const coap_opt_view_t *o = coap_msg_find(m, COAP_OPT_URI_PATH); o; o = coap_msg_next(m, o)) {
+		uint16_t next = COAP_ROUTER_NONE;
+		if (o->len < COAP_ROUTER_SEG_MAX) {
+			uint32_t h = seg_hash(o->value, o->len);
+			for (uint32_t i = edge_slot(r, at, h); r->edges[i].child != COAP_ROUTER_NONE; i = (i + 1) & r->edge_mask) {
+				const coap_route_edge_t *e = &r->edges[i];
+				const coap_route_node_t *cn = &r->nodes[e->child];
+				if (e->hash == h && e->parent == at && cn->len == o->len && memcmp(cn->label, o->value, o->len) == 0) {
+					next = e->child;
+					break;
+				}
+			}
+		}
+		if (next == COAP_ROUTER_NONE) next = r->nodes[at].wild_child;
+		if (next == COAP_ROUTER_NONE) return -1;
+		at = next;
+	}
+	const coap_route_node_t *n = &r->nodes[at];
+	int any = 0;
+	for (int i = 0; i < COAP_ROUTER_METHODS; ++i) any |= n->handler[i] != COAP_ROUTER_NONE;
+	if (!any) return -1;
+	if (m->code < 1 || m->code > COAP_ROUTER_METHODS || n->handler[m->code - 1] == COAP_ROUTER_NONE) return -2;
+	*handler = n->handler[m->code - 1];
+	return 0;
+}
+
+// 深度优先输出 at 子树中有处理的路径，prefix 为 at 的完整路径；通配段的子树都不是具体资源，整棵跳过
+static size_t links_of(const coap_router_t *r, uint16_t at, char *prefix, size_t plen, char *out, size_t cap, size_t n) {
+	for (uint16_t c = r->nodes[at].first_child; c != COAP_ROUTER_NONE; c = r->nodes[c].next) {
+		const coap_route_node_t *cn = &r->nodes[c];
+		if (cn->wildcard) continue;
+		size_t len = plen + 1 + cn->len;
+		prefix[plen] = '/';
+		memcpy(prefix + plen + 1, cn->label, cn->len);
+		int any = 0;
+		for (int i = 0; i < COAP_ROUTER_METHODS; ++i) any |= cn->handler[i] != COAP_ROUTER_NONE;
+		// "</path>" 前面另有 ',' 分隔
+		size_t need = len + 2 + (n ? 1 : 0);
+		if (any && n + need < cap) {
+			if (n) out[n++] = ',';
+			out[n++] = '<';
+			memcpy(out + n, prefix, len);
+			n += len;
+			out[n++] = '>';
+		}
+		n = links_of(r, c, prefix, len, out, cap, n);
+	}
+	return n;
+}
+
+size_t coap_router_links(const coap_router_t *r, char *out, size_t cap) {
+	// 前缀缓冲按最深的情况（每个节点一层）分配；只在启动时调用
+	size_t pcap = (size_t)r->count * (COAP_ROUTER_SEG_MAX + 1) + 1;
+	char *prefix = cap ? (char*)malloc(pcap) : NULL;
+	if (!prefix) return 0;
+	size_t n = links_of(r, 0, prefix, 0, out, cap, 0);
+	out[n] = '\0';
+	free(prefix);
+	return n;
+}
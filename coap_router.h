@@ -0,0 +1,66 @@
+// coap_router.h
+// 请求路由：按 Uri-Path 段建前缀树（每段一个节点），节点上按方法（GET/POST/PUT/DELETE）挂处理编号
+// 父子边放在一张开放寻址散列表里，键为 (父节点, 段散列)，下行一层只需对该段做一次散列与一次比较，与同层路由数无关；
+// 启动时一次性建好，运行期间只读、各线程共享；匹配逐段下行，精确段优先、否则走该层的通配段 "+"（不回溯），
+// 开销与路径长度成正比，不分配内存
+
+#ifndef COAP_ROUTER_H
+#define COAP_ROUTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "coap_msg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define COAP_ROUTER_METHODS 4  // GET(1) POST(2) PUT(3) DELETE(4)
+#define COAP_ROUTER_SEG_MAX 32 // 单段路径的最大长度
+#define COAP_ROUTER_NONE 0xFFFF
+
+typedef struct {
+	char label[COAP_ROUTER_SEG_MAX]; // 路径段，"+" 匹配任意一段
+	uint8_t len;
+	uint8_t wildcard;
+	uint16_t first_child;            // 子节点链首（只用于列出资源），COAP_ROUTER_NONE 为无
+	uint16_t next;                   // 同层的下一个兄弟
+	uint16_t wild_child;             // 通配子节点，单独记录，匹配时不必遍历兄弟链
+	uint16_t handler[COAP_ROUTER_METHODS]; // 各方法的处理编号，COAP_ROUTER_NONE 为未注册
+} coap_route_node_t;
+
+typedef struct {
+	uint32_t hash;   // 段内容的散列
+	uint16_t parent;
+	uint16_t child;  // COAP_ROUTER_NONE 为空位
+} coap_route_edge_t;
+
+typedef struct {
+	coap_route_node_t *nodes; // nodes[0] 为根（空路径）
+	uint16_t count;
+	uint16_t cap;
+	coap_route_edge_t *edges; // 精确段的父子边，容量为不小于 2 * cap 的 2 的幂
+	uint32_t edge_mask;
+} coap_router_t;
+
+// 分配至多 max_nodes 个节点（含根，不超过 65535）。返回 0 成功，-1 参数错误，-2 内存不足
+int coap_router_init(coap_router_t *r, uint32_t max_nodes);
+void coap_router_destroy(coap_router_t *r);
+
+// 注册路由：method 为 CoAP 方法码 1..4，path 为 '/' 分隔的路径（首尾 '/' 可省，空串为根），handler 为调用方的处理编号
+// 返回 0 成功；-1 参数错误（方法、段长或空段）；-2 节点已满；-3 该方法与路径已注册
+int coap_router_add(coap_router_t *r, uint8_t method, const char *path, uint16_t handler);
+
+// 按请求的方法与 Uri-Path 匹配，命中时处理编号写入 *handler
+// 返回 0 命中；-1 路径不存在（4.04）；-2 路径存在但不支持该方法（4.05）
+int coap_router_match(const coap_router_t *r, const coap_msg_view_t *m, uint16_t *handler);
+
+// 生成 CoRE Link Format（RFC 6690）的资源列表："</auth>,</things/upload>,..."，深度优先、同层按注册顺序输出有处理的路径；
+// 含通配段的路径（如 things/+/+）不是可直接请求的资源，不输出。放不下的条目略去，返回写入长度（不含结尾 '\0'）
+size_t coap_router_links(const coap_router_t *r, char *out, size_t cap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COAP_ROUTER_H
@@ -0,0 +1,111 @@
+// coap_rto.c
+// CoCoA（draft-ietf-core-cocoa）风格的自适应重传超时
+
+#include "coap_rto.h"
+#include <string.h>
+
+static uint32_t clamp_rto(uint64_t us) {
+	if (us < (uint64_t)COAP_RTO_MIN_MS * 1000u) return COAP_RTO_MIN_MS * 1000u;
+	if (us > (uint64_t)COAP_RTO_MAX_MS * 1000u) return COAP_RTO_MAX_MS * 1000u;
+	return (uint32_t)us;
+}
+
+void coap_rto_init(coap_rto_t *rto, coap_rto_mode_t mode, uint32_t ack_timeout_ms, uint8_t max_retransmit) {
+	memset(rto, 0, sizeof(*rto));
+	rto->mode = mode;
+	rto->base_ms = ack_timeout_ms ? ack_timeout_ms : 2000;
+	rto->max_retransmit = max_retransmit;
+	rto->rto_us = clamp_rto((uint64_t)rto->base_ms * 1000u);
+}
+
+uint32_t coap_rto_initial(coap_rto_t *rto, uint64_t now_us, uint32_t rand32) {
+	if (rto->mode == COAP_RTO_FIXED) return rto->base_ms;
+
+	// RTO 老化：长时间没有新样本时向 1s 回归，防止估计值过期
+	if (rto->last_update_us != 0) {
+		uint64_t idle = now_us - rto->last_update_us;
+		if (rto->rto_us < 1000000u && idle > 16ull * rto->rto_us) {
+			rto->rto_us = clamp_rto(rto->rto_us * 2ull);
+			rto->last_update_us = now_us;
+		} else if (rto->rto_us > 3000000u && idle > 4ull * rto->rto_us) {
+			rto->rto_us = clamp_rto(1000000ull + rto->rto_us / 2);
+			rto->last_update_us = now_us;
+		}
+	}
+	// ACK_RANDOM_FACTOR = 1.5：在 [RTO, 1.5*RTO] 内均匀抖动，打散同步重传
+	uint64_t jitter = ((uint64_t)(rto->rto_us / 2) * rand32) >> 32;
+	uint64_t ms = (rto->rto_us + jitter + 999u) / 1000u;
+	return (uint32_t)ms;
+}
+
+uint32_t coap_rto_backoff(const coap_rto_t *rto, uint32_t cur_ms) {
+	uint64_t next;
+	if (rto->mode == COAP_RTO_FIXED) {
+		next = (uint64_t)cur_ms * 2u; // 指数退避
+	} else if (cur_ms < 1000u) {
+		next = (uint64_t)cur_ms * 3u; // 可变退避系数：小 RTO 退得更快
+	} else if (cur_ms > 3000u) {
+		next = (uint64_t)cur_ms * 3u / 2u;
+	} else {
+		next = (uint64_t)cur_ms * 2u;
+	}
+	return next > COAP_RTO_MAX_MS ? COAP_RTO_MAX_MS : (uint32_t)next;
+}
+
+// RFC6298：首个样本 SRTT=R、RTTVAR=R/2；之后 RTTVAR=3/4*RTTVAR+1/4*|SRTT-R|、SRTT=7/8*SRTT+1/8*R
+static void rtt_update(uint32_t *srtt, uint32_t *rttvar, uint8_t *valid, uint32_t r) {
+	if (!*valid) {
+		*srtt = r;
+		*rttvar = r / 2;
+		*valid = 1;
+		return;
+	}
+	uint32_t diff = *srtt > r ? *srtt - r : r - *srtt;
+	*rttvar = (uint32_t)(((uint64_t)*rttvar * 3u + diff) / 4u);
+	*srtt = (uint32_t)(((uint64_t)*srtt * 7u + r) / 8u);
+}
+
+// 固定策略第 i 次重传发生在 base*(2^i - 1)；统计在 elapsed 之前会发生几次
+static uint8_t fixed_equiv(const coap_rto_t *rto, int acked, uint64_t elapsed_us) {
+	if (!acked) return rto->max_retransmit;
+	uint8_t n = 0;
+	uint64_t t = 0, step = (uint64_t)rto->base_ms * 1000u;
+	while (n < rto->max_retransmit) {
+		t += step;
+		if (t > elapsed_us) break;
+		n++;
+		step *= 2;
+	}
+	return n;
+}
+
+uint8_t coap_rto_complete(coap_rto_t *rto, int acked, uint64_t first_send_us, uint64_t now_us,
+						  uint8_t retransmits) {
+	uint64_t elapsed = now_us > first_send_us ? now_us - first_send_us : 0;
+	uint8_t fixed = fixed_equiv(rto, acked, elapsed);
+	rto->stats.exchanges++;
+	rto->stats.retransmits += retransmits;
+	rto->stats.retransmits_fixed += fixed;
+	if (!acked) return fixed;
+	rto->stats.acked++;
+	if (rto->mode == COAP_RTO_FIXED) return fixed;
+
+	uint32_t r = elapsed > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)elapsed;
+	if (retransmits == 0) {
+		// 强估计器：K=4，RTO_overall = 0.5*RTO_strong + 0.5*RTO_overall
+		rtt_update(&rto->strong_srtt_us, &rto->strong_rttvar_us, &rto->strong_valid, r);
+		uint64_t strong = (uint64_t)rto->strong_srtt_us + 4ull * rto->strong_rttvar_us;
+		rto->rto_us = clamp_rto((strong + rto->rto_us) / 2u);
+		rto->stats.strong_samples++;
+	} else if (retransmits <= 2) {
+		// 弱估计器（从首次发送计时，存在重传歧义）：K=1，RTO_overall = 0.25*RTO_weak + 0.75*RTO_overall
+		rtt_update(&rto->weak_srtt_us, &rto->weak_rttvar_us, &rto->weak_valid, r);
+		uint64_t weak = (uint64_t)rto->weak_srtt_us + rto->weak_rttvar_us;
+		rto->rto_us = clamp_rto((weak + 3ull * rto->rto_us) / 4u);
+		rto->stats.weak_samples++;
+	} else {
+		return fixed;
+	}
+	rto->last_update_us = now_us;
+	return fixed;
+}
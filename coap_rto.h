@@ -0,0 +1,62 @@
+// coap_rto.h
+// CON 重传超时策略：固定（RFC7252 原始指数退避）或 CoCoA 风格的自适应 RTO
+// 自适应模式按远端维护强/弱两个 RTT 估计器（RFC6298 SRTT/RTTVAR），
+// 首次超时在 [RTO, RTO*1.5] 内随机（ACK_RANDOM_FACTOR），退避系数随 RTO 变化且有上限
+
+#ifndef COAP_RTO_H
+#define COAP_RTO_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define COAP_RTO_MIN_MS 10      // 自适应 RTO 下限，避免回环/局域网上 RTT 抖动引发的伪重传
+#define COAP_RTO_MAX_MS 32000   // 单次超时上限（退避有界）
+
+typedef enum {
+	COAP_RTO_FIXED = 0, // 固定初始超时，每次翻倍（原有行为）
+	COAP_RTO_COCOA = 1  // CoCoA：RTT 估计 + 随机初始超时 + 可变退避系数
+} coap_rto_mode_t;
+
+typedef struct {
+	uint64_t exchanges;       // 结束的 CON 交换数
+	uint64_t acked;           // 其中收到响应的
+	uint64_t retransmits;     // 实际重传次数
+	uint64_t retransmits_fixed; // 同样的 RTT 下固定策略估计会产生的重传次数
+	uint64_t strong_samples;  // 强估计器样本数（无重传的交换）
+	uint64_t weak_samples;    // 弱估计器样本数（重传 1~2 次后收到响应）
+} coap_rto_stats_t;
+
+typedef struct {
+	coap_rto_mode_t mode;
+	uint32_t base_ms;         // ACK_TIMEOUT：固定策略的初始超时，也是自适应策略的初值
+	uint8_t max_retransmit;
+	uint8_t strong_valid;
+	uint8_t weak_valid;
+	uint32_t strong_srtt_us, strong_rttvar_us;
+	uint32_t weak_srtt_us, weak_rttvar_us;
+	uint32_t rto_us;          // RTO_overall
+	uint64_t last_update_us;  // 上次更新估计器的时刻，用于 RTO 老化
+	coap_rto_stats_t stats;
+} coap_rto_t;
+
+void coap_rto_init(coap_rto_t *rto, coap_rto_mode_t mode, uint32_t ack_timeout_ms, uint8_t max_retransmit);
+
+// 一次新交换的首次超时（ms）；rand32 为调用方提供的随机数，用于 ACK_RANDOM_FACTOR 抖动
+uint32_t coap_rto_initial(coap_rto_t *rto, uint64_t now_us, uint32_t rand32);
+
+// 超时后的下一次等待时间（ms）
+uint32_t coap_rto_backoff(const coap_rto_t *rto, uint32_t cur_ms);
+
+// 交换结束（acked=1 收到响应，0 放弃）时调用：更新估计器与计数
+// 返回同样的 RTT 下固定策略估计会产生的重传次数
+uint8_t coap_rto_complete(coap_rto_t *rto, int acked, uint64_t first_send_us, uint64_t now_us,
+						  uint8_t retransmits);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COAP_RTO_H
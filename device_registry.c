@@ -0,0 +1,460 @@
+// device_registry.c
+#include "device_registry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define REG_MIN_SLOTS 16
+#define REG_MAX_THREADS 64
+
+// 索引槽：高 32 位为标签，低 32 位为条目下标 + 1，0 表示空槽
+#define SLOT_MAKE(tag, idx) (((uint64_t)(tag) << 32) | (uint64_t)((idx) + 1u))
+#define SLOT_TAG(v) ((uint32_t)((v) >> 32))
+#define SLOT_IDX(v) ((uint32_t)(v) - 1u)
+
+struct device_registry {
+	registry_entry_t *entries;
+	uint32_t count;
+	uint32_t cap;
+	uint64_t *by_name;   // productKey+deviceName -> 条目
+	uint64_t *by_token;  // Token -> 条目（每个 Token 只登记一次）
+	uint32_t mask;       // 两个索引同样大小，槽数 - 1
+	char **blocks;       // 字符串所在的内存块（文件内容 / registry_add 的拷贝）
+	uint32_t block_count;
+	uint32_t block_cap;
+};
+
+// ---- 并发插入用的原子操作 ----
+
+#ifdef _MSC_VER
+static uint64_t slot_load(uint64_t *p) {
+	return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)p, 0, 0);
+}
+
+static int slot_cas(uint64_t *p, uint64_t *expected, uint64_t desired) {
+	uint64_t old = (uint64_t)InterlockedCompareExchange64((volatile LONG64*)p, (LONG64)desired, (LONG64)*expected);
+	if (old == *expected) return 1;
+	*expected = old;
+	return 0;
+}
+#else
+static uint64_t slot_load(uint64_t *p) {
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static int slot_cas(uint64_t *p, uint64_t *expected, uint64_t desired) {
+	return __atomic_compare_exchange_n(p, expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+#endif
+
+uint32_t registry_token(const char *product_key, const char *device_name, const char *device_secret) {
+	uint32_t sum = 0;
+	const char *p;
+	for (p = product_key; *p; ++p) sum += (unsigned char)(*p);
+	for (p = device_name; *p; ++p) sum += (unsigned char)(*p);
+	for (p = device_secret; *p; ++p) sum += (unsigned char)(*p);
+	return sum ^ 0x5Au;
+}
+
+// FNV-1a，productKey 与 deviceName 之间插入分隔字节，避免 "ab"+"c" 与 "a"+"bc" 相同
+static uint64_t name_hash(const char *pk, const char *dn) {
+	uint64_t h = 1469598103934665603ull;
+	for (; *pk; ++pk) h = (h ^ (unsigned char)*pk) * 1099511628211ull;
+	h = (h ^ 0xFFu) * 1099511628211ull;
+	for (; *dn; ++dn) h = (h ^ (unsigned char)*dn) * 1099511628211ull;
+	return h;
+}
+
+// Token 是 32 位值，直接作标签；槽位用乘法散列打散
+static uint32_t token_pos(uint32_t token) {
+	return (uint32_t)((token * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+// 插入按名索引；返回 1 插入成功，0 已有同名设备
+static int insert_name(device_registry_t *reg, uint32_t idx) {
+	const registry_entry_t *e = &reg->entries[idx];
+	uint64_t h = name_hash(e->product_key, e->device_name);
+	uint32_t tag = (uint32_t)(h >> 32);
+	uint64_t want = SLOT_MAKE(tag, idx);
+	for (uint32_t pos = (uint32_t)h & reg->mask;; pos = (pos + 1) & reg->mask) {
+		uint64_t *slot = &reg->by_name[pos];
+		uint64_t v = slot_load(slot);
+		if (v == 0) {
+			if (slot_cas(slot, &v, want)) return 1;
+			// 被其他线程抢先，v 已是新值，继续比较
+		}
+		if (SLOT_TAG(v) == tag) {
+			const registry_entry_t *o = &reg->entries[SLOT_IDX(v)];
+			if (strcmp(o->device_name, e->device_name) == 0 && strcmp(o->product_key, e->product_key) == 0) return 0;
+		}
+	}
+}
+
+// 插入按 Token 索引；该 Token 已登记时不再插入
+static void insert_token(device_registry_t *reg, uint32_t idx) {
+	uint32_t token = reg->entries[idx].token;
+	uint64_t want = SLOT_MAKE(token, idx);
+	for (uint32_t pos = token_pos(token) & reg->mask;; pos = (pos + 1) & reg->mask) {
+		uint64_t *slot = &reg->by_token[pos];
+		uint64_t v = slot_load(slot);
+		if (v == 0) {
+			if (slot_cas(slot, &v, want)) return;
+		}
+		if (SLOT_TAG(v) == token) return;
+	}
+}
+
+// 重建两个索引（单线程）
+static void rebuild_index(device_registry_t *reg) {
+	size_t slots = (size_t)reg->mask + 1;
+	memset(reg->by_name, 0, slots * sizeof(uint64_t));
+	memset(reg->by_token, 0, slots * sizeof(uint64_t));
+	for (uint32_t i = 0; i < reg->count; ++i) {
+		insert_name(reg, i);
+		insert_token(reg, i);
+	}
+}
+
+// 保证能容纳 need 个条目，索引负载不超过 1/2
+static int reserve(device_registry_t *reg, uint32_t need) {
+	if (need > 0x7FFFFFFEu) return -2;
+	if (need > reg->cap) {
+		registry_entry_t *ne = (registry_entry_t*)realloc(reg->entries, (size_t)need * sizeof(registry_entry_t));
+		if (!ne) return -2;
+		reg->entries = ne;
+		reg->cap = need;
+	}
+	uint64_t slots = REG_MIN_SLOTS;
+	while (slots < (uint64_t)need * 2) slots <<= 1;
+	if (reg->by_name && slots <= (uint64_t)reg->mask + 1) return 0;
+	uint64_t *bn = (uint64_t*)calloc((size_t)slots, sizeof(uint64_t));
+	uint64_t *bt = (uint64_t*)calloc((size_t)slots, sizeof(uint64_t));
+	if (!bn || !bt) {
+		free(bn);
+		free(bt);
+		return -2;
+	}
+	free(reg->by_name);
+	free(reg->by_token);
+	reg->by_name = bn;
+	reg->by_token = bt;
+	reg->mask = (uint32_t)(slots - 1);
+	rebuild_index(reg);
+	return 0;
+}
+
+static int own_block(device_registry_t *reg, char *block) {
+	if (reg->block_count == reg->block_cap) {
+		uint32_t nc = reg->block_cap ? reg->block_cap * 2 : 8;
+		char **nb = (char**)realloc(reg->blocks, nc * sizeof(char*));
+		if (!nb) return -2;
+		reg->blocks = nb;
+		reg->block_cap = nc;
+	}
+	reg->blocks[reg->block_count++] = block;
+	return 0;
+}
+
+int registry_create(device_registry_t **out, uint32_t capacity_hint) {
+	if (!out) return -1;
+	device_registry_t *reg = (device_registry_t*)calloc(1, sizeof(device_registry_t));
+	if (!reg) return -2;
+	if (reserve(reg, capacity_hint ? capacity_hint : 1) != 0) {
+		free(reg);
+		return -2;
+	}
+	*out = reg;
+	return 0;
+}
+
+void registry_destroy(device_registry_t *reg) {
+	if (!reg) return;
+	for (uint32_t i = 0; i < reg->block_count; ++i) free(reg->blocks[i]);
+	free(reg->blocks);
+	free(reg->entries);
+	free(reg->by_name);
+	free(reg->by_token);
+	free(reg);
+}
+
+int registry_add(device_registry_t *reg, const char *product_key, const char *device_name, const char *device_secret) {
+	if (!reg || !product_key || !device_name || !device_secret || !*product_key || !*device_name) return -1;
+	if (registry_find_name(reg, product_key, device_name)) return 1;
+	uint32_t need = reg->count + 1;
+	if (need > reg->cap && reserve(reg, reg->cap * 2 > need ? reg->cap * 2 : need) != 0) return -2;
+	size_t lp = strlen(product_key) + 1, ln = strlen(device_name) + 1, ls = strlen(device_secret) + 1;
+	char *s = (char*)malloc(lp + ln + ls);
+	if (!s) return -2;
+	if (own_block(reg, s) != 0) {
+		free(s);
+		return -2;
+	}
+	memcpy(s, product_key, lp);
+	memcpy(s + lp, device_name, ln);
+	memcpy(s + lp + ln, device_secret, ls);
+	registry_entry_t *e = &reg->entries[reg->count];
+	e->product_key = s;
+	e->device_name = s + lp;
+	e->device_secret = s + lp + ln;
+	e->token = registry_token(e->product_key, e->device_name, e->device_secret);
+	insert_name(reg, reg->count);
+	insert_token(reg, reg->count);
+	reg->count++;
+	return 0;
+}
+
+// ---- 文件加载 ----
+
+// 检查 [s, e) 一行是否为 "pk,dn,ds"（去掉行尾 \r）；返回 1 有效，0 忽略（空行/注释），-1 格式错误
+// commas 输出两个逗号的位置，end 输出去掉 \r 后的行尾
+static int scan_line(const char *s, const char *e, const char **commas, const char **end) {
+	if (e > s && e[-1] == '\r') --e;
+	*end = e;
+	if (s == e || *s == '#') return 0;
+	int n = 0;
+	for (const char *p = s; p < e; ++p) {
+		if (*p == ',') {
+			if (n == 2) return -1;
+			commas[n++] = p;
+		}
+	}
+	if (n != 2) return -1;
+	// productKey、deviceName 不能为空，deviceSecret 可以为空
+	if (commas[0] == s || commas[1] == commas[0] + 1) return -1;
+	return 1;
+}
+
+typedef struct {
+	device_registry_t *reg;
+	char *begin;
+	char *end;
+	uint32_t valid;     // 第一遍：有效行数
+	uint32_t bad;       // 第一遍：格式错误行数
+	uint32_t base;      // 第二遍：本块条目写入的起始下标
+	uint32_t dup;       // 第二遍：同名重复行数
+	int pass;
+} load_chunk_t;
+
+static void chunk_run(load_chunk_t *c) {
+	char *s = c->begin;
+	uint32_t k = c->base;
+	while (s < c->end) {
+		char *nl = (char*)memchr(s, '\n', (size_t)(c->end - s));
+		char *e = nl ? nl : c->end;
+		const char *commas[2];
+		const char *le;
+		int rc = scan_line(s, e, commas, &le);
+		if (c->pass == 1) {
+			if (rc > 0) c->valid++;
+			else if (rc < 0) c->bad++;
+		} else if (rc > 0) {
+			// 原地切分：逗号与行尾改为 '\0'
+			*(char*)commas[0] = '\0';
+			*(char*)commas[1] = '\0';
+			*(char*)le = '\0';
+			registry_entry_t *en = &c->reg->entries[k];
+			en->product_key = s;
+			en->device_name = commas[0] + 1;
+			en->device_secret = commas[1] + 1;
+			en->token = registry_token(en->product_key, en->device_name, en->device_secret);
+			if (insert_name(c->reg, k)) {
+				insert_token(c->reg, k);
+			} else {
+				en->product_key = NULL; // 重复，稍后压缩掉
+				c->dup++;
+			}
+			k++;
+		}
+		s = e + 1;
+	}
+}
+
+#ifdef _WIN32
+static unsigned __stdcall chunk_thread(void *arg) {
+	chunk_run((load_chunk_t*)arg);
+	return 0;
+}
+#else
+static void *chunk_thread(void *arg) {
+	chunk_run((load_chunk_t*)arg);
+	return NULL;
+}
+#endif
+
+// 每块一个线程并行执行，块 0 在调用线程上执行
+static void run_chunks(load_chunk_t *chunks, uint32_t n) {
+#ifdef _WIN32
+	HANDLE th[REG_MAX_THREADS];
+#else
+	pthread_t th[REG_MAX_THREADS];
+#endif
+	int started[REG_MAX_THREADS];
+	for (uint32_t i = 1; i < n; ++i) {
+#ifdef _WIN32
+		th[i] = (HANDLE)_beginthreadex(NULL, 0, chunk_thread, &chunks[i], 0, NULL);
+		started[i] = th[i] != 0;
+#else
+		started[i] = pthread_create(&th[i], NULL, chunk_thread, &chunks[i]) == 0;
+#endif
+		if (!started[i]) chunk_run(&chunks[i]); // 建线程失败时就地执行
+	}
+	chunk_run(&chunks[0]);
+	for (uint32_t i = 1; i < n; ++i) {
+		if (!started[i]) continue;
+#ifdef _WIN32
+		WaitForSingleObject(th[i], INFINITE);
+		CloseHandle(th[i]);
+#else
+		pthread_join(th[i], NULL);
+#endif
+	}
+}
+
+static uint32_t cpu_count(void) {
+#ifdef _WIN32
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	return si.dwNumberOfProcessors ? (uint32_t)si.dwNumberOfProcessors : 1;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (uint32_t)n : 1;
+#endif
+}
+
+int registry_load_file(device_registry_t *reg, const char *path, uint32_t threads,
+	uint32_t *loaded, uint32_t *bad_lines) {
+	if (loaded) *loaded = 0;
+	if (bad_lines) *bad_lines = 0;
+	if (!reg || !path) return -1;
+	FILE *fp = fopen(path, "rb");
+	if (!fp) return -1;
+	fseek(fp, 0, SEEK_END);
+	long sz = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	if (sz < 0) {
+		fclose(fp);
+		return -1;
+	}
+	char *buf = (char*)malloc((size_t)sz + 1);
+	if (!buf) {
+		fclose(fp);
+		return -2;
+	}
+	size_t len = fread(buf, 1, (size_t)sz, fp);
+	fclose(fp);
+	buf[len] = '\0';
+	if (own_block(reg, buf) != 0) {
+		free(buf);
+		return -2;
+	}
+
+	// 按行边界切块：小文件不值得开线程
+	uint32_t n = threads ? threads : cpu_count();
+	if (n > REG_MAX_THREADS) n = REG_MAX_THREADS;
+	if ((size_t)n > len / 65536 + 1) n = (uint32_t)(len / 65536 + 1);
+	load_chunk_t chunks[REG_MAX_THREADS];
+	memset(chunks, 0, sizeof(chunks));
+	char *prev = buf;
+	for (uint32_t i = 0; i < n; ++i) {
+		char *e = buf + len;
+		if (i + 1 < n) {
+			e = buf + len * (i + 1) / n;
+			if (e < prev) e = prev;
+			char *nl = (char*)memchr(e, '\n', (size_t)(buf + len - e));
+			e = nl ? nl + 1 : buf + len;
+		}
+		chunks[i].reg = reg;
+		chunks[i].begin = prev;
+		chunks[i].end = e;
+		chunks[i].pass = 1;
+		prev = e;
+	}
+
+	// 第一遍：并行统计有效行，前缀和得到各块的写入位置
+	run_chunks(chunks, n);
+	uint32_t total = 0, bad = 0;
+	for (uint32_t i = 0; i < n; ++i) {
+		chunks[i].base = reg->count + total;
+		chunks[i].pass = 2;
+		total += chunks[i].valid;
+		bad += chunks[i].bad;
+	}
+	if (reserve(reg, reg->count + total) != 0) return -2;
+
+	// 第二遍：并行切分、计算 Token、插入索引
+	run_chunks(chunks, n);
+	uint32_t dup = 0;
+	for (uint32_t i = 0; i < n; ++i) dup += chunks[i].dup;
+	reg->count += total;
+	if (dup) {
+		// 重复设备会在条目数组里留下空洞，压缩后重建索引（少见路径）
+		uint32_t w = 0;
+		for (uint32_t i = 0; i < reg->count; ++i) {
+			if (reg->entries[i].product_key) reg->entries[w++] = reg->entries[i];
+		}
+		reg->count = w;
+		rebuild_index(reg);
+	}
+	if (loaded) *loaded = total - dup;
+	if (bad_lines) *bad_lines = bad;
+	return 0;
+}
+
+// ---- 查找 ----
+
+const registry_entry_t *registry_find_token(const device_registry_t *reg, uint32_t token) {
+	for (uint32_t pos = token_pos(token) & reg->mask;; pos = (pos + 1) & reg->mask) {
+		uint64_t v = reg->by_token[pos];
+		if (v == 0) return NULL;
+		if (SLOT_TAG(v) == token) return &reg->entries[SLOT_IDX(v)];
+	}
+}
+
+const registry_entry_t *registry_find_name(const device_registry_t *reg, const char *product_key, const char *device_name) {
+	uint64_t h = name_hash(product_key, device_name);
+	uint32_t tag = (uint32_t)(h >> 32);
+	for (uint32_t pos = (uint32_t)h & reg->mask;; pos = (pos + 1) & reg->mask) {
+		uint64_t v = reg->by_name[pos];
+		if (v == 0) return NULL;
+		if (SLOT_TAG(v) == tag) {
+			const registry_entry_t *e = &reg->entries[SLOT_IDX(v)];
+			if (strcmp(e->device_name, device_name) == 0 && strcmp(e->product_key, product_key) == 0) return e;
+		}
+	}
+}
+
+uint32_t registry_count(const device_registry_t *reg) {
+	return reg ? reg->count : 0;
+}
+
+uint32_t registry_index_of(const device_registry_t *reg, const registry_entry_t *e) {
+	return (uint32_t)(e - reg->entries);
+}
+
+const registry_entry_t *registry_entry_at(const device_registry_t *reg, uint32_t index) {
+	return index < reg->count ? &reg->entries[index] : NULL;
+}
+
+int registry_parse_token(const uint8_t *text, uint32_t len, uint32_t *out) {
+	if (len != 8) return -1;
+	uint32_t v = 0;
+	for (uint32_t i = 0; i < 8; ++i) {
+		uint8_t c = text[i];
+		uint32_t d;
+		if (c >= '0' && c <= '9') d = c - '0';
+		else if (c >= 'A' && c <= 'F') d = c - 'A' + 10;
+		else if (c >= 'a' && c <= 'f') d = c - 'a' + 10;
+		else return -1;
+		v = (v << 4) | d;
+	}
+	*out = v;
+	return 0;
+}
@@ -0,0 +1,61 @@
+// device_registry.h
+// 模拟服务端的设备注册表：保存大量设备三元组，加载时一次性算好每台设备的 Token
+// 条目顺序存放在数组中，另有两个开放寻址索引（按 Token、按 productKey+deviceName），
+// 索引槽只有 8 字节（32 位标签 + 条目下标），线性探测，查找通常落在同一缓存行内
+// 从文件加载时按 CPU 数分块并行解析、计算 Token 并以 CAS 并发插入索引
+
+#ifndef DEVICE_REGISTRY_H
+#define DEVICE_REGISTRY_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	const char *product_key;
+	const char *device_name;
+	const char *device_secret;
+	uint32_t token;            // 预计算的鉴权 Token（文本形式为 %08X）
+} registry_entry_t;
+
+typedef struct device_registry device_registry_t;
+
+// 与客户端一致的简化 Token 算法：sum(bytes(productKey+deviceName+deviceSecret)) ^ 0x5A
+uint32_t registry_token(const char *product_key, const char *device_name, const char *device_secret);
+
+// 创建空注册表，capacity_hint 为预计设备数（可为 0）；返回 0 成功，-2 内存不足
+int registry_create(device_registry_t **out, uint32_t capacity_hint);
+void registry_destroy(device_registry_t *reg);
+
+// 添加一台设备（拷贝字符串）；同名设备已存在时返回 1 且不重复添加，0 成功，<0 失败
+// 添加/加载可能扩容条目数组，之前查到的条目指针随之失效；服务端在启动前完成全部登记
+int registry_add(device_registry_t *reg, const char *product_key, const char *device_name, const char *device_secret);
+
+// 从文本文件加载：每行 "productKey,deviceName,deviceSecret"，空行与 # 开头的行忽略，格式不对的行计入 bad_lines
+// threads 为 0 时取 CPU 数；字符串直接指向整块读入的文件内容，不逐条分配
+// 返回 0 成功，-1 打不开文件，-2 内存不足；loaded/bad_lines 可为 NULL
+int registry_load_file(device_registry_t *reg, const char *path, uint32_t threads,
+	uint32_t *loaded, uint32_t *bad_lines);
+
+// 按 Token 查找（简化算法下不同设备可能 Token 相同，此时返回其中一台），不存在返回 NULL
+const registry_entry_t *registry_find_token(const device_registry_t *reg, uint32_t token);
+
+// 按 productKey + deviceName 查找，不存在返回 NULL
+const registry_entry_t *registry_find_name(const device_registry_t *reg, const char *product_key, const char *device_name);
+
+uint32_t registry_count(const device_registry_t *reg);
+
+// 条目下标（0..count-1，加载完成后不再变化，可作设备号）与按下标取条目
+uint32_t registry_index_of(const device_registry_t *reg, const registry_entry_t *e);
+const registry_entry_t *registry_entry_at(const device_registry_t *reg, uint32_t index);
+
+// 解析 8 位十六进制 Token 文本；返回 0 成功，-1 格式错误
+int registry_parse_token(const uint8_t *text, uint32_t len, uint32_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DEVICE_REGISTRY_H
@@ -9,32 +9,61 @@
 #include "coap_client.h"
 #include "sensor_sim.h"
 #include "aliyun_sim.h"
+#include "coap_engine.h"
+#include "coap_auth.h"
+#include "sensor_cbor.h"
+#include "senml.h"
+#include "coap_block.h"
+#include "observer_sim.h"
+#include "coap_metrics.h"
+#include "coap_log.h"
+#include "net_impair.h"
 
 #ifdef _WIN32
 #include <windows.h>
 #endif
 
-static const char* now_ts() {
-	static char buf[32];
-	time_t t = time(NULL);
-	struct tm tmv;
+static void sleep_sec(int s) {
 #ifdef _WIN32
-	localtime_s(&tmv, &t);
+	Sleep(s * 1000);
 #else
-	localtime_r(&t, &tmv);
+	sleep(s);
 #endif
-	strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tmv);
-	return buf;
 }
 
-static void sleep_sec(int s) {
+static void sleep_ms(uint32_t ms) {
 #ifdef _WIN32
-	Sleep(s * 1000);
+	Sleep(ms);
 #else
-	sleep(s);
+	struct timespec ts;
+	ts.tv_sec = (time_t)(ms / 1000);
+	ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+	nanosleep(&ts, NULL);
 #endif
 }
 
+static uint64_t mono_ms(void) {
+#ifdef _WIN32
+	return (uint64_t)GetTickCount64();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+#endif
+}
+
+// 采样时刻（Unix 毫秒）：首次调用时取一次墙钟，之后按单调时钟推进
+static uint64_t wall_ms(void) {
+	static uint64_t base_wall, base_mono;
+	static int inited;
+	if (!inited) {
+		base_wall = (uint64_t)time(NULL) * 1000u;
+		base_mono = mono_ms();
+		inited = 1;
+	}
+	return base_wall + (mono_ms() - base_mono);
+}
+
 static void enable_utf8_console(void) {
 #ifdef _WIN32
 	SetConsoleOutputCP(CP_UTF8);
@@ -42,28 +71,758 @@ static void enable_utf8_console(void) {
 #endif
 }
 
-static void make_token_client(const device_triple_t *triple, char *out, int out_len) {
-	unsigned int sum = 0; const char *p;
-	for (p = triple->product_key; *p; ++p) sum += (unsigned char)(*p);
-	for (p = triple->device_name; *p; ++p) sum += (unsigned char)(*p);
-	for (p = triple->device_secret; *p; ++p) sum += (unsigned char)(*p);
-	unsigned int v = (sum ^ 0x5Au) & 0xFFFFFFFFu;
-	snprintf(out, out_len, "%08X", v);
+// /auth 握手：用设备三元组签名换取会话 Token；握手本身不受 --net 模拟影响
+static int auth_handshake(const coap_client_conf_t *base, const device_triple_t *triple, char *token, size_t cap) {
+	coap_client_conf_t conf = *base;
+	conf.msg_type = COAP_TYPE_CON;
+	conf.net_mode = NETWORK_OK;
+	conf.nstart = 1;
+	conf.payload_key = NULL;
+	conf.payload_fmt = COAP_PAYLOAD_JSON;
+	coap_client_t client;
+	if (coap_client_init(&client, &conf) != 0) return -1;
+	char client_id[160], ts[24], body[512];
+	snprintf(client_id, sizeof(client_id), "%s.%s", triple->product_key, triple->device_name);
+	snprintf(ts, sizeof(ts), "%llu", (unsigned long long)time(NULL) * 1000ull);
+	if (auth_build_request(body, sizeof(body), triple->product_key, triple->device_name, triple->device_secret,
+		client_id, ts) < 0) {
+		coap_client_close(&client);
+		return -1;
+	}
+	uint8_t code = 0, resp[256];
+	size_t rlen = 0;
+	uint64_t t0 = coap_mono_us();
+	int rc = coap_client_post_json_resp(&client, "localhost", "auth", NULL, body, &code, resp, sizeof(resp), &rlen);
+	uint64_t t1 = coap_mono_us();
+	coap_client_close(&client);
+	if (rc != 0 || code != ((2 << 5) | 5) || auth_parse_response(resp, rlen, token, cap) != 0) {
+		coap_log_error("设备 %s/%s 认证失败 rc=%d code=%s", triple->product_key, triple->device_name, rc, coap_code_to_text(code));
+		return -1;
+	}
+	coap_log_debug("设备 %s/%s 认证成功，会话 Token %s（握手 %.2f ms）", triple->product_key, triple->device_name,
+		token, (double)(t1 - t0) / 1000.0);
+	return 0;
+}
+
+// 设备身份：单设备或服务端未加载注册表文件时只有内置三元组一个；多设备且有 --registry 时
+// 设备 d 用文件中的第 d % count 台（注册表下标 1 + d % count，count 取设备数与文件设备数的较小者）。
+// 每个身份各自取得 Token（简化算法或 /auth 握手）、派生会话密钥，并预编译带自己 token= 的上报模板
+typedef struct {
+	device_triple_t triple;
+	char token[AUTH_TOKEN_LEN + 1];
+	aes128_key_t key;
+} dev_cred_t;
+
+typedef struct {
+	dev_cred_t *c;
+	coap_tmpl_t *tmpls; // 与 c 一一对应
+	uint32_t count;
+	uint32_t first;     // 第一个身份的注册表下标
+} dev_creds_t;
+
+static void creds_destroy(dev_creds_t *cr) {
+	free(cr->c);
+	free(cr->tmpls);
+	memset(cr, 0, sizeof(*cr));
+}
+
+// 须在服务端启动后调用（读取其注册表）；加密时把 cconf->payload_key 指向第一个身份的会话密钥（决定 Content-Format）
+static int creds_init(dev_creds_t *cr, coap_client_conf_t *cconf, uint32_t devices, int auth_hmac, int encrypt,
+		aes_impl_t aes_impl) {
+	memset(cr, 0, sizeof(*cr));
+	uint32_t reg = aliyun_sim_device_count();
+	uint32_t n = 1;
+	if (devices && reg > 1) {
+		n = devices < reg - 1 ? devices : reg - 1;
+		cr->first = 1;
+	}
+	cr->c = (dev_cred_t*)calloc(n, sizeof(dev_cred_t));
+	cr->tmpls = (coap_tmpl_t*)calloc(n, sizeof(coap_tmpl_t));
+	if (!cr->c || !cr->tmpls) {
+		creds_destroy(cr);
+		return -1;
+	}
+	cr->count = n;
+	uint64_t t0 = coap_mono_us();
+	for (uint32_t i = 0; i < n; ++i) {
+		dev_cred_t *c = &cr->c[i];
+		if (aliyun_sim_device_triple(cr->first + i, &c->triple) != 0) return -1;
+		if (!auth_hmac) aliyun_make_token(&c->triple, c->token, sizeof(c->token));
+		else if (auth_handshake(cconf, &c->triple, c->token, sizeof(c->token)) != 0) return -1;
+		// 负载加密：会话密钥由设备密钥与 Token 算出，扩展一次后该身份的所有上报共用
+		if (encrypt) {
+			uint8_t key[AES128_KEY_LEN];
+			auth_session_key(c->triple.device_secret, (const uint8_t*)c->token, strlen(c->token), key);
+			aes128_key_init(&c->key, key, aes_impl);
+		}
+	}
+	if (auth_hmac && n == 1) {
+		coap_log_info("认证成功，会话 Token %s（握手 %.2f ms）", cr->c[0].token, (double)(coap_mono_us() - t0) / 1000.0);
+	} else if (auth_hmac) {
+		coap_log_info("认证成功：%u 个设备身份各自握手，共 %.1f ms", n, (double)(coap_mono_us() - t0) / 1000.0);
+	}
+	if (encrypt) cconf->payload_key = &cr->c[0].key;
+	for (uint32_t i = 0; i < n; ++i) {
+		char query[128];
+		snprintf(query, sizeof(query), "token=%s", cr->c[i].token);
+		if (coap_tmpl_build_cf(&cr->tmpls[i], cconf->msg_type, "localhost", "things/upload", query,
+				coap_client_content_format(cconf)) != 0) return -1;
+	}
+	return 0;
+}
+
+static const coap_tmpl_t *cred_tmpl(const dev_creds_t *cr, uint32_t device) {
+	return &cr->tmpls[device % cr->count];
+}
+
+// 加密时每台设备换用所属身份的会话密钥
+static void creds_bind(const dev_creds_t *cr, coap_engine_t *eng, const coap_engine_conf_t *econf) {
+	if (!econf->client.payload_key) return;
+	for (uint32_t d = 0; d < econf->device_count; ++d) coap_engine_set_payload_key(eng, d, &cr->c[d % cr->count].key);
 }
 
 static void usage(const char *exe) {
-	printf("用法: %s --period N --net [ok|timeout|down] --type [con|non]\n", exe);
+	printf("用法: %s --period N --net [ok|timeout|down] --type [con|non] [--devices N] [--nstart N] [--rto fixed|cocoa]\n", exe);
+	printf("      [--rounds N]           (单设备与多设备闭环的上报轮数，默认 20)\n");
+	printf("      [--rate HZ --profile constant|poisson|burst --jitter US --burst N --duration S]\n");
+	printf("      [--server-threads N]   (模拟服务端工作线程数，SO_REUSEPORT 分片)\n");
+	printf("      [--batch N] [--gso]    (recvmmsg/sendmmsg 批量收发，服务端响应 UDP GSO 合并)\n");
+	printf("      [--batch-socks N]      (批量模式下多设备共用的客户端套接字数，默认 64)\n");
+	printf("      [--io socket|uring|compare]   (收发后端；compare 依次运行两种后端并对比吞吐与 p99)\n");
+	printf("      [--auth hmac|simple] [--auth-cache N]   (hmac：先 /auth 握手换会话 Token，服务端缓存已校验 Token；simple：字节和 Token)\n");
+	printf("      [--payload json|cbor]  (上报负载编码：JSON 文本 Content-Format 50，或 CBOR 二进制 60)\n");
+	printf("      [--senml N] [--senml-bytes B] [--senml-delay MS]   (每台设备攒满 N 条、B 字节或最早一条滞留 MS 毫秒即打成一个 SenML pack 上报)\n");
+	printf("      [--sensor-seed N]      (传感器随机种子：每台设备的读数序列由种子与设备号决定，便于复现；默认按时钟取)\n");
+	printf("      [--observe N]          (另起一个观察者，用 N 个 Token 观察 dev001 的读数，服务端按批扇出通知)\n");
+	printf("      [--block-szx N]        (单设备上报超过 16<<N 字节（N 为 0~6）时按 Block1 分块；不指定时只在一个报文放不下时分块)\n");
+	printf("      [--encrypt auto|soft|ni]   (上报负载用会话密钥 AES-128-CBC 加密；auto 在支持 AES-NI 时用硬件)\n");
+	printf("      [--dedup N]            (服务端每分片 CON 去重缓存条目数，默认 65536，0 关闭)\n");
+	printf("      [--registry FILE]      (服务端从文件加载设备三元组，每行 productKey,deviceName,deviceSecret)\n");
+	printf("      [--store DIR]          (服务端把接受的读数按列追加到 DIR 下的内存映射文件，结束时输出入库统计与查询示例)\n");
+	printf("      [--stats-interval S] [--stats-json FILE] [--stats-prom FILE]   (每 S 秒输出一行区间请求统计；结束及每个区间把统计写成 JSON / Prometheus 文本)\n");
+	printf("      [--log-level debug|info|warn|error] [--log-sample N]   (日志级别；逐包日志每 N 条输出 1 条，0 关闭，单设备默认 1，多设备默认 0)\n");
+	printf("      [--impair SPEC]        (客户端经网络损伤代理连到服务端；SPEC 为预置场景 %s，可跟 ,key=value 覆盖，\n", net_impair_presets());
+	printf("                              键 loss/dup/reorder（%%）、ge=P:R:BAD（%%）、delay/jitter（ms）、dist=uniform|normal|pareto、rate（kbit/s）、\n");
+	printf("                              burst/queue（字节）、seed=N，加 up./down. 前缀只改一个方向）\n");
+	printf("      [--gen-registry FILE N] (生成含 N 台设备的注册表文件后退出)\n");
 	printf("示例: %s --period 2 --net ok --type con\n", exe);
+	printf("      %s --period 2 --type con --devices 10000 --nstart 4   (事件驱动多设备压测)\n", exe);
+	printf("      %s --devices 10000 --rate 10 --profile poisson --duration 30   (开环定速压测)\n", exe);
+	printf("      %s --devices 1000 --period 1 --impair cellular,loss=2   (经模拟的蜂窝链路压测)\n", exe);
+}
+
+// 生成测试用注册表文件：N 台设备分属 1000 个产品
+static int gen_registry(const char *path, uint32_t n) {
+	FILE *fp = fopen(path, "w");
+	if (!fp) {
+		perror(path);
+		return 1;
+	}
+	fprintf(fp, "# productKey,deviceName,deviceSecret\n");
+	for (uint32_t i = 0; i < n; ++i) {
+		fprintf(fp, "pk%04u,dev%07u,secret%08x\n", i % 1000, i, i * 2654435761u);
+	}
+	fclose(fp);
+	printf("已生成 %s：%u 台设备\n", path, n);
+	return 0;
+}
+
+// 按客户端配置的负载编码写出一条读数；返回字节数，<0 表示 cap 不足
+static int encode_reading(const coap_client_conf_t *conf, const sensor_reading_t *r, uint8_t *out, size_t cap) {
+	if (conf->payload_fmt == COAP_PAYLOAD_CBOR) return sensor_cbor_encode(r, out, cap);
+	int n = snprintf((char*)out, cap, "{\"temp\":%.1f,\"humidity\":%.1f,\"abn\":%d}", r->temperature_c, r->humidity_rh, r->is_abnormal);
+	return (n < 0 || (size_t)n >= cap) ? -1 : n;
+}
+
+static double per_call(uint64_t n, uint64_t calls) {
+	return calls ? (double)n / (double)calls : 0.0;
+}
+
+// 读数来源：每台设备一份传感器时间序列，逐条编码，或按设备攒进 SenML 缓冲（senml.max_count 为 0 表示不聚合）
+typedef struct {
+	const coap_client_conf_t *conf;
+	sensor_bank_t sensors;
+	senml_batch_conf_t senml;
+	senml_batch_t *dev;
+	uint32_t devices;
+	uint64_t samples; // 进入缓冲的读数
+	uint64_t packs;   // 编码出的 pack
+	uint64_t bytes;   // pack 总字节数
+} reading_src_t;
+
+static int reading_src_init(reading_src_t *src, const coap_client_conf_t *conf, const senml_batch_conf_t *senml,
+		uint32_t devices, const device_triple_t *triple, const sensor_model_t *model, uint64_t seed) {
+	memset(src, 0, sizeof(*src));
+	src->conf = conf;
+	src->senml = *senml;
+	uint32_t n = devices ? devices : 1;
+	if (sensor_bank_init(&src->sensors, n, model, seed) != 0) return -1;
+	if (senml->max_count == 0) return 0;
+	src->dev = (senml_batch_t*)calloc(n, sizeof(senml_batch_t));
+	if (!src->dev) return -1;
+	for (uint32_t d = 0; d < n; ++d) {
+		// 名称前缀与设备身份一致：单设备用三元组，多设备用注册表中的设备名
+		char prefix[160]; // 超出 SENML_PREFIX_MAX 的部分由 senml_batch_init 截断
+		if (devices) snprintf(prefix, sizeof(prefix), "dev%07u/", d);
+		else snprintf(prefix, sizeof(prefix), "%s/%s/", triple->product_key, triple->device_name);
+		if (senml_batch_init(&src->dev[d], &src->senml, prefix) != 0) {
+			src->devices = d;
+			return -1;
+		}
+	}
+	src->devices = n;
+	return 0;
+}
+
+static void reading_src_destroy(reading_src_t *src) {
+	for (uint32_t d = 0; d < src->devices; ++d) senml_batch_destroy(&src->dev[d]);
+	free(src->dev);
+	src->dev = NULL;
+	src->devices = 0;
+	sensor_bank_destroy(&src->sensors);
+}
+
+static int reading_src_count(reading_src_t *src, int n) {
+	if (n > 0) {
+		src->packs++;
+		src->bytes += (uint64_t)n;
+	}
+	return n;
+}
+
+// 取一条读数并得到要发送的负载：返回字节数；聚合时读数进缓冲而暂不发送返回 0；<0 表示 cap 不足
+static int reading_src_next(reading_src_t *src, uint32_t device, const sensor_reading_t *r, uint8_t *out, size_t cap) {
+	if (!src->devices) return encode_reading(src->conf, r, out, cap);
+	senml_sample_t s;
+	s.r = *r;
+	s.t_ms = wall_ms();
+	src->samples++;
+	return reading_src_count(src, senml_batch_add(&src->dev[device], &src->senml, &s, out, cap));
+}
+
+// 到期（flush 非 0 时不论是否到期）的缓冲编码成 pack：返回字节数，0 表示无需发送
+static int reading_src_due(reading_src_t *src, uint32_t device, int flush, uint8_t *out, size_t cap) {
+	if (!src->devices) return 0;
+	senml_batch_t *b = &src->dev[device];
+	if (b->count == 0) return 0;
+	return reading_src_count(src, flush ? senml_batch_flush(b, &src->senml, out, cap) :
+		senml_batch_poll(b, &src->senml, wall_ms(), out, cap));
+}
+
+static void print_senml_stats(const reading_src_t *src) {
+	if (!src->devices) return;
+	coap_log_info("SenML 聚合：读数 %llu 条 → pack %llu 个（平均 %.1f 条/个, %.1f 字节/个, %.1f 字节/条）",
+		(unsigned long long)src->samples, (unsigned long long)src->packs,
+		per_call(src->samples, src->packs), per_call(src->bytes, src->packs), per_call(src->bytes, src->samples));
+}
+
+typedef struct {
+	uint32_t ok;      // 收到 2.xx
+	uint32_t rejected; // 收到 4.xx/5.xx
+	uint32_t failed;  // 超时/发送失败
+} round_result_t;
+
+static void on_engine_done(void *user, uint32_t device, uint16_t mid, int rc, uint8_t code) {
+	round_result_t *res = (round_result_t*)user;
+	(void)device; (void)mid;
+	if (rc != 0) res->failed++;
+	else if ((code >> 5) >= 4) res->rejected++;
+	else res->ok++;
+}
+
+// 引擎收发系统调用统计：平均每次调用处理的报文数
+static void print_engine_io(const coap_engine_stats_t *st) {
+	if (st->uring_enters) {
+		coap_log_info("客户端：收包 %llu 条, 发包 %llu 条, io_uring_enter %llu 次 (%.2f 条/次)",
+			(unsigned long long)st->recv_datagrams, (unsigned long long)st->sent, (unsigned long long)st->uring_enters,
+			per_call(st->recv_datagrams + st->sent, st->uring_enters + st->send_calls));
+		return;
+	}
+	coap_log_info("客户端：收包 %llu 条 / %llu 次调用 (%.2f 条/次), 发包 %llu 条 / %llu 次调用 (%.2f 条/次)",
+		(unsigned long long)st->recv_datagrams, (unsigned long long)st->recv_calls, per_call(st->recv_datagrams, st->recv_calls),
+		(unsigned long long)st->sent, (unsigned long long)st->send_calls, per_call(st->sent, st->send_calls));
+}
+
+// 请求统计输出：结束时打印全程汇总；interval_s 非 0 时每隔这么久打印一行区间统计；两种时刻都改写 JSON/Prometheus 文件
+typedef struct {
+	uint32_t interval_s;
+	const char *json_path;
+	const char *prom_path;
+	uint64_t next_ms;
+	uint64_t prev_us;
+	coap_metrics_totals_t prev; // 上一次区间输出时的合计
+} stats_out_t;
+
+static stats_out_t g_stats_out;
+
+static void stats_save(const coap_metrics_t *m) {
+	double secs = (double)(coap_mono_us() - m->start_us) / 1e6;
+	if (g_stats_out.json_path && coap_metrics_save(m, secs, g_stats_out.json_path, 0) != 0) {
+		coap_log_error("写入 %s 失败", g_stats_out.json_path);
+	}
+	if (g_stats_out.prom_path && coap_metrics_save(m, secs, g_stats_out.prom_path, 1) != 0) {
+		coap_log_error("写入 %s 失败", g_stats_out.prom_path);
+	}
+}
+
+// 开始一段统计（m 刚清空或刚创建）
+static void stats_begin(const coap_metrics_t *m) {
+	memset(&g_stats_out.prev, 0, sizeof(g_stats_out.prev));
+	g_stats_out.prev_us = m->start_us;
+	g_stats_out.next_ms = mono_ms() + (uint64_t)g_stats_out.interval_s * 1000u;
+}
+
+// 到了区间输出时刻则打印自上次以来的统计
+static void stats_tick(const coap_metrics_t *m) {
+	if (!m || !g_stats_out.interval_s || mono_ms() < g_stats_out.next_ms) return;
+	uint64_t now = coap_mono_us();
+	coap_metrics_totals_t d;
+	coap_metrics_summary_t s;
+	coap_metrics_delta(&d, &m->t, &g_stats_out.prev);
+	coap_metrics_summarize(&d, (double)(now - g_stats_out.prev_us) / 1e6, &s);
+	coap_log_info("区间 %.1f s：结束 %llu（成功 %.0f/s, 4.01 %llu, 其他错误 %llu, 超时 %llu）, 往返 p50 %llu p99 %llu p99.9 %llu 最大 %llu us, "
+		"重传 %.3f 次/条, 估计丢包 %.2f%%", s.seconds, (unsigned long long)s.requests, s.throughput,
+		(unsigned long long)s.outcomes[COAP_OUTCOME_UNAUTH], (unsigned long long)s.outcomes[COAP_OUTCOME_ERROR],
+		(unsigned long long)s.outcomes[COAP_OUTCOME_TIMEOUT], (unsigned long long)s.p50_us, (unsigned long long)s.p99_us,
+		(unsigned long long)s.p999_us, (unsigned long long)s.max_us, s.retx_per_msg, s.loss_rate * 100.0);
+	stats_save(m);
+	g_stats_out.prev = m->t;
+	g_stats_out.prev_us = now;
+	g_stats_out.next_ms += (uint64_t)g_stats_out.interval_s * 1000u;
+}
+
+// 全程汇总：结束的 CON 请求按结果计数、成功请求的往返分位数、重传与丢包估计、按设备的失败与最慢设备
+static void stats_finish(const coap_metrics_t *m) {
+	if (!m) return;
+	coap_metrics_summary_t s;
+	coap_metrics_summarize(&m->t, (double)(coap_mono_us() - m->start_us) / 1e6, &s);
+	stats_save(m);
+	if (s.requests == 0) return;
+	coap_log_info("请求统计：%.1f s 内结束 CON 请求 %llu 个，成功 %llu（%.0f/s）, 4.01 %llu, 其他错误 %llu, 超时放弃 %llu",
+		s.seconds, (unsigned long long)s.requests, (unsigned long long)s.outcomes[COAP_OUTCOME_OK], s.throughput,
+		(unsigned long long)s.outcomes[COAP_OUTCOME_UNAUTH], (unsigned long long)s.outcomes[COAP_OUTCOME_ERROR],
+		(unsigned long long)s.outcomes[COAP_OUTCOME_TIMEOUT]);
+	if (s.outcomes[COAP_OUTCOME_OK]) {
+		coap_log_info("往返时延（成功）：p50 %llu us, p99 %llu us, p99.9 %llu us, 最大 %llu us, 平均 %.1f us",
+			(unsigned long long)s.p50_us, (unsigned long long)s.p99_us, (unsigned long long)s.p999_us,
+			(unsigned long long)s.max_us, s.mean_us);
+	}
+	coap_log_info("重传 %llu 次（%.3f 次/条）, 估计丢包率 %.2f%%, 超时放弃率 %.2f%%",
+		(unsigned long long)s.retransmits, s.retx_per_msg, s.loss_rate * 100.0, s.timeout_rate * 100.0);
+	if (m->devices > 1) {
+		uint32_t active = 0, failing = 0, worst = 0;
+		for (uint32_t d = 0; d < m->devices; ++d) {
+			active += m->devs[d].requests != 0;
+			failing += m->devs[d].failures != 0;
+			if (m->devs[d].rtt_max_us > m->devs[worst].rtt_max_us) worst = d;
+		}
+		coap_log_info("设备：有请求 %u 台, 出现失败 %u 台, 最大往返最高的是设备 %u（%u us）", active, failing,
+			worst, m->devs[worst].rtt_max_us);
+	}
+}
+
+// 多设备模式：所有设备每个周期各上报 nstart 次（填满在途窗口），由事件驱动引擎并发收发
+// 多设备闭环压测的汇总：吞吐按各轮实际收发耗时（不含轮间等待）计算
+typedef struct {
+	io_backend_t backend;
+	uint64_t ok;
+	uint64_t busy_ms;
+	uint64_t p50_us;
+	uint64_t p99_us;
+} run_summary_t;
+
+// 等待在途 CON 全部完成；先 poll 一次，批量模式下攒批中的 NON 也随之发出
+static void drain_inflight(coap_engine_t *eng, coap_engine_stats_t *st) {
+	coap_engine_poll(eng, 0);
+	for (;;) {
+		coap_engine_get_stats(eng, st);
+		if (st->inflight == 0) break;
+		coap_engine_poll(eng, -1);
+	}
+}
+
+// 聚合时把到期（flush 非 0 时为全部）的缓冲打包提交；返回提交失败数
+static uint32_t post_due_packs(coap_engine_t *eng, const dev_creds_t *cr, reading_src_t *src, int flush) {
+	uint32_t fail = 0;
+	for (uint32_t d = 0; d < src->devices; ++d) {
+		uint8_t body[SENML_PACK_MAX];
+		int bn = reading_src_due(src, d, flush, body, sizeof(body));
+		if (bn == 0) continue;
+		if (bn < 0 || coap_engine_post_tmpl(eng, d, cred_tmpl(cr, d), body, (size_t)bn, NULL) != 0) fail++;
+		if ((d & 1023) == 1023) coap_engine_poll(eng, 0);
+	}
+	return fail;
+}
+
+static int run_devices(const coap_engine_conf_t *econf, int period, int rounds, const dev_creds_t *cr, reading_src_t *src,
+		run_summary_t *sum) {
+	const coap_client_conf_t *cconf = &econf->client;
+	uint32_t devices = econf->device_count;
+	round_result_t res;
+	coap_engine_t *eng = NULL;
+	int rc = coap_engine_create(&eng, econf, on_engine_done, &res);
+	if (rc != 0) {
+		coap_log_error("创建多设备引擎失败 rc=%d", rc);
+		return 1;
+	}
+	creds_bind(cr, eng, econf);
+	coap_log_info("启动多设备上报：devices=%u（设备身份 %u 个）, period=%ds, rounds=%d, type=%s, 收发后端 %s", devices, cr->count,
+		period, rounds, cconf->msg_type==COAP_TYPE_CON?"CON":"NON", io_backend_name(coap_engine_io_backend(eng)));
+
+	memset(sum, 0, sizeof(*sum));
+	sum->backend = coap_engine_io_backend(eng);
+	stats_begin(coap_engine_metrics(eng));
+	for (int loop = 0; loop < rounds; ++loop) {
+		memset(&res, 0, sizeof(res));
+		uint64_t t0 = mono_ms();
+		uint32_t submit_fail = 0;
+		uint32_t window = cconf->nstart ? cconf->nstart : 1;
+		// 每轮先批量生成全部设备的一个采样，同一轮内同一设备的后续请求再单独前进
+		sensor_bank_step(&src->sensors);
+		for (uint32_t d = 0; d < devices; ++d) {
+			for (uint32_t k = 0; k < window; ++k) {
+				sensor_reading_t r = k ? sensor_bank_next(&src->sensors, d) : sensor_bank_get(&src->sensors, d);
+				uint8_t body[SENML_PACK_MAX];
+				int bn = reading_src_next(src, d, &r, body, sizeof(body));
+				if (bn == 0) continue; // 已进聚合缓冲
+				if (bn < 0 || coap_engine_post_tmpl(eng, d, cred_tmpl(cr, d), body, (size_t)bn, NULL) != 0) submit_fail++;
+			}
+			// 边提交边收包，避免套接字缓冲积压
+			if ((d & 1023) == 1023) coap_engine_poll(eng, 0);
+		}
+		coap_engine_stats_t st;
+		drain_inflight(eng, &st);
+		// 聚合：在途窗口空出后补发到期的 pack，最后一轮清空全部缓冲
+		if (src->devices) {
+			submit_fail += post_due_packs(eng, cr, src, loop == rounds - 1);
+			drain_inflight(eng, &st);
+		}
+		uint64_t elapsed = mono_ms() - t0;
+		sum->ok += res.ok;
+		sum->busy_ms += elapsed;
+		coap_log_info("第 %d 轮：成功 %u, 拒绝 %u, 失败 %u, 提交失败 %u, 累计重传 %llu (固定策略估计 %llu), 耗时 %llu ms",
+			loop + 1, res.ok, res.rejected, res.failed, submit_fail,
+			(unsigned long long)st.retransmits, (unsigned long long)st.retransmits_fixed,
+			(unsigned long long)elapsed);
+		stats_tick(coap_engine_metrics(eng));
+		if (elapsed < (uint64_t)period * 1000u) sleep_ms((uint32_t)((uint64_t)period * 1000u - elapsed));
+	}
+
+	coap_engine_stats_t st;
+	coap_engine_get_stats(eng, &st);
+	print_engine_io(&st);
+	print_senml_stats(src);
+	sum->p50_us = coap_engine_latency_us(eng, 0.50);
+	sum->p99_us = coap_engine_latency_us(eng, 0.99);
+	coap_log_info("吞吐 %.0f 条/s（按各轮收发耗时，不含轮间等待）",
+		sum->busy_ms ? (double)sum->ok * 1000.0 / (double)sum->busy_ms : 0.0);
+	stats_finish(coap_engine_metrics(eng));
+	coap_engine_destroy(eng);
+	return 0;
+}
+
+static int fill_reading(void *user, uint32_t device, uint8_t *payload, size_t cap) {
+	reading_src_t *src = (reading_src_t*)user;
+	sensor_reading_t r = sensor_bank_next(&src->sensors, device);
+	int n = reading_src_next(src, device, &r, payload, cap);
+	return n > 0 ? n : -1; // 进了聚合缓冲的读数本次不发
+}
+
+// 开环模式：按流量模型在计划时刻发送，不等待响应，每秒输出一行汇总
+static int run_open_loop(const coap_engine_conf_t *econf, const traffic_conf_t *tc, int duration, const dev_creds_t *cr,
+		reading_src_t *src) {
+	const coap_client_conf_t *cconf = &econf->client;
+	uint32_t devices = econf->device_count;
+	round_result_t res;
+	memset(&res, 0, sizeof(res));
+	coap_engine_t *eng = NULL;
+	int rc = coap_engine_create(&eng, econf, on_engine_done, &res);
+	if (rc != 0) {
+		coap_log_error("创建多设备引擎失败 rc=%d", rc);
+		return 1;
+	}
+
+	creds_bind(cr, eng, econf);
+	// 调度器与到期 pack 的扫描都按设备所属身份的模板提交
+	coap_engine_traffic_t tr;
+	memset(&tr, 0, sizeof(tr));
+	tr.traffic = *tc;
+	tr.fill = fill_reading;
+	tr.fill_user = src;
+	tr.tmpls = cr->tmpls;
+	tr.tmpl_count = cr->count;
+	if (coap_engine_start_traffic(eng, &tr) != 0) {
+		coap_log_error("启动开环调度失败");
+		coap_engine_destroy(eng);
+		return 1;
+	}
+	static const char *profile_names[] = { "constant", "poisson", "burst" };
+	coap_log_info("启动开环上报：devices=%u, rate=%.3f/s/设备, profile=%s, duration=%ds, type=%s",
+		devices, tc->rate_hz, profile_names[tc->profile], duration,
+		cconf->msg_type==COAP_TYPE_CON?"CON":"NON");
+
+	coap_engine_stats_t prev, st;
+	coap_engine_get_stats(eng, &prev);
+	stats_begin(coap_engine_metrics(eng));
+	uint64_t start = mono_ms(), next_report = start + 1000, end = start + (uint64_t)duration * 1000u;
+	uint64_t next_sweep = start + 100;
+	uint32_t pack_fail = 0;
+	for (;;) {
+		uint64_t now = mono_ms();
+		if (src->devices && now >= next_sweep) {
+			pack_fail += post_due_packs(eng, cr, src, 0);
+			next_sweep = now + 100;
+		}
+		if (now >= next_report) {
+			coap_engine_get_stats(eng, &st);
+			uint64_t fired = st.sched_fired - prev.sched_fired;
+			coap_log_info("计划发送 %llu/s, 跳过 %llu, 完成 %llu, 失败 %llu, 重传 %llu, 在途 %u, 平均滞后 %.1f us, 最大滞后 %llu us", (unsigned long long)fired,
+				(unsigned long long)(st.sched_skipped - prev.sched_skipped),
+				(unsigned long long)(st.completed - prev.completed),
+				(unsigned long long)(st.failed - prev.failed),
+				(unsigned long long)(st.retransmits - prev.retransmits), st.inflight,
+				fired ? (double)(st.sched_lag_sum_us - prev.sched_lag_sum_us) / (double)fired : 0.0,
+				(unsigned long long)st.sched_lag_max_us);
+			prev = st;
+			next_report += 1000;
+		}
+		stats_tick(coap_engine_metrics(eng));
+		if (now >= end) break;
+		uint64_t wake = src->devices && next_sweep < next_report ? next_sweep : next_report;
+		coap_engine_poll(eng, wake > now ? (int)(wake - now) : 0);
+	}
+	coap_engine_stop_traffic(eng);
+	// 收尾：等待已发出的 CON 完成，再把聚合缓冲中剩下的读数发出
+	drain_inflight(eng, &st);
+	if (src->devices) {
+		pack_fail += post_due_packs(eng, cr, src, 1);
+		drain_inflight(eng, &st);
+	}
+	coap_log_info("开环上报结束：成功 %u, 拒绝 %u, 失败 %u, 跳过 %llu", res.ok, res.rejected, res.failed,
+		(unsigned long long)st.sched_skipped);
+	print_engine_io(&st);
+	if (src->devices) {
+		print_senml_stats(src);
+		if (pack_fail) coap_log_warn("到期 pack 提交失败 %u 个（在途窗口已满）", pack_fail);
+	}
+	stats_finish(coap_engine_metrics(eng));
+	coap_engine_destroy(eng);
+	return 0;
+}
+
+// 停止观察者（取消全部观察）并输出其统计
+static void stop_observer(observer_sim_t *obs) {
+	if (!obs) return;
+	observer_stats_t st;
+	observer_sim_stop(obs, &st);
+	coap_log_info("观察者：观察 %u 个（注册成功 %llu，未接受 %llu），收到通知 %llu 条 / %llu 轮（平均 %.1f 条/轮），"
+		"过旧序号 %llu 条，取消 %llu 个", st.count, (unsigned long long)st.registered,
+		(unsigned long long)st.refused, (unsigned long long)st.notifications, (unsigned long long)st.rounds,
+		per_call(st.notifications, st.rounds), (unsigned long long)st.stale, (unsigned long long)st.cancelled);
+	if (st.rounds) {
+		coap_log_info("观察者：每轮通知从第一条到最后一条到达 平均 %.2f ms，最大 %.2f ms",
+			(double)st.spread_us_sum / (double)st.rounds / 1000.0, (double)st.spread_us_max / 1000.0);
+	}
+}
+
+static void print_impair_dir(const char *name, const net_impair_dir_stats_t *d) {
+	coap_log_info("网络损伤 %s：收到 %llu，丢包 %llu（%.2f%%），积压丢弃 %llu，重复 %llu，乱序 %llu，转发 %llu（%llu 字节），"
+		"代理内停留 平均 %.2f ms / 最大 %.2f ms", name, (unsigned long long)d->received, (unsigned long long)d->lost,
+		d->received ? 100.0 * (double)d->lost / (double)d->received : 0.0, (unsigned long long)d->queue_drops,
+		(unsigned long long)d->duplicated, (unsigned long long)d->reordered, (unsigned long long)d->delivered,
+		(unsigned long long)d->bytes, d->delivered ? (double)d->delay_sum_us / (double)d->delivered / 1000.0 : 0.0,
+		(double)d->delay_max_us / 1000.0);
+}
+
+// 停止网络损伤代理并输出上下行统计
+static void stop_impair(net_impair_t *imp) {
+	if (!imp) return;
+	net_impair_stats_t st;
+	net_impair_stop(imp, &st);
+	print_impair_dir("上行", &st.up);
+	print_impair_dir("下行", &st.down);
+	if (st.flow_drops) coap_log_warn("网络损伤：流表已满丢弃上行报文 %llu 个", (unsigned long long)st.flow_drops);
+	coap_log_info("网络损伤：客户端端点 %u 个", st.flows);
+}
+
+// 列存：等环里的读数提交后输出入库统计，再做一次全部设备的聚合与设备 dev（注册表下标）最近 60 s 的范围扫描
+static void print_store_stats(uint32_t dev) {
+	reading_store_t *s = aliyun_sim_store();
+	if (!s) return;
+	reading_store_sync(s);
+	reading_store_stats_t st;
+	reading_store_get_stats(s, &st);
+	coap_log_info("服务端列存：入库 %llu 条（环满丢弃 %llu）, 组提交 %llu 次（平均 %.1f 条/次）, 段 %llu 个, 共 %llu 行",
+		(unsigned long long)st.appended, (unsigned long long)st.dropped, (unsigned long long)st.commits,
+		per_call(st.appended - st.dropped, st.commits), (unsigned long long)st.segments, (unsigned long long)st.committed);
+	reading_store_agg_t all, one;
+	uint64_t t0 = mono_ms(), now = wall_ms();
+	reading_store_aggregate(s, READING_STORE_ALL, 0, UINT64_MAX, &all);
+	uint64_t t1 = mono_ms();
+	reading_store_aggregate(s, dev, now - 60000, now + 60000, &one);
+	uint64_t t2 = mono_ms();
+	if (all.count) {
+		coap_log_info("列存查询：全部 %llu 条, 温度 %.1f~%.1f（均值 %.2f）, 湿度 %.1f~%.1f（均值 %.2f）, 异常 %llu 条, 用时 %llu ms",
+			(unsigned long long)all.count, all.temp_min, all.temp_max, all.temp_sum / (double)all.count,
+			all.hum_min, all.hum_max, all.hum_sum / (double)all.count, (unsigned long long)all.abnormal,
+			(unsigned long long)(t1 - t0));
+	}
+	coap_log_info("列存查询：设备 %u 最近 60 s %llu 条, 温度均值 %.2f, 异常 %llu 条, 用时 %llu ms", dev,
+		(unsigned long long)one.count, one.count ? one.temp_sum / (double)one.count : 0.0, (unsigned long long)one.abnormal,
+		(unsigned long long)(t2 - t1));
+}
+
+// 打印模拟服务端的汇总与各分片的收发计数；store_dev 为列存范围查询的设备（注册表下标）
+static void print_server_stats(uint32_t store_dev) {
+	aliyun_sim_stats_t total, shards[256];
+	uint32_t n = aliyun_sim_get_stats(&total, shards, 256);
+	coap_log_info("服务端：收到 %llu, 2.05 %llu（异常读数 %llu）, 4.00 %llu, 4.01 %llu, 畸形 %llu, 响应 %llu",
+		(unsigned long long)total.received, (unsigned long long)total.accepted, (unsigned long long)total.abnormal,
+		(unsigned long long)total.bad_payload, (unsigned long long)total.rejected, (unsigned long long)total.malformed,
+		(unsigned long long)total.sent);
+	if (aliyun_sim_io_backend() == IO_BACKEND_URING) {
+		coap_log_info("服务端：io_uring_enter %llu 次, %.2f 条/次", (unsigned long long)total.uring_enters,
+			per_call(total.received + total.sent, total.uring_enters));
+	} else {
+		coap_log_info("服务端：收包 %.2f 条/次调用, 发包 %.2f 条/次调用, GSO 合并报文 %llu",
+			per_call(total.received, total.recv_calls), per_call(total.sent, total.send_calls),
+			(unsigned long long)total.gso_sends);
+	}
+	if (total.auth_handshakes + total.auth_verifies + total.auth_cache_hits) {
+		coap_log_info("服务端认证：握手 %llu, 会话 Token HMAC 校验 %llu, 缓存命中 %llu, 缓存替换 %llu",
+			(unsigned long long)total.auth_handshakes, (unsigned long long)total.auth_verifies,
+			(unsigned long long)total.auth_cache_hits, (unsigned long long)total.auth_cache_evicted);
+	}
+	if (total.json_payloads + total.cbor_payloads) {
+		coap_log_info("服务端负载：JSON %llu 条, CBOR %llu 条, 平均 %.1f 字节/条（解密后）",
+			(unsigned long long)total.json_payloads, (unsigned long long)total.cbor_payloads,
+			(double)total.payload_bytes / (double)(total.json_payloads + total.cbor_payloads));
+	}
+	if (total.senml_packs) {
+		coap_log_info("服务端 SenML：pack %llu 个, 还原读数 %llu 条（平均 %.1f 条/个）, 超量程丢弃 %llu 条",
+			(unsigned long long)total.senml_packs, (unsigned long long)total.readings,
+			per_call(total.readings, total.senml_packs), (unsigned long long)total.dropped_readings);
+	}
+	if (total.block_continues + total.block_uploads + total.block_incomplete + total.block_rejected) {
+		coap_log_info("服务端分块：重组完成 %llu 次, 中间块 %llu 个（2.31）, 缺块 %llu 次, 超时回收 %llu 个, 拒绝 %llu 次",
+			(unsigned long long)total.block_uploads, (unsigned long long)total.block_continues,
+			(unsigned long long)total.block_incomplete, (unsigned long long)total.block_expired,
+			(unsigned long long)total.block_rejected);
+	}
+	if (total.not_found + total.bad_method + total.pings) {
+		coap_log_info("服务端路由：路径不存在 %llu 次（4.04）, 方法不支持 %llu 次（4.05）, 空消息 %llu 个（CON 回 RST）",
+			(unsigned long long)total.not_found, (unsigned long long)total.bad_method, (unsigned long long)total.pings);
+	}
+	if (total.obs_registered + total.obs_rejected) {
+		coap_log_info("服务端观察：注册 %llu（重新注册 %llu）, 取消 %llu, RST %llu, 过期 %llu, 未接受 %llu, 当前 %llu",
+			(unsigned long long)total.obs_registered, (unsigned long long)total.obs_refreshed,
+			(unsigned long long)total.obs_cancelled, (unsigned long long)total.obs_reset,
+			(unsigned long long)total.obs_expired, (unsigned long long)total.obs_rejected,
+			(unsigned long long)total.obs_active);
+		coap_log_info("服务端通知：%llu 轮, %llu 条（平均 %.1f 条/轮）, 发送调用 %llu 次（%.1f 条/次）, 读数争用未发布 %llu 条",
+			(unsigned long long)total.obs_rounds, (unsigned long long)total.obs_notifications,
+			per_call(total.obs_notifications, total.obs_rounds), (unsigned long long)total.obs_send_calls,
+			per_call(total.obs_notifications, total.obs_send_calls), (unsigned long long)total.obs_publish_lost);
+	}
+	if (total.decrypted + total.session_keys) {
+		coap_log_info("服务端解密：负载 %llu 条, 会话密钥派生 %llu 次",
+			(unsigned long long)total.decrypted, (unsigned long long)total.session_keys);
+	}
+	if (total.dedup_hits + total.dedup_misses) {
+		coap_log_info("服务端去重：命中 %llu（重放响应）, 未命中 %llu, 未过期即被覆盖 %llu",
+			(unsigned long long)total.dedup_hits, (unsigned long long)total.dedup_misses,
+			(unsigned long long)total.dedup_evicted);
+	}
+	print_store_stats(store_dev);
+	for (uint32_t i = 0; n > 1 && i < n && i < 256; ++i) {
+		coap_log_info("    分片 %u: 收到 %llu, 响应 %llu", i, (unsigned long long)shards[i].received,
+			(unsigned long long)shards[i].sent);
+	}
+}
+
+// 依次用套接字与 io_uring 后端（服务端与客户端同时切换）跑同一闭环负载，并排输出吞吐与 p99
+static int run_io_compare(aliyun_sim_conf_t *scfg, coap_engine_conf_t *econf, int period, int rounds, const dev_creds_t *cr,
+		reading_src_t *src) {
+	static const io_backend_t order[2] = { IO_BACKEND_SOCKET, IO_BACKEND_URING };
+	run_summary_t sums[2];
+	int n = 0;
+	for (int i = 0; i < 2; ++i) {
+		scfg->io_backend = econf->io_backend = order[i];
+		if (i > 0) {
+			aliyun_sim_stop();
+			if (aliyun_sim_start(scfg) != 0) {
+				coap_log_error("无法重启阿里云模拟服务");
+				break;
+			}
+		}
+		if (run_devices(econf, period, rounds, cr, src, &sums[n]) != 0) break;
+		print_server_stats(cr->first);
+		n++;
+	}
+	coap_log_flush();
+	printf("\n%-10s %14s %10s %10s\n", "后端", "吞吐(条/s)", "p50(us)", "p99(us)");
+	for (int i = 0; i < n; ++i) {
+		printf("%-10s %14.0f %10llu %10llu\n", io_backend_name(sums[i].backend),
+			sums[i].busy_ms ? (double)sums[i].ok * 1000.0 / (double)sums[i].busy_ms : 0.0,
+			(unsigned long long)sums[i].p50_us, (unsigned long long)sums[i].p99_us);
+	}
+	return n == 2 ? 0 : 1;
+}
+
+// 单设备模式发送一个 SenML pack
+static void single_post_pack(coap_client_t *client, const char *query, const uint8_t *body, int bn) {
+	uint16_t mid = 0;
+	int rc = bn < 0 ? -1 : coap_client_post(client, "localhost", "things/upload", query, body, (size_t)bn, &mid);
+	if (rc == 0) coap_log_info("发送: SenML pack %d 字节 -> 状态: 成功 (消息ID: 0x%04X)", bn, mid);
+	else coap_log_info("发送: SenML pack %d 字节 -> 状态: 失败 rc=%d (消息ID: 0x%04X)", bn, rc, mid);
 }
 
 int main(int argc, char **argv) {
 	int period = 2; // 秒
+	int rounds = 20; // 闭环与单设备模式的上报轮数
 	network_mode_t net = NETWORK_OK;
 	coap_msg_type_t mtype = COAP_TYPE_CON;
+	uint32_t devices = 0; // 0 表示单设备阻塞模式
+	int nstart = 1;
+	coap_rto_mode_t rto_mode = COAP_RTO_FIXED;
+	traffic_conf_t traffic;
+	memset(&traffic, 0, sizeof(traffic));
+	int duration = 20;
+	uint32_t server_threads = 1;
+	uint32_t batch = 1;
+	uint32_t batch_socks = 0;
+	int gso = 0;
+	io_backend_t io_backend = IO_BACKEND_SOCKET;
+	int io_compare = 0;
+	const char *registry_file = NULL;
+	const char *store_dir = NULL;
+	uint32_t dedup_entries = 65536;
+	int auth_hmac = 1;
+	uint32_t auth_cache = 65536;
+	int encrypt = 0;
+	aes_impl_t aes_impl = AES_IMPL_AUTO;
+	coap_payload_fmt_t payload_fmt = COAP_PAYLOAD_JSON;
+	senml_batch_conf_t senml;
+	memset(&senml, 0, sizeof(senml));
+	senml.max_bytes = SENML_PACK_DGRAM;
+	senml.max_delay_ms = 1000;
+	int block_szx = -1; // 未指定时只在一个报文放不下时分块
+	uint32_t observe = 0;
+	uint64_t sensor_seed = 0; // 0 按时钟取
+	coap_log_conf_t lconf;
+	memset(&lconf, 0, sizeof(lconf));
+	lconf.level = COAP_LOG_INFO;
+	int log_sample = -1; // 未指定时单设备逐包输出，多设备不输出
+	const char *impair_spec = NULL;
+	net_impair_conf_t iconf;
+	memset(&iconf, 0, sizeof(iconf));
 
 	for (int i = 1; i < argc; ++i) {
 		if (strcmp(argv[i], "--period") == 0 && i + 1 < argc) {
 			period = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+			rounds = atoi(argv[++i]);
+			if (rounds < 1) { usage(argv[0]); return 1; }
 		} else if (strcmp(argv[i], "--net") == 0 && i + 1 < argc) {
 			const char *v = argv[++i];
 			if (strcmp(v, "ok") == 0) net = NETWORK_OK;
@@ -75,13 +834,136 @@ int main(int argc, char **argv) {
 			if (strcmp(v, "con") == 0) mtype = COAP_TYPE_CON;
 			else if (strcmp(v, "non") == 0) mtype = COAP_TYPE_NON;
 			else { usage(argv[0]); return 1; }
+		} else if (strcmp(argv[i], "--devices") == 0 && i + 1 < argc) {
+			devices = (uint32_t)strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--nstart") == 0 && i + 1 < argc) {
+			nstart = atoi(argv[++i]);
+			if (nstart < 1 || nstart > 255) { usage(argv[0]); return 1; }
+		} else if (strcmp(argv[i], "--rto") == 0 && i + 1 < argc) {
+			const char *v = argv[++i];
+			if (strcmp(v, "fixed") == 0) rto_mode = COAP_RTO_FIXED;
+			else if (strcmp(v, "cocoa") == 0) rto_mode = COAP_RTO_COCOA;
+			else { usage(argv[0]); return 1; }
+		} else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+			traffic.rate_hz = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+			const char *v = argv[++i];
+			if (strcmp(v, "constant") == 0) traffic.profile = TRAFFIC_CONSTANT;
+			else if (strcmp(v, "poisson") == 0) traffic.profile = TRAFFIC_POISSON;
+			else if (strcmp(v, "burst") == 0) traffic.profile = TRAFFIC_BURST;
+			else { usage(argv[0]); return 1; }
+		} else if (strcmp(argv[i], "--jitter") == 0 && i + 1 < argc) {
+			traffic.jitter_us = (uint32_t)strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--burst") == 0 && i + 1 < argc) {
+			traffic.burst_len = (uint32_t)strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+			duration = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--server-threads") == 0 && i + 1 < argc) {
+			server_threads = (uint32_t)strtoul(argv[++i], NULL, 10);
+			if (server_threads < 1 || server_threads > 256) { usage(argv[0]); return 1; }
+		} else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+			batch = (uint32_t)strtoul(argv[++i], NULL, 10);
+			if (batch < 1 || batch > 1024) { usage(argv[0]); return 1; }
+		} else if (strcmp(argv[i], "--batch-socks") == 0 && i + 1 < argc) {
+			batch_socks = (uint32_t)strtoul(argv[++i], NULL, 10);
+			if (batch_socks < 1 || batch_socks > 1024) { usage(argv[0]); return 1; }
+		} else if (strcmp(argv[i], "--gso") == 0) {
+			gso = 1;
+		} else if (strcmp(argv[i], "--io") == 0 && i + 1 < argc) {
+			const char *v = argv[++i];
+			if (strcmp(v, "socket") == 0) io_backend = IO_BACKEND_SOCKET;
+			else if (strcmp(v, "uring") == 0) io_backend = IO_BACKEND_URING;
+			else if (strcmp(v, "compare") == 0) io_compare = 1;
+			else { usage(argv[0]); return 1; }
+		} else if (strcmp(argv[i], "--auth") == 0 && i + 1 < argc) {
+			const char *v = argv[++i];
+			if (strcmp(v, "hmac") == 0) auth_hmac = 1;
+			else if (strcmp(v, "simple") == 0) auth_hmac = 0;
+			else { usage(argv[0]); return 1; }
+		} else if (strcmp(argv[i], "--encrypt") == 0 && i + 1 < argc) {
+			const char *v = argv[++i];
+			encrypt = 1;
+			if (strcmp(v, "auto") == 0) aes_impl = AES_IMPL_AUTO;
+			else if (strcmp(v, "soft") == 0) aes_impl = AES_IMPL_SOFT;
+			else if (strcmp(v, "ni") == 0) aes_impl = AES_IMPL_NI;
+			else { usage(argv[0]); return 1; }
+		} else if (strcmp(argv[i], "--payload") == 0 && i + 1 < argc) {
+			const char *v = argv[++i];
+			if (strcmp(v, "json") == 0) payload_fmt = COAP_PAYLOAD_JSON;
+			else if (strcmp(v, "cbor") == 0) payload_fmt = COAP_PAYLOAD_CBOR;
+			else { usage(argv[0]); return 1; }
+		} else if (strcmp(argv[i], "--senml") == 0 && i + 1 < argc) {
+			senml.max_count = (uint32_t)strtoul(argv[++i], NULL, 10);
+			if (senml.max_count < 1 || senml.max_count > SENML_BATCH_MAX) { usage(argv[0]); return 1; }
+		} else if (strcmp(argv[i], "--senml-bytes") == 0 && i + 1 < argc) {
+			senml.max_bytes = (uint32_t)strtoul(argv[++i], NULL, 10);
+			if (senml.max_bytes < 64 || senml.max_bytes > SENML_PACK_MAX) { usage(argv[0]); return 1; }
+		} else if (strcmp(argv[i], "--sensor-seed") == 0 && i + 1 < argc) {
+			sensor_seed = strtoull(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--observe") == 0 && i + 1 < argc) {
+			observe = (uint32_t)strtoul(argv[++i], NULL, 10);
+			if (observe < 1 || observe > OBSERVER_SIM_MAX) { usage(argv[0]); return 1; }
+		} else if (strcmp(argv[i], "--block-szx") == 0 && i + 1 < argc) {
+			block_szx = atoi(argv[++i]);
+			if (block_szx < 0 || block_szx > COAP_BLOCK_SZX_MAX) { usage(argv[0]); return 1; }
+		} else if (strcmp(argv[i], "--senml-delay") == 0 && i + 1 < argc) {
+			senml.max_delay_ms = (uint32_t)strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--auth-cache") == 0 && i + 1 < argc) {
+			auth_cache = (uint32_t)strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--dedup") == 0 && i + 1 < argc) {
+			dedup_entries = (uint32_t)strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--registry") == 0 && i + 1 < argc) {
+			registry_file = argv[++i];
+		} else if (strcmp(argv[i], "--store") == 0 && i + 1 < argc) {
+			store_dir = argv[++i];
+		} else if (strcmp(argv[i], "--stats-interval") == 0 && i + 1 < argc) {
+			g_stats_out.interval_s = (uint32_t)strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--stats-json") == 0 && i + 1 < argc) {
+			g_stats_out.json_path = argv[++i];
+		} else if (strcmp(argv[i], "--stats-prom") == 0 && i + 1 < argc) {
+			g_stats_out.prom_path = argv[++i];
+		} else if (strcmp(argv[i], "--log-level") == 0 && i + 1 < argc) {
+			const char *v = argv[++i];
+			if (strcmp(v, "debug") == 0) lconf.level = COAP_LOG_DEBUG;
+			else if (strcmp(v, "info") == 0) lconf.level = COAP_LOG_INFO;
+			else if (strcmp(v, "warn") == 0) lconf.level = COAP_LOG_WARN;
+			else if (strcmp(v, "error") == 0) lconf.level = COAP_LOG_ERROR;
+			else { usage(argv[0]); return 1; }
+		} else if (strcmp(argv[i], "--log-sample") == 0 && i + 1 < argc) {
+			log_sample = atoi(argv[++i]);
+			if (log_sample < 0) { usage(argv[0]); return 1; }
+		} else if (strcmp(argv[i], "--impair") == 0 && i + 1 < argc) {
+			impair_spec = argv[++i];
+			if (net_impair_parse(impair_spec, &iconf.up, &iconf.down, &iconf.seed) != 0) {
+				printf("无法解析 --impair %s\n", impair_spec);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--gen-registry") == 0 && i + 2 < argc) {
+			const char *path = argv[++i];
+			return gen_registry(path, (uint32_t)strtoul(argv[++i], NULL, 10));
 		} else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
 			usage(argv[0]); return 0;
 		}
 	}
 
+	// 多设备引擎每条上报只发一个报文，pack 须放得进单个数据报；分块上传只在单设备模式下使用
+	if (devices > 0 && senml.max_bytes > SENML_PACK_DGRAM) {
+		printf("多设备模式下 --senml-bytes 不能超过 %d（不支持分块上传）\n", SENML_PACK_DGRAM);
+		return 1;
+	}
+
+	if (observe && io_compare) {
+		printf("--observe 不能与 --io compare 同用（对比时服务端会重启，观察注册随之丢失）\n");
+		return 1;
+	}
+
+	// 大量观察者注册时默认不逐包打印
+	if (log_sample < 0) log_sample = devices == 0 && observe < 100;
+	lconf.packet_sample = (uint32_t)log_sample;
+	if (coap_log_start(&lconf) == 0) atexit(coap_log_stop);
+
 	if (platform_net_init() != 0) {
-		printf("网络栈初始化失败\n");
+		coap_log_error("网络栈初始化失败");
 		return 1;
 	}
 
@@ -90,12 +972,31 @@ int main(int argc, char **argv) {
 	// 启动阿里云模拟服务
 	aliyun_sim_conf_t scfg;
 	scfg.listen_port = 5683;
+	scfg.log_packets = lconf.packet_sample > 0;
+	scfg.worker_threads = server_threads;
+	scfg.batch_size = batch;
+	scfg.gso = gso;
+	scfg.io_backend = io_compare ? IO_BACKEND_SOCKET : io_backend;
+	scfg.registry_file = registry_file;
+	scfg.store_dir = store_dir;
+	scfg.store_commit_ms = 0;
+	scfg.registry_threads = 0;
+	scfg.dedup_entries = dedup_entries;
+	scfg.auth_ttl_s = 0;
+	scfg.auth_cache_entries = auth_cache;
+	scfg.session_key_cache = encrypt;
+	scfg.aes_impl = aes_impl;
+	scfg.block_transfers = 64;
+	scfg.block_timeout_ms = 0;
+	scfg.observe_observers = observe > 65536 ? observe : 65536;
+	scfg.observe_resources = 0;
+	scfg.observe_ttl_s = 0;
 	memset(&scfg.triple, 0, sizeof(scfg.triple));
 	strcpy(scfg.triple.product_key, "a1b2c3d4");
 	strcpy(scfg.triple.device_name, "dev001");
 	strcpy(scfg.triple.device_secret, "secret123");
 	if (aliyun_sim_start(&scfg) != 0) {
-		printf("无法启动阿里云模拟服务\n");
+		coap_log_error("无法启动阿里云模拟服务");
 		platform_net_deinit();
 		return 1;
 	}
@@ -109,37 +1010,163 @@ int main(int argc, char **argv) {
 	cconf.ack_timeout_ms = 1000; // 1s 起始
 	cconf.max_retransmit = 3;
 	cconf.net_mode = net;
+	cconf.nstart = (uint8_t)nstart;
+	cconf.rto_mode = rto_mode;
+	cconf.block_size = block_szx < 0 ? 0 : (uint16_t)coap_block_size((uint8_t)block_szx);
+	// 聚合时沿用所选编码：JSON → SenML JSON (110)，CBOR → SenML CBOR (112)
+	cconf.payload_fmt = senml.max_count ? (coap_payload_fmt_t)(payload_fmt + 2) : payload_fmt;
+	senml.cbor = payload_fmt == COAP_PAYLOAD_CBOR;
+
+	// 传感器日周期按采样间隔折算：闭环与单设备每 period 秒一个采样，开环按每台设备的平均发送速率
+	sensor_model_t model;
+	sensor_model_default(&model);
+	double sample_hz = devices && traffic.rate_hz > 0.0 ? traffic.rate_hz : period > 0 ? 1.0 / period : 1.0;
+	model.period_samples = (uint32_t)(86400.0 * sample_hz + 0.5);
+	dev_creds_t creds;
+	if (creds_init(&creds, &cconf, devices, auth_hmac, encrypt, aes_impl) != 0) {
+		coap_log_error("准备设备身份失败");
+		creds_destroy(&creds);
+		aliyun_sim_stop();
+		platform_net_deinit();
+		return 1;
+	}
+	const device_triple_t *triple = &creds.c[0].triple;
+	if (encrypt) {
+		coap_log_info("上报负载加密：AES-128-CBC，实现 %s%s", aes128_impl_name((aes_impl_t)creds.c[0].key.impl),
+			aes_impl == AES_IMPL_NI && creds.c[0].key.impl != AES_IMPL_NI ? "（CPU 不支持 AES-NI）" : "");
+	}
+
+	reading_src_t src;
+	if (reading_src_init(&src, &cconf, &senml, devices, triple, &model, sensor_seed) != 0) {
+		coap_log_error("分配传感器状态或 SenML 聚合缓冲失败");
+		reading_src_destroy(&src);
+		creds_destroy(&creds);
+		aliyun_sim_stop();
+		platform_net_deinit();
+		return 1;
+	}
+	observer_sim_t *obs = NULL;
+	if (observe) {
+		int orc = observer_sim_start(&obs, cconf.server_host, cconf.server_port, triple->product_key, triple->device_name, observe);
+		if (orc != 0) coap_log_error("启动观察者失败 rc=%d", orc);
+		else coap_log_info("观察者：以 %u 个 Token 观察 things/%s/%s", observe, triple->product_key, triple->device_name);
+	}
+	if (senml.max_count) {
+		coap_log_info("读数聚合：SenML %s，每 pack 至多 %u 条 / %u 字节，最长滞留 %u ms",
+			senml.cbor ? "CBOR" : "JSON", senml.max_count, senml.max_bytes, senml.max_delay_ms);
+	}
+
+	// 网络损伤代理：握手与观察者直连服务端，上报改发到代理端口
+	net_impair_t *imp = NULL;
+	if (impair_spec) {
+		iconf.listen_port = (unsigned short)(scfg.listen_port + 1);
+		strcpy(iconf.upstream_host, cconf.server_host);
+		iconf.upstream_port = scfg.listen_port;
+		iconf.batch_size = batch > 1 ? batch : 0;
+		int irc = net_impair_start(&imp, &iconf);
+		if (irc != 0) {
+			coap_log_error("启动网络损伤代理失败 rc=%d", irc);
+			stop_observer(obs);
+			reading_src_destroy(&src);
+			creds_destroy(&creds);
+			aliyun_sim_stop();
+			platform_net_deinit();
+			return 1;
+		}
+		cconf.server_port = iconf.listen_port;
+		coap_log_info("网络损伤：%s，客户端经代理端口 %u 连到服务端", impair_spec, (unsigned)iconf.listen_port);
+	}
+
+	if (devices > 0) {
+		coap_engine_conf_t econf;
+		memset(&econf, 0, sizeof(econf));
+		econf.client = cconf;
+		econf.device_count = devices;
+		econf.batch_size = batch;
+		econf.shared_sockets = batch_socks;
+		econf.io_backend = io_backend;
+		int ret;
+		if (io_compare) {
+			ret = run_io_compare(&scfg, &econf, period, rounds, &creds, &src);
+			stop_impair(imp);
+		} else {
+			run_summary_t sum;
+			ret = traffic.rate_hz > 0.0 ?
+				run_open_loop(&econf, &traffic, duration, &creds, &src) :
+				run_devices(&econf, period, rounds, &creds, &src, &sum);
+			stop_observer(obs);
+			stop_impair(imp);
+			print_server_stats(creds.first);
+		}
+		reading_src_destroy(&src);
+		creds_destroy(&creds);
+		aliyun_sim_stop();
+		platform_net_deinit();
+		return ret;
+	}
 
 	coap_client_t client;
 	if (coap_client_init(&client, &cconf) != 0) {
-		printf("初始化 CoAP 客户端失败\n");
+		coap_log_error("初始化 CoAP 客户端失败");
+		stop_observer(obs);
+		stop_impair(imp);
+		reading_src_destroy(&src);
+		creds_destroy(&creds);
+		aliyun_sim_stop();
 		platform_net_deinit();
 		return 1;
 	}
 
-	sensor_sim_init();
-	device_triple_t triple = scfg.triple;
-	char token[16]; make_token_client(&triple, token, sizeof(token));
-
-	printf("[%s] 启动上报：period=%ds, net=%d, type=%s\n", now_ts(), period, net, mtype==COAP_TYPE_CON?"CON":"NON");
+	coap_metrics_t metrics;
+	coap_metrics_init(&metrics, 0);
+	metrics.start_us = coap_mono_us();
+	client.metrics = &metrics;
+	stats_begin(&metrics);
+	coap_log_info("启动上报：period=%ds, rounds=%d, net=%d, type=%s", period, rounds, net, mtype==COAP_TYPE_CON?"CON":"NON");
 
-	for (int loop = 0; loop < 20; ++loop) {
-		sensor_reading_t r = sensor_sim_read();
-		char json[128];
-		snprintf(json, sizeof(json), "{\"temp\":%.1f,\"humidity\":%.1f,\"abn\":%d}", r.temperature_c, r.humidity_rh, r.is_abnormal);
-		char query[128];
-		snprintf(query, sizeof(query), "token=%s", token);
+	char query[128];
+	snprintf(query, sizeof(query), "token=%s", creds.c[0].token);
+	for (int loop = 0; loop < rounds; ++loop) {
+		uint8_t body[SENML_PACK_MAX];
+		// 聚合：先发滞留到期的 pack，最后一轮后清空缓冲
+		int bn = reading_src_due(&src, 0, 0, body, sizeof(body));
+		if (bn > 0) single_post_pack(&client, query, body, bn);
+		sensor_reading_t r = sensor_bank_next(&src.sensors, 0);
+		bn = reading_src_next(&src, 0, &r, body, sizeof(body));
+		if (src.devices) {
+			if (bn == 0) coap_log_info("采样: temp=%.1f, humidity=%.1f -> 已缓存 %u 条", r.temperature_c, r.humidity_rh, src.dev[0].count);
+			else single_post_pack(&client, query, body, bn);
+			if (loop == rounds - 1 && (bn = reading_src_due(&src, 0, 1, body, sizeof(body))) > 0) single_post_pack(&client, query, body, bn);
+			stats_tick(&metrics);
+			sleep_sec(period);
+			continue;
+		}
 		uint16_t mid = 0;
-		int rc = coap_client_post_json(&client, "localhost", "things/upload", query, json, &mid);
+		int rc = bn < 0 ? -1 : coap_client_post(&client, "localhost", "things/upload", query, body, (size_t)bn, &mid);
 		if (rc == 0) {
-			printf("[%s] 发送: temp=%.1f, humidity=%.1f -> 状态: 成功 (消息ID: 0x%04X)\n", now_ts(), r.temperature_c, r.humidity_rh, mid);
+			coap_log_info("发送: temp=%.1f, humidity=%.1f -> 状态: 成功 (消息ID: 0x%04X)", r.temperature_c, r.humidity_rh, mid);
 		} else {
-			printf("[%s] 发送: temp=%.1f, humidity=%.1f -> 状态: 失败 rc=%d (消息ID: 0x%04X)\n", now_ts(), r.temperature_c, r.humidity_rh, rc, mid);
+			coap_log_info("发送: temp=%.1f, humidity=%.1f -> 状态: 失败 rc=%d (消息ID: 0x%04X)", r.temperature_c, r.humidity_rh, rc, mid);
 		}
+		stats_tick(&metrics);
 		sleep_sec(period);
 	}
+	print_senml_stats(&src);
+	reading_src_destroy(&src);
+
+	const coap_rto_stats_t *rs = &client.rto.stats;
+	coap_log_info("CON 交换 %llu 次，收到响应 %llu 次，重传 %llu 次（固定策略估计 %llu 次，节省 %lld 次）",
+		(unsigned long long)rs->exchanges, (unsigned long long)rs->acked,
+		(unsigned long long)rs->retransmits, (unsigned long long)rs->retransmits_fixed,
+		(long long)rs->retransmits_fixed - (long long)rs->retransmits);
+	stats_finish(&metrics);
+	coap_metrics_destroy(&metrics);
 
 	coap_client_close(&client);
+	stop_observer(obs);
+	stop_impair(imp);
+	print_server_stats(creds.first);
+	creds_destroy(&creds);
 	aliyun_sim_stop();
 	platform_net_deinit();
 	return 0;
@@ -0,0 +1,657 @@
+// net_impair.c
+// 网络损伤代理：场景解析与预置场景各平台通用，转发线程仅 Linux（epoll + timerfd 驱动的时间轮）
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // recvmmsg/sendmmsg
+#endif
+
+#include "net_impair.h"
+#include "coap_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+	const char *name;
+	net_impair_link_t up;
+	net_impair_link_t down;
+} impair_preset_t;
+
+// 预置场景：除 cellular 的限速外上下行相同
+//   lan        局域网：0.2 ms ± 0.05 ms
+//   lossy      5% 独立丢包，20 ms ± 5 ms
+//   bursty     GE 突发丢包（平均约 7% 的报文处于坏状态，坏状态丢 80%），30 ms、标准差 10 ms
+//   cellular   NB-IoT/LTE-M 风格：GE 突发丢包，80 ms 加帕累托长尾，0.5% 重复，1% 乱序，上行 256 kbit/s、下行 1 Mbit/s
+//   congested  拥塞的窄带链路：1% 丢包，40 ms ± 10 ms，64 kbit/s，积压 16 KB 后尾丢
+static const impair_preset_t presets[] = {
+	{ "none", { 0 }, { 0 } },
+	{ "lan",
+		{ IMPAIR_LOSS_NONE, 0, 0, 0, 0, 0, 200, 50, IMPAIR_DELAY_UNIFORM, 0, 0, 0, 0, 0 },
+		{ IMPAIR_LOSS_NONE, 0, 0, 0, 0, 0, 200, 50, IMPAIR_DELAY_UNIFORM, 0, 0, 0, 0, 0 } },
+	{ "lossy",
+		{ IMPAIR_LOSS_BERNOULLI, 0.05, 0, 0, 0, 0, 20000, 5000, IMPAIR_DELAY_UNIFORM, 0, 0, 0, 0, 0 },
+		{ IMPAIR_LOSS_BERNOULLI, 0.05, 0, 0, 0, 0, 20000, 5000, IMPAIR_DELAY_UNIFORM, 0, 0, 0, 0, 0 } },
+	{ "bursty",
+		{ IMPAIR_LOSS_GE, 0, 0.02, 0.25, 0, 0.8, 30000, 10000, IMPAIR_DELAY_NORMAL, 0, 0, 0, 0, 0 },
+		{ IMPAIR_LOSS_GE, 0, 0.02, 0.25, 0, 0.8, 30000, 10000, IMPAIR_DELAY_NORMAL, 0, 0, 0, 0, 0 } },
+	{ "cellular",
+		{ IMPAIR_LOSS_GE, 0, 0.01, 0.3, 0, 0.5, 80000, 30000, IMPAIR_DELAY_PARETO, 0.005, 0.01, 256, 0, 0 },
+		{ IMPAIR_LOSS_GE, 0, 0.01, 0.3, 0, 0.5, 80000, 30000, IMPAIR_DELAY_PARETO, 0.005, 0.01, 1024, 0, 0 } },
+	{ "congested",
+		{ IMPAIR_LOSS_BERNOULLI, 0.01, 0, 0, 0, 0, 40000, 10000, IMPAIR_DELAY_UNIFORM, 0, 0, 64, 0, 16000 },
+		{ IMPAIR_LOSS_BERNOULLI, 0.01, 0, 0, 0, 0, 40000, 10000, IMPAIR_DELAY_UNIFORM, 0, 0, 64, 0, 16000 } },
+};
+
+const char *net_impair_presets(void) {
+	return "none|lan|lossy|bursty|cellular|congested";
+}
+
+static int parse_pct(const char *v, double *out) {
+	char *end;
+	double d = strtod(v, &end);
+	if (end == v || *end || d < 0 || d > 100) return -1;
+	*out = d / 100.0;
+	return 0;
+}
+
+static int parse_ms(const char *v, uint32_t *out) {
+	char *end;
+	double d = strtod(v, &end);
+	if (end == v || *end || d < 0 || d > 3600000.0) return -1;
+	*out = (uint32_t)(d * 1000.0 + 0.5);
+	return 0;
+}
+
+static int parse_u32(const char *v, uint32_t *out) {
+	char *end;
+	unsigned long x = strtoul(v, &end, 10);
+	if (end == v || *end || x > 0xFFFFFFFFul) return -1;
+	*out = (uint32_t)x;
+	return 0;
+}
+
+// 把一个 key=value 应用到一个方向
+static int apply_kv(net_impair_link_t *lk, const char *key, const char *v) {
+	if (strcmp(key, "loss") == 0) {
+		if (parse_pct(v, &lk->loss) != 0) return -1;
+		lk->loss_model = lk->loss > 0 ? IMPAIR_LOSS_BERNOULLI : IMPAIR_LOSS_NONE;
+		return 0;
+	}
+	if (strcmp(key, "ge") == 0) {
+		char a[32], b[32], c[32];
+		if (sscanf(v, "%31[^:]:%31[^:]:%31s", a, b, c) != 3 ||
+			parse_pct(a, &lk->ge_p) != 0 || parse_pct(b, &lk->ge_r) != 0 || parse_pct(c, &lk->ge_loss_bad) != 0) return -1;
+		lk->ge_loss_good = 0;
+		lk->loss_model = IMPAIR_LOSS_GE;
+		return 0;
+	}
+	if (strcmp(key, "delay") == 0) return parse_ms(v, &lk->delay_us);
+	if (strcmp(key, "jitter") == 0) return parse_ms(v, &lk->jitter_us);
+	if (strcmp(key, "dist") == 0) {
+		if (strcmp(v, "uniform") == 0) lk->delay_dist = IMPAIR_DELAY_UNIFORM;
+		else if (strcmp(v, "normal") == 0) lk->delay_dist = IMPAIR_DELAY_NORMAL;
+		else if (strcmp(v, "pareto") == 0) lk->delay_dist = IMPAIR_DELAY_PARETO;
+		else return -1;
+		return 0;
+	}
+	if (strcmp(key, "dup") == 0) return parse_pct(v, &lk->duplicate);
+	if (strcmp(key, "reorder") == 0) return parse_pct(v, &lk->reorder);
+	if (strcmp(key, "rate") == 0) return parse_u32(v, &lk->rate_kbps);
+	if (strcmp(key, "burst") == 0) return parse_u32(v, &lk->burst_bytes);
+	if (strcmp(key, "queue") == 0) return parse_u32(v, &lk->queue_bytes);
+	return -1;
+}
+
+int net_impair_parse(const char *spec, net_impair_link_t *up, net_impair_link_t *down, uint64_t *seed) {
+	if (!spec || !up || !down) return -1;
+	memset(up, 0, sizeof(*up));
+	memset(down, 0, sizeof(*down));
+	char buf[256];
+	if (strlen(spec) >= sizeof(buf)) return -1;
+	strcpy(buf, spec);
+	int first = 1;
+	for (char *tok = strtok(buf, ","); tok; tok = strtok(NULL, ","), first = 0) {
+		char *eq = strchr(tok, '=');
+		if (!eq) {
+			// 只有第一段可以是场景名
+			if (!first) return -1;
+			size_t i;
+			for (i = 0; i < sizeof(presets) / sizeof(presets[0]); ++i) {
+				if (strcmp(tok, presets[i].name) == 0) break;
+			}
+			if (i == sizeof(presets) / sizeof(presets[0])) return -1;
+			*up = presets[i].up;
+			*down = presets[i].down;
+			continue;
+		}
+		*eq = '\0';
+		const char *key = tok, *v = eq + 1;
+		if (strcmp(key, "seed") == 0) {
+			char *end;
+			unsigned long long s = strtoull(v, &end, 10);
+			if (!seed || end == v || *end) return -1;
+			*seed = s;
+			continue;
+		}
+		if (strncmp(key, "up.", 3) == 0) {
+			if (apply_kv(up, key + 3, v) != 0) return -1;
+		} else if (strncmp(key, "down.", 5) == 0) {
+			if (apply_kv(down, key + 5, v) != 0) return -1;
+		} else if (apply_kv(up, key, v) != 0 || apply_kv(down, key, v) != 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+#ifdef __linux__
+
+#include "coap_client.h"
+#include "coap_pool.h"
+#include "timer_wheel.h"
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+
+#define TIMERFD_ID 0xFFFFFFFFu // epoll 数据中标识 timerfd（流下标不会取到）
+#define LISTEN_ID 0xFFFFFFFEu  // epoll 数据中标识监听套接字
+#define BATCH_MAX 1024
+#define EVENTS_MAX 256
+#define POLL_MS 10             // 无事件时的最长等待，据此检查停止标志
+#define LISTEN_RCVBUF (8 << 20)
+
+enum { DIR_UP = 0, DIR_DOWN = 1 };
+
+// 一条链路（一个流的一个方向）的状态
+typedef struct {
+	uint8_t ge_bad;      // Gilbert-Elliott 当前是否处于坏状态
+	double tokens;       // 令牌（字节），为负表示积压等待令牌的字节数
+	uint64_t tb_us;      // 上次补充令牌的时刻，0 表示尚未使用（桶满）
+	uint64_t last_at_us; // 上一个报文的放行时刻（限速时保证同一链路先进先出）
+} link_state_t;
+
+typedef struct {
+	uint64_t key;        // (IPv4 << 16 | 端口) + 1
+	struct sockaddr_in client;
+	int sock;            // 连接到服务端的上游套接字
+	link_state_t up;
+	link_state_t down;
+} flow_t;
+
+// 排队中的报文：与缓冲池的槽一一对应
+typedef struct {
+	tw_timer_t timer;    // 必须在首位：到期回调据此转回报文
+	uint8_t *buf;
+	uint64_t arrive_us;
+	uint32_t flow;
+	uint16_t len;
+	uint8_t dir;
+} impair_pkt_t;
+
+struct net_impair {
+	net_impair_conf_t conf;
+	struct sockaddr_in upstream;
+	int lsock;           // 监听套接字（客户端一侧）
+	int epfd;
+	int tfd;
+	uint64_t tfd_armed;
+	uint64_t origin_us;
+	uint64_t now_us;     // 本轮推进时间轮时的时刻
+	uint64_t rng;
+	timer_wheel_t wheel;
+	coap_pool_t pool;
+	impair_pkt_t *pkts;
+	flow_t *flows;
+	uint32_t nflows;
+	uint32_t *table;     // 开放寻址：流下标 + 1，0 为空
+	uint32_t table_mask;
+	double bytes_per_us[2]; // 各方向令牌补充速率
+	double burst[2];
+	double queue[2];
+	// 批量收发
+	uint32_t batch;
+	struct mmsghdr *rx_msgs;
+	struct iovec *rx_iov;
+	struct sockaddr_in *rx_addrs;
+	uint8_t *rx_bufs;
+	struct mmsghdr *tx_msgs;
+	struct iovec *tx_iov;
+	impair_pkt_t **tx_pkts;
+	uint32_t tx_count;
+	struct epoll_event events[EVENTS_MAX];
+	volatile int running;
+	int started;
+	pthread_t thread;
+	net_impair_stats_t st;
+};
+
+static uint64_t splitmix64(uint64_t x) {
+	x += 0x9E3779B97F4A7C15ull;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
+static uint64_t next_rand(uint64_t *state) {
+	// xorshift64*
+	uint64_t x = *state;
+	x ^= x >> 12; x ^= x << 25; x ^= x >> 27;
+	*state = x;
+	return x * 0x2545F4914F6CDD1Dull;
+}
+
+// [0, 1) 均匀分布
+static double rand_unit(net_impair_t *p) {
+	return (double)(next_rand(&p->rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int chance(net_impair_t *p, double prob) {
+	return prob > 0 && rand_unit(p) < prob;
+}
+
+static void raise_fd_limit(uint32_t want) {
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) != 0) return;
+	if (rl.rlim_cur >= want) return;
+	rl.rlim_cur = (rl.rlim_max == RLIM_INFINITY || rl.rlim_max >= want) ? want : rl.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &rl);
+}
+
+static uint64_t now_tick(const net_impair_t *p) {
+	return (coap_mono_us() - p->origin_us) / p->conf.tick_us;
+}
+
+// 放行时刻换成 tick 时向下取整：不计时延的报文在本轮推进时就能发出
+static uint64_t us_to_tick(const net_impair_t *p, uint64_t mono_us) {
+	return mono_us <= p->origin_us ? 0 : (mono_us - p->origin_us) / p->conf.tick_us;
+}
+
+// 按分布取一次单向时延（us）
+static uint64_t sample_delay(net_impair_t *p, const net_impair_link_t *lk) {
+	double d = lk->delay_us, j = lk->jitter_us;
+	if (j > 0) {
+		switch (lk->delay_dist) {
+		case IMPAIR_DELAY_NORMAL: {
+			// Box-Muller
+			double u1 = rand_unit(p), u2 = rand_unit(p);
+			d += j * sqrt(-2.0 * log(1.0 - u1)) * cos(6.283185307179586 * u2);
+			break;
+		}
+		case IMPAIR_DELAY_PARETO: {
+			// 形状 2 的帕累托减 1：均值为 1，乘 j 得尾部均值 j
+			double tail = 1.0 / sqrt(1.0 - rand_unit(p)) - 1.0;
+			d += j * (tail > 100.0 ? 100.0 : tail);
+			break;
+		}
+		default:
+			d += j * (2.0 * rand_unit(p) - 1.0);
+			break;
+		}
+	}
+	return d > 0 ? (uint64_t)d : 0;
+}
+
+// 对一个到达的报文决定去留与放行时刻；返回放行份数（0 丢弃，1 或 2），at 为各份的放行时刻
+static int impair_decide(net_impair_t *p, int dir, link_state_t *ls, uint32_t len, uint64_t now_us, uint64_t at[2]) {
+	const net_impair_link_t *lk = dir == DIR_UP ? &p->conf.up : &p->conf.down;
+	net_impair_dir_stats_t *st = dir == DIR_UP ? &p->st.up : &p->st.down;
+	// 丢包：GE 先按报文转移状态，再按所在状态的丢包率丢弃
+	if (lk->loss_model == IMPAIR_LOSS_BERNOULLI) {
+		if (chance(p, lk->loss)) { st->lost++; return 0; }
+	} else if (lk->loss_model == IMPAIR_LOSS_GE) {
+		if (ls->ge_bad) { if (chance(p, lk->ge_r)) ls->ge_bad = 0; }
+		else if (chance(p, lk->ge_p)) ls->ge_bad = 1;
+		if (chance(p, ls->ge_bad ? lk->ge_loss_bad : lk->ge_loss_good)) { st->lost++; return 0; }
+	}
+	int copies = chance(p, lk->duplicate) ? 2 : 1;
+	// 令牌桶：令牌不足时欠账，欠账的字节按速率还清后放行；欠账超过积压上限则尾丢
+	uint64_t wait_us = 0;
+	if (lk->rate_kbps) {
+		double need = (double)len * copies;
+		if (ls->tb_us == 0) ls->tokens = p->burst[dir];
+		else ls->tokens += (double)(now_us - ls->tb_us) * p->bytes_per_us[dir];
+		if (ls->tokens > p->burst[dir]) ls->tokens = p->burst[dir];
+		ls->tb_us = now_us;
+		if (ls->tokens - need < -p->queue[dir]) { st->queue_drops++; return 0; }
+		ls->tokens -= need;
+		if (ls->tokens < 0) wait_us = (uint64_t)(-ls->tokens / p->bytes_per_us[dir]);
+	}
+	for (int c = 0; c < copies; ++c) {
+		if (chance(p, lk->reorder)) {
+			at[c] = now_us + wait_us;
+			st->reordered++;
+		} else {
+			at[c] = now_us + wait_us + sample_delay(p, lk);
+			// 限速链路先进先出：抖动不会让报文越过前面排队的报文
+			if (lk->rate_kbps && at[c] < ls->last_at_us) at[c] = ls->last_at_us;
+			if (lk->rate_kbps) ls->last_at_us = at[c];
+		}
+	}
+	if (copies == 2) st->duplicated++;
+	return copies;
+}
+
+static void impair_packet(net_impair_t *p, int dir, uint32_t flow, const uint8_t *data, uint32_t len, uint64_t now_us) {
+	flow_t *f = &p->flows[flow];
+	net_impair_dir_stats_t *st = dir == DIR_UP ? &p->st.up : &p->st.down;
+	uint64_t at[2];
+	st->received++;
+	int copies = impair_decide(p, dir, dir == DIR_UP ? &f->up : &f->down, len, now_us, at);
+	for (int c = 0; c < copies; ++c) {
+		uint8_t *buf = coap_pool_alloc(&p->pool);
+		if (!buf) { st->queue_drops++; continue; }
+		impair_pkt_t *pkt = &p->pkts[coap_pool_index(&p->pool, buf)];
+		pkt->buf = buf;
+		pkt->arrive_us = now_us;
+		pkt->flow = flow;
+		pkt->len = (uint16_t)len;
+		pkt->dir = (uint8_t)dir;
+		memcpy(buf, data, len);
+		tw_add(&p->wheel, &pkt->timer, us_to_tick(p, at[c]));
+	}
+}
+
+static void pkt_delivered(net_impair_t *p, const impair_pkt_t *pkt) {
+	net_impair_dir_stats_t *st = pkt->dir == DIR_UP ? &p->st.up : &p->st.down;
+	uint64_t d = p->now_us > pkt->arrive_us ? p->now_us - pkt->arrive_us : 0;
+	st->delivered++;
+	st->bytes += pkt->len;
+	st->delay_sum_us += d;
+	if (d > st->delay_max_us) st->delay_max_us = d;
+}
+
+// 下行待发报文用一次 sendmmsg 从监听套接字发给各自的客户端；发送缓冲满时余下的按积压丢弃
+static void tx_flush(net_impair_t *p) {
+	uint32_t off = 0;
+	while (off < p->tx_count) {
+		int n = sendmmsg(p->lsock, p->tx_msgs + off, p->tx_count - off, 0);
+		if (n <= 0) {
+			if (n < 0 && errno == EINTR) continue;
+			break;
+		}
+		for (int i = 0; i < n; ++i) pkt_delivered(p, p->tx_pkts[off + i]);
+		off += (uint32_t)n;
+	}
+	p->st.down.queue_drops += p->tx_count - off;
+	for (uint32_t i = 0; i < p->tx_count; ++i) coap_pool_free(&p->pool, p->tx_pkts[i]->buf);
+	p->tx_count = 0;
+}
+
+static void on_release(tw_timer_t *t, void *ctx) {
+	net_impair_t *p = (net_impair_t*)ctx;
+	impair_pkt_t *pkt = (impair_pkt_t*)t;
+	flow_t *f = &p->flows[pkt->flow];
+	if (pkt->dir == DIR_UP) {
+		// 上行各流的套接字不同，逐包发出
+		if (send(f->sock, pkt->buf, pkt->len, MSG_DONTWAIT) == (ssize_t)pkt->len) pkt_delivered(p, pkt);
+		else p->st.up.queue_drops++;
+		coap_pool_free(&p->pool, pkt->buf);
+		return;
+	}
+	uint32_t i = p->tx_count++;
+	p->tx_iov[i].iov_base = pkt->buf;
+	p->tx_iov[i].iov_len = pkt->len;
+	p->tx_msgs[i].msg_hdr.msg_name = &f->client;
+	p->tx_msgs[i].msg_hdr.msg_namelen = sizeof(f->client);
+	p->tx_pkts[i] = pkt;
+	if (p->tx_count == p->batch) tx_flush(p);
+}
+
+// 按客户端端点查找流，没有则建立（连接上游套接字并加入 epoll）；流表已满返回 UINT32_MAX
+static uint32_t flow_lookup(net_impair_t *p, const struct sockaddr_in *from) {
+	uint64_t key = (((uint64_t)from->sin_addr.s_addr << 16) | from->sin_port) + 1;
+	uint32_t h = (uint32_t)splitmix64(key) & p->table_mask;
+	while (p->table[h]) {
+		uint32_t idx = p->table[h] - 1;
+		if (p->flows[idx].key == key) return idx;
+		h = (h + 1) & p->table_mask;
+	}
+	if (p->nflows >= p->conf.max_flows) return UINT32_MAX;
+	int s = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (s < 0) return UINT32_MAX;
+	uint32_t idx = p->nflows;
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.u32 = idx;
+	if (connect(s, (struct sockaddr*)&p->upstream, sizeof(p->upstream)) != 0 ||
+		epoll_ctl(p->epfd, EPOLL_CTL_ADD, s, &ev) != 0) {
+		close(s);
+		return UINT32_MAX;
+	}
+	flow_t *f = &p->flows[idx];
+	memset(f, 0, sizeof(*f));
+	f->key = key;
+	f->client = *from;
+	f->sock = s;
+	p->table[h] = idx + 1;
+	p->nflows++;
+	return idx;
+}
+
+static void drain_listen(net_impair_t *p) {
+	for (;;) {
+		for (uint32_t i = 0; i < p->batch; ++i) p->rx_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		int n = recvmmsg(p->lsock, p->rx_msgs, p->batch, MSG_DONTWAIT, NULL);
+		if (n <= 0) return;
+		uint64_t now = coap_mono_us();
+		for (int i = 0; i < n; ++i) {
+			uint32_t flow = flow_lookup(p, &p->rx_addrs[i]);
+			if (flow == UINT32_MAX) { p->st.flow_drops++; continue; }
+			impair_packet(p, DIR_UP, flow, p->rx_bufs + (size_t)i * COAP_MAX_PKT, p->rx_msgs[i].msg_len, now);
+		}
+		if ((uint32_t)n < p->batch) return;
+	}
+}
+
+static void drain_flow(net_impair_t *p, uint32_t flow) {
+	for (;;) {
+		for (uint32_t i = 0; i < p->batch; ++i) p->rx_msgs[i].msg_hdr.msg_namelen = 0;
+		int n = recvmmsg(p->flows[flow].sock, p->rx_msgs, p->batch, MSG_DONTWAIT, NULL);
+		if (n <= 0) return;
+		uint64_t now = coap_mono_us();
+		for (int i = 0; i < n; ++i) {
+			impair_packet(p, DIR_DOWN, flow, p->rx_bufs + (size_t)i * COAP_MAX_PKT, p->rx_msgs[i].msg_len, now);
+		}
+		if ((uint32_t)n < p->batch) return;
+	}
+}
+
+// 把 timerfd 设到时间轮下一次到期的时刻；返回 0 表示已有到期
+static uint64_t arm_timerfd(net_impair_t *p, uint64_t now) {
+	uint64_t next = tw_next_expiry(&p->wheel);
+	if (next == UINT64_MAX) return UINT64_MAX;
+	if (next <= now) return 0;
+	if (next != p->tfd_armed) {
+		uint64_t at = p->origin_us + next * p->conf.tick_us;
+		struct itimerspec its;
+		memset(&its, 0, sizeof(its));
+		its.it_value.tv_sec = (time_t)(at / 1000000u);
+		its.it_value.tv_nsec = (long)(at % 1000000u) * 1000L;
+		timerfd_settime(p->tfd, TFD_TIMER_ABSTIME, &its, NULL);
+		p->tfd_armed = next;
+	}
+	return next - now;
+}
+
+static void *impair_thread(void *arg) {
+	net_impair_t *p = (net_impair_t*)arg;
+	while (p->running) {
+		int timeout = arm_timerfd(p, now_tick(p)) == 0 ? 0 : POLL_MS;
+		int n = epoll_wait(p->epfd, p->events, EVENTS_MAX, timeout);
+		if (n < 0 && errno != EINTR) { perror("epoll_wait"); break; }
+		for (int i = 0; i < n; ++i) {
+			uint32_t id = p->events[i].data.u32;
+			if (id == TIMERFD_ID) {
+				uint64_t expirations;
+				if (read(p->tfd, &expirations, sizeof(expirations)) < 0) { /* 已被读空 */ }
+				p->tfd_armed = 0;
+			} else if (id == LISTEN_ID) {
+				drain_listen(p);
+			} else {
+				drain_flow(p, id);
+			}
+		}
+		p->now_us = coap_mono_us();
+		tw_advance(&p->wheel, now_tick(p), p);
+		if (p->tx_count) tx_flush(p);
+	}
+	return NULL;
+}
+
+// 令牌桶参数：速率换成字节/us，桶深与积压上限按默认时长折算
+static void setup_rate(net_impair_t *p, int dir, const net_impair_link_t *lk) {
+	if (!lk->rate_kbps) return;
+	double bpus = (double)lk->rate_kbps * 1000.0 / 8.0 / 1e6;
+	p->bytes_per_us[dir] = bpus;
+	p->burst[dir] = lk->burst_bytes ? lk->burst_bytes : bpus * 10000.0;
+	if (p->burst[dir] < 1500) p->burst[dir] = 1500;
+	p->queue[dir] = lk->queue_bytes ? lk->queue_bytes : bpus * 200000.0;
+	if (p->queue[dir] < 3000) p->queue[dir] = 3000;
+}
+
+static void impair_free(net_impair_t *p) {
+	if (p->flows) {
+		for (uint32_t i = 0; i < p->nflows; ++i) close(p->flows[i].sock);
+	}
+	if (p->lsock >= 0) close(p->lsock);
+	if (p->epfd >= 0) close(p->epfd);
+	if (p->tfd >= 0) close(p->tfd);
+	coap_pool_destroy(&p->pool);
+	free(p->pkts);
+	free(p->flows);
+	free(p->table);
+	free(p->rx_msgs);
+	free(p->rx_iov);
+	free(p->rx_addrs);
+	free(p->rx_bufs);
+	free(p->tx_msgs);
+	free(p->tx_iov);
+	free(p->tx_pkts);
+	free(p);
+}
+
+int net_impair_start(net_impair_t **out, const net_impair_conf_t *conf) {
+	if (!out || !conf || conf->listen_port == 0 || conf->upstream_port == 0) return -1;
+	*out = NULL;
+	net_impair_t *p = (net_impair_t*)calloc(1, sizeof(*p));
+	if (!p) return -2;
+	p->conf = *conf;
+	p->lsock = p->epfd = p->tfd = -1;
+	if (p->conf.max_flows == 0) p->conf.max_flows = 65536;
+	if (p->conf.pool_size == 0) p->conf.pool_size = 65536;
+	if (p->conf.tick_us == 0) p->conf.tick_us = 50;
+	p->batch = p->conf.batch_size == 0 ? 64 : (p->conf.batch_size > BATCH_MAX ? BATCH_MAX : p->conf.batch_size);
+	p->upstream.sin_family = AF_INET;
+	p->upstream.sin_port = htons(conf->upstream_port);
+	if (inet_pton(AF_INET, conf->upstream_host[0] ? conf->upstream_host : "127.0.0.1", &p->upstream.sin_addr) != 1) {
+		free(p);
+		return -1;
+	}
+	p->rng = splitmix64(conf->seed ? conf->seed : coap_mono_us() ^ ((uint64_t)time(NULL) << 20));
+	if (p->rng == 0) p->rng = 1;
+	setup_rate(p, DIR_UP, &conf->up);
+	setup_rate(p, DIR_DOWN, &conf->down);
+	p->origin_us = coap_mono_us();
+	tw_init(&p->wheel, 0);
+
+	uint32_t tsize = 1;
+	while (tsize < p->conf.max_flows * 2u) tsize <<= 1;
+	p->table_mask = tsize - 1;
+	uint32_t b = p->batch;
+	p->pkts = (impair_pkt_t*)calloc(p->conf.pool_size, sizeof(impair_pkt_t));
+	p->flows = (flow_t*)calloc(p->conf.max_flows, sizeof(flow_t));
+	p->table = (uint32_t*)calloc(tsize, sizeof(uint32_t));
+	p->rx_msgs = (struct mmsghdr*)calloc(b, sizeof(struct mmsghdr));
+	p->rx_iov = (struct iovec*)calloc(b, sizeof(struct iovec));
+	p->rx_addrs = (struct sockaddr_in*)calloc(b, sizeof(struct sockaddr_in));
+	p->rx_bufs = (uint8_t*)malloc((size_t)b * COAP_MAX_PKT);
+	p->tx_msgs = (struct mmsghdr*)calloc(b, sizeof(struct mmsghdr));
+	p->tx_iov = (struct iovec*)calloc(b, sizeof(struct iovec));
+	p->tx_pkts = (impair_pkt_t**)calloc(b, sizeof(impair_pkt_t*));
+	if (!p->pkts || !p->flows || !p->table || !p->rx_msgs || !p->rx_iov || !p->rx_addrs || !p->rx_bufs ||
+		!p->tx_msgs || !p->tx_iov || !p->tx_pkts || coap_pool_init(&p->pool, p->conf.pool_size, COAP_MAX_PKT) != 0) {
+		impair_free(p);
+		return -2;
+	}
+	for (uint32_t i = 0; i < p->conf.pool_size; ++i) tw_timer_init(&p->pkts[i].timer, on_release);
+	for (uint32_t i = 0; i < b; ++i) {
+		p->rx_iov[i].iov_base = p->rx_bufs + (size_t)i * COAP_MAX_PKT;
+		p->rx_iov[i].iov_len = COAP_MAX_PKT;
+		p->rx_msgs[i].msg_hdr.msg_iov = &p->rx_iov[i];
+		p->rx_msgs[i].msg_hdr.msg_iovlen = 1;
+		p->rx_msgs[i].msg_hdr.msg_name = &p->rx_addrs[i];
+		p->tx_msgs[i].msg_hdr.msg_iov = &p->tx_iov[i];
+		p->tx_msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	raise_fd_limit(p->conf.max_flows + 64);
+	p->epfd = epoll_create1(EPOLL_CLOEXEC);
+	p->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	p->lsock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (p->epfd < 0 || p->tfd < 0 || p->lsock < 0) {
+		perror("net_impair");
+		impair_free(p);
+		return -3;
+	}
+	int rcvbuf = LISTEN_RCVBUF;
+	setsockopt(p->lsock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	setsockopt(p->lsock, SOL_SOCKET, SO_SNDBUF, &rcvbuf, sizeof(rcvbuf));
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(conf->listen_port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	struct epoll_event ev, tev;
+	ev.events = EPOLLIN;
+	ev.data.u32 = LISTEN_ID;
+	tev.events = EPOLLIN;
+	tev.data.u32 = TIMERFD_ID;
+	if (bind(p->lsock, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+		epoll_ctl(p->epfd, EPOLL_CTL_ADD, p->lsock, &ev) != 0 ||
+		epoll_ctl(p->epfd, EPOLL_CTL_ADD, p->tfd, &tev) != 0) {
+		coap_log_error("net_impair: 无法监听端口 %u", (unsigned)conf->listen_port);
+		impair_free(p);
+		return -3;
+	}
+	p->running = 1;
+	p->started = pthread_create(&p->thread, NULL, impair_thread, p) == 0;
+	if (!p->started) {
+		impair_free(p);
+		return -3;
+	}
+	*out = p;
+	return 0;
+}
+
+void net_impair_stop(net_impair_t *p, net_impair_stats_t *st) {
+	if (!p) return;
+	p->running = 0;
+	if (p->started) pthread_join(p->thread, NULL);
+	p->st.flows = p->nflows;
+	if (st) *st = p->st;
+	impair_free(p);
+}
+
+#else // !__linux__
+
+int net_impair_start(net_impair_t **out, const net_impair_conf_t *conf) {
+	(void)conf;
+	if (out) *out = NULL;
+	coap_log_error("net_impair: 当前平台不支持 epoll");
+	return -5;
+}
+
+void net_impair_stop(net_impair_t *p, net_impair_stats_t *st) {
+	(void)p;
+	if (st) memset(st, 0, sizeof(*st));
+}
+
+#endif
@@ -0,0 +1,101 @@
+// net_impair.h
+// 网络损伤代理：在客户端与服务端之间转发 UDP 报文，上下行各按一组链路参数施加丢包（Bernoulli 或 Gilbert-Elliott 突发）、
+// 时延与抖动（均匀/正态/帕累托分布）、重复、乱序与令牌桶限速；客户端改发到代理端口即可，服务端与各收发后端无需改动
+// 每个客户端端点一条流，流各有一个连到服务端的上游套接字（服务端看到的端点与客户端一一对应），丢包状态与令牌桶按流按方向独立，
+// 即每台设备一条自己的"链路"；一个线程用 epoll + recvmmsg 成批收包，报文拷进预分配的缓冲池，按放行时刻挂到时间轮，
+// 到期后下行用 sendmmsg 成批发出，热路径不分配内存
+// 仅支持 Linux（epoll），其他平台上 net_impair_start 返回 -5
+
+#ifndef NET_IMPAIR_H
+#define NET_IMPAIR_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	IMPAIR_LOSS_NONE = 0,
+	IMPAIR_LOSS_BERNOULLI = 1, // 每个报文独立按 loss 丢弃
+	IMPAIR_LOSS_GE = 2         // Gilbert-Elliott 两状态：好/坏状态各有丢包率，按报文转移状态，丢包成串出现
+} impair_loss_model_t;
+
+typedef enum {
+	IMPAIR_DELAY_UNIFORM = 0,  // delay ± jitter 均匀分布
+	IMPAIR_DELAY_NORMAL = 1,   // 均值 delay、标准差 jitter
+	IMPAIR_DELAY_PARETO = 2    // delay 加帕累托长尾（形状 2，尾部均值 jitter，截断在 100*jitter）
+} impair_delay_dist_t;
+
+// 一个方向的链路参数；概率均取 0..1
+typedef struct {
+	impair_loss_model_t loss_model;
+	double loss;            // Bernoulli 丢包率
+	double ge_p;            // GE：好 -> 坏的转移概率（每个报文）
+	double ge_r;            // GE：坏 -> 好的转移概率，平均突发长度约 1/ge_r 个报文
+	double ge_loss_good;    // GE：好状态下的丢包率
+	double ge_loss_bad;     // GE：坏状态下的丢包率
+	uint32_t delay_us;      // 基础单向时延
+	uint32_t jitter_us;     // 抖动幅度，含义见 impair_delay_dist_t
+	impair_delay_dist_t delay_dist;
+	double duplicate;       // 重复概率：副本另算一次时延
+	double reorder;         // 乱序概率：这部分报文不计时延直接放行，越过排在前面的报文（同 netem reorder）
+	uint32_t rate_kbps;     // 令牌桶限速（kbit/s，按 UDP 负载计），0 不限
+	uint32_t burst_bytes;   // 桶深，0 取 10 ms 的量（至少 1500 字节）
+	uint32_t queue_bytes;   // 等待令牌的积压上限，超出尾丢，0 取 200 ms 的量（至少 3000 字节）
+} net_impair_link_t;
+
+typedef struct {
+	unsigned short listen_port;  // 代理监听端口（客户端发往此端口）
+	char upstream_host[64];      // 服务端地址（IPv4）
+	unsigned short upstream_port;
+	net_impair_link_t up;        // 客户端 -> 服务端
+	net_impair_link_t down;      // 服务端 -> 客户端
+	uint32_t max_flows;          // 客户端端点数上限（流不回收），0 取 65536
+	uint32_t pool_size;          // 代理内排队报文的缓冲数，耗尽时新报文按积压丢弃，0 取 65536
+	uint32_t batch_size;         // recvmmsg/sendmmsg 单次上限，0 取 64
+	uint32_t tick_us;            // 时间轮 tick（时延精度），0 取 50
+	uint64_t seed;               // 随机数种子，0 按时钟取
+} net_impair_conf_t;
+
+typedef struct {
+	uint64_t received;      // 进入代理的报文
+	uint64_t lost;          // 按丢包模型丢弃
+	uint64_t queue_drops;   // 超出限速积压或缓冲池耗尽而丢弃
+	uint64_t duplicated;    // 额外产生的副本
+	uint64_t reordered;     // 不计时延直接放行的报文
+	uint64_t delivered;     // 发出的报文（含副本）
+	uint64_t bytes;         // 发出的字节
+	uint64_t delay_sum_us;  // 发出报文在代理内停留的时间合计
+	uint64_t delay_max_us;
+} net_impair_dir_stats_t;
+
+typedef struct {
+	net_impair_dir_stats_t up;
+	net_impair_dir_stats_t down;
+	uint32_t flows;         // 建立的流（客户端端点）数
+	uint64_t flow_drops;    // 流表已满或上游套接字建立失败而丢弃的上行报文
+} net_impair_stats_t;
+
+typedef struct net_impair net_impair_t;
+
+// 绑定监听端口并启动转发线程。返回 0 成功；-1 参数错误；-2 内存不足；-3 套接字/epoll/线程失败；-5 平台不支持
+int net_impair_start(net_impair_t **out, const net_impair_conf_t *conf);
+// 停止转发线程，丢弃仍在排队的报文，输出统计（st 可为 NULL）后释放
+void net_impair_stop(net_impair_t *p, net_impair_stats_t *st);
+
+// 按场景描述填写上下行参数：逗号分隔，可以先给一个预置场景名，再跟 key=value 覆盖，
+// key 前加 "up." 或 "down." 只改一个方向。百分数的键：loss、dup、reorder，ge=P:R:BAD（好->坏、坏->好、坏状态丢包率，均为百分数）；
+// 毫秒：delay、jitter；dist=uniform|normal|pareto；rate（kbit/s）；burst、queue（字节）
+// 例："cellular"、"lossy,loss=10"、"delay=50,jitter=10,dist=normal,up.rate=64"
+// seed 非 NULL 时接受 seed=N。返回 0 成功，-1 无法解析（未知场景或键）
+int net_impair_parse(const char *spec, net_impair_link_t *up, net_impair_link_t *down, uint64_t *seed);
+
+// 预置场景名，'|' 分隔（用于帮助文本）
+const char *net_impair_presets(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NET_IMPAIR_H
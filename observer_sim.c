@@ -0,0 +1,263 @@
+// observer_sim.c
+#include "observer_sim.h"
+#include "coap_client.h"
+#include "coap_msg.h"
+#include "coap_observe.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <pthread.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#define OBS_SIM_CHUNK 256     // 注册/取消每批发送的请求数，收齐响应（或超时）再发下一批
+#define OBS_SIM_WAIT_MS 500   // 等一批响应的最长时间
+#define OBS_SIM_POLL_MS 100   // 接收线程的接收超时，据此检查停止标志
+#define OBS_SIM_RCVBUF (8 << 20)
+
+struct observer_sim {
+	socket_t sock;
+	struct sockaddr_in server;
+	char pk[64];
+	char dn[64];
+	uint32_t count;
+	uint32_t *last_seq;   // 每个 Token 最近的序号
+	uint8_t *state;       // 0 未注册，1 观察中，2 已取消
+	uint16_t mid;
+	volatile int running;
+	int started;
+#ifdef _WIN32
+	HANDLE thread;
+#else
+	pthread_t thread;
+#endif
+	uint32_t round_seq;   // 当前轮的序号
+	uint64_t round_first_us;
+	uint64_t round_last_us;
+	int in_round;
+	observer_stats_t st;
+};
+
+static void close_sock(socket_t s) {
+#ifdef _WIN32
+	closesocket(s);
+#else
+	close(s);
+#endif
+}
+
+static void set_timeout(socket_t s, uint32_t ms) {
+#ifdef _WIN32
+	DWORD tv = ms;
+	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
+#else
+	struct timeval tv;
+	tv.tv_sec = ms / 1000;
+	tv.tv_usec = (ms % 1000) * 1000;
+	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+#endif
+}
+
+// Token：'O' 'B' 0 0 + 4 字节观察编号（大端）
+static void make_token(uint32_t idx, uint8_t *tok) {
+	tok[0] = 'O'; tok[1] = 'B'; tok[2] = 0; tok[3] = 0;
+	tok[4] = (uint8_t)(idx >> 24); tok[5] = (uint8_t)(idx >> 16); tok[6] = (uint8_t)(idx >> 8); tok[7] = (uint8_t)idx;
+}
+
+static int token_index(const observer_sim_t *o, const coap_msg_view_t *m, uint32_t *idx) {
+	if (m->tkl != 8 || m->token[0] != 'O' || m->token[1] != 'B' || m->token[2] || m->token[3]) return 0;
+	*idx = (uint32_t)m->token[4] << 24 | (uint32_t)m->token[5] << 16 | (uint32_t)m->token[6] << 8 | m->token[7];
+	return *idx < o->count;
+}
+
+static size_t put_opt(uint8_t *p, uint16_t delta, const void *v, size_t len) {
+	size_t n = 0;
+	uint8_t dh = delta < 13 ? (uint8_t)delta : 13, lh = len < 13 ? (uint8_t)len : 13;
+	p[n++] = (uint8_t)(dh << 4 | lh);
+	if (dh == 13) p[n++] = (uint8_t)(delta - 13);
+	if (lh == 13) p[n++] = (uint8_t)(len - 13);
+	memcpy(p + n, v, len);
+	return n + len;
+}
+
+// GET /things/<pk>/<dn>，Observe=observe（0 注册，1 取消），CON
+static int send_get(observer_sim_t *o, uint32_t idx, uint8_t observe) {
+	uint8_t pkt[192];
+	size_t n = 0;
+	uint16_t mid = o->mid++;
+	pkt[n++] = 0x48; // ver=1，CON，TKL=8
+	pkt[n++] = 0x01; // GET
+	pkt[n++] = (uint8_t)(mid >> 8);
+	pkt[n++] = (uint8_t)mid;
+	make_token(idx, pkt + n);
+	n += 8;
+	n += put_opt(pkt + n, COAP_OPT_OBSERVE, &observe, observe ? 1 : 0);
+	n += put_opt(pkt + n, COAP_OPT_URI_PATH - COAP_OPT_OBSERVE, "things", 6);
+	n += put_opt(pkt + n, 0, o->pk, strlen(o->pk));
+	n += put_opt(pkt + n, 0, o->dn, strlen(o->dn));
+	return sendto(o->sock, (const char*)pkt, (int)n, 0, (struct sockaddr*)&o->server, sizeof(o->server)) < 0 ? -1 : 0;
+}
+
+// 序号 v2 是否比 v1 新（RFC 7641 3.4，24 位回绕）
+static int seq_newer(uint32_t v1, uint32_t v2) {
+	return (v1 < v2 && v2 - v1 < (1u << 23)) || (v1 > v2 && v1 - v2 > (1u << 23));
+}
+
+static void round_close(observer_sim_t *o) {
+	if (!o->in_round) return;
+	uint64_t spread = o->round_last_us - o->round_first_us;
+	o->st.rounds++;
+	o->st.spread_us_sum += spread;
+	if (spread > o->st.spread_us_max) o->st.spread_us_max = spread;
+	o->in_round = 0;
+}
+
+// 处理一个收到的报文：注册/取消的响应（ACK）与通知（NON）。返回 1 表示是待收的响应
+static int on_packet(observer_sim_t *o, const uint8_t *buf, size_t len, uint8_t want) {
+	coap_msg_view_t m;
+	uint32_t idx;
+	if (coap_msg_parse(&m, buf, len) != 0 || !token_index(o, &m, &idx)) return 0;
+	const coap_opt_view_t *ob = coap_msg_find(&m, COAP_OPT_OBSERVE);
+	if (m.type == 2) {
+		// 注册响应带 Observe 表示接受；取消响应不带
+		if (want == 1 && o->state[idx] == 0) {
+			if (m.code == ((2 << 5) | 5) && ob) {
+				o->state[idx] = 1;
+				o->last_seq[idx] = coap_opt_uint(ob);
+				o->st.registered++;
+			} else {
+				o->st.refused++;
+			}
+			return 1;
+		}
+		if (want == 2 && o->state[idx] == 1) {
+			o->state[idx] = 2;
+			o->st.cancelled++;
+			return 1;
+		}
+		return 0;
+	}
+	if (m.type != 1 || !ob || o->state[idx] != 1) return 0;
+	uint32_t seq = coap_opt_uint(ob);
+	if (!seq_newer(o->last_seq[idx], seq)) {
+		o->st.stale++;
+		return 0;
+	}
+	o->last_seq[idx] = seq;
+	o->st.notifications++;
+	uint64_t now = coap_mono_us();
+	if (!o->in_round || seq != o->round_seq) {
+		round_close(o);
+		o->in_round = 1;
+		o->round_seq = seq;
+		o->round_first_us = now;
+	}
+	o->round_last_us = now;
+	return 0;
+}
+
+// 逐批发送注册（want=1）或取消（want=2）请求并收齐响应
+static void exchange_all(observer_sim_t *o, uint8_t want) {
+	uint8_t buf[512];
+	set_timeout(o->sock, 50);
+	for (uint32_t base = 0; base < o->count; base += OBS_SIM_CHUNK) {
+		uint32_t end = base + OBS_SIM_CHUNK < o->count ? base + OBS_SIM_CHUNK : o->count, pending = 0;
+		for (uint32_t i = base; i < end; ++i) {
+			if (o->state[i] != want - 1) continue;
+			if (send_get(o, i, want == 1 ? 0 : 1) == 0) pending++;
+		}
+		uint64_t deadline = coap_mono_us() + OBS_SIM_WAIT_MS * 1000u;
+		while (pending && coap_mono_us() < deadline) {
+			int r = recvfrom(o->sock, (char*)buf, sizeof(buf), 0, NULL, NULL);
+			if (r > 0) pending -= (uint32_t)on_packet(o, buf, (size_t)r, want);
+		}
+	}
+}
+
+#ifdef _WIN32
+static unsigned __stdcall observer_thread(void *arg)
+#else
+static void* observer_thread(void *arg)
+#endif
+{
+	observer_sim_t *o = (observer_sim_t*)arg;
+	uint8_t buf[512];
+	while (o->running) {
+		int r = recvfrom(o->sock, (char*)buf, sizeof(buf), 0, NULL, NULL);
+		if (r > 0) on_packet(o, buf, (size_t)r, 0);
+	}
+#ifdef _WIN32
+	return 0;
+#else
+	return NULL;
+#endif
+}
+
+int observer_sim_start(observer_sim_t **out, const char *host, uint16_t port, const char *product_key,
+	const char *device_name, uint32_t count) {
+	if (!out || !host || !product_key || !device_name || count == 0 || count > OBSERVER_SIM_MAX ||
+		strlen(product_key) >= sizeof(((observer_sim_t*)0)->pk) || strlen(device_name) >= sizeof(((observer_sim_t*)0)->dn)) return -1;
+	*out = NULL;
+	observer_sim_t *o = (observer_sim_t*)calloc(1, sizeof(*o));
+	if (!o) return -2;
+	o->last_seq = (uint32_t*)calloc(count, sizeof(uint32_t));
+	o->state = (uint8_t*)calloc(count, 1);
+	o->sock = (socket_t)socket(AF_INET, SOCK_DGRAM, 0);
+	if (!o->last_seq || !o->state || (int)o->sock < 0) {
+		if ((int)o->sock >= 0) close_sock(o->sock);
+		free(o->last_seq);
+		free(o->state);
+		free(o);
+		return -2;
+	}
+	int rcvbuf = OBS_SIM_RCVBUF;
+	setsockopt(o->sock, SOL_SOCKET, SO_RCVBUF, (const char*)&rcvbuf, sizeof(rcvbuf));
+	o->server.sin_family = AF_INET;
+	o->server.sin_port = htons(port);
+	inet_pton(AF_INET, host, &o->server.sin_addr);
+	strcpy(o->pk, product_key);
+	strcpy(o->dn, device_name);
+	o->count = count;
+	o->st.count = count;
+
+	exchange_all(o, 1);
+	set_timeout(o->sock, OBS_SIM_POLL_MS);
+	o->running = 1;
+#ifdef _WIN32
+	o->thread = (HANDLE)_beginthreadex(NULL, 0, observer_thread, o, 0, NULL);
+	o->started = o->thread != 0;
+#else
+	o->started = pthread_create(&o->thread, NULL, observer_thread, o) == 0;
+#endif
+	if (!o->started) {
+		observer_sim_stop(o, NULL);
+		return -2;
+	}
+	*out = o;
+	return 0;
+}
+
+void observer_sim_stop(observer_sim_t *o, observer_stats_t *st) {
+	if (!o) return;
+	o->running = 0;
+	if (o->started) {
+#ifdef _WIN32
+		WaitForSingleObject(o->thread, INFINITE);
+		CloseHandle(o->thread);
+#else
+		pthread_join(o->thread, NULL);
+#endif
+	}
+	round_close(o);
+	exchange_all(o, 2);
+	if (st) *st = o->st;
+	close_sock(o->sock);
+	free(o->last_seq);
+	free(o->state);
+	free(o);
+}
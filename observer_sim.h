@@ -0,0 +1,42 @@
+// observer_sim.h
+// 观察者模拟：在一个 UDP 套接字上用 count 个不同的 Token 观察同一台设备的读数（GET /things/<pk>/<dn>，Observe=0），
+// 后台线程接收通知，按 RFC 7641 的序号新旧规则校验，并统计每轮通知从第一条到最后一条到达的扇出用时
+
+#ifndef OBSERVER_SIM_H
+#define OBSERVER_SIM_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OBSERVER_SIM_MAX 1000000
+
+typedef struct {
+	uint32_t count;          // 请求的观察数
+	uint64_t registered;     // 注册成功（2.05 带 Observe）
+	uint64_t refused;        // 注册未被接受（无 Observe 或错误码）
+	uint64_t notifications;  // 收到的新通知（序号比该 Token 上一次新）
+	uint64_t stale;          // 序号不比上一次新的通知（乱序或重复）
+	uint64_t rounds;         // 按序号区分的通知轮数
+	uint64_t spread_us_sum;  // 各轮从第一条到最后一条通知到达的用时之和
+	uint64_t spread_us_max;
+	uint64_t cancelled;      // 停止时以 Observe=1 取消并收到响应的观察
+} observer_stats_t;
+
+typedef struct observer_sim observer_sim_t;
+
+// 建立套接字并逐批注册 count 个观察（1..OBSERVER_SIM_MAX），再启动接收线程
+// 返回 0 成功；-1 参数错误；-2 套接字/线程/内存失败
+int observer_sim_start(observer_sim_t **out, const char *host, uint16_t port, const char *product_key,
+	const char *device_name, uint32_t count);
+
+// 停止接收线程，逐个以 Observe=1 取消观察，输出统计后释放
+void observer_sim_stop(observer_sim_t *o, observer_stats_t *st);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OBSERVER_SIM_H
@@ -0,0 +1,547 @@
+// reading_store.c
+#include "reading_store.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#define RS_MAGIC "RSTORE01"
+#define RS_RING_DEFAULT 65536
+#define RS_COMMIT_MS 10
+
+static const char *const col_name[RS_COLS] = {"dev", "ts", "temp", "hum", "abn"};
+static const size_t col_width[RS_COLS] = {sizeof(uint32_t), sizeof(uint64_t), sizeof(float), sizeof(float), sizeof(uint8_t)};
+
+typedef struct {
+	uint64_t t_ms;
+	uint32_t dev;
+	float temp;
+	float hum;
+	uint8_t abn;
+} rs_item_t;
+
+// 单生产者单消费者环：head 只由接收线程写，tail 只由写线程写，两者分在不同缓存行
+struct reading_store_ring {
+	rs_item_t *items;
+	uint32_t mask;
+	char pad0[64];
+	uint32_t head;
+	uint64_t appended;
+	uint64_t dropped;
+	char pad1[64];
+	uint32_t tail;
+	uint32_t committed; // 已提交到的 tail，持锁读写
+	char pad2[64];
+};
+
+// ---- 平台相关：原子、锁、线程、映射 ----
+
+#ifdef _MSC_VER
+static uint32_t load_acquire(const uint32_t *p) {
+	uint32_t v = *(const volatile uint32_t*)p;
+	MemoryBarrier();
+	return v;
+}
+
+static void store_release(uint32_t *p, uint32_t v) {
+	MemoryBarrier();
+	*(volatile uint32_t*)p = v;
+}
+#else
+static uint32_t load_acquire(const uint32_t *p) {
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void store_release(uint32_t *p, uint32_t v) {
+	__atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+#endif
+
+#ifdef _WIN32
+typedef CRITICAL_SECTION rs_lock_t;
+static void lock_init(rs_lock_t *l) { InitializeCriticalSection(l); }
+static void lock_free(rs_lock_t *l) { DeleteCriticalSection(l); }
+static void lock_take(void *l) { EnterCriticalSection((rs_lock_t*)l); }
+static void lock_give(void *l) { LeaveCriticalSection((rs_lock_t*)l); }
+static void sleep_ms(uint32_t ms) { Sleep(ms); }
+static int make_dir(const char *dir) { return _mkdir(dir) == 0 || errno == EEXIST ? 0 : -1; }
+#else
+typedef pthread_mutex_t rs_lock_t;
+static void lock_init(rs_lock_t *l) { pthread_mutex_init(l, NULL); }
+static void lock_free(rs_lock_t *l) { pthread_mutex_destroy(l); }
+static void lock_take(void *l) { pthread_mutex_lock((rs_lock_t*)l); }
+static void lock_give(void *l) { pthread_mutex_unlock((rs_lock_t*)l); }
+static void sleep_ms(uint32_t ms) {
+	struct timespec ts = {(time_t)(ms / 1000), (long)(ms % 1000) * 1000000L};
+	nanosleep(&ts, NULL);
+}
+static int make_dir(const char *dir) { return mkdir(dir, 0755) == 0 || errno == EEXIST ? 0 : -1; }
+#endif
+
+// 把 path 定长映射为 bytes 字节（文件不足时扩展，新增部分为 0）；返回映射地址，失败 NULL
+static void *map_file(const char *path, size_t bytes, void **handle) {
+#ifdef _WIN32
+	HANDLE f = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (f == INVALID_HANDLE_VALUE) return NULL;
+	HANDLE m = CreateFileMappingA(f, NULL, PAGE_READWRITE, (DWORD)((uint64_t)bytes >> 32), (DWORD)bytes, NULL);
+	CloseHandle(f);
+	if (!m) return NULL;
+	void *p = MapViewOfFile(m, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+	if (!p) {
+		CloseHandle(m);
+		return NULL;
+	}
+	*handle = m;
+	return p;
+#else
+	(void)handle;
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) return NULL;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || ((size_t)st.st_size < bytes && ftruncate(fd, (off_t)bytes) != 0)) {
+		close(fd);
+		return NULL;
+	}
+	void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	return p == MAP_FAILED ? NULL : p;
+#endif
+}
+
+static void unmap_file(void *p, size_t bytes, void *handle) {
+#ifdef _WIN32
+	(void)bytes;
+	UnmapViewOfFile(p);
+	CloseHandle((HANDLE)handle);
+#else
+	(void)handle;
+	munmap(p, bytes);
+#endif
+}
+
+// 把映射中 [off, off + len) 所在的页异步写回
+static void flush_range(void *p, size_t off, size_t len) {
+	if (!len) return;
+	size_t page = 4096, lo = off & ~(page - 1);
+#ifdef _WIN32
+	FlushViewOfFile((uint8_t*)p + lo, off + len - lo);
+#else
+	msync((uint8_t*)p + lo, off + len - lo, MS_ASYNC);
+#endif
+}
+
+// ---- 段与元数据 ----
+
+static int seg_map(reading_store_t *s, uint32_t seg) {
+	if (seg >= READING_STORE_MAX_SEGS) return -1;
+	reading_store_seg_t *g = &s->segs[seg];
+	for (int c = 0; c < RS_COLS; ++c) {
+		char path[320];
+		void *h = NULL;
+		snprintf(path, sizeof(path), "%s/%s.%04u", s->dir, col_name[c], seg);
+		g->col[c] = map_file(path, (size_t)READING_STORE_SEG_ROWS * col_width[c], &h);
+#ifdef _WIN32
+		g->map[c] = h;
+#endif
+		if (!g->col[c]) {
+			for (int k = 0; k < c; ++k) {
+#ifdef _WIN32
+				unmap_file(g->col[k], (size_t)READING_STORE_SEG_ROWS * col_width[k], g->map[k]);
+#else
+				unmap_file(g->col[k], (size_t)READING_STORE_SEG_ROWS * col_width[k], NULL);
+#endif
+				g->col[k] = NULL;
+			}
+			return -1;
+		}
+	}
+	s->seg_count = seg + 1;
+	s->st.segments = s->seg_count;
+	return 0;
+}
+
+static void meta_write(reading_store_t *s) {
+	uint8_t hdr[16];
+	uint32_t shift = READING_STORE_SEG_SHIFT, rows = s->rows;
+	memcpy(hdr, RS_MAGIC, 8);
+	memcpy(hdr + 8, &shift, 4);
+	memcpy(hdr + 12, &rows, 4);
+	FILE *f = (FILE*)s->meta;
+	fseek(f, 0, SEEK_SET);
+	fwrite(hdr, 1, sizeof(hdr), f);
+	fflush(f);
+}
+
+// 读取已有的 store.meta（没有则新建）；返回提交行数，<0 失败
+static int64_t meta_open(reading_store_t *s) {
+	char path[320];
+	snprintf(path, sizeof(path), "%s/store.meta", s->dir);
+	FILE *f = fopen(path, "r+b");
+	if (!f) {
+		f = fopen(path, "w+b");
+		if (!f) return -3;
+		s->meta = f;
+		meta_write(s);
+		return 0;
+	}
+	s->meta = f;
+	uint8_t hdr[16];
+	uint32_t shift, rows;
+	if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr) || memcmp(hdr, RS_MAGIC, 8) != 0) return -4;
+	memcpy(&shift, hdr + 8, 4);
+	memcpy(&rows, hdr + 12, 4);
+	if (shift != READING_STORE_SEG_SHIFT) return -4;
+	return rows;
+}
+
+// ---- 索引 ----
+
+static int index_add(reading_store_t *s, uint32_t row) {
+	uint32_t d = reading_store_dev(s, row);
+	if (d >= s->devices) {
+		s->st.unindexed++;
+		return 0;
+	}
+	reading_store_index_t *x = &s->index[d];
+	if (x->count == x->cap) {
+		uint32_t cap = x->cap ? x->cap * 2u : READING_STORE_PAGE;
+		uint32_t *rows = (uint32_t*)realloc(x->rows, (size_t)cap * sizeof(uint32_t));
+		if (!rows) return -1;
+		x->rows = rows;
+		uint64_t *mn = (uint64_t*)realloc(x->page_min, (size_t)(cap / READING_STORE_PAGE) * sizeof(uint64_t));
+		if (!mn) return -1;
+		x->page_min = mn;
+		uint64_t *mx = (uint64_t*)realloc(x->page_max, (size_t)(cap / READING_STORE_PAGE) * sizeof(uint64_t));
+		if (!mx) return -1;
+		x->page_max = mx;
+		x->cap = cap;
+	}
+	uint64_t ts = reading_store_ts(s, row);
+	uint32_t page = x->count / READING_STORE_PAGE;
+	if (x->count % READING_STORE_PAGE == 0) {
+		x->page_min[page] = x->page_max[page] = ts;
+	} else {
+		if (ts < x->page_min[page]) x->page_min[page] = ts;
+		if (ts > x->page_max[page]) x->page_max[page] = ts;
+	}
+	x->rows[x->count++] = row;
+	return 0;
+}
+
+// ---- 写线程 ----
+
+// 把各环中的读数追加到列，写回脏页后发布提交行数并更新 store.meta
+static void commit(reading_store_t *s) {
+	uint32_t start = s->rows, row = start;
+	for (uint32_t p = 0; p < s->producers; ++p) {
+		reading_store_ring_t *r = &s->rings[p];
+		uint32_t head = load_acquire(&r->head), tail = r->tail;
+		for (; tail != head; ++tail) {
+			const rs_item_t *it = &r->items[tail & r->mask];
+			uint32_t seg = row >> READING_STORE_SEG_SHIFT, at = row & (READING_STORE_SEG_ROWS - 1);
+			if (row == 0xFFFFFFFFu || (seg >= s->seg_count && seg_map(s, seg) != 0)) {
+				s->st.dropped++;
+				continue;
+			}
+			reading_store_seg_t *g = &s->segs[seg];
+			((uint32_t*)g->col[RS_COL_DEV])[at] = it->dev;
+			((uint64_t*)g->col[RS_COL_TS])[at] = it->t_ms;
+			((float*)g->col[RS_COL_TEMP])[at] = it->temp;
+			((float*)g->col[RS_COL_HUM])[at] = it->hum;
+			((uint8_t*)g->col[RS_COL_ABN])[at] = it->abn;
+			row++;
+		}
+		store_release(&r->tail, tail);
+	}
+	if (row == start) {
+		lock_take(s->lock);
+		for (uint32_t p = 0; p < s->producers; ++p) s->rings[p].committed = s->rings[p].tail;
+		lock_give(s->lock);
+		return;
+	}
+	// 本批跨越的各段分别写回
+	for (uint32_t from = start; from < row;) {
+		uint32_t seg = from >> READING_STORE_SEG_SHIFT, at = from & (READING_STORE_SEG_ROWS - 1);
+		uint32_t n = READING_STORE_SEG_ROWS - at < row - from ? READING_STORE_SEG_ROWS - at : row - from;
+		for (int c = 0; c < RS_COLS; ++c) flush_range(s->segs[seg].col[c], at * col_width[c], n * col_width[c]);
+		from += n;
+	}
+	lock_take(s->lock);
+	for (uint32_t p = 0; p < s->producers; ++p) s->rings[p].committed = s->rings[p].tail;
+	for (uint32_t r = start; r < row; ++r) {
+		if (index_add(s, r) != 0) s->st.unindexed++;
+	}
+	s->rows = row;
+	s->st.committed = row;
+	s->st.commits++;
+	lock_give(s->lock);
+	meta_write(s);
+}
+
+#ifdef _WIN32
+static unsigned __stdcall writer_thread(void *arg)
+#else
+static void* writer_thread(void *arg)
+#endif
+{
+	reading_store_t *s = (reading_store_t*)arg;
+	while (s->running) {
+		sleep_ms(s->commit_ms);
+		commit(s);
+	}
+	commit(s);
+#ifdef _WIN32
+	return 0;
+#else
+	return NULL;
+#endif
+}
+
+// ---- 接口 ----
+
+static void store_free(reading_store_t *s) {
+	for (uint32_t g = 0; g < s->seg_count; ++g) {
+		for (int c = 0; c < RS_COLS; ++c) {
+			if (!s->segs[g].col[c]) continue;
+#ifdef _WIN32
+			unmap_file(s->segs[g].col[c], (size_t)READING_STORE_SEG_ROWS * col_width[c], s->segs[g].map[c]);
+#else
+			unmap_file(s->segs[g].col[c], (size_t)READING_STORE_SEG_ROWS * col_width[c], NULL);
+#endif
+		}
+	}
+	for (uint32_t d = 0; s->index && d < s->devices; ++d) {
+		free(s->index[d].rows);
+		free(s->index[d].page_min);
+		free(s->index[d].page_max);
+	}
+	free(s->index);
+	for (uint32_t p = 0; s->rings && p < s->producers; ++p) free(s->rings[p].items);
+	free(s->rings);
+	if (s->lock) {
+		lock_free((rs_lock_t*)s->lock);
+		free(s->lock);
+	}
+	if (s->meta) fclose((FILE*)s->meta);
+	free(s);
+}
+
+int reading_store_open(reading_store_t **out, const char *dir, uint32_t devices, uint32_t producers, uint32_t ring_cap,
+	uint32_t commit_ms) {
+	if (!out || !dir || !*dir || strlen(dir) >= sizeof(((reading_store_t*)0)->dir) || producers == 0) return -1;
+	*out = NULL;
+	uint32_t cap = 1;
+	while (cap < (ring_cap ? ring_cap : RS_RING_DEFAULT) && cap < 0x80000000u) cap <<= 1;
+	reading_store_t *s = (reading_store_t*)calloc(1, sizeof(*s));
+	if (!s) return -2;
+	strcpy(s->dir, dir);
+	s->devices = devices;
+	s->producers = producers;
+	s->commit_ms = commit_ms ? commit_ms : RS_COMMIT_MS;
+	s->index = (reading_store_index_t*)calloc(devices ? devices : 1, sizeof(reading_store_index_t));
+	s->rings = (reading_store_ring_t*)calloc(producers, sizeof(reading_store_ring_t));
+	s->lock = malloc(sizeof(rs_lock_t));
+	if (!s->index || !s->rings || !s->lock) {
+		free(s->lock);
+		s->lock = NULL;
+		store_free(s);
+		return -2;
+	}
+	lock_init((rs_lock_t*)s->lock);
+	for (uint32_t p = 0; p < producers; ++p) {
+		s->rings[p].items = (rs_item_t*)malloc((size_t)cap * sizeof(rs_item_t));
+		s->rings[p].mask = cap - 1;
+		if (!s->rings[p].items) {
+			store_free(s);
+			return -2;
+		}
+	}
+	if (make_dir(dir) != 0) {
+		store_free(s);
+		return -3;
+	}
+	int64_t rows = meta_open(s);
+	if (rows < 0) {
+		store_free(s);
+		return (int)rows;
+	}
+	// 重新打开：映射已提交行所在的段，扫描设备列重建索引
+	uint32_t segs = (uint32_t)(((uint64_t)rows + READING_STORE_SEG_ROWS - 1) >> READING_STORE_SEG_SHIFT);
+	for (uint32_t g = 0; g < segs; ++g) {
+		if (seg_map(s, g) != 0) {
+			store_free(s);
+			return -3;
+		}
+	}
+	s->rows = (uint32_t)rows;
+	for (uint32_t r = 0; r < s->rows; ++r) {
+		if (index_add(s, r) != 0) {
+			store_free(s);
+			return -2;
+		}
+	}
+	s->st.committed = s->rows;
+	s->running = 1;
+#ifdef _WIN32
+	HANDLE th = (HANDLE)_beginthreadex(NULL, 0, writer_thread, s, 0, NULL);
+	s->writer = th;
+	if (!th) {
+#else
+	pthread_t *th = (pthread_t*)malloc(sizeof(pthread_t));
+	s->writer = th;
+	if (!th || pthread_create(th, NULL, writer_thread, s) != 0) {
+		free(th);
+#endif
+		s->writer = NULL;
+		store_free(s);
+		return -2;
+	}
+	*out = s;
+	return 0;
+}
+
+void reading_store_close(reading_store_t *s) {
+	if (!s) return;
+	s->running = 0;
+#ifdef _WIN32
+	WaitForSingleObject((HANDLE)s->writer, INFINITE);
+	CloseHandle((HANDLE)s->writer);
+#else
+	pthread_join(*(pthread_t*)s->writer, NULL);
+	free(s->writer);
+#endif
+	store_free(s);
+}
+
+int reading_store_append(reading_store_t *s, uint32_t producer, uint32_t device, uint64_t t_ms, float temp, float hum,
+	uint8_t abn) {
+	reading_store_ring_t *r = &s->rings[producer];
+	uint32_t head = r->head;
+	if (head - load_acquire(&r->tail) > r->mask) {
+		r->dropped++;
+		return -1;
+	}
+	rs_item_t *it = &r->items[head & r->mask];
+	it->t_ms = t_ms;
+	it->dev = device;
+	it->temp = temp;
+	it->hum = hum;
+	it->abn = abn;
+	r->appended++;
+	store_release(&r->head, head + 1);
+	return 0;
+}
+
+int64_t reading_store_scan(reading_store_t *s, uint32_t device, uint64_t t_from, uint64_t t_to, reading_store_fn fn,
+	void *arg) {
+	if (device >= s->devices) return -1;
+	int64_t visited = 0;
+	lock_take(s->lock);
+	const reading_store_index_t *x = &s->index[device];
+	for (uint32_t base = 0; base < x->count; base += READING_STORE_PAGE) {
+		uint32_t page = base / READING_STORE_PAGE;
+		if (x->page_max[page] < t_from || x->page_min[page] > t_to) continue;
+		uint32_t end = base + READING_STORE_PAGE < x->count ? base + READING_STORE_PAGE : x->count;
+		for (uint32_t i = base; i < end; ++i) {
+			uint32_t row = x->rows[i];
+			uint64_t ts = reading_store_ts(s, row);
+			if (ts < t_from || ts > t_to) continue;
+			visited++;
+			if (fn && fn(arg, s, row)) {
+				lock_give(s->lock);
+				return visited;
+			}
+		}
+	}
+	lock_give(s->lock);
+	return visited;
+}
+
+static void agg_row(reading_store_agg_t *a, uint64_t ts, float t, float h, uint8_t abn) {
+	if (a->count == 0 || ts < a->t_first) a->t_first = ts;
+	if (a->count == 0 || ts > a->t_last) a->t_last = ts;
+	if (t < a->temp_min) a->temp_min = t;
+	if (t > a->temp_max) a->temp_max = t;
+	if (h < a->hum_min) a->hum_min = h;
+	if (h > a->hum_max) a->hum_max = h;
+	a->temp_sum += t;
+	a->hum_sum += h;
+	a->abnormal += abn != 0;
+	a->count++;
+}
+
+static int agg_visit(void *arg, const reading_store_t *s, uint32_t row) {
+	agg_row((reading_store_agg_t*)arg, reading_store_ts(s, row), reading_store_temp(s, row), reading_store_hum(s, row),
+		reading_store_abn(s, row));
+	return 0;
+}
+
+int reading_store_aggregate(reading_store_t *s, uint32_t device, uint64_t t_from, uint64_t t_to, reading_store_agg_t *agg) {
+	memset(agg, 0, sizeof(*agg));
+	agg->temp_min = agg->hum_min = FLT_MAX;
+	agg->temp_max = agg->hum_max = -FLT_MAX;
+	if (device != READING_STORE_ALL) {
+		if (reading_store_scan(s, device, t_from, t_to, agg_visit, agg) < 0) return -1;
+	} else {
+		// 已提交的行不再改动，取得行数后即可不加锁地逐段扫描
+		lock_take(s->lock);
+		uint32_t rows = s->rows;
+		lock_give(s->lock);
+		for (uint32_t base = 0; base < rows; base += READING_STORE_SEG_ROWS) {
+			const reading_store_seg_t *g = &s->segs[base >> READING_STORE_SEG_SHIFT];
+			const uint64_t *ts = (const uint64_t*)g->col[RS_COL_TS];
+			const float *temp = (const float*)g->col[RS_COL_TEMP], *hum = (const float*)g->col[RS_COL_HUM];
+			const uint8_t *abn = (const uint8_t*)g->col[RS_COL_ABN];
+			uint32_t n = rows - base < READING_STORE_SEG_ROWS ? rows - base : READING_STORE_SEG_ROWS;
+			for (uint32_t i = 0; i < n; ++i) {
+				if (ts[i] >= t_from && ts[i] <= t_to) agg_row(agg, ts[i], temp[i], hum[i], abn[i]);
+			}
+		}
+	}
+	if (agg->count == 0) agg->temp_min = agg->temp_max = agg->hum_min = agg->hum_max = 0;
+	return 0;
+}
+
+void reading_store_sync(reading_store_t *s) {
+	for (uint32_t p = 0; p < s->producers; ++p) {
+		uint32_t head = load_acquire(&s->rings[p].head);
+		for (;;) {
+			lock_take(s->lock);
+			uint32_t done = s->rings[p].committed;
+			lock_give(s->lock);
+			if ((int32_t)(done - head) >= 0) break;
+			sleep_ms(1);
+		}
+	}
+}
+
+uint32_t reading_store_rows(reading_store_t *s) {
+	lock_take(s->lock);
+	uint32_t rows = s->rows;
+	lock_give(s->lock);
+	return rows;
+}
+
+void reading_store_get_stats(reading_store_t *s, reading_store_stats_t *st) {
+	lock_take(s->lock);
+	*st = s->st;
+	lock_give(s->lock);
+	for (uint32_t p = 0; p < s->producers; ++p) {
+		st->appended += s->rings[p].appended;
+		st->dropped += s->rings[p].dropped;
+	}
+}
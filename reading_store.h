@@ -0,0 +1,134 @@
+// reading_store.h
+// 读数列存：服务端接收的读数（设备号、时刻、温度、湿度、异常标记）按列追加到内存映射文件
+// 每列按段增长：每段 READING_STORE_SEG_ROWS 行一个文件（<dir>/<列名>.<段号>），建段时一次定长映射，已映射的段地址不再变化；
+// 提交行数写在 <dir>/store.meta，重新打开时只认提交过的行，并扫描设备列重建索引
+// 写入分两步：接收线程把读数压进各自的单生产者环（不加锁、不做 IO），后台写线程定期把所有环里的读数成批追加到列、
+// 更新索引，再一次性发布提交行数（组提交）；查询只看已提交的行，直接读映射的列，不拷贝
+// 每台设备的索引是按追加顺序的行号列表，每 READING_STORE_PAGE 个行号一页并记录页内时刻范围，时间窗查询跳过不相交的页
+
+#ifndef READING_STORE_H
+#define READING_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define READING_STORE_SEG_SHIFT 20
+#define READING_STORE_SEG_ROWS (1u << READING_STORE_SEG_SHIFT) // 每段行数
+#define READING_STORE_MAX_SEGS 4096                            // 至多 2^32 行
+#define READING_STORE_PAGE 64                                  // 设备索引每页的行号数
+#define READING_STORE_ALL 0xFFFFFFFFu                          // 聚合查询不区分设备
+
+enum { RS_COL_DEV, RS_COL_TS, RS_COL_TEMP, RS_COL_HUM, RS_COL_ABN, RS_COLS };
+
+typedef struct {
+	void *col[RS_COLS];      // 各列的映射地址：uint32_t 设备号、uint64_t 时刻（Unix 毫秒）、float 温度、float 湿度、uint8_t 异常
+#ifdef _WIN32
+	void *map[RS_COLS];      // 文件映射句柄
+#endif
+} reading_store_seg_t;
+
+typedef struct {
+	uint32_t *rows;          // 该设备的行号，按追加顺序
+	uint64_t *page_min;      // 每页的最小/最大时刻
+	uint64_t *page_max;
+	uint32_t count;
+	uint32_t cap;
+} reading_store_index_t;
+
+typedef struct reading_store_ring reading_store_ring_t;
+
+typedef struct {
+	uint64_t appended;       // 接收线程压入环的读数
+	uint64_t dropped;        // 环满（或段无法映射）而丢弃的读数
+	uint64_t committed;      // 已提交的行（含重新打开前的）
+	uint64_t commits;        // 组提交次数
+	uint64_t segments;       // 已映射的段数
+	uint64_t unindexed;      // 设备号超出索引范围、只进列不进索引的行
+} reading_store_stats_t;
+
+typedef struct {
+	char dir[256];
+	reading_store_seg_t segs[READING_STORE_MAX_SEGS];
+	uint32_t seg_count;
+	volatile uint32_t rows;       // 已提交的行数，只有写线程修改
+	reading_store_index_t *index; // 按设备号
+	uint32_t devices;
+	reading_store_ring_t *rings;  // 每个生产者（接收线程）一个
+	uint32_t producers;
+	uint32_t commit_ms;
+	void *lock;                   // 保护索引与提交行数：写线程发布一批、查询遍历索引时持有
+	void *writer;                 // 写线程
+	volatile int running;
+	void *meta;                   // store.meta（FILE*）
+	reading_store_stats_t st;
+} reading_store_t;
+
+// 打开（不存在则创建）dir 下的列存，并启动写线程
+// devices：索引的设备数（设备号 0..devices-1）；producers：接收线程数，每个一个 ring_cap 条（取 2 的幂，0 取 65536）的环；
+// commit_ms：组提交间隔，0 取 10
+// 返回 0 成功；-1 参数错误；-2 内存/线程失败；-3 目录或文件无法建立/映射；-4 已有的 store.meta 格式不符
+int reading_store_open(reading_store_t **out, const char *dir, uint32_t devices, uint32_t producers, uint32_t ring_cap,
+	uint32_t commit_ms);
+
+// 停止写线程（先把环里剩下的读数提交），解除映射并关闭文件
+void reading_store_close(reading_store_t *s);
+
+// 接收线程 producer 追加一条读数：只写入环，不阻塞；返回 0 成功，-1 环满（读数丢弃并计数）
+int reading_store_append(reading_store_t *s, uint32_t producer, uint32_t device, uint64_t t_ms, float temp, float hum,
+	uint8_t abn);
+
+// 列访问：直接读映射内存，row 须小于已提交行数
+static inline uint32_t reading_store_dev(const reading_store_t *s, uint32_t row) {
+	return ((const uint32_t*)s->segs[row >> READING_STORE_SEG_SHIFT].col[RS_COL_DEV])[row & (READING_STORE_SEG_ROWS - 1)];
+}
+static inline uint64_t reading_store_ts(const reading_store_t *s, uint32_t row) {
+	return ((const uint64_t*)s->segs[row >> READING_STORE_SEG_SHIFT].col[RS_COL_TS])[row & (READING_STORE_SEG_ROWS - 1)];
+}
+static inline float reading_store_temp(const reading_store_t *s, uint32_t row) {
+	return ((const float*)s->segs[row >> READING_STORE_SEG_SHIFT].col[RS_COL_TEMP])[row & (READING_STORE_SEG_ROWS - 1)];
+}
+static inline float reading_store_hum(const reading_store_t *s, uint32_t row) {
+	return ((const float*)s->segs[row >> READING_STORE_SEG_SHIFT].col[RS_COL_HUM])[row & (READING_STORE_SEG_ROWS - 1)];
+}
+static inline uint8_t reading_store_abn(const reading_store_t *s, uint32_t row) {
+	return ((const uint8_t*)s->segs[row >> READING_STORE_SEG_SHIFT].col[RS_COL_ABN])[row & (READING_STORE_SEG_ROWS - 1)];
+}
+
+// 范围扫描：设备 device 在 [t_from, t_to]（Unix 毫秒，闭区间）内的读数，按追加顺序对每行调用 fn(arg, s, row)，
+// fn 返回非 0 时提前结束；扫描期间写线程暂停发布。返回访问的行数，-1 设备号超出索引范围
+typedef int (*reading_store_fn)(void *arg, const reading_store_t *s, uint32_t row);
+int64_t reading_store_scan(reading_store_t *s, uint32_t device, uint64_t t_from, uint64_t t_to, reading_store_fn fn,
+	void *arg);
+
+typedef struct {
+	uint64_t count;
+	uint64_t abnormal;
+	uint64_t t_first;        // 窗口内最早/最晚的时刻
+	uint64_t t_last;
+	float temp_min, temp_max;
+	float hum_min, hum_max;
+	double temp_sum;
+	double hum_sum;
+} reading_store_agg_t;
+
+// 时间窗聚合：device 为 READING_STORE_ALL 时逐段顺序扫描时刻列（不经索引），否则按设备索引跳页
+// 返回 0 成功，-1 设备号超出索引范围
+int reading_store_aggregate(reading_store_t *s, uint32_t device, uint64_t t_from, uint64_t t_to, reading_store_agg_t *agg);
+
+// 等待调用前已压入各环的读数全部提交（查询刚接收的读数前调用）
+void reading_store_sync(reading_store_t *s);
+
+// 已提交的行数
+uint32_t reading_store_rows(reading_store_t *s);
+
+void reading_store_get_stats(reading_store_t *s, reading_store_stats_t *st);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // READING_STORE_H
@@ -0,0 +1,609 @@
+// senml.c
+#include "senml.h"
+#include "sensor_json.h"
+#include "sensor_cbor.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum { F_TEMP = 0, F_HUM = 1, F_ABN = 2 };
+
+static const char *const g_field[3] = { "temp", "humidity", "abn" };
+static const uint8_t g_field_len[3] = { 4, 8, 3 };
+static const char *const g_unit[2] = { "Cel", "%RH" };
+
+#define REC_MAX 192 // 单条记录编码后的最大字节数（前缀 32 字节时）
+
+// SenML CBOR 标签（RFC 8428 第 6 节）
+#define LBL_BVER -1
+#define LBL_BN   -2
+#define LBL_BT   -3
+#define LBL_BU   -4
+#define LBL_BV   -5
+#define LBL_N     0
+#define LBL_U     1
+#define LBL_V     2
+#define LBL_VB    4
+#define LBL_T     6
+
+static float field_value(const sensor_reading_t *r, int f) {
+	return f == F_TEMP ? r->temperature_c : r->humidity_rh;
+}
+
+// 按 %.1f 的精度取十分位整数（JSON 与单条上报保持同样的精度）
+static int64_t tenths(float v) {
+	double d = (double)v * 10.0;
+	if (!(d > -1e15 && d < 1e15)) d = 0.0;
+	return (int64_t)llround(d);
+}
+
+// ---- JSON 记录 ----
+
+static size_t put_lit(uint8_t *p, const char *s) {
+	size_t n = strlen(s);
+	memcpy(p, s, n);
+	return n;
+}
+
+// 写定点数 x / 10^dec，省略小数部分末尾的 0
+static size_t put_fixed(uint8_t *p, int64_t x, int dec) {
+	size_t n = 0;
+	uint64_t u = (uint64_t)x;
+	if (x < 0) {
+		p[n++] = '-';
+		u = 0 - u;
+	}
+	uint64_t scale = 1;
+	for (int i = 0; i < dec; ++i) scale *= 10;
+	uint64_t ip = u / scale, fp = u % scale;
+	char d[20];
+	int k = 0;
+	do { d[k++] = (char)('0' + ip % 10); ip /= 10; } while (ip);
+	while (k) p[n++] = (uint8_t)d[--k];
+	if (fp) {
+		int w = dec;
+		while (fp % 10 == 0) { fp /= 10; w--; }
+		p[n++] = '.';
+		for (int i = w - 1; i >= 0; --i) { p[n + (size_t)i] = (uint8_t)('0' + fp % 10); fp /= 10; }
+		n += (size_t)w;
+	}
+	return n;
+}
+
+// 一条记录；head 非 0 时为字段组首条（带 bn，温湿度另带 bu、bv），with_bt 非 0 时带 bt
+static size_t rec_json(uint8_t *p, const senml_batch_t *b, int f, const senml_sample_t *s, int head, int with_bt) {
+	const senml_sample_t *base = &b->buf[0];
+	size_t n = 0;
+	p[n++] = '{';
+	if (head) {
+		n += put_lit(p + n, "\"bn\":\"");
+		memcpy(p + n, b->prefix, b->prefix_len);
+		n += b->prefix_len;
+		memcpy(p + n, g_field[f], g_field_len[f]);
+		n += g_field_len[f];
+		n += put_lit(p + n, "\",");
+	}
+	if (with_bt) {
+		n += put_lit(p + n, "\"bt\":");
+		n += put_fixed(p + n, (int64_t)base->t_ms, 3);
+		p[n++] = ',';
+	}
+	if (head && f != F_ABN) {
+		n += put_lit(p + n, "\"bu\":\"");
+		n += put_lit(p + n, g_unit[f]);
+		n += put_lit(p + n, "\",\"bv\":");
+		n += put_fixed(p + n, tenths(field_value(&base->r, f)), 1);
+		p[n++] = ',';
+	}
+	if (s->t_ms != base->t_ms) {
+		n += put_lit(p + n, "\"t\":");
+		n += put_fixed(p + n, (int64_t)(s->t_ms - base->t_ms), 3);
+		p[n++] = ',';
+	}
+	if (f == F_ABN) {
+		n += put_lit(p + n, "\"vb\":true");
+	} else {
+		n += put_lit(p + n, "\"v\":");
+		n += put_fixed(p + n, tenths(field_value(&s->r, f)) - tenths(field_value(&base->r, f)), 1);
+	}
+	p[n++] = '}';
+	return n;
+}
+
+// ---- CBOR 记录 ----
+
+static size_t put_head(uint8_t *p, int major, uint64_t v) {
+	uint8_t m = (uint8_t)(major << 5);
+	if (v < 24) { p[0] = (uint8_t)(m | v); return 1; }
+	if (v <= 0xFF) { p[0] = m | 24; p[1] = (uint8_t)v; return 2; }
+	if (v <= 0xFFFF) { p[0] = m | 25; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)v; return 3; }
+	if (v <= 0xFFFFFFFFull) {
+		p[0] = m | 26;
+		for (int i = 0; i < 4; ++i) p[1 + i] = (uint8_t)(v >> (24 - 8 * i));
+		return 5;
+	}
+	p[0] = m | 27;
+	for (int i = 0; i < 8; ++i) p[1 + i] = (uint8_t)(v >> (56 - 8 * i));
+	return 9;
+}
+
+static size_t put_label(uint8_t *p, int label) {
+	return label >= 0 ? put_head(p, SENSOR_CBOR_MAJOR_UINT, (uint64_t)label) :
+		put_head(p, SENSOR_CBOR_MAJOR_NEGINT, (uint64_t)(-1 - label));
+}
+
+static size_t put_double(uint8_t *p, double d) {
+	uint64_t u;
+	memcpy(&u, &d, sizeof(u));
+	p[0] = 0xFB;
+	for (int i = 0; i < 8; ++i) p[1 + i] = (uint8_t)(u >> (56 - 8 * i));
+	return 9;
+}
+
+// 数值取最短的精确写法：小整数 1 字节，其次半/单精度，否则双精度
+static size_t put_num(uint8_t *p, double d) {
+	if (d == 0.0 && !signbit(d)) return put_head(p, SENSOR_CBOR_MAJOR_UINT, 0);
+	if (d == floor(d) && fabs(d) < 24.0) {
+		return d > 0 ? put_head(p, SENSOR_CBOR_MAJOR_UINT, (uint64_t)d) :
+			put_head(p, SENSOR_CBOR_MAJOR_NEGINT, (uint64_t)(-1.0 - d));
+	}
+	if ((double)(float)d == d) return sensor_cbor_put_float(p, (float)d);
+	return put_double(p, d);
+}
+
+// 毫秒时长写成秒：整秒写整数；单精度在 8000 s 内能还原到毫秒，更长用双精度
+static size_t put_secs(uint8_t *p, uint64_t ms) {
+	if (ms % 1000 == 0) return put_head(p, SENSOR_CBOR_MAJOR_UINT, ms / 1000);
+	if (ms < 8000000u) return sensor_cbor_put_float(p, (float)((double)ms / 1000.0));
+	return put_double(p, (double)ms / 1000.0);
+}
+
+static size_t rec_cbor(uint8_t *p, const senml_batch_t *b, int f, const senml_sample_t *s, int head, int with_bt) {
+	const senml_sample_t *base = &b->buf[0];
+	int with_t = s->t_ms != base->t_ms;
+	int with_base = head && f != F_ABN;
+	uint64_t entries = (uint64_t)(head + with_bt + 2 * with_base + with_t + 1);
+	size_t n = put_head(p, SENSOR_CBOR_MAJOR_MAP, entries);
+	if (head) {
+		n += put_label(p + n, LBL_BN);
+		n += put_head(p + n, SENSOR_CBOR_MAJOR_TEXT, (uint64_t)b->prefix_len + g_field_len[f]);
+		memcpy(p + n, b->prefix, b->prefix_len);
+		n += b->prefix_len;
+		memcpy(p + n, g_field[f], g_field_len[f]);
+		n += g_field_len[f];
+	}
+	if (with_bt) {
+		n += put_label(p + n, LBL_BT);
+		n += put_double(p + n, (double)base->t_ms / 1000.0);
+	}
+	if (with_base) {
+		size_t ul = strlen(g_unit[f]);
+		n += put_label(p + n, LBL_BU);
+		n += put_head(p + n, SENSOR_CBOR_MAJOR_TEXT, ul);
+		memcpy(p + n, g_unit[f], ul);
+		n += ul;
+		n += put_label(p + n, LBL_BV);
+		n += sensor_cbor_put_float(p + n, field_value(&base->r, f));
+	}
+	if (with_t) {
+		n += put_label(p + n, LBL_T);
+		n += put_secs(p + n, s->t_ms - base->t_ms);
+	}
+	if (f == F_ABN) {
+		n += put_label(p + n, LBL_VB);
+		p[n++] = 0xF5; // true
+	} else {
+		// 两个 float 之差在 double 中是精确的，接收端 bv + v 还原出原始 float
+		n += put_label(p + n, LBL_V);
+		n += put_num(p + n, (double)field_value(&s->r, f) - (double)field_value(&base->r, f));
+	}
+	return n;
+}
+
+// ---- 聚合缓冲 ----
+
+static size_t rec(const senml_batch_conf_t *c, uint8_t *p, const senml_batch_t *b, int f, const senml_sample_t *s,
+	int head, int with_bt) {
+	return c->cbor ? rec_cbor(p, b, f, s, head, with_bt) : rec_json(p, b, f, s, head, with_bt);
+}
+
+// 记录以外的字节：JSON 为方括号与逗号，CBOR 为数组头
+static uint32_t pack_overhead(const senml_batch_conf_t *c, uint32_t records) {
+	if (c->cbor) return records < 24 ? 1u : 2u;
+	return records + 1u;
+}
+
+static uint32_t batch_records(const senml_batch_t *b) {
+	return 2u * b->count + b->abn_count;
+}
+
+// 把 x 放到缓冲第 count 条（尚不计入），返回计入后的 pack 字节数
+static uint32_t place(senml_batch_t *b, const senml_batch_conf_t *c, const senml_sample_t *x) {
+	b->buf[b->count] = *x;
+	const senml_sample_t *s = &b->buf[b->count];
+	int first = b->count == 0;
+	uint8_t tmp[REC_MAX];
+	uint32_t len = (uint32_t)rec(c, tmp, b, F_TEMP, s, first, first) + (uint32_t)rec(c, tmp, b, F_HUM, s, first, 0);
+	uint32_t recs = 2;
+	if (s->r.is_abnormal) {
+		len += (uint32_t)rec(c, tmp, b, F_ABN, s, b->abn_count == 0, 0);
+		recs++;
+	}
+	uint32_t old = batch_records(b);
+	uint32_t sum = b->count ? b->bytes - pack_overhead(c, old) : 0;
+	return sum + len + pack_overhead(c, old + recs);
+}
+
+static int encode(const senml_batch_t *b, const senml_batch_conf_t *c, uint8_t *out, size_t cap) {
+	if (b->bytes > cap) return -1;
+	size_t n = c->cbor ? put_head(out, SENSOR_CBOR_MAJOR_ARRAY, batch_records(b)) : 0;
+	if (!c->cbor) out[n++] = '[';
+	for (int f = F_TEMP; f <= F_HUM; ++f) {
+		for (uint32_t i = 0; i < b->count; ++i) {
+			if (!c->cbor && n > 1) out[n++] = ',';
+			n += rec(c, out + n, b, f, &b->buf[i], i == 0, f == F_TEMP && i == 0);
+		}
+	}
+	int head = 1;
+	for (uint32_t i = 0; i < b->count; ++i) {
+		if (!b->buf[i].r.is_abnormal) continue;
+		if (!c->cbor) out[n++] = ',';
+		n += rec(c, out + n, b, F_ABN, &b->buf[i], head, 0);
+		head = 0;
+	}
+	if (!c->cbor) out[n++] = ']';
+	return (int)n;
+}
+
+int senml_batch_init(senml_batch_t *b, const senml_batch_conf_t *c, const char *prefix) {
+	memset(b, 0, sizeof(*b));
+	if (!c || c->max_count < 1 || c->max_count > SENML_BATCH_MAX || c->max_bytes > SENML_PACK_MAX) return -1;
+	b->buf = (senml_sample_t*)malloc(sizeof(senml_sample_t) * c->max_count);
+	if (!b->buf) return -2;
+	size_t pl = prefix ? strlen(prefix) : 0;
+	if (pl > SENML_PREFIX_MAX) pl = SENML_PREFIX_MAX;
+	if (pl) memcpy(b->prefix, prefix, pl);
+	b->prefix[pl] = '\0';
+	b->prefix_len = (uint8_t)pl;
+	return 0;
+}
+
+void senml_batch_destroy(senml_batch_t *b) {
+	free(b->buf);
+	b->buf = NULL;
+	b->count = 0;
+}
+
+int senml_batch_flush(senml_batch_t *b, const senml_batch_conf_t *c, uint8_t *out, size_t cap) {
+	if (!b->count) return 0;
+	int n = encode(b, c, out, cap);
+	if (n < 0) return n;
+	b->count = 0;
+	b->abn_count = 0;
+	b->bytes = 0;
+	return n;
+}
+
+int senml_batch_add(senml_batch_t *b, const senml_batch_conf_t *c, const senml_sample_t *s, uint8_t *out, size_t cap) {
+	// 上次达到条数阈值时 cap 不足未能发出：缓冲已满，先补发，仍发不出则不加入
+	int sent = 0;
+	if (b->count >= c->max_count) {
+		sent = senml_batch_flush(b, c, out, cap);
+		if (sent < 0) return sent;
+	}
+	senml_sample_t x = *s;
+	if (b->count && x.t_ms <= b->buf[b->count - 1].t_ms) x.t_ms = b->buf[b->count - 1].t_ms + 1;
+	uint32_t bytes = place(b, c, &x);
+	if (b->count && bytes > c->max_bytes) {
+		sent = senml_batch_flush(b, c, out, cap);
+		if (sent < 0) return sent;
+		bytes = place(b, c, &x);
+	}
+	b->count++;
+	b->abn_count += x.r.is_abnormal != 0;
+	b->bytes = bytes;
+	if (!sent && b->count >= c->max_count) sent = senml_batch_flush(b, c, out, cap);
+	return sent;
+}
+
+int senml_batch_poll(senml_batch_t *b, const senml_batch_conf_t *c, uint64_t now_ms, uint8_t *out, size_t cap) {
+	if (!b->count || !c->max_delay_ms || now_ms < b->buf[0].t_ms + c->max_delay_ms) return 0;
+	return senml_batch_flush(b, c, out, cap);
+}
+
+// ---- 解包 ----
+
+#define NAME_MAX_LEN (SENML_PREFIX_MAX + 32)
+
+typedef struct {
+	senml_sample_t *out;
+	uint32_t cap;
+	uint32_t n;
+	uint8_t seen[SENML_BATCH_MAX]; // 每条读数已出现的字段位
+	char bn[NAME_MAX_LEN];
+	size_t bn_len;
+	double bt;
+	double bv;
+} dec_t;
+
+// 一条记录中出现的字段
+typedef struct {
+	unsigned has;       // REC_* 位
+	const uint8_t *bn;
+	size_t bn_len;
+	const uint8_t *n;
+	size_t n_len;
+	double bt, bv, t, v;
+	int vb;
+} rec_t;
+
+#define REC_BN   0x001u
+#define REC_BT   0x002u
+#define REC_BU   0x004u
+#define REC_BV   0x008u
+#define REC_BVER 0x010u
+#define REC_N    0x020u
+#define REC_U    0x040u
+#define REC_V    0x080u
+#define REC_VB   0x100u
+#define REC_T    0x200u
+
+// 记录解析完：先更新基准字段，再按名称与时刻归入读数
+static int dec_record(dec_t *d, const rec_t *r) {
+	if (r->has & REC_BN) {
+		if (r->bn_len > sizeof(d->bn)) return -2;
+		memcpy(d->bn, r->bn, r->bn_len);
+		d->bn_len = r->bn_len;
+	}
+	if (r->has & REC_BT) d->bt = r->bt;
+	if (r->has & REC_BV) d->bv = r->bv;
+
+	// 名称 = bn + n，字段取最后一个 '/' 或 ':' 之后的部分
+	char name[NAME_MAX_LEN * 2];
+	size_t nl = r->has & REC_N ? r->n_len : 0;
+	if (d->bn_len + nl > sizeof(name)) return -2;
+	memcpy(name, d->bn, d->bn_len);
+	if (nl) memcpy(name + d->bn_len, r->n, nl);
+	size_t len = d->bn_len + nl, k = len;
+	while (k > 0 && name[k - 1] != '/' && name[k - 1] != ':') k--;
+	const char *field = name + k;
+	size_t fl = len - k;
+	int f = -1;
+	for (int i = 0; i < 3; ++i) {
+		if (fl == g_field_len[i] && memcmp(field, g_field[i], fl) == 0) f = i;
+	}
+	if (f < 0) return -2;
+
+	double t = d->bt + (r->has & REC_T ? r->t : 0.0);
+	if (!(t >= 0.0 && t < 1e13)) return -3;
+	uint64_t ms = (uint64_t)llround(t * 1000.0);
+	uint32_t i = d->n;
+	while (i > 0 && d->out[i - 1].t_ms != ms) i--;
+	if (i == 0) {
+		if (d->n >= d->cap || d->n >= SENML_BATCH_MAX) return -5;
+		i = ++d->n;
+		memset(&d->out[i - 1], 0, sizeof(d->out[i - 1]));
+		d->out[i - 1].t_ms = ms;
+		d->seen[i - 1] = 0;
+	}
+	senml_sample_t *s = &d->out[i - 1];
+	if (d->seen[i - 1] & (1u << f)) return -2;
+	d->seen[i - 1] |= (uint8_t)(1u << f);
+	if (f == F_ABN) {
+		if (!(r->has & REC_VB)) return -3;
+		s->r.is_abnormal = r->vb;
+	} else {
+		if (!(r->has & REC_V)) return -3;
+		double v = d->bv + r->v;
+		if (f == F_TEMP) s->r.temperature_c = (float)v;
+		else s->r.humidity_rh = (float)v;
+	}
+	return 0;
+}
+
+// 所有记录处理完：检查每条读数的字段齐全，丢弃超出量程的读数
+static int dec_finish(dec_t *d, uint32_t *dropped) {
+	if (d->n == 0) return -2;
+	uint32_t kept = 0, bad = 0;
+	for (uint32_t i = 0; i < d->n; ++i) {
+		if ((d->seen[i] & 3u) != 3u) return -2;
+		const sensor_reading_t *r = &d->out[i].r;
+		if (!(r->temperature_c >= SENSOR_TEMP_MIN && r->temperature_c <= SENSOR_TEMP_MAX) ||
+			!(r->humidity_rh >= SENSOR_HUMIDITY_MIN && r->humidity_rh <= SENSOR_HUMIDITY_MAX)) {
+			bad++;
+			continue;
+		}
+		d->out[kept++] = d->out[i];
+	}
+	if (dropped) *dropped = bad;
+	return (int)kept;
+}
+
+static unsigned key_bit(const uint8_t *k, size_t kl) {
+	switch (kl) {
+	case 1:
+		return k[0] == 'n' ? REC_N : k[0] == 'u' ? REC_U : k[0] == 'v' ? REC_V : k[0] == 't' ? REC_T : 0;
+	case 2:
+		if (k[0] == 'b') return k[1] == 'n' ? REC_BN : k[1] == 't' ? REC_BT : k[1] == 'u' ? REC_BU : k[1] == 'v' ? REC_BV : 0;
+		return k[0] == 'v' && k[1] == 'b' ? REC_VB : 0;
+	case 4:
+		return memcmp(k, "bver", 4) == 0 ? REC_BVER : 0;
+	default:
+		return 0;
+	}
+}
+
+// ---- JSON 解包 ----
+
+typedef struct {
+	const uint8_t *p;
+	size_t len;
+	size_t i;
+} jcur_t;
+
+static void jws(jcur_t *c) {
+	while (c->i < c->len && (c->p[c->i] == ' ' || c->p[c->i] == '\t' || c->p[c->i] == '\n' || c->p[c->i] == '\r')) c->i++;
+}
+
+static int jchar(jcur_t *c, uint8_t ch) {
+	jws(c);
+	if (c->i < c->len && c->p[c->i] == ch) {
+		c->i++;
+		return 1;
+	}
+	return 0;
+}
+
+// 字符串不支持转义（名称与单位都不需要）
+static int jstring(jcur_t *c, const uint8_t **s, size_t *sl) {
+	if (!jchar(c, '"')) return -1;
+	size_t a = c->i;
+	while (c->i < c->len && c->p[c->i] != '"') {
+		if (c->p[c->i] == '\\' || c->p[c->i] < 0x20) return -1;
+		c->i++;
+	}
+	if (c->i >= c->len) return -1;
+	*s = c->p + a;
+	*sl = c->i - a;
+	c->i++;
+	return 0;
+}
+
+static int jnumber(jcur_t *c, double *v) {
+	jws(c);
+	size_t a = c->i;
+	while (c->i < c->len) {
+		uint8_t ch = c->p[c->i];
+		if (!((ch >= '0' && ch <= '9') || ch == '-' || ch == '+' || ch == '.' || ch == 'e' || ch == 'E')) break;
+		c->i++;
+	}
+	return sensor_json_number(c->p + a, c->i - a, v) == 0 ? 0 : -3;
+}
+
+static int jbool(jcur_t *c, int *b) {
+	jws(c);
+	if (c->len - c->i >= 4 && memcmp(c->p + c->i, "true", 4) == 0) { c->i += 4; *b = 1; return 0; }
+	if (c->len - c->i >= 5 && memcmp(c->p + c->i, "false", 5) == 0) { c->i += 5; *b = 0; return 0; }
+	return -3;
+}
+
+static int decode_json(dec_t *d, const uint8_t *p, size_t len) {
+	jcur_t c = { p, len, 0 };
+	if (!jchar(&c, '[')) return -1;
+	if (jchar(&c, ']')) return -2;
+	do {
+		if (!jchar(&c, '{')) return -1;
+		rec_t r;
+		memset(&r, 0, sizeof(r));
+		if (!jchar(&c, '}')) {
+			do {
+				const uint8_t *k, *sv;
+				size_t kl, sl;
+				if (jstring(&c, &k, &kl) != 0 || !jchar(&c, ':')) return -1;
+				unsigned bit = key_bit(k, kl);
+				if (!bit || (r.has & bit)) return -2;
+				r.has |= bit;
+				int rc;
+				switch (bit) {
+				case REC_BN: rc = jstring(&c, &r.bn, &r.bn_len); break;
+				case REC_N: rc = jstring(&c, &r.n, &r.n_len); break;
+				case REC_BU: case REC_U: rc = jstring(&c, &sv, &sl); break;
+				case REC_BT: rc = jnumber(&c, &r.bt); break;
+				case REC_BV: rc = jnumber(&c, &r.bv); break;
+				case REC_V: rc = jnumber(&c, &r.v); break;
+				case REC_T: rc = jnumber(&c, &r.t); break;
+				case REC_VB: rc = jbool(&c, &r.vb); break;
+				default: { double ver; rc = jnumber(&c, &ver); break; }
+				}
+				if (rc != 0) return rc == -1 ? -1 : -3;
+			} while (jchar(&c, ','));
+			if (!jchar(&c, '}')) return -1;
+		}
+		int rc = dec_record(d, &r);
+		if (rc != 0) return rc;
+	} while (jchar(&c, ','));
+	if (!jchar(&c, ']')) return -1;
+	jws(&c);
+	return c.i == len ? 0 : -1;
+}
+
+// ---- CBOR 解包 ----
+
+static int cbor_text(sensor_cbor_reader_t *r, const uint8_t **s, size_t *sl) {
+	int major, ai;
+	uint64_t n;
+	if (sensor_cbor_read_head(r, &major, &ai, &n) != 0) return -1;
+	if (major != SENSOR_CBOR_MAJOR_TEXT) return -3;
+	if ((uint64_t)(r->end - r->p) < n) return -1;
+	*s = r->p;
+	*sl = (size_t)n;
+	r->p += n;
+	return 0;
+}
+
+static int cbor_bool(sensor_cbor_reader_t *r, int *b) {
+	int major, ai;
+	uint64_t v;
+	if (sensor_cbor_read_head(r, &major, &ai, &v) != 0) return -1;
+	if (major != SENSOR_CBOR_MAJOR_SIMPLE || (ai != 20 && ai != 21)) return -3;
+	*b = ai == 21;
+	return 0;
+}
+
+static int decode_cbor(dec_t *d, const uint8_t *p, size_t len) {
+	sensor_cbor_reader_t r = { p, p + len };
+	int major, ai;
+	uint64_t count;
+	if (sensor_cbor_read_head(&r, &major, &ai, &count) != 0 || major != SENSOR_CBOR_MAJOR_ARRAY) return -1;
+	if (count == 0) return -2;
+	for (uint64_t i = 0; i < count; ++i) {
+		uint64_t entries;
+		if (sensor_cbor_read_head(&r, &major, &ai, &entries) != 0 || major != SENSOR_CBOR_MAJOR_MAP) return -1;
+		rec_t rec;
+		memset(&rec, 0, sizeof(rec));
+		for (uint64_t e = 0; e < entries; ++e) {
+			uint64_t arg;
+			if (sensor_cbor_read_head(&r, &major, &ai, &arg) != 0) return -1;
+			if ((major != SENSOR_CBOR_MAJOR_UINT && major != SENSOR_CBOR_MAJOR_NEGINT) || arg > 16) return -2;
+			int label = major == SENSOR_CBOR_MAJOR_UINT ? (int)arg : -1 - (int)arg;
+			unsigned bit;
+			const uint8_t *sv;
+			size_t sl;
+			double ver;
+			int rc;
+			switch (label) {
+			case LBL_BN: bit = REC_BN; rc = cbor_text(&r, &rec.bn, &rec.bn_len); break;
+			case LBL_N: bit = REC_N; rc = cbor_text(&r, &rec.n, &rec.n_len); break;
+			case LBL_BU: bit = REC_BU; rc = cbor_text(&r, &sv, &sl); break;
+			case LBL_U: bit = REC_U; rc = cbor_text(&r, &sv, &sl); break;
+			case LBL_BT: bit = REC_BT; rc = sensor_cbor_read_number(&r, &rec.bt); break;
+			case LBL_BV: bit = REC_BV; rc = sensor_cbor_read_number(&r, &rec.bv); break;
+			case LBL_V: bit = REC_V; rc = sensor_cbor_read_number(&r, &rec.v); break;
+			case LBL_T: bit = REC_T; rc = sensor_cbor_read_number(&r, &rec.t); break;
+			case LBL_BVER: bit = REC_BVER; rc = sensor_cbor_read_number(&r, &ver); break;
+			case LBL_VB: bit = REC_VB; rc = cbor_bool(&r, &rec.vb); break;
+			default: return -2;
+			}
+			if (rc != 0) return rc;
+			if (rec.has & bit) return -2;
+			rec.has |= bit;
+		}
+		int rc = dec_record(d, &rec);
+		if (rc != 0) return rc;
+	}
+	return r.p == r.end ? 0 : -1;
+}
+
+int senml_decode(const uint8_t *p, size_t len, int cbor, senml_sample_t *out, uint32_t cap, uint32_t *dropped) {
+	dec_t d;
+	d.out = out;
+	d.cap = cap;
+	d.n = 0;
+	d.bn_len = 0;
+	d.bt = 0.0;
+	d.bv = 0.0;
+	if (dropped) *dropped = 0;
+	int rc = cbor ? decode_cbor(&d, p, len) : decode_json(&d, p, len);
+	if (rc != 0) return rc;
+	return dec_finish(&d, dropped);
+}
@@ -0,0 +1,75 @@
+// senml.h
+// 读数聚合（RFC 8428 SenML）：设备侧把多次采样攒进缓冲，达到条数阈值、字节预算或最长滞留时间之一时
+// 打成一个 SenML pack 一次 POST（JSON Content-Format 110，CBOR 112），服务端解包还原为带时间戳的读数
+// pack 按字段分组：每组首条记录给出 bn（名称前缀 + 字段名）、bu、bv（该组第一条读数），
+// 整个 pack 的首条记录给出 bt（第一条读数的时刻）；之后每条记录只带相对 bt 的时间偏移 t 与相对 bv 的差值 v，
+// 异常标记只为 abn=1 的读数写一条 vb=true 记录
+
+#ifndef SENML_H
+#define SENML_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sensor_sim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SENML_CF_JSON 110 // application/senml+json
+#define SENML_CF_CBOR 112 // application/senml+cbor
+
+#define SENML_BATCH_MAX 64    // 一个 pack 最多的读数条数
+#define SENML_PACK_MAX  4096  // 一个 pack 的字节预算上限（超过一个报文时按 Block1 分块上传）
+#define SENML_PACK_DGRAM 1024 // 单个报文能装下的预算（加上报文头、选项与加密填充仍在 1152 字节内），默认取它
+#define SENML_PREFIX_MAX 32   // 名称前缀（bn 中字段名之前的部分）最长字节数
+
+typedef struct {
+	sensor_reading_t r;
+	uint64_t t_ms; // 采样时刻（Unix 毫秒）
+} senml_sample_t;
+
+typedef struct {
+	uint32_t max_count;    // 条数阈值（1..SENML_BATCH_MAX）
+	uint32_t max_bytes;    // 编码后字节预算（不超过 SENML_PACK_MAX）
+	uint32_t max_delay_ms; // 最早一条读数的最长滞留时间，0 表示不限
+	int cbor;              // 非 0 时编码为 SenML CBOR
+} senml_batch_conf_t;
+
+// 单个设备的聚合缓冲；字节数随每次加入精确累计，保证 pack 不超预算
+typedef struct {
+	senml_sample_t *buf;   // max_count 条
+	uint32_t count;
+	uint32_t abn_count;    // 缓冲中 abn=1 的读数条数
+	uint32_t bytes;        // 当前缓冲编码成 pack 的字节数
+	char prefix[SENML_PREFIX_MAX + 1];
+	uint8_t prefix_len;
+} senml_batch_t;
+
+// 分配缓冲；prefix 为名称前缀（如 "dev001/"），超长截断。返回 0 成功，-1 参数错误，-2 内存不足
+int senml_batch_init(senml_batch_t *b, const senml_batch_conf_t *c, const char *prefix);
+void senml_batch_destroy(senml_batch_t *b);
+
+// 加入一条读数（时刻不晚于上一条时顺延 1 ms，保证 pack 内时刻唯一）
+// 需要发送时把 pack 编码进 out 并返回字节数：加入前已放不下这一条（先发旧的，这一条进新缓冲），
+// 或加入后达到条数阈值；不需要发送返回 0，<0 表示 cap 不足（读数留在缓冲；缓冲已满时这一条不加入，
+// 下次加入或 flush 时再发）
+int senml_batch_add(senml_batch_t *b, const senml_batch_conf_t *c, const senml_sample_t *s, uint8_t *out, size_t cap);
+
+// 最早一条读数已滞留 max_delay_ms 时编码发送；返回字节数，0 表示未到期或为空
+int senml_batch_poll(senml_batch_t *b, const senml_batch_conf_t *c, uint64_t now_ms, uint8_t *out, size_t cap);
+
+// 不论条件立即编码缓冲中的读数并清空；返回字节数，0 表示为空，<0 表示 cap 不足
+int senml_batch_flush(senml_batch_t *b, const senml_batch_conf_t *c, uint8_t *out, size_t cap);
+
+// 解包一个 pack（cbor 非 0 时为 SenML CBOR），按时刻把 temp/humidity/abn 记录归并为读数写入 out
+// 超出量程的读数单独丢弃并计入 *dropped（与单条上报一致的量程，见 sensor_json.h），不影响同一 pack 的其他读数
+// 返回有效读数条数（>=0）；-1 结构错误；-2 不认识的字段或名称、缺少 temp/humidity、同一时刻重复、空 pack；
+// -3 值的类型不对；-5 读数条数超过 cap
+int senml_decode(const uint8_t *p, size_t len, int cbor, senml_sample_t *out, uint32_t cap, uint32_t *dropped);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SENML_H
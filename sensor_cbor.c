@@ -0,0 +1,150 @@
+// sensor_cbor.c
+#include "sensor_cbor.h"
+#include "sensor_json.h"
+#include <math.h>
+#include <string.h>
+
+static uint32_t float_bits(float f) {
+	uint32_t u;
+	memcpy(&u, &f, sizeof(u));
+	return u;
+}
+
+// f 能用半精度精确表示时写入 *h 并返回 1
+static int half_exact(float f, uint16_t *h) {
+	uint32_t u = float_bits(f);
+	uint16_t sign = (uint16_t)((u >> 16) & 0x8000u);
+	int e = (int)((u >> 23) & 0xFF);
+	uint32_t mant = u & 0x7FFFFFu;
+	if (e == 0 && mant == 0) { *h = sign; return 1; } // ±0
+	if (e == 0 || e == 0xFF) return 0;                  // 单精度非规格数、Inf/NaN 不走半精度
+	e -= 127;
+	if (e >= -14 && e <= 15) {
+		if (mant & 0x1FFFu) return 0;
+		*h = (uint16_t)(sign | (uint16_t)((e + 15) << 10) | (uint16_t)(mant >> 13));
+		return 1;
+	}
+	if (e >= -24 && e < -14) {
+		// 半精度非规格数：值 = m * 2^-24
+		uint32_t full = mant | 0x800000u;
+		int shift = -1 - e;
+		if (full & ((1u << shift) - 1u)) return 0;
+		*h = (uint16_t)(sign | (uint16_t)(full >> shift));
+		return 1;
+	}
+	return 0;
+}
+
+static double half_to_double(uint16_t h) {
+	int e = (h >> 10) & 0x1F;
+	int m = h & 0x3FF;
+	double v = e == 0 ? ldexp((double)m, -24) :
+		e == 31 ? (m ? NAN : INFINITY) : ldexp((double)(m | 0x400), e - 25);
+	return (h & 0x8000u) ? -v : v;
+}
+
+size_t sensor_cbor_put_float(uint8_t *p, float f) {
+	uint16_t h;
+	if (half_exact(f, &h)) {
+		p[0] = 0xF9;
+		p[1] = (uint8_t)(h >> 8);
+		p[2] = (uint8_t)h;
+		return 3;
+	}
+	uint32_t u = float_bits(f);
+	p[0] = 0xFA;
+	p[1] = (uint8_t)(u >> 24);
+	p[2] = (uint8_t)(u >> 16);
+	p[3] = (uint8_t)(u >> 8);
+	p[4] = (uint8_t)u;
+	return 5;
+}
+
+int sensor_cbor_encode(const sensor_reading_t *r, uint8_t *out, size_t cap) {
+	uint8_t buf[SENSOR_CBOR_MAX];
+	size_t n = 0;
+	buf[n++] = 0xA3; // map(3)
+	buf[n++] = 0x64; memcpy(buf + n, "temp", 4); n += 4;
+	n += sensor_cbor_put_float(buf + n, r->temperature_c);
+	buf[n++] = 0x68; memcpy(buf + n, "humidity", 8); n += 8;
+	n += sensor_cbor_put_float(buf + n, r->humidity_rh);
+	buf[n++] = 0x63; memcpy(buf + n, "abn", 3); n += 3;
+	buf[n++] = r->is_abnormal ? 0x01 : 0x00;
+	if (n > cap) return -1;
+	memcpy(out, buf, n);
+	return (int)n;
+}
+
+int sensor_cbor_read_head(sensor_cbor_reader_t *r, int *major, int *ai, uint64_t *arg) {
+	if (r->p >= r->end) return -1;
+	uint8_t b = *r->p++;
+	*major = b >> 5;
+	*ai = b & 0x1F;
+	if (*ai < 24) {
+		*arg = (uint64_t)*ai;
+		return 0;
+	}
+	if (*ai > 27) return -1;
+	size_t n = (size_t)1 << (*ai - 24);
+	if ((size_t)(r->end - r->p) < n) return -1;
+	uint64_t v = 0;
+	for (size_t i = 0; i < n; ++i) v = v << 8 | r->p[i];
+	r->p += n;
+	*arg = v;
+	return 0;
+}
+
+int sensor_cbor_read_number(sensor_cbor_reader_t *r, double *out) {
+	int major, ai;
+	uint64_t arg;
+	if (sensor_cbor_read_head(r, &major, &ai, &arg) != 0) return -1;
+	switch (major) {
+	case SENSOR_CBOR_MAJOR_UINT:
+		*out = (double)arg;
+		return 0;
+	case SENSOR_CBOR_MAJOR_NEGINT:
+		*out = -1.0 - (double)arg;
+		return 0;
+	case SENSOR_CBOR_MAJOR_SIMPLE:
+		if (ai == 25) { *out = half_to_double((uint16_t)arg); return 0; }
+		if (ai == 26) { uint32_t u = (uint32_t)arg; float f; memcpy(&f, &u, sizeof(f)); *out = f; return 0; }
+		if (ai == 27) { double d; memcpy(&d, &arg, sizeof(d)); *out = d; return 0; }
+		return -3;
+	default:
+		return major == 6 ? -1 : -3; // 标签按结构错误（不支持），字符串、数组、map 按类型错误
+	}
+}
+
+int sensor_cbor_decode(const uint8_t *p, size_t len, sensor_reading_t *out) {
+	sensor_cbor_reader_t r = { p, p + len };
+	int major, ai;
+	uint64_t count;
+	if (sensor_cbor_read_head(&r, &major, &ai, &count) != 0 || major != SENSOR_CBOR_MAJOR_MAP) return -1;
+	if (count == 0) return -2;
+	double val[3] = { 0.0, 0.0, 0.0 }; // temp, humidity, abn
+	unsigned seen = 0;
+	for (uint64_t i = 0; i < count; ++i) {
+		uint64_t kl;
+		if (sensor_cbor_read_head(&r, &major, &ai, &kl) != 0) return -1;
+		if (major != SENSOR_CBOR_MAJOR_TEXT) return -2;
+		if ((uint64_t)(r.end - r.p) < kl) return -1;
+		const uint8_t *k = r.p;
+		r.p += kl;
+		int f = (kl == 4 && memcmp(k, "temp", 4) == 0) ? 0 :
+			(kl == 8 && memcmp(k, "humidity", 8) == 0) ? 1 :
+			(kl == 3 && memcmp(k, "abn", 3) == 0) ? 2 : -1;
+		if (f < 0 || (seen >> f) & 1u) return -2;
+		seen |= 1u << f;
+		int rc = sensor_cbor_read_number(&r, &val[f]);
+		if (rc != 0) return rc;
+	}
+	if (r.p != r.end) return -1;
+	if (seen != 7u) return -2;
+	if (!(val[0] >= SENSOR_TEMP_MIN && val[0] <= SENSOR_TEMP_MAX) ||
+		!(val[1] >= SENSOR_HUMIDITY_MIN && val[1] <= SENSOR_HUMIDITY_MAX) ||
+		(val[2] != 0.0 && val[2] != 1.0)) return -4;
+	out->temperature_c = (float)val[0];
+	out->humidity_rh = (float)val[1];
+	out->is_abnormal = (int)val[2];
+	return 0;
+}
@@ -0,0 +1,53 @@
+// sensor_cbor.h
+// 上报负载的 CBOR 编码（RFC 8949，Content-Format 60）：与 JSON 同一数据模型，
+// 定长 map {"temp": 浮点, "humidity": 浮点, "abn": 0/1}，浮点取能精确还原的最短宽度（半精度或单精度），
+// 一条读数约 30 字节，省去浮点转文本；解码同样单遍、不分配内存，校验规则与返回值同 sensor_json_decode
+
+#ifndef SENSOR_CBOR_H
+#define SENSOR_CBOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sensor_sim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SENSOR_CBOR_MAX 32 // 一条读数编码后的最大字节数
+
+// 编码一条读数写入 out；返回字节数，-1 表示 cap 不足
+int sensor_cbor_encode(const sensor_reading_t *r, uint8_t *out, size_t cap);
+
+// 返回 0 成功；-1 结构错误（截断、不定长、标签、map 外多余字节）；-2 缺少、重复或不认识的键；
+// -3 值的类型不对；-4 超出量程（abn 只能为 0/1）
+int sensor_cbor_decode(const uint8_t *p, size_t len, sensor_reading_t *out);
+
+// ---- 供其他 CBOR 负载（如 SenML）复用的读写工具 ----
+
+#define SENSOR_CBOR_MAJOR_UINT   0
+#define SENSOR_CBOR_MAJOR_NEGINT 1
+#define SENSOR_CBOR_MAJOR_TEXT   3
+#define SENSOR_CBOR_MAJOR_ARRAY  4
+#define SENSOR_CBOR_MAJOR_MAP    5
+#define SENSOR_CBOR_MAJOR_SIMPLE 7 // 简单值（false=20, true=21）与浮点
+
+typedef struct {
+	const uint8_t *p;
+	const uint8_t *end;
+} sensor_cbor_reader_t;
+
+// 写一个浮点：能用半精度精确表示时 3 字节，否则单精度 5 字节；返回写入字节数（p 至少留 5 字节）
+size_t sensor_cbor_put_float(uint8_t *p, float f);
+
+// 读一个数据项的头：主类型与参数（长度、整数值或浮点位模式）；不定长（31）与保留值（28~30）返回 -1
+int sensor_cbor_read_head(sensor_cbor_reader_t *r, int *major, int *ai, uint64_t *arg);
+
+// 读一个数值（整数或浮点）；返回 0 成功，-1 结构错误，-3 不是数值
+int sensor_cbor_read_number(sensor_cbor_reader_t *r, double *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SENSOR_CBOR_H
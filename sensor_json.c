@@ -0,0 +1,214 @@
+// sensor_json.c
+#include "sensor_json.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SJ_SSE2 1
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#define SJ_BLOCK 64
+
+// 结构字符；反斜杠也算在内，出现在任何位置都会打乱期望的结构序列而被拒绝
+static const uint8_t g_structural[256] = {
+	['{'] = 1, ['}'] = 1, [':'] = 1, [','] = 1, ['"'] = 1, ['\\'] = 1
+};
+
+// 10^0 ~ 10^22 都能用 double 精确表示：尾数 < 2^53 时一次乘除即得正确舍入的结果
+static const double g_pow10[23] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+typedef uint64_t (*block_fn)(const uint8_t *p); // p 起 SJ_BLOCK 字节可读，返回结构字符位置掩码
+
+static uint64_t block_mask_scalar(const uint8_t *p) {
+	uint64_t m = 0;
+	for (int i = 0; i < SJ_BLOCK; ++i) m |= (uint64_t)g_structural[p[i]] << i;
+	return m;
+}
+
+#ifdef SJ_SSE2
+static uint64_t block_mask_sse2(const uint8_t *p) {
+	const __m128i lb = _mm_set1_epi8('{'), rb = _mm_set1_epi8('}'), colon = _mm_set1_epi8(':');
+	const __m128i comma = _mm_set1_epi8(','), quote = _mm_set1_epi8('"'), bs = _mm_set1_epi8('\\');
+	uint64_t m = 0;
+	for (int i = 0; i < SJ_BLOCK / 16; ++i) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(p + 16 * i));
+		__m128i x = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, lb), _mm_cmpeq_epi8(v, rb)),
+			_mm_or_si128(_mm_cmpeq_epi8(v, colon), _mm_cmpeq_epi8(v, comma)));
+		x = _mm_or_si128(x, _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bs)));
+		m |= (uint64_t)(uint32_t)_mm_movemask_epi8(x) << (16 * i);
+	}
+	return m;
+}
+#endif
+
+static int ctz64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctzll(x);
+#elif defined(_MSC_VER) && defined(_M_X64)
+	unsigned long i;
+	_BitScanForward64(&i, x);
+	return (int)i;
+#else
+	int n = 0;
+	while (!(x & 1)) { x >>= 1; n++; }
+	return n;
+#endif
+}
+
+// 结构字符游标：按块生成掩码，逐个取出最低位
+typedef struct {
+	const uint8_t *p;
+	size_t len;
+	size_t base;   // 当前块起点
+	uint64_t mask; // 当前块中尚未取出的结构字符
+	block_fn block;
+} scan_t;
+
+static uint64_t load_block(const scan_t *s) {
+	if (s->len - s->base >= SJ_BLOCK) return s->block(s->p + s->base);
+	uint8_t tail[SJ_BLOCK]; // 末块补 0（非结构字符）后再分类，不越界读
+	memset(tail, 0, sizeof(tail));
+	memcpy(tail, s->p + s->base, s->len - s->base);
+	return s->block(tail);
+}
+
+// 下一个结构字符的位置，没有了返回 len
+static size_t scan_next(scan_t *s) {
+	while (!s->mask) {
+		if (s->len - s->base <= SJ_BLOCK) return s->len;
+		s->base += SJ_BLOCK;
+		s->mask = load_block(s);
+	}
+	size_t i = s->base + (size_t)ctz64(s->mask);
+	s->mask &= s->mask - 1;
+	return i;
+}
+
+static int all_ws(const uint8_t *p, size_t a, size_t b) {
+	for (; a < b; ++a) {
+		if (p[a] != ' ' && p[a] != '\t' && p[a] != '\n' && p[a] != '\r') return 0;
+	}
+	return 1;
+}
+
+static int is_digit(uint8_t c) {
+	return c >= '0' && c <= '9';
+}
+
+// 解析 p[a..b) 中的 JSON 数值（两侧可有空白）；返回 0 成功，-1 格式不对
+static int parse_number(const uint8_t *p, size_t a, size_t b, double *out) {
+	while (a < b && (p[a] == ' ' || p[a] == '\t' || p[a] == '\n' || p[a] == '\r')) a++;
+	while (b > a && (p[b - 1] == ' ' || p[b - 1] == '\t' || p[b - 1] == '\n' || p[b - 1] == '\r')) b--;
+	size_t i = a;
+	int neg = i < b && p[i] == '-';
+	if (neg) i++;
+	if (i >= b || !is_digit(p[i])) return -1;
+	uint64_t mant = 0;
+	int digits = 0, exp10 = 0;
+	if (p[i] == '0') {
+		i++; // 不允许前导 0
+	} else {
+		for (; i < b && is_digit(p[i]); ++i) {
+			if (digits < 19) { mant = mant * 10 + (uint64_t)(p[i] - '0'); digits++; }
+			else exp10++;
+		}
+	}
+	if (i < b && p[i] == '.') {
+		if (++i >= b || !is_digit(p[i])) return -1;
+		for (; i < b && is_digit(p[i]); ++i) {
+			if (mant == 0 && p[i] == '0') exp10--; // 前导 0 不占有效位
+			else if (digits < 19) { mant = mant * 10 + (uint64_t)(p[i] - '0'); digits++; exp10--; }
+		}
+	}
+	if (i < b && (p[i] == 'e' || p[i] == 'E')) {
+		i++;
+		int eneg = i < b && p[i] == '-';
+		if (i < b && (p[i] == '-' || p[i] == '+')) i++;
+		if (i >= b || !is_digit(p[i])) return -1;
+		int e = 0;
+		for (; i < b && is_digit(p[i]); ++i) {
+			if (e < 10000) e = e * 10 + (p[i] - '0');
+		}
+		exp10 += eneg ? -e : e;
+	}
+	if (i != b) return -1;
+	double v;
+	if (mant == 0) {
+		v = 0.0;
+	} else if (mant < (1ull << 53) && exp10 >= -22 && exp10 <= 22) {
+		v = exp10 < 0 ? (double)mant / g_pow10[-exp10] : (double)mant * g_pow10[exp10];
+	} else {
+		// 极少见的长尾数或大指数：拷到栈上交给 strtod
+		char tmp[64];
+		if (b - a >= sizeof(tmp)) return -1;
+		memcpy(tmp, p + a, b - a);
+		tmp[b - a] = '\0';
+		*out = strtod(tmp, NULL);
+		return 0;
+	}
+	*out = neg ? -v : v;
+	return 0;
+}
+
+static int decode(const uint8_t *p, size_t len, sensor_reading_t *out, block_fn block) {
+	scan_t s = { p, len, 0, 0, block };
+	if (len) s.mask = load_block(&s);
+	size_t open = scan_next(&s);
+	if (open >= len || p[open] != '{' || !all_ws(p, 0, open)) return -1;
+	double val[3] = { 0.0, 0.0, 0.0 }; // temp, humidity, abn
+	unsigned seen = 0;
+	size_t prev = open;
+	for (;;) {
+		// "key" : value (, | })
+		size_t q0 = scan_next(&s);
+		if (q0 < len && p[q0] == '}' && prev == open && all_ws(p, open + 1, q0)) return -2; // 空对象
+		if (q0 >= len || p[q0] != '"' || !all_ws(p, prev + 1, q0)) return -1;
+		size_t q1 = scan_next(&s);
+		size_t colon = scan_next(&s);
+		if (q1 >= len || p[q1] != '"' || colon >= len || p[colon] != ':' || !all_ws(p, q1 + 1, colon)) return -1;
+		size_t end = scan_next(&s);
+		if (end >= len || (p[end] != ',' && p[end] != '}')) return -1;
+		const uint8_t *k = p + q0 + 1;
+		size_t kl = q1 - q0 - 1;
+		int f = (kl == 4 && memcmp(k, "temp", 4) == 0) ? 0 :
+			(kl == 8 && memcmp(k, "humidity", 8) == 0) ? 1 :
+			(kl == 3 && memcmp(k, "abn", 3) == 0) ? 2 : -1;
+		if (f < 0 || (seen >> f) & 1u) return -2;
+		seen |= 1u << f;
+		if (parse_number(p, colon + 1, end, &val[f]) != 0) return -3;
+		prev = end;
+		if (p[end] == '}') break;
+	}
+	if (!all_ws(p, prev + 1, len)) return -1;
+	if (seen != 7u) return -2;
+	if (!(val[0] >= SENSOR_TEMP_MIN && val[0] <= SENSOR_TEMP_MAX) ||
+		!(val[1] >= SENSOR_HUMIDITY_MIN && val[1] <= SENSOR_HUMIDITY_MAX) ||
+		(val[2] != 0.0 && val[2] != 1.0)) return -4;
+	out->temperature_c = (float)val[0];
+	out->humidity_rh = (float)val[1];
+	out->is_abnormal = (int)val[2];
+	return 0;
+}
+
+int sensor_json_decode(const uint8_t *p, size_t len, sensor_reading_t *out) {
+#ifdef SJ_SSE2
+	return decode(p, len, out, block_mask_sse2);
+#else
+	return decode(p, len, out, block_mask_scalar);
+#endif
+}
+
+int sensor_json_number(const uint8_t *p, size_t len, double *out) {
+	return parse_number(p, 0, len, out);
+}
+
+int sensor_json_decode_scalar(const uint8_t *p, size_t len, sensor_reading_t *out) {
+	return decode(p, len, out, block_mask_scalar);
+}
@@ -0,0 +1,37 @@
+// sensor_json.h
+// 服务端上报负载解码：把 {"temp":..,"humidity":..,"abn":..} 解析并校验成 sensor_reading_t
+// 单遍、不分配内存：先按 64 字节块用 SIMD（x86 SSE2，其他平台逐字节查表）标出结构字符 { } : , " \ 的位置掩码，
+// 再沿掩码在结构字符之间跳转，键按定长比较，数值就地解析；三个键各出现一次，不认识的键、转义、多余字符一律拒绝
+
+#ifndef SENSOR_JSON_H
+#define SENSOR_JSON_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sensor_sim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 物理量程：超出按无效读数拒绝（异常读数 abn=1 只要在量程内仍然接收）
+#define SENSOR_TEMP_MIN     -40.0f
+#define SENSOR_TEMP_MAX      80.0f
+#define SENSOR_HUMIDITY_MIN   0.0f
+#define SENSOR_HUMIDITY_MAX 100.0f
+
+// 返回 0 成功；-1 语法错误（结构字符、空白以外的多余内容、转义）；-2 缺少、重复或不认识的键；
+// -3 数值格式不对；-4 超出量程（abn 只能为 0/1）
+int sensor_json_decode(const uint8_t *p, size_t len, sensor_reading_t *out);
+
+// 同上，结构字符逐字节查表定位（不用 SIMD），供基准对比
+int sensor_json_decode_scalar(const uint8_t *p, size_t len, sensor_reading_t *out);
+
+// 解析 p[0..len) 中的一个 JSON 数值（两侧可有空白），供其他 JSON 负载（如 SenML）复用；返回 0 成功，-1 格式不对
+int sensor_json_number(const uint8_t *p, size_t len, double *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SENSOR_JSON_H
@@ -1,35 +1,285 @@
 // sensor_sim.c
 #include "sensor_sim.h"
+#include "sensor_json.h"
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
-static int abnormal_counter = 0;
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SS_SSE2 1
+#endif
 
-void sensor_sim_init(void) {
-	unsigned int seed = (unsigned int)time(NULL);
-	srand(seed);
-	abnormal_counter = 0;
+#define SS_LANES 4
+#define SS_U16 (1.0f / 65536.0f)
+
+void sensor_model_default(sensor_model_t *m) {
+	memset(m, 0, sizeof(*m));
+	m->temp_base = 22.0f;
+	m->temp_spread = 4.0f;
+	m->temp_amp = 5.0f;
+	m->temp_step = 0.05f;
+	m->hum_base = 50.0f;
+	m->hum_spread = 8.0f;
+	m->hum_amp = 10.0f;
+	m->hum_step = 0.1f;
+	m->revert = 0.002f;
+	m->period_samples = 86400;
+	m->anomaly_rate = 0.01f;
+	m->anomaly_len = 5;
+	m->anomaly_temp = 45.0f;
+	m->anomaly_hum = 55.0f;
+}
+
+static uint64_t splitmix64(uint64_t x) {
+	x += 0x9E3779B97F4A7C15ull;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
+// [0, 1) 均匀分布（53 位）
+static double unit53(uint64_t x) {
+	return (double)(x >> 11) * (1.0 / 9007199254740992.0);
+}
+
+int sensor_bank_init(sensor_bank_t *b, uint32_t count, const sensor_model_t *m, uint64_t seed) {
+	if (!b || !m || count == 0 || count > 0x7FFFFFF0u || m->anomaly_len == 0 || m->revert < 0 || m->revert > 1) return -1;
+	memset(b, 0, sizeof(*b));
+	b->count = count;
+	b->lanes = (count + SS_LANES - 1) & ~(uint32_t)(SS_LANES - 1);
+	b->model = *m;
+	if (b->model.period_samples == 0) b->model.period_samples = 86400;
+	// 16 列 4 字节的数组放在一块内存里，每列起点 16 字节对齐
+	size_t col = (size_t)b->lanes * 4;
+	uint8_t *p = (uint8_t*)calloc(16 * col + 16, 1);
+	if (!p) return -2;
+	b->mem = p;
+	p += (16 - ((uintptr_t)p & 15)) & 15;
+	for (int k = 0; k < 4; ++k) b->rng[k] = (uint32_t*)(p + col * (size_t)k);
+	b->pc = (float*)(p + col * 4);
+	b->ps = (float*)(p + col * 5);
+	b->base_t = (float*)(p + col * 6);
+	b->base_h = (float*)(p + col * 7);
+	b->walk_t = (float*)(p + col * 8);
+	b->walk_h = (float*)(p + col * 9);
+	b->anom_t = (float*)(p + col * 10);
+	b->anom_h = (float*)(p + col * 11);
+	b->anom_left = (int32_t*)(p + col * 12);
+	b->temp = (float*)(p + col * 13);
+	b->hum = (float*)(p + col * 14);
+	b->abnormal = (int32_t*)(p + col * 15);
+
+	b->keep = 1.0f - b->model.revert;
+	double step = 6.283185307179586 / (double)b->model.period_samples;
+	b->rot_c = (float)cos(step);
+	b->rot_s = (float)sin(step);
+	double th = (double)b->model.anomaly_rate * 2147483648.0;
+	b->anom_thresh = th <= 0 ? 0 : th >= 2147483647.0 ? 0x7FFFFFFFu : (uint32_t)th;
+
+	if (seed == 0) seed = splitmix64((uint64_t)time(NULL) ^ ((uint64_t)clock() << 20));
+	for (uint32_t i = 0; i < b->lanes; ++i) {
+		// 每台设备的状态只由 (seed, i) 决定：设备数不同时同一设备的序列不变
+		uint64_t a = splitmix64(seed + 4ull * i), c = splitmix64(seed + 4ull * i + 1);
+		b->rng[0][i] = (uint32_t)a;
+		b->rng[1][i] = (uint32_t)(a >> 32);
+		b->rng[2][i] = (uint32_t)c;
+		b->rng[3][i] = (uint32_t)(c >> 32);
+		if ((a | c) == 0) b->rng[0][i] = 1;
+		double ph = unit53(splitmix64(seed + 4ull * i + 2)) * 6.283185307179586;
+		uint64_t off = splitmix64(seed + 4ull * i + 3);
+		b->pc[i] = (float)cos(ph);
+		b->ps[i] = (float)sin(ph);
+		b->base_t[i] = b->model.temp_base + b->model.temp_spread * (float)(2.0 * unit53(off << 32) - 1.0);
+		b->base_h[i] = b->model.hum_base + b->model.hum_spread * (float)(2.0 * unit53(off) - 1.0);
+	}
+	return 0;
+}
+
+void sensor_bank_destroy(sensor_bank_t *b) {
+	if (!b) return;
+	free(b->mem);
+	memset(b, 0, sizeof(*b));
+}
+
+static inline uint32_t rotl32(uint32_t x, int k) {
+	return (x << k) | (x >> (32 - k));
+}
+
+// 三角分布噪声：两个 16 位均匀数之和减 1，落在 [-1, 1)
+static inline float tri16(uint32_t r) {
+	return (float)(r & 0xFFFF) * SS_U16 + (float)(r >> 16) * SS_U16 - 1.0f;
+}
+
+static inline float clampf(float x, float lo, float hi) {
+	x = x < hi ? x : hi;
+	return x > lo ? x : lo;
+}
+
+// 设备 i 前进一个采样（标量）；运算顺序与 SSE2 版一致
+static void step_one(sensor_bank_t *b, uint32_t i) {
+	const sensor_model_t *m = &b->model;
+	uint32_t s0 = b->rng[0][i], s1 = b->rng[1][i], s2 = b->rng[2][i], s3 = b->rng[3][i];
+	uint32_t r[4];
+	for (int k = 0; k < 4; ++k) {
+		// xoshiro128+
+		r[k] = s0 + s3;
+		uint32_t t = s1 << 9;
+		s2 ^= s0; s3 ^= s1; s1 ^= s2; s0 ^= s3; s2 ^= t; s3 = rotl32(s3, 11);
+	}
+	b->rng[0][i] = s0; b->rng[1][i] = s1; b->rng[2][i] = s2; b->rng[3][i] = s3;
+
+	float wt = b->walk_t[i] * b->keep + m->temp_step * tri16(r[0]);
+	float wh = b->walk_h[i] * b->keep + m->hum_step * tri16(r[1]);
+	b->walk_t[i] = wt;
+	b->walk_h[i] = wh;
+	float c = b->pc[i], s = b->ps[i];
+	float nc = c * b->rot_c - s * b->rot_s;
+	float ns = s * b->rot_c + c * b->rot_s;
+	// 一步牛顿迭代把 (c, s) 拉回单位圆，避免旋转累积误差改变振幅
+	float k = 1.5f - 0.5f * (nc * nc + ns * ns);
+	b->pc[i] = nc * k;
+	b->ps[i] = s = ns * k;
+	float t = clampf(b->base_t[i] + m->temp_amp * s + wt, SENSOR_TEMP_MIN, SENSOR_TEMP_MAX);
+	float h = clampf(b->base_h[i] - m->hum_amp * s + wh, SENSOR_HUMIDITY_MIN, SENSOR_HUMIDITY_MAX);
+
+	int32_t left = b->anom_left[i];
+	if (left == 0 && (r[2] >> 1) < b->anom_thresh) {
+		left = (int32_t)m->anomaly_len;
+		b->anom_t[i] = m->anomaly_temp * ((float)(r[3] & 0xFFFF) * (2.0f * SS_U16) - 1.0f);
+		b->anom_h[i] = m->anomaly_hum * ((float)(r[3] >> 16) * (2.0f * SS_U16) - 1.0f);
+	}
+	if (left > 0) {
+		t += b->anom_t[i];
+		h += b->anom_h[i];
+		left--;
+		b->abnormal[i] = 1;
+	} else {
+		b->abnormal[i] = 0;
+	}
+	b->anom_left[i] = left;
+	b->temp[i] = t;
+	b->hum[i] = h;
+}
+
+#ifdef SS_SSE2
+static inline __m128i rotl32x4(__m128i x, int k) {
+	return _mm_or_si128(_mm_slli_epi32(x, k), _mm_srli_epi32(x, 32 - k));
+}
+
+static inline __m128 tri16x4(__m128i r, __m128i lo16, __m128 u16, __m128 one) {
+	__m128 a = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(r, lo16)), u16);
+	__m128 b = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(r, 16)), u16);
+	return _mm_sub_ps(_mm_add_ps(a, b), one);
 }
 
-static float frand_range(float minv, float maxv) {
-	float r = (float)rand() / (float)RAND_MAX;
-	return minv + r * (maxv - minv);
+static inline __m128 blendv(__m128 mask, __m128 a, __m128 b) {
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
 }
 
-sensor_reading_t sensor_sim_read(void) {
-	sensor_reading_t r;
-	r.is_abnormal = 0;
-	// 约每 20 次触发一次异常
-	if ((rand() % 20) == 0) {
-		r.temperature_c = frand_range(-10.0f, 80.0f);
-		r.humidity_rh = frand_range(-5.0f, 110.0f);
-		r.is_abnormal = 1;
-		return r;
+// 设备 [first, end) 每 4 台一组前进一个采样；常量与列指针先取到局部变量，循环内不因写列而重新读取
+static void step_groups(sensor_bank_t *b, uint32_t first, uint32_t end) {
+	const sensor_model_t *m = &b->model;
+	const __m128i lo16 = _mm_set1_epi32(0xFFFF), zero = _mm_setzero_si128();
+	const __m128i thresh = _mm_set1_epi32((int32_t)b->anom_thresh), len = _mm_set1_epi32((int32_t)m->anomaly_len);
+	const __m128 u16 = _mm_set1_ps(SS_U16), u16x2 = _mm_set1_ps(2.0f * SS_U16);
+	const __m128 one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f), three_half = _mm_set1_ps(1.5f);
+	const __m128 keep = _mm_set1_ps(b->keep), rc = _mm_set1_ps(b->rot_c), rs = _mm_set1_ps(b->rot_s);
+	const __m128 tstep = _mm_set1_ps(m->temp_step), hstep = _mm_set1_ps(m->hum_step);
+	const __m128 tamp = _mm_set1_ps(m->temp_amp), hamp = _mm_set1_ps(m->hum_amp);
+	const __m128 tmin = _mm_set1_ps(SENSOR_TEMP_MIN), tmax = _mm_set1_ps(SENSOR_TEMP_MAX);
+	const __m128 hmin = _mm_set1_ps(SENSOR_HUMIDITY_MIN), hmax = _mm_set1_ps(SENSOR_HUMIDITY_MAX);
+	const __m128 atemp = _mm_set1_ps(m->anomaly_temp), ahum = _mm_set1_ps(m->anomaly_hum);
+	uint32_t *r0 = b->rng[0], *r1 = b->rng[1], *r2 = b->rng[2], *r3 = b->rng[3];
+	float *pc = b->pc, *ps = b->ps, *walk_t = b->walk_t, *walk_h = b->walk_h, *anom_t = b->anom_t, *anom_h = b->anom_h;
+	const float *base_t = b->base_t, *base_h = b->base_h;
+	float *temp = b->temp, *hum = b->hum;
+	int32_t *anom_left = b->anom_left, *abnormal = b->abnormal;
+	for (uint32_t i = first; i < end; i += SS_LANES) {
+		__m128i s0 = _mm_load_si128((const __m128i*)(r0 + i));
+		__m128i s1 = _mm_load_si128((const __m128i*)(r1 + i));
+		__m128i s2 = _mm_load_si128((const __m128i*)(r2 + i));
+		__m128i s3 = _mm_load_si128((const __m128i*)(r3 + i));
+		__m128i r[4];
+		for (int k = 0; k < 4; ++k) {
+			// xoshiro128+，4 台设备各一路
+			r[k] = _mm_add_epi32(s0, s3);
+			__m128i t = _mm_slli_epi32(s1, 9);
+			s2 = _mm_xor_si128(s2, s0);
+			s3 = _mm_xor_si128(s3, s1);
+			s1 = _mm_xor_si128(s1, s2);
+			s0 = _mm_xor_si128(s0, s3);
+			s2 = _mm_xor_si128(s2, t);
+			s3 = rotl32x4(s3, 11);
+		}
+		_mm_store_si128((__m128i*)(r0 + i), s0);
+		_mm_store_si128((__m128i*)(r1 + i), s1);
+		_mm_store_si128((__m128i*)(r2 + i), s2);
+		_mm_store_si128((__m128i*)(r3 + i), s3);
+
+		__m128 wt = _mm_add_ps(_mm_mul_ps(_mm_load_ps(walk_t + i), keep), _mm_mul_ps(tstep, tri16x4(r[0], lo16, u16, one)));
+		__m128 wh = _mm_add_ps(_mm_mul_ps(_mm_load_ps(walk_h + i), keep), _mm_mul_ps(hstep, tri16x4(r[1], lo16, u16, one)));
+		_mm_store_ps(walk_t + i, wt);
+		_mm_store_ps(walk_h + i, wh);
+		__m128 c = _mm_load_ps(pc + i), s = _mm_load_ps(ps + i);
+		__m128 nc = _mm_sub_ps(_mm_mul_ps(c, rc), _mm_mul_ps(s, rs));
+		__m128 ns = _mm_add_ps(_mm_mul_ps(s, rc), _mm_mul_ps(c, rs));
+		__m128 k = _mm_sub_ps(three_half, _mm_mul_ps(half, _mm_add_ps(_mm_mul_ps(nc, nc), _mm_mul_ps(ns, ns))));
+		s = _mm_mul_ps(ns, k);
+		_mm_store_ps(pc + i, _mm_mul_ps(nc, k));
+		_mm_store_ps(ps + i, s);
+		__m128 t = _mm_add_ps(_mm_add_ps(_mm_load_ps(base_t + i), _mm_mul_ps(tamp, s)), wt);
+		__m128 h = _mm_add_ps(_mm_sub_ps(_mm_load_ps(base_h + i), _mm_mul_ps(hamp, s)), wh);
+		t = _mm_max_ps(_mm_min_ps(t, tmax), tmin);
+		h = _mm_max_ps(_mm_min_ps(h, hmax), hmin);
+
+		// 突发：剩余为 0 且抽中时开始新一段，取新的偏移
+		__m128i left = _mm_load_si128((const __m128i*)(anom_left + i));
+		__m128i start = _mm_and_si128(_mm_cmpeq_epi32(left, zero), _mm_cmplt_epi32(_mm_srli_epi32(r[2], 1), thresh));
+		left = _mm_or_si128(_mm_and_si128(start, len), _mm_andnot_si128(start, left));
+		__m128 startf = _mm_castsi128_ps(start);
+		__m128 at = blendv(startf, _mm_mul_ps(atemp, _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(r[3], lo16)), u16x2), one)),
+			_mm_load_ps(anom_t + i));
+		__m128 ah = blendv(startf, _mm_mul_ps(ahum, _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(r[3], 16)), u16x2), one)),
+			_mm_load_ps(anom_h + i));
+		_mm_store_ps(anom_t + i, at);
+		_mm_store_ps(anom_h + i, ah);
+		__m128i active = _mm_cmpgt_epi32(left, zero);
+		__m128 activef = _mm_castsi128_ps(active);
+		t = blendv(activef, _mm_add_ps(t, at), t);
+		h = blendv(activef, _mm_add_ps(h, ah), h);
+		_mm_store_si128((__m128i*)(anom_left + i), _mm_add_epi32(left, active)); // active 为 -1：剩余减一
+		_mm_store_si128((__m128i*)(abnormal + i), _mm_srli_epi32(active, 31));
+		_mm_store_ps(temp + i, t);
+		_mm_store_ps(hum + i, h);
 	}
-	// 正常范围
-	r.temperature_c = frand_range(10.0f, 35.0f);
-	r.humidity_rh = frand_range(30.0f, 70.0f);
-	return r;
 }
+#endif
 
+void sensor_bank_step_range(sensor_bank_t *b, uint32_t first, uint32_t n) {
+	if (!b || first >= b->count) return;
+	uint32_t end = n > b->count - first ? b->count : first + n;
+#ifdef SS_SSE2
+	if ((first & (SS_LANES - 1)) == 0) {
+		// 尾部不足 4 台的一组也整组计算：列长已按 4 对齐，多出的设备不使用
+		step_groups(b, first, end);
+		return;
+	}
+#endif
+	for (uint32_t i = first; i < end; ++i) step_one(b, i);
+}
 
+void sensor_bank_step(sensor_bank_t *b) {
+	if (b) sensor_bank_step_range(b, 0, b->count);
+}
+
+void sensor_bank_step_scalar(sensor_bank_t *b) {
+	if (!b) return;
+	for (uint32_t i = 0; i < b->count; ++i) step_one(b, i);
+}
+
+sensor_reading_t sensor_bank_next(sensor_bank_t *b, uint32_t i) {
+	step_one(b, i);
+	return sensor_bank_get(b, i);
+}
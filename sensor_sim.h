@@ -1,21 +1,91 @@
 // sensor_sim.h
-// DHT11 温湿度数据模拟
+// DHT11 温湿度数据模拟：每台设备一份时间序列状态与独立的随机数序列（xoshiro128+，由种子与设备号派生，可复现）
+// 模型：日周期正弦（每台设备随机相位与固定基线偏移）+ 均值回归的随机游走 + 成段出现的异常突发
+// 设备状态按列存放（SoA）：批量生成一次让全部设备前进一个采样，SSE2 下每次处理 4 台；也可单台前进（开环发送按设备取读数）
+// 同一个 sensor_bank_t 只在一个线程里使用；不同线程可各自生成不相交的设备区间
 
 #ifndef SENSOR_SIM_H
 #define SENSOR_SIM_H
 
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef struct {
 	float temperature_c;
 	float humidity_rh;
 	int is_abnormal; // 1 表示异常值
 } sensor_reading_t;
 
-// 初始化随机种子
-void sensor_sim_init(void);
+typedef struct {
+	float temp_base;         // 温度基线（℃）
+	float temp_spread;       // 每台设备基线的固定偏移范围（±）
+	float temp_amp;          // 日周期振幅
+	float temp_step;         // 游走每个采样的步长幅度（三角分布噪声，落在 ±temp_step 内）
+	float hum_base;          // 湿度基线（%RH），日周期与温度反相
+	float hum_spread;
+	float hum_amp;
+	float hum_step;
+	float revert;            // 游走分量每个采样向 0 回归的比例（0..1）
+	uint32_t period_samples; // 一个日周期的采样数（如 1 Hz 采样为 86400）
+	float anomaly_rate;      // 每个采样开始一段异常突发的概率
+	uint32_t anomaly_len;    // 一段突发持续的采样数
+	float anomaly_temp;      // 突发期间叠加的温度偏移：每段突发在 ±anomaly_temp 内随机取一个值
+	float anomaly_hum;
+} sensor_model_t;
 
-// 生成一次读数（温度10~35℃，湿度30%~70%，约每20次产生1次异常值）
-sensor_reading_t sensor_sim_read(void);
+typedef struct {
+	uint32_t count;          // 设备数
+	uint32_t lanes;          // 每列的长度（count 向上取 4 的倍数，多出的设备照常计算但不使用）
+	sensor_model_t model;
+	float keep;              // 1 - revert
+	float rot_c, rot_s;      // 每个采样日相位旋转角的 cos/sin
+	uint32_t anom_thresh;    // anomaly_rate 折成的 31 位阈值
+	// 每台设备的状态
+	uint32_t *rng[4];        // xoshiro128+ 状态字
+	float *pc, *ps;          // 日相位的 cos/sin，逐采样旋转（不调用三角函数）
+	float *base_t, *base_h;
+	float *walk_t, *walk_h;
+	float *anom_t, *anom_h;  // 当前突发的偏移
+	int32_t *anom_left;      // 当前突发剩余的采样数
+	// 最近一次生成的读数
+	float *temp;
+	float *hum;
+	int32_t *abnormal;
+	void *mem;
+} sensor_bank_t;
 
-#endif // SENSOR_SIM_H
+// 默认模型：温度 22 ℃ ± 4、日较差 ±5，湿度 50 %RH ± 8、日较差 ±10，1 Hz 采样一天一个周期，
+// 每个采样 1% 的概率开始一段 5 个采样的异常突发（异常读数约占 5%，部分超出量程）
+void sensor_model_default(sensor_model_t *m);
 
+// 分配 count 台设备的状态并按 seed 初始化（0 按时钟取）。返回 0 成功，-1 参数错误，-2 内存不足
+int sensor_bank_init(sensor_bank_t *b, uint32_t count, const sensor_model_t *m, uint64_t seed);
+void sensor_bank_destroy(sensor_bank_t *b);
 
+// 全部设备前进一个采样，读数写到 temp/hum/abnormal 列
+void sensor_bank_step(sensor_bank_t *b);
+// 设备 [first, first + n) 前进一个采样（first 须为 4 的倍数），供多线程分段生成
+void sensor_bank_step_range(sensor_bank_t *b, uint32_t first, uint32_t n);
+// 同 sensor_bank_step，逐台标量计算（不用 SIMD），供基准对比
+void sensor_bank_step_scalar(sensor_bank_t *b);
+
+// 设备 i 单独前进一个采样并返回读数
+sensor_reading_t sensor_bank_next(sensor_bank_t *b, uint32_t i);
+
+// 设备 i 最近一次生成的读数
+static inline sensor_reading_t sensor_bank_get(const sensor_bank_t *b, uint32_t i) {
+	sensor_reading_t r;
+	r.temperature_c = b->temp[i];
+	r.humidity_rh = b->hum[i];
+	r.is_abnormal = b->abnormal[i];
+	return r;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SENSOR_SIM_H
@@ -0,0 +1,132 @@
+// sha256.c
+#include "sha256.h"
+#include <string.h>
+
+static const uint32_t K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void compress(uint32_t h[8], const uint8_t *p) {
+	uint32_t w[64];
+	for (int i = 0; i < 16; ++i) {
+		w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 | (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+	}
+	for (int i = 16; i < 64; ++i) {
+		uint32_t s0 = ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		uint32_t s1 = ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+	uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+	for (int i = 0; i < 64; ++i) {
+		uint32_t t1 = hh + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+		uint32_t t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		hh = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+	h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+}
+
+void sha256_init(sha256_ctx_t *c) {
+	static const uint32_t iv[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+	memcpy(c->h, iv, sizeof(iv));
+	c->total = 0;
+	c->buf_len = 0;
+}
+
+void sha256_update(sha256_ctx_t *c, const void *data, size_t len) {
+	const uint8_t *p = (const uint8_t*)data;
+	c->total += len;
+	if (c->buf_len) {
+		size_t n = SHA256_BLOCK_LEN - c->buf_len;
+		if (n > len) n = len;
+		memcpy(c->buf + c->buf_len, p, n);
+		c->buf_len += (uint32_t)n;
+		p += n;
+		len -= n;
+		if (c->buf_len < SHA256_BLOCK_LEN) return;
+		compress(c->h, c->buf);
+		c->buf_len = 0;
+	}
+	for (; len >= SHA256_BLOCK_LEN; p += SHA256_BLOCK_LEN, len -= SHA256_BLOCK_LEN) compress(c->h, p);
+	if (len) {
+		memcpy(c->buf, p, len);
+		c->buf_len = (uint32_t)len;
+	}
+}
+
+void sha256_final(sha256_ctx_t *c, uint8_t out[SHA256_DIGEST_LEN]) {
+	uint64_t bits = c->total * 8;
+	c->buf[c->buf_len++] = 0x80;
+	if (c->buf_len > 56) {
+		memset(c->buf + c->buf_len, 0, SHA256_BLOCK_LEN - c->buf_len);
+		compress(c->h, c->buf);
+		c->buf_len = 0;
+	}
+	memset(c->buf + c->buf_len, 0, 56 - c->buf_len);
+	for (int i = 0; i < 8; ++i) c->buf[56 + i] = (uint8_t)(bits >> (56 - 8 * i));
+	compress(c->h, c->buf);
+	for (int i = 0; i < 8; ++i) {
+		out[4 * i] = (uint8_t)(c->h[i] >> 24);
+		out[4 * i + 1] = (uint8_t)(c->h[i] >> 16);
+		out[4 * i + 2] = (uint8_t)(c->h[i] >> 8);
+		out[4 * i + 3] = (uint8_t)c->h[i];
+	}
+}
+
+void sha256(const void *data, size_t len, uint8_t out[SHA256_DIGEST_LEN]) {
+	sha256_ctx_t c;
+	sha256_init(&c);
+	sha256_update(&c, data, len);
+	sha256_final(&c, out);
+}
+
+void hmac_sha256_key(hmac_sha256_key_t *k, const void *key, size_t key_len) {
+	uint8_t kb[SHA256_BLOCK_LEN];
+	memset(kb, 0, sizeof(kb));
+	if (key_len > SHA256_BLOCK_LEN) sha256(key, key_len, kb);
+	else memcpy(kb, key, key_len);
+	uint8_t pad[SHA256_BLOCK_LEN];
+	for (int i = 0; i < SHA256_BLOCK_LEN; ++i) pad[i] = kb[i] ^ 0x36;
+	sha256_init(&k->inner);
+	sha256_update(&k->inner, pad, sizeof(pad));
+	for (int i = 0; i < SHA256_BLOCK_LEN; ++i) pad[i] = kb[i] ^ 0x5c;
+	sha256_init(&k->outer);
+	sha256_update(&k->outer, pad, sizeof(pad));
+}
+
+void hmac_sha256_with(const hmac_sha256_key_t *k, const void *msg, size_t len, uint8_t out[SHA256_DIGEST_LEN]) {
+	sha256_ctx_t c = k->inner;
+	uint8_t ih[SHA256_DIGEST_LEN];
+	sha256_update(&c, msg, len);
+	sha256_final(&c, ih);
+	c = k->outer;
+	sha256_update(&c, ih, sizeof(ih));
+	sha256_final(&c, out);
+}
+
+void hmac_sha256(const void *key, size_t key_len, const void *msg, size_t len, uint8_t out[SHA256_DIGEST_LEN]) {
+	hmac_sha256_key_t k;
+	hmac_sha256_key(&k, key, key_len);
+	hmac_sha256_with(&k, msg, len, out);
+}
+
+void hex_encode(const uint8_t *in, size_t len, char *out) {
+	static const char digits[] = "0123456789abcdef";
+	for (size_t i = 0; i < len; ++i) {
+		out[2 * i] = digits[in[i] >> 4];
+		out[2 * i + 1] = digits[in[i] & 0x0F];
+	}
+	out[2 * len] = '\0';
+}
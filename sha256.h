@@ -0,0 +1,47 @@
+// sha256.h
+// SHA-256（FIPS 180-4）与 HMAC-SHA256（RFC 2104），纯 C 实现，无第三方依赖
+// HMAC 密钥可预先算好内外两层填充块的中间状态，同一密钥反复签名时每次省去两次压缩
+
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHA256_DIGEST_LEN 32
+#define SHA256_BLOCK_LEN 64
+
+typedef struct {
+	uint32_t h[8];
+	uint64_t total;          // 已输入字节数
+	uint8_t buf[SHA256_BLOCK_LEN];
+	uint32_t buf_len;
+} sha256_ctx_t;
+
+void sha256_init(sha256_ctx_t *c);
+void sha256_update(sha256_ctx_t *c, const void *data, size_t len);
+void sha256_final(sha256_ctx_t *c, uint8_t out[SHA256_DIGEST_LEN]);
+void sha256(const void *data, size_t len, uint8_t out[SHA256_DIGEST_LEN]);
+
+// 预处理过的 HMAC 密钥：已吸收 K^ipad / K^opad 两个块
+typedef struct {
+	sha256_ctx_t inner;
+	sha256_ctx_t outer;
+} hmac_sha256_key_t;
+
+void hmac_sha256_key(hmac_sha256_key_t *k, const void *key, size_t key_len);
+void hmac_sha256_with(const hmac_sha256_key_t *k, const void *msg, size_t len, uint8_t out[SHA256_DIGEST_LEN]);
+void hmac_sha256(const void *key, size_t key_len, const void *msg, size_t len, uint8_t out[SHA256_DIGEST_LEN]);
+
+// 小写十六进制输出，out 至少 2*len+1 字节
+void hex_encode(const uint8_t *in, size_t len, char *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SHA256_H
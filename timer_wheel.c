@@ -0,0 +1,100 @@
+// timer_wheel.c
+// 分层时间轮（级联式）：第 L 层的槽宽为 256^L 个 tick，低层转满一圈时把上一层当前槽重新分发下来
+
+#include "timer_wheel.h"
+
+#define TW_MASK (TW_SLOTS - 1)
+
+static void list_unlink(tw_timer_t *t) {
+	t->prev->next = t->next;
+	t->next->prev = t->prev;
+	t->next = t->prev = 0;
+}
+
+static void list_push(tw_timer_t *head, tw_timer_t *t) {
+	t->prev = head->prev;
+	t->next = head;
+	head->prev->next = t;
+	head->prev = t;
+}
+
+void tw_init(timer_wheel_t *tw, uint64_t now_tick) {
+	for (int l = 0; l < TW_LEVELS; ++l) {
+		for (uint32_t i = 0; i < TW_SLOTS; ++i) {
+			tw->slots[l][i].next = tw->slots[l][i].prev = &tw->slots[l][i];
+		}
+	}
+	tw->now = now_tick;
+	tw->count = 0;
+}
+
+static void place(timer_wheel_t *tw, tw_timer_t *t) {
+	uint64_t delta = t->expires - tw->now;
+	int level = 0;
+	while (level < TW_LEVELS - 1 && delta >= ((uint64_t)1 << (TW_SLOT_BITS * (level + 1)))) level++;
+	uint64_t at = t->expires;
+	if (delta >= ((uint64_t)1 << (TW_SLOT_BITS * TW_LEVELS))) {
+		// 超出最高层范围：只按最远的时刻选槽，expires 保持不变，该槽级联时按真实到期时刻重新放置
+		at = tw->now + ((uint64_t)1 << (TW_SLOT_BITS * TW_LEVELS)) - 1;
+	}
+	uint32_t slot = (uint32_t)(at >> (TW_SLOT_BITS * level)) & TW_MASK;
+	list_push(&tw->slots[level][slot], t);
+}
+
+void tw_add(timer_wheel_t *tw, tw_timer_t *t, uint64_t expires) {
+	if (t->prev) list_unlink(t);
+	else tw->count++;
+	// 已过期的放到下一个 tick 触发
+	t->expires = expires > tw->now ? expires : tw->now + 1;
+	place(tw, t);
+}
+
+void tw_del(timer_wheel_t *tw, tw_timer_t *t) {
+	if (!t->prev) return;
+	list_unlink(t);
+	tw->count--;
+}
+
+// 把第 level 层 index 槽的定时器重新分发到更低层
+static void cascade(timer_wheel_t *tw, int level, uint32_t index) {
+	tw_timer_t *head = &tw->slots[level][index];
+	tw_timer_t *t = head->next;
+	head->next = head->prev = head;
+	while (t != head) {
+		tw_timer_t *n = t->next;
+		place(tw, t);
+		t = n;
+	}
+}
+
+uint32_t tw_advance(timer_wheel_t *tw, uint64_t to_tick, void *ctx) {
+	uint32_t fired = 0;
+	while (tw->now < to_tick) {
+		if (tw->count == 0) { tw->now = to_tick; break; }
+		tw->now++;
+		uint32_t idx = (uint32_t)tw->now & TW_MASK;
+		// 低层转满一圈时逐层级联
+		for (int l = 1; l < TW_LEVELS && ((tw->now >> (TW_SLOT_BITS * (l - 1))) & TW_MASK) == 0; ++l) {
+			cascade(tw, l, (uint32_t)(tw->now >> (TW_SLOT_BITS * l)) & TW_MASK);
+		}
+		tw_timer_t *head = &tw->slots[0][idx];
+		while (head->next != head) {
+			tw_timer_t *t = head->next;
+			list_unlink(t);
+			tw->count--;
+			t->fn(t, ctx);
+			fired++;
+		}
+	}
+	return fired;
+}
+
+uint64_t tw_next_expiry(const timer_wheel_t *tw) {
+	if (tw->count == 0) return UINT64_MAX;
+	// 第 0 层逐槽查找到本圈结束；到下一圈起点要先级联，级联前更高层的定时器可能更早到期，起点即为下界
+	for (uint64_t t = tw->now + 1; ; ++t) {
+		if (((uint32_t)t & TW_MASK) == 0) return t;
+		const tw_timer_t *head = &tw->slots[0][(uint32_t)t & TW_MASK];
+		if (head->next != head) return t;
+	}
+}
@@ -0,0 +1,61 @@
+// timer_wheel.h
+// 分层时间轮：4 层 x 256 槽，按 tick 计时（tick 长度由使用方决定，例如 100us）
+// 定时器节点侵入式嵌入调用方结构体，增删 O(1)、无内存分配；到期时调用节点上的回调
+// 发送调度与 CON 重传共用同一个时间轮
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TW_LEVELS 4
+#define TW_SLOT_BITS 8
+#define TW_SLOTS (1u << TW_SLOT_BITS)
+
+typedef struct tw_timer tw_timer_t;
+typedef void (*tw_fn)(tw_timer_t *t, void *ctx);
+
+struct tw_timer {
+	tw_timer_t *next;
+	tw_timer_t *prev;   // 为 NULL 表示未挂在轮上
+	uint64_t expires;   // 到期 tick
+	tw_fn fn;
+};
+
+typedef struct {
+	tw_timer_t slots[TW_LEVELS][TW_SLOTS]; // 每个槽是一个带哨兵的双向循环链表
+	uint64_t now;       // 已处理到的 tick
+	uint32_t count;     // 挂着的定时器数
+} timer_wheel_t;
+
+void tw_init(timer_wheel_t *tw, uint64_t now_tick);
+
+static inline void tw_timer_init(tw_timer_t *t, tw_fn fn) {
+	t->next = t->prev = 0;
+	t->expires = 0;
+	t->fn = fn;
+}
+
+static inline int tw_timer_pending(const tw_timer_t *t) {
+	return t->prev != 0;
+}
+
+// 挂上/重挂定时器；到期 tick 不晚于当前时刻的在下一次推进时触发
+void tw_add(timer_wheel_t *tw, tw_timer_t *t, uint64_t expires);
+void tw_del(timer_wheel_t *tw, tw_timer_t *t);
+
+// 推进到 to_tick，依次触发到期定时器（回调内可安全增删任意定时器）；返回触发个数
+uint32_t tw_advance(timer_wheel_t *tw, uint64_t to_tick, void *ctx);
+
+// 下一次需要推进的 tick 下界（最早到期或下一次层级级联的时刻）；无定时器时返回 UINT64_MAX
+uint64_t tw_next_expiry(const timer_wheel_t *tw);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TIMER_WHEEL_H
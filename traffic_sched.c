@@ -0,0 +1,60 @@
+// traffic_sched.c
+#include "traffic_sched.h"
+#include <math.h>
+
+static uint64_t next_rand(uint64_t *state) {
+	// xorshift64*
+	uint64_t x = *state;
+	x ^= x >> 12; x ^= x << 25; x ^= x >> 27;
+	*state = x;
+	return x * 0x2545F4914F6CDD1Dull;
+}
+
+// (0,1] 均匀分布
+static double rand_unit(uint64_t *state) {
+	return ((double)(next_rand(state) >> 11) + 1.0) * (1.0 / 9007199254740992.0);
+}
+
+void traffic_state_init(traffic_state_t *st, uint64_t seed) {
+	st->rng = seed ? seed : 0x9E3779B97F4A7C15ull;
+	st->burst_left = 0;
+}
+
+static double mean_interval_us(const traffic_conf_t *tc) {
+	return tc->rate_hz > 0.0 ? 1e6 / tc->rate_hz : 1e6;
+}
+
+uint64_t traffic_first_offset_us(const traffic_conf_t *tc, traffic_state_t *st) {
+	double span = mean_interval_us(tc);
+	if (tc->profile == TRAFFIC_BURST) {
+		uint32_t len = tc->burst_len ? tc->burst_len : 10;
+		span *= len;
+	}
+	return (uint64_t)(rand_unit(&st->rng) * span);
+}
+
+uint64_t traffic_next_interval_us(const traffic_conf_t *tc, traffic_state_t *st) {
+	double mean = mean_interval_us(tc);
+	switch (tc->profile) {
+	case TRAFFIC_POISSON:
+		return (uint64_t)(-log(rand_unit(&st->rng)) * mean);
+	case TRAFFIC_BURST: {
+		uint32_t len = tc->burst_len ? tc->burst_len : 10;
+		uint32_t gap = tc->burst_gap_us ? tc->burst_gap_us : 1000;
+		if (st->burst_left == 0) st->burst_left = len;
+		if (--st->burst_left > 0) return gap;
+		// 簇间隔：保证 len 条报文平均占用 len*mean
+		double rest = mean * len - (double)gap * (len - 1);
+		return rest > 0.0 ? (uint64_t)rest : gap;
+	}
+	case TRAFFIC_CONSTANT:
+	default: {
+		double iv = mean;
+		if (tc->jitter_us) {
+			iv += (rand_unit(&st->rng) * 2.0 - 1.0) * tc->jitter_us;
+			if (iv < 1.0) iv = 1.0;
+		}
+		return (uint64_t)iv;
+	}
+	}
+}
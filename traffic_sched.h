@@ -0,0 +1,45 @@
+// traffic_sched.h
+// 开环流量模型：按恒定速率、泊松到达或突发模式生成每个设备的发送间隔
+// 间隔以“计划发送时刻”为基准累加，不依赖响应是否返回，避免协同遗漏（coordinated omission）
+
+#ifndef TRAFFIC_SCHED_H
+#define TRAFFIC_SCHED_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	TRAFFIC_CONSTANT = 0, // 固定间隔 1/rate，可叠加均匀抖动
+	TRAFFIC_POISSON = 1,  // 指数分布间隔，平均速率为 rate
+	TRAFFIC_BURST = 2     // 每簇 burst_len 条、簇内间隔 burst_gap_us，簇间隔使平均速率为 rate
+} traffic_profile_t;
+
+typedef struct {
+	traffic_profile_t profile;
+	double rate_hz;        // 每设备平均发送速率（条/秒）
+	uint32_t jitter_us;    // 恒定模式下的均匀抖动幅度（±jitter_us）
+	uint32_t burst_len;    // 突发模式每簇报文数，0 视为 10
+	uint32_t burst_gap_us; // 突发模式簇内间隔，0 视为 1000us
+} traffic_conf_t;
+
+typedef struct {
+	uint64_t rng;          // 每设备独立的随机数状态
+	uint32_t burst_left;   // 当前簇剩余报文数
+} traffic_state_t;
+
+void traffic_state_init(traffic_state_t *st, uint64_t seed);
+
+// 首次发送相对起点的偏移（在一个平均间隔内均匀分布，打散设备相位）
+uint64_t traffic_first_offset_us(const traffic_conf_t *tc, traffic_state_t *st);
+
+// 下一次计划发送相对本次计划时刻的间隔（us）
+uint64_t traffic_next_interval_us(const traffic_conf_t *tc, traffic_state_t *st);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRAFFIC_SCHED_H
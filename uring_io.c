@@ -0,0 +1,201 @@
+// uring_io.c
+#include "uring_io.h"
+#include <string.h>
+
+const char *io_backend_name(io_backend_t b) {
+	return b == IO_BACKEND_URING ? "io_uring" : "socket";
+}
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+static int sys_setup(unsigned entries, struct io_uring_params *p) {
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz) {
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int sys_register(int fd, unsigned op, void *arg, unsigned nr) {
+	return (int)syscall(__NR_io_uring_register, fd, op, arg, nr);
+}
+
+int uring_init(uring_t *r, unsigned entries, unsigned cq_entries) {
+	memset(r, 0, sizeof(*r));
+	r->fd = -1;
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+	p.cq_entries = cq_entries ? cq_entries : entries * 2;
+	int fd = sys_setup(entries, &p);
+	if (fd < 0 && errno == EINVAL) {
+		// 老内核不认识 SUBMIT_ALL/COOP_TASKRUN
+		memset(&p, 0, sizeof(p));
+		p.flags = IORING_SETUP_CQSIZE;
+		p.cq_entries = cq_entries ? cq_entries : entries * 2;
+		fd = sys_setup(entries, &p);
+	}
+	if (fd < 0) return -errno;
+	// 需要单次 mmap 与带超时的 io_uring_enter
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG)) {
+		close(fd);
+		return -ENOSYS;
+	}
+	r->fd = fd;
+
+	size_t sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	size_t cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (cq_sz > sq_sz) sq_sz = cq_sz;
+	r->sq_sz = r->cq_sz = sq_sz;
+	r->sq_ptr = mmap(NULL, sq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (r->sq_ptr == MAP_FAILED) { r->sq_ptr = NULL; uring_destroy(r); return -ENOMEM; }
+	r->cq_ptr = r->sq_ptr;
+	r->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = (struct io_uring_sqe*)mmap(NULL, r->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED) { r->sqes = NULL; uring_destroy(r); return -ENOMEM; }
+
+	uint8_t *sq = (uint8_t*)r->sq_ptr;
+	r->sq_head = (unsigned*)(sq + p.sq_off.head);
+	r->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+	r->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+	r->sq_flags = (unsigned*)(sq + p.sq_off.flags);
+	r->sq_array = (unsigned*)(sq + p.sq_off.array);
+	r->sq_entries = p.sq_entries;
+	// SQ 下标数组固定为恒等映射，之后只需推进 tail
+	for (unsigned i = 0; i < p.sq_entries; ++i) r->sq_array[i] = i;
+	r->cq_head = (unsigned*)(sq + p.cq_off.head);
+	r->cq_tail = (unsigned*)(sq + p.cq_off.tail);
+	r->cq_mask = (unsigned*)(sq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe*)(sq + p.cq_off.cqes);
+	r->cq_entries = p.cq_entries;
+	r->sqe_head = r->sqe_tail = *r->sq_tail;
+	return 0;
+}
+
+void uring_destroy(uring_t *r) {
+	if (r->sqes) munmap(r->sqes, r->sqes_sz);
+	if (r->sq_ptr) munmap(r->sq_ptr, r->sq_sz);
+	if (r->fd >= 0) close(r->fd);
+	r->sqes = NULL;
+	r->sq_ptr = r->cq_ptr = NULL;
+	r->fd = -1;
+}
+
+struct io_uring_sqe *uring_get_sqe(uring_t *r) {
+	unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+	if (r->sqe_tail - head >= r->sq_entries) return NULL;
+	struct io_uring_sqe *sqe = &r->sqes[r->sqe_tail & *r->sq_mask];
+	r->sqe_tail++;
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+int uring_submit(uring_t *r, unsigned wait_nr, int64_t timeout_us) {
+	unsigned to_submit = r->sqe_tail - r->sqe_head;
+	if (to_submit) {
+		__atomic_store_n(r->sq_tail, r->sqe_tail, __ATOMIC_RELEASE);
+		r->sqe_head = r->sqe_tail;
+	}
+	unsigned flags = 0;
+	// CQ 溢出或 COOP_TASKRUN 下有待运行的任务时也需进入内核收割
+	unsigned sqf = __atomic_load_n(r->sq_flags, __ATOMIC_RELAXED);
+	if (wait_nr || (sqf & (IORING_SQ_CQ_OVERFLOW | IORING_SQ_TASKRUN))) flags |= IORING_ENTER_GETEVENTS;
+	if (!to_submit && !flags) return 0;
+	struct __kernel_timespec ts;
+	struct io_uring_getevents_arg arg;
+	void *argp = NULL;
+	size_t argsz = 0;
+	if (wait_nr && timeout_us >= 0) {
+		ts.tv_sec = timeout_us / 1000000;
+		ts.tv_nsec = (timeout_us % 1000000) * 1000;
+		memset(&arg, 0, sizeof(arg));
+		arg.ts = (uint64_t)(uintptr_t)&ts;
+		argp = &arg;
+		argsz = sizeof(arg);
+		flags |= IORING_ENTER_EXT_ARG;
+	}
+	for (;;) {
+		r->enters++;
+		int ret = sys_enter(r->fd, to_submit, wait_nr, flags, argp, argsz);
+		if (ret >= 0) return ret;
+		if (errno == ETIME) return 0;
+		if (errno != EINTR) return -errno;
+		// 被信号打断：已提交部分不会重复提交
+		to_submit = 0;
+	}
+}
+
+int uring_bufring_init(uring_t *r, uring_bufring_t *b, uint16_t bgid, uint32_t count, uint32_t size) {
+	memset(b, 0, sizeof(*b));
+	uint32_t n = 1;
+	while (n < count && n < 32768) n <<= 1;
+	b->count = n;
+	b->size = size;
+	b->bgid = bgid;
+	b->br_sz = (size_t)n * sizeof(struct io_uring_buf);
+	void *ring = mmap(NULL, b->br_sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ring == MAP_FAILED) return -ENOMEM;
+	b->br = (struct io_uring_buf_ring*)ring;
+	b->bufs = (uint8_t*)mmap(NULL, (size_t)n * size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (b->bufs == MAP_FAILED) {
+		b->bufs = NULL;
+		uring_bufring_destroy(r, b);
+		return -ENOMEM;
+	}
+	struct io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)(uintptr_t)ring;
+	reg.ring_entries = n;
+	reg.bgid = bgid;
+	if (sys_register(r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+		int err = -errno;
+		munmap(b->bufs, (size_t)n * size);
+		munmap(ring, b->br_sz);
+		memset(b, 0, sizeof(*b));
+		return err;
+	}
+	for (uint32_t i = 0; i < n; ++i) uring_buf_recycle(b, (uint16_t)i);
+	return 0;
+}
+
+void uring_bufring_destroy(uring_t *r, uring_bufring_t *b) {
+	if (!b->br) return;
+	struct io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.bgid = b->bgid;
+	if (r && r->fd >= 0) sys_register(r->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+	if (b->bufs) munmap(b->bufs, (size_t)b->count * b->size);
+	munmap(b->br, b->br_sz);
+	memset(b, 0, sizeof(*b));
+}
+
+int uring_available(void) {
+	static int cached = -1;
+	if (cached >= 0) return cached;
+	uring_t r;
+	uring_bufring_t b;
+	cached = 0;
+	if (uring_init(&r, 8, 0) == 0) {
+		if (uring_bufring_init(&r, &b, 0, 8, 64) == 0) {
+			cached = 1;
+			uring_bufring_destroy(&r, &b);
+		}
+		uring_destroy(&r);
+	}
+	return cached;
+}
+
+#else // !__linux__
+
+int uring_available(void) {
+	return 0;
+}
+
+#endif // __linux__
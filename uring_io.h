@@ -0,0 +1,159 @@
+// uring_io.h
+// io_uring 的最小封装：直接走 io_uring_setup/io_uring_enter/io_uring_register 系统调用，不依赖 liburing
+// 提供 SQ/CQ 环的映射与提交、收割，以及注册到内核的“提供缓冲环”（provided buffer ring），
+// 配合 multishot 接收：一次提交持续产出完成事件，内核自行从缓冲环取缓冲，稳态下收包不再需要系统调用
+// 仅 Linux；其他平台只有 uring_available（恒为 0）
+
+#ifndef URING_IO_H
+#define URING_IO_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 收发后端：服务端与多设备引擎共用
+typedef enum {
+	IO_BACKEND_SOCKET = 0, // 普通套接字调用（recvfrom/sendmsg 或 recvmmsg/sendmmsg）
+	IO_BACKEND_URING = 1   // io_uring（multishot 接收 + 提供缓冲环）
+} io_backend_t;
+
+const char *io_backend_name(io_backend_t b);
+
+// 当前内核是否可用 io_uring（能创建环且支持提供缓冲环），结果缓存
+int uring_available(void);
+
+#ifdef __linux__
+
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+
+typedef struct {
+	int fd;
+	// 提交队列（共享内存中的指针）
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_flags;
+	unsigned *sq_array;
+	struct io_uring_sqe *sqes;
+	unsigned sq_entries;
+	unsigned sqe_tail;     // 本地已填写、尚未发布给内核的 SQE 位置
+	unsigned sqe_head;     // 已发布位置
+	// 完成队列
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+	unsigned cq_entries;
+	// 映射区域
+	void *sq_ptr;
+	size_t sq_sz;
+	void *cq_ptr;
+	size_t cq_sz;
+	size_t sqes_sz;
+	uint64_t enters;       // io_uring_enter 调用次数
+} uring_t;
+
+// 提供缓冲环：count 个 size 字节的缓冲，按 bgid 注册；多 multishot 接收共用
+typedef struct {
+	struct io_uring_buf_ring *br;
+	size_t br_sz;
+	uint8_t *bufs;
+	uint32_t count;        // 2 的幂
+	uint32_t size;
+	uint16_t bgid;
+	uint16_t tail;         // 本地尾指针
+} uring_bufring_t;
+
+// 创建环：entries 为 SQ 大小，cq_entries 为 CQ 大小（0 表示 2*entries）
+// 返回 0 成功，<0 为 -errno
+int uring_init(uring_t *r, unsigned entries, unsigned cq_entries);
+void uring_destroy(uring_t *r);
+
+// 取一个空闲 SQE（已清零）；SQ 满时返回 NULL，调用方先 uring_submit
+struct io_uring_sqe *uring_get_sqe(uring_t *r);
+
+// 发布已填写的 SQE 并进入内核；wait_nr > 0 时至少等待 wait_nr 个完成事件，
+// timeout_us >= 0 时最多等待该时长（超时不算错误）。返回提交数，<0 为 -errno
+int uring_submit(uring_t *r, unsigned wait_nr, int64_t timeout_us);
+
+// 尚未发布的 SQE 数
+static inline unsigned uring_sq_pending(const uring_t *r) {
+	return r->sqe_tail - r->sqe_head;
+}
+
+// 取队首完成事件，没有时返回 NULL；处理完后调用 uring_cqe_seen
+static inline struct io_uring_cqe *uring_peek_cqe(uring_t *r) {
+	unsigned head = *r->cq_head;
+	if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) return NULL;
+	return &r->cqes[head & *r->cq_mask];
+}
+
+static inline void uring_cqe_seen(uring_t *r) {
+	__atomic_store_n(r->cq_head, *r->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+// ---- SQE 填写 ----
+
+static inline void uring_prep_sendmsg(struct io_uring_sqe *sqe, int fd, const struct msghdr *msg, uint64_t user) {
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t)msg;
+	sqe->len = 1;
+	sqe->user_data = user;
+}
+
+// multishot recv（已 connect 的套接字），缓冲取自 bgid 缓冲环
+static inline void uring_prep_recv_multishot(struct io_uring_sqe *sqe, int fd, uint16_t bgid, uint64_t user) {
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = fd;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = bgid;
+	sqe->user_data = user;
+}
+
+// multishot recvmsg（需要对端地址）：msg 只用来给出 msg_namelen/msg_controllen，
+// 每个缓冲依次是 io_uring_recvmsg_out、地址、控制信息、负载
+static inline void uring_prep_recvmsg_multishot(struct io_uring_sqe *sqe, int fd, const struct msghdr *msg,
+	uint16_t bgid, uint64_t user) {
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t)msg;
+	sqe->len = 1;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = bgid;
+	sqe->user_data = user;
+}
+
+// ---- 提供缓冲环 ----
+
+// 分配 count（向上取 2 的幂，最多 32768）个 size 字节缓冲并注册为 bgid；返回 0 成功，<0 为 -errno
+int uring_bufring_init(uring_t *r, uring_bufring_t *b, uint16_t bgid, uint32_t count, uint32_t size);
+void uring_bufring_destroy(uring_t *r, uring_bufring_t *b);
+
+static inline uint8_t *uring_buf_addr(const uring_bufring_t *b, uint16_t bid) {
+	return b->bufs + (size_t)bid * b->size;
+}
+
+// 把用完的缓冲还给内核
+static inline void uring_buf_recycle(uring_bufring_t *b, uint16_t bid) {
+	struct io_uring_buf *e = &b->br->bufs[b->tail & (b->count - 1)];
+	e->addr = (uint64_t)(uintptr_t)uring_buf_addr(b, bid);
+	e->len = b->size;
+	e->bid = bid;
+	b->tail++;
+	__atomic_store_n(&b->br->tail, b->tail, __ATOMIC_RELEASE);
+}
+
+#endif // __linux__
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // URING_IO_H